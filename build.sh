@@ -34,7 +34,7 @@ fi
 if [[ ! -d build ]]; then
     mkdir build
     cd build
-    cmake -DUSE_DOUBLE_PRECISION=ON -DUSE_GRAPHICAL_BENCHMARK=OFF -DBULLET2_MULTITHREADING=ON -DBUILD_CPU_DEMOS=OFF -DBUILD_BULLET3=OFF ../
+    cmake -DUSE_DOUBLE_PRECISION=ON -DUSE_GRAPHICAL_BENCHMARK=OFF -DBULLET2_MULTITHREADING=ON -DBULLET2_USE_OPEN_MP_MULTITHREADING=ON -DBUILD_CPU_DEMOS=OFF -DBUILD_BULLET3=OFF ../
 else
     cd build
 fi
@@ -0,0 +1,9 @@
+#version 410
+
+in vec4 line_color;
+
+out vec4 frag_colour;
+
+void main() {
+    frag_colour = line_color;
+}
@@ -0,0 +1,30 @@
+#version 410
+
+// has to match ORBIT_MAX_LINES (PlanetarySystem.hpp)
+#define MAX_ORBITS 32
+
+uniform mat4 view, proj;
+uniform int vertices; // vertices per orbit
+// p_axis.xyz: semi-major axis towards the periapsis, p_axis.w: eccentricity
+// q_axis.xyz: semi-minor axis, q_axis.w: current mean anomaly
+uniform vec4 p_axis[MAX_ORBITS], q_axis[MAX_ORBITS];
+uniform vec4 color[MAX_ORBITS];
+
+out vec4 line_color;
+
+// no vertex buffers, each orbit is 2 * vertices line endpoints and the index of the endpoint along
+// the orbit is the mean anomaly
+void main() {
+    int orbit = gl_VertexID / (2 * vertices);
+    int k = gl_VertexID - orbit * 2 * vertices;
+    float e = p_axis[orbit].w;
+    float M = q_axis[orbit].w + 6.28318530718 * float(k / 2 + k % 2) / float(vertices);
+
+    float E = M + (sin(M) < 0.0 ? -0.85 : 0.85) * e;
+    for(int i = 0; i < 8; i++)
+        E -= (E - e * sin(E) - M) / (1.0 - e * cos(E));
+
+    vec3 position = p_axis[orbit].xyz * (cos(E) - e) + q_axis[orbit].xyz * sin(E);
+    line_color = color[orbit];
+    gl_Position = proj * view * vec4(position, 1.0);
+}
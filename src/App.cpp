@@ -31,7 +31,13 @@ App::App(int gl_width, int gl_height) : BaseApp(gl_width, gl_height){
 void App::init(){
     m_quit = false;
 
+#ifdef BULLET_MT
+    m_physics->initDynamicsWorld(btVector3(0.0, 0.0, 0.0), true);
+#elif defined(BULLET_MULTIBODY)
+    m_physics->initDynamicsWorld(btVector3(0.0, 0.0, 0.0), false, true);
+#else
     m_physics->initDynamicsWorld();
+#endif
     m_render_context->setDebugDrawer();
 
     if(m_asset_manager->loadResources() == EXIT_FAILURE){
@@ -82,6 +88,11 @@ void App::terminate(){
 }
 
 
+void App::setRecording(int mode, const std::string& path){
+    m_simulation->setRecording(mode, path);
+}
+
+
 void App::run(){
     double delta_t_ms = (1. / 60.) * 1000000.;
     logic_timing timing;
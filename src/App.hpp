@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <cstdint>
+#include <string>
 
 #include "core/BaseApp.hpp"
 
@@ -36,6 +37,15 @@ class App : public BaseApp{
         ~App();
 
         void run();
+
+        /*
+         * Records the simulation to a file or replays a recording, see
+         * GameSimulation::setRecording.
+         *
+         * @mode: RECORDER_RECORD or RECORDER_REPLAY (see core/Recorder.hpp).
+         * @path: path of the recording.
+         */
+        void setRecording(int mode, const std::string& path);
 };
 
 
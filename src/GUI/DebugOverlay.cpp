@@ -61,6 +61,51 @@ void DebugOverlay::setPhysicsTimes(const physics_timing& times){
 }
 
 
+void DebugOverlay::setGravityStats(int bodies, int sources, int aggregated, const char* kernel,
+                                   int pairs, double cull_error){
+    m_stats_physics.gravity_bodies = bodies;
+    m_stats_physics.gravity_sources = sources;
+    m_stats_physics.gravity_aggregated = aggregated;
+    m_stats_physics.gravity_kernel = kernel;
+    m_stats_physics.gravity_pairs = pairs;
+    m_stats_physics.gravity_cull_error = cull_error;
+}
+
+
+void DebugOverlay::setRailsStats(double time_warp, int on_rails, int packed){
+    m_stats_physics.time_warp = time_warp;
+    m_stats_physics.vessels_on_rails = on_rails;
+    m_stats_physics.packed_vessels = packed;
+}
+
+
+void DebugOverlay::setPhysicsWarpStats(int substeps, int warp){
+    m_stats_physics.physics_substeps = substeps;
+    m_stats_physics.physics_warp = warp;
+}
+
+
+void DebugOverlay::setClusterStats(int worlds, int threads, bool multithreaded){
+    m_stats_physics.dynamics_worlds = worlds;
+    m_stats_physics.bullet_threads = threads;
+    m_stats_physics.bullet_multithreaded = multithreaded;
+}
+
+
+void DebugOverlay::setBulletThreadTime(int threads, double time){
+    if(threads >= 1 && threads <= OVERLAY_MAX_THREADS)
+        m_stats_physics.bullet_thread_times[threads] = time;
+}
+
+
+void DebugOverlay::setBroadphaseStats(int pairs, long rejected, bool filter, long proxies){
+    m_stats_physics.broadphase_pairs[filter] = pairs;
+    m_stats_physics.rejected_pairs = rejected;
+    m_stats_physics.part_filter = filter;
+    m_stats_physics.proxy_creations = proxies;
+}
+
+
 void DebugOverlay::setRenderTimes(const render_timing& times){
     m_times_render.load_time = times.avg_rend_load;
     m_times_render.rscene_load_time = times.avg_scene;
@@ -115,6 +160,68 @@ void DebugOverlay::render(){
     m_text_dynamic_text->addString(buffer2, 15, 165, 1, 
                                    STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
 
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Grav. kernel: " << m_stats_physics.gravity_kernel
+         << " - Grav. bodies: " << m_stats_physics.gravity_bodies
+         << " - Grav. sources: " << m_stats_physics.gravity_sources
+         << " - Aggregated vessels: " << m_stats_physics.gravity_aggregated
+         << " - Pairs: " << m_stats_physics.gravity_pairs
+         << " - Cull err: " << std::scientific << std::setprecision(1)
+         << m_stats_physics.gravity_cull_error << std::defaultfloat << std::setprecision(3);
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 185, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Time warp: " << m_stats_physics.time_warp
+         << "x - Physics warp: " << m_stats_physics.physics_substeps
+         << "/" << m_stats_physics.physics_warp
+         << " - Vessels on rails: " << m_stats_physics.vessels_on_rails
+         << " (packed: " << m_stats_physics.packed_vessels << ")";
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 205, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Dynamics worlds: " << m_stats_physics.dynamics_worlds
+         << " - Bullet threads: " << m_stats_physics.bullet_threads
+         << (m_stats_physics.bullet_multithreaded ? " (multithreaded world)" : " (clusters only)");
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 225, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Bullet update per threads:";
+    for(int i=1; i <= OVERLAY_MAX_THREADS && oss2.tellp() < 100; i++){
+        if(m_stats_physics.bullet_thread_times[i] > 0.0)
+            oss2 << " " << i << ": " << std::setprecision(3)
+                 << m_stats_physics.bullet_thread_times[i] << "ms";
+    }
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 245, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Broadphase pairs: " << m_stats_physics.broadphase_pairs[1] << " (part filter)"
+         << " - " << m_stats_physics.broadphase_pairs[0] << " (no filter)"
+         << " - Part filter: " << (m_stats_physics.part_filter ? "on" : "off")
+         << ", rejected: " << m_stats_physics.rejected_pairs;
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 265, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
+    oss2.str("");
+    oss2.clear();
+    oss2 << "Broadphase proxies created: " << m_stats_physics.proxy_creations;
+    mbstowcs(buffer2, oss2.str().c_str(), 128);
+    m_text_dynamic_text->addString(buffer2, 15, 285, 1,
+                                   STRING_DRAW_ABSOLUTE_TL, STRING_ALIGN_RIGHT, c);
+
     m_text_dynamic_text->render();
 
     m_text_debug->render();
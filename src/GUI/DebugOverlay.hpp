@@ -3,6 +3,8 @@
 
 #include <memory>
 
+/* maximum number of threads of bullet with timing stats */
+#define OVERLAY_MAX_THREADS 64
 
 class RenderContext;
 class Text2D;
@@ -26,6 +28,46 @@ struct times_physics{
 };
 
 
+struct stats_physics{
+    int gravity_bodies, gravity_sources, gravity_aggregated, gravity_pairs;
+    double gravity_cull_error;
+    const char* gravity_kernel;
+    double time_warp;
+    int vessels_on_rails, packed_vessels, physics_substeps, physics_warp;
+    int dynamics_worlds, bullet_threads;
+    bool bullet_multithreaded;
+    double bullet_thread_times[OVERLAY_MAX_THREADS + 1]; // ms, indexed by the number of threads
+    int broadphase_pairs[2]; // indexed by the state of the part filter
+    long rejected_pairs;
+    bool part_filter;
+    long proxy_creations;
+
+    stats_physics(){
+        gravity_bodies = 0;
+        gravity_sources = 0;
+        gravity_aggregated = 0;
+        gravity_pairs = 0;
+        gravity_cull_error = 0.0;
+        gravity_kernel = "";
+        time_warp = 1.0;
+        vessels_on_rails = 0;
+        packed_vessels = 0;
+        physics_substeps = 1;
+        physics_warp = 1;
+        dynamics_worlds = 1;
+        bullet_threads = 1;
+        bullet_multithreaded = false;
+        for(int i=0; i <= OVERLAY_MAX_THREADS; i++)
+            bullet_thread_times[i] = 0.0;
+        broadphase_pairs[0] = 0;
+        broadphase_pairs[1] = 0;
+        rejected_pairs = 0;
+        part_filter = false;
+        proxy_creations = 0;
+    }
+};
+
+
 struct times_logic{
     double load_time, sleep_time;
 
@@ -58,6 +100,7 @@ class DebugOverlay{
         std::unique_ptr<FontAtlas> m_font_atlas;
         int m_rendered_obj;        
         times_physics m_times_physics;
+        stats_physics m_stats_physics;
         times_logic m_times_logic;
         times_render m_times_render;
     public:
@@ -87,6 +130,66 @@ class DebugOverlay{
          */
         void setPhysicsTimes(const physics_timing& times);
 
+        /*
+         * Sets the statistics of the gravity computation.
+         *
+         * @bodies: number of bodies that received gravity during the last tick.
+         * @sources: number of gravity sources (star + planets).
+         * @aggregated: number of vessels whose gravity was evaluated at their CoM.
+         * @kernel: name of the gravity kernel, see gravity_kernel_name in core/gravity.hpp.
+         * @pairs: number of source-body pairs evaluated, less than bodies * sources if the
+         * sources are culled (see Physics::setGravityCulling).
+         * @cull_error: maximum error of the culling, in m/s^2.
+         */
+        void setGravityStats(int bodies, int sources, int aggregated, const char* kernel,
+                             int pairs, double cull_error);
+
+        /*
+         * Sets the time warp statistics.
+         *
+         * @time_warp: time warp factor applied during the last tick.
+         * @on_rails: number of vessels that are propagated analytically (on rails).
+         * @packed: number of vessels on rails because they are far from the player.
+         */
+        void setRailsStats(double time_warp, int on_rails, int packed);
+
+        /*
+         * Sets the physics warp statistics.
+         *
+         * @substeps: number of physics ticks run during the last logic frame.
+         * @warp: requested physics warp (ticks per logic frame).
+         */
+        void setPhysicsWarpStats(int substeps, int warp);
+
+        /*
+         * Sets the statistics of the world clusters.
+         *
+         * @worlds: number of dynamics worlds stepped during the last tick (main world + clusters).
+         * @threads: number of threads of bullet.
+         * @multithreaded: true if the main world is multithreaded (btDiscreteDynamicsWorldMt).
+         */
+        void setClusterStats(int worlds, int threads, bool multithreaded);
+
+        /*
+         * Sets the average time of bullet (step_bullet) with a given number of threads, the times
+         * of every number of threads that has been used are shown so they can be compared.
+         *
+         * @threads: number of threads of bullet, see Physics::setBulletThreads.
+         * @time: average time in ms.
+         */
+        void setBulletThreadTime(int threads, double time);
+
+        /*
+         * Sets the broadphase statistics. The last number of pairs with and without the part
+         * filter are both shown, so they can be compared.
+         *
+         * @pairs: number of overlapping pairs of the worlds stepped during the last tick.
+         * @rejected: number of pairs rejected by the part filter during the last tick.
+         * @filter: true if the part filter is enabled, see Physics::setPartCollisionFilter.
+         * @proxies: number of broadphase proxies created, see Physics::getProxyCreations.
+         */
+        void setBroadphaseStats(int pairs, long rejected, bool filter, long proxies);
+
         /*
          * Sets the render thread load times. Check the structs with the timings defined in
          * core/timing.hpp.
@@ -68,8 +68,7 @@ void PlanetariumGUI::showVessels(const math::mat4& proj_mat, const math::mat4& v
     wchar_t buff[256];
 
     for(it = active_vessels.begin(); it != active_vessels.end(); it++){
-        const btVector3& com = it->second->getCoM();
-
+        btVector3 com = it->second->getCoM() + m_app->getPhysics()->getWorldOrigin();
 
         math::vec4 pos(com.getX() / PLANETARIUM_SCALE_FACTOR,
                        com.getY() / PLANETARIUM_SCALE_FACTOR,
@@ -338,12 +337,33 @@ void PlanetariumGUI::renderImGUI(){
         ImGui::InputDouble("Predictor period (days)", &period_days);
         m_fixed_traj_config.predictor_period_secs = period_days * 24 * 60 * 60;
 
+        ImGui::InputDouble("Gravity threshold (m/s^2)", &m_fixed_traj_config.gravity_threshold);
+
+        const char* integrators[] = {"Symplectic Euler", "Dormand-Prince", "Adaptive leapfrog",
+                                     "Patched conics"};
+        ImGui::Combo("Integrator", &m_fixed_traj_config.integrator, integrators,
+                     IM_ARRAYSIZE(integrators));
+        if(m_fixed_traj_config.integrator == PREDICTOR_DORMAND_PRINCE ||
+           m_fixed_traj_config.integrator == PREDICTOR_PATCHED_CONIC)
+            ImGui::InputDouble("Tolerance", &m_fixed_traj_config.tolerance);
+        else if(m_fixed_traj_config.integrator == PREDICTOR_ADAPTIVE_LEAPFROG)
+            ImGui::InputDouble("Eta", &m_fixed_traj_config.eta);
+
         if(m_fixed_traj_config.predictor_steps <= 0)
             m_fixed_traj_config.predictor_steps = 1;
 
         if(m_fixed_traj_config.predictor_period_secs <= 0)
             m_fixed_traj_config.predictor_period_secs = 1;
 
+        if(m_fixed_traj_config.gravity_threshold < 0)
+            m_fixed_traj_config.gravity_threshold = 0;
+
+        if(m_fixed_traj_config.tolerance <= 0)
+            m_fixed_traj_config.tolerance = DEFAULT_PREDICTOR_TOLERANCE;
+
+        if(m_fixed_traj_config.eta <= 0)
+            m_fixed_traj_config.eta = DEFAULT_PREDICTOR_ETA;
+
         const planet_map& planets = m_asset_manager->m_planetary_system.get()->getPlanets();
         planet_map::const_iterator it;
         if(ImGui::BeginCombo("Relative to", m_fixed_traj_config.relative_to == 0 ? "Star" : 
@@ -382,7 +402,7 @@ void PlanetariumGUI::showCheatsMenu(){
     const Vessel* vessel = m_app->getPlayer()->getVessel();
     if(vessel != nullptr){
         const btVector3& vel = vessel->getVesselVelocity();
-        const btVector3& com = vessel->getCoM();
+        btVector3 com = vessel->getCoM() + m_app->getPhysics()->getWorldOrigin();
 
         // vessel velocity
         ImGui::Text("Vessel velocity");
@@ -0,0 +1,352 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <random>
+
+#include "HeadlessApp.hpp"
+#include "core/AssetManager.hpp"
+#include "core/Physics.hpp"
+#include "core/Input.hpp"
+#include "core/log.hpp"
+#include "core/timing.hpp"
+#include "core/Recorder.hpp"
+#include "core/id_manager.hpp"
+#include "assets/BasePart.hpp"
+#include "assets/Vessel.hpp"
+#include "assets/Planet.hpp"
+#include "assets/PlanetarySystem.hpp"
+#include "assets/utils/planet_utils.hpp"
+
+
+/* launch site and velocity of the vessel in GameSimulation::editorToSimulation, the position is
+   the center of the earth */
+#define LAUNCH_SITE_ORIGIN btVector3(-26504446806.42, -38663.47, 144693255800.63)
+#define LAUNCH_SITE_VELOCITY btVector3(-29786.6, -0.00889649, -5478.81)
+#define EARTH_RADIUS 6371025.0
+
+
+HeadlessApp::HeadlessApp(const headless_workload& workload) : BaseApp(){
+    m_workload = workload;
+    init();
+}
+
+
+HeadlessApp::~HeadlessApp(){
+}
+
+
+void HeadlessApp::init(){
+    m_acc_gravity = 0.0;
+    m_acc_bullet = 0.0;
+    m_acc_orbital = 0.0;
+    m_acc_kinematic = 0.0;
+    m_ticks = 0;
+    m_exit_code = EXIT_SUCCESS;
+    m_num_worlds = 0;
+    m_max_aggregation_error = 0.0;
+    m_recorder.reset(new Recorder());
+    m_recording_mode = RECORDER_OFF;
+
+#ifdef BULLET_MT
+    m_physics->initDynamicsWorld(btVector3(0.0, 0.0, 0.0), true);
+#elif defined(BULLET_MULTIBODY)
+    m_physics->initDynamicsWorld(btVector3(0.0, 0.0, 0.0), false, true);
+#else
+    m_physics->initDynamicsWorld();
+#endif
+
+    if(m_asset_manager->loadResources() == EXIT_FAILURE){
+        std::cerr << "HeadlessApp::init: fatal - failed to load the resources,"
+                     "check the xml file!" << std::endl;
+        log("HeadlessApp::init: fatal - failed to load resources, check the xml file!");
+        exit(EXIT_FAILURE);
+    }
+
+    if(m_asset_manager->loadStarSystem() == EXIT_FAILURE){
+        std::cerr << "HeadlessApp::init: fatal - failed to load the star system,"
+                     "check the xml file!" << std::endl;
+        log("HeadlessApp::init: fatal - failed to load the star system, check the xml file!");
+        exit(EXIT_FAILURE);
+    }
+
+    if(m_asset_manager->loadParts() == EXIT_FAILURE){
+        std::cerr << "HeadlessApp::init: fatal - failed to load the parts,"
+                     "check the xml file!" << std::endl;
+        log("HeadlessApp::init: fatal - failed to load the parts, check the xml file!");
+        exit(EXIT_FAILURE);
+    }
+
+    if(buildVessels() == EXIT_FAILURE){
+        std::cerr << "HeadlessApp::init: fatal - failed to build the vessels" << std::endl;
+        log("HeadlessApp::init: fatal - failed to build the vessels");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+void HeadlessApp::terminate(){
+    m_asset_manager->cleanup();
+    m_physics->stopSimulation();
+}
+
+
+int HeadlessApp::buildVessels(){
+    std::hash<std::string> str_hash;
+    BasePartMap::const_iterator master = m_asset_manager->m_master_parts.find(
+        str_hash(m_workload.part_name));
+    planet_map& planets = m_asset_manager->m_planetary_system->getPlanets();
+    planet_map::iterator earth = planets.find(str_hash("Earth"));
+
+    if(master == m_asset_manager->m_master_parts.end()){
+        std::cerr << "HeadlessApp::buildVessels: there's no part named "
+                  << m_workload.part_name << std::endl;
+        log("HeadlessApp::buildVessels: there's no part named ", m_workload.part_name);
+        return EXIT_FAILURE;
+    }
+    if(earth == planets.end()){
+        std::cerr << "HeadlessApp::buildVessels: the star system has no Earth" << std::endl;
+        log("HeadlessApp::buildVessels: the star system has no Earth");
+        return EXIT_FAILURE;
+    }
+
+    // circular orbit over the launch site, the vessels are spaced along the orbit
+    double radius = EARTH_RADIUS + HEADLESS_ALTITUDE;
+    double speed = std::sqrt(GRAVITATIONAL_CONSTANT * earth->second->getOrbitalData().m / radius);
+    btVector3 up = reference_ellipse_to_xyz(btRadians(0.0), btRadians(0.0), 1.0).normalized();
+    btVector3 prograde = up.cross(btVector3(0.0, 1.0, 0.0)).normalized();
+    btVector3 origin = LAUNCH_SITE_ORIGIN + up * radius - m_physics->getWorldOrigin();
+
+    for(int i=0; i < m_workload.num_vessels; i++){
+        buildVessel(master->second.get(), origin + prograde * (i * m_workload.vessel_spacing),
+                    LAUNCH_SITE_VELOCITY + prograde * speed);
+    }
+
+    log("HeadlessApp::buildVessels: built ", m_workload.num_vessels, " vessels of ",
+        m_workload.parts_per_vessel, " parts (", m_workload.part_name, ")");
+
+    return EXIT_SUCCESS;
+}
+
+
+void HeadlessApp::buildVessel(const BasePart* master, const btVector3& origin,
+                              const btVector3& velocity){
+    std::vector<std::shared_ptr<BasePart>> parts;
+    btVector3 part_origin = origin;
+
+    // the bodies have to exist before the parts are added to the vessel
+    for(int i=0; i < std::max(m_workload.parts_per_vessel, 1); i++){
+        std::shared_ptr<BasePart> part(master->clone());
+
+        if(i > 0){
+            const math::vec3& parent_att = parts.back()->getAttachmentPoints().size() ?
+                                           parts.back()->getAttachmentPoints().at(0).point :
+                                           parts.back()->getFreeAttachmentPoint().point;
+            const math::vec3& child_att = part->getParentAttachmentPoint().point;
+
+            part_origin += btVector3(parent_att.v[0] - child_att.v[0],
+                                     parent_att.v[1] - child_att.v[1],
+                                     parent_att.v[2] - child_att.v[2]);
+        }
+        m_asset_manager->addBody(part.get(), part_origin, btVector3(0.0, 0.0, 0.0),
+                                 btQuaternion::getIdentity());
+        parts.push_back(std::move(part));
+    }
+    m_asset_manager->processCommandBuffers(true);
+
+    std::shared_ptr<Vessel> vessel = std::make_shared<Vessel>(std::move(parts.front()),
+                                                              m_input.get());
+    BasePart* parent = vessel->getRoot();
+
+    for(uint i=1; i < parts.size(); i++){
+        BasePart* child = parts.at(i).get();
+
+        vessel->addChildById(std::move(parts.at(i)), parent->getUniqueId());
+        parent = child;
+    }
+
+    m_asset_manager->buildConstraintSubtree(vessel->getRoot());
+    m_asset_manager->processCommandBuffers(true);
+
+    vessel->setVesselVelocity(velocity);
+    m_asset_manager->m_active_vessels.insert({vessel->getId(), vessel});
+    m_physics->refreshVesselPairs(vessel.get());
+}
+
+
+void HeadlessApp::accumulatePhysicsTimes(){
+    const physics_timing& timing = m_physics->getTiming();
+
+    m_acc_gravity += duration(timing.end_gravity - timing.loop_start).count();
+    m_acc_bullet += duration(timing.end_bullet - timing.end_gravity).count();
+    m_acc_orbital += duration(timing.end_orbital - timing.end_bullet).count();
+    m_acc_kinematic += duration(timing.loop_end - timing.end_orbital).count();
+}
+
+
+void HeadlessApp::setRecording(int mode, const std::string& path){
+    m_recording_mode = mode;
+    m_recording_path = path;
+}
+
+
+void HeadlessApp::startRecorder(){
+    std::uint64_t initial_digest;
+
+    if(m_recording_mode == RECORDER_OFF)
+        return;
+
+    m_asset_manager->processCommandBuffers(false);
+    m_asset_manager->updateCoMs();
+    initial_digest = m_asset_manager->getStateDigest();
+
+    if(m_recording_mode == RECORDER_RECORD){
+        std::uint32_t seed = std::random_device()();
+
+        if(!m_recorder->startRecording(m_recording_path, seed, initial_digest))
+            return;
+    }
+    else if(!m_recorder->startReplay(m_recording_path, initial_digest)){
+        return;
+    }
+
+    set_id_seed(m_recorder->getSeed());
+    m_asset_manager->setDigestCommands(true);
+}
+
+
+bool HeadlessApp::recordPreStep(){
+    if(!m_recorder->beginFrame())
+        return false;
+
+    recorded_frame& frame = m_recorder->getFrame();
+
+    m_asset_manager->getCommandsDigest(frame.num_commands, frame.commands_digest);
+    if(m_recorder->getMode() == RECORDER_REPLAY){
+        const recorded_frame& recorded = m_recorder->getRecordedFrame();
+
+        m_input->setState(recorded.input);
+        m_physics->setReplayTicks(recorded.due_ticks, recorded.sub_ticks);
+    }
+    else{
+        m_input->getState(frame.input);
+    }
+    return true;
+}
+
+
+void HeadlessApp::recordPostStep(){
+    recorded_frame& frame = m_recorder->getFrame();
+
+    frame.due_ticks = m_physics->getDueTicks();
+    frame.sub_ticks = m_physics->getSubTicks();
+    frame.state_digest = m_asset_manager->getStateDigest();
+    m_recorder->endFrame();
+}
+
+
+void HeadlessApp::run(){
+    time_point start, frame_start;
+    const Vessel* focus = m_asset_manager->m_active_vessels.size() ?
+                          m_asset_manager->m_active_vessels.begin()->second.get() : nullptr;
+    bool replay;
+
+    m_frame_times.reserve(m_workload.num_frames);
+
+    // sub_ticks ticks per frame whatever the real time is, and no budget for the physics warp
+    m_physics->setPhysicsWarp(m_workload.sub_ticks);
+    m_physics->setReplayTicks(1, m_workload.sub_ticks);
+    m_physics->setGravityAggregation(m_workload.gravity_aggregation);
+    m_physics->setGravityCulling(m_workload.gravity_culling);
+    m_physics->setWorldClusters(m_workload.world_clusters);
+    m_physics->setResidency(m_workload.residency);
+    m_physics->startSimulation(10);
+    m_physics->pauseSimulation(false);
+    startRecorder();
+    replay = m_recorder->getMode() == RECORDER_REPLAY;
+
+    start = sch_now();
+    for(long i=0; replay || i < m_workload.num_frames; i++){
+        frame_start = sch_now();
+
+        m_asset_manager->processCommandBuffers(false);
+        if(m_recorder->getMode() != RECORDER_OFF && !recordPreStep())
+            break; // the replay ended
+        if(focus){
+            m_physics->updateFloatingOrigin(focus->getCoM());
+            m_physics->setResidencyFocus(focus->getCoM());
+        }
+        m_physics->wakeSimulation();
+        m_asset_manager->updateVessels();
+        m_physics->waitSimulation();
+        m_asset_manager->updateCoMs();
+        if(m_recorder->getMode() != RECORDER_OFF)
+            recordPostStep();
+        m_ticks += m_physics->getSubTicks();
+        m_num_worlds = m_physics->getNumWorlds();
+        m_max_aggregation_error = std::max(m_max_aggregation_error,
+                                           m_physics->getGravityAggregationError());
+
+        m_frame_times.push_back(duration(sch_now() - frame_start).count());
+        accumulatePhysicsTimes();
+    }
+    double wall_time = duration(sch_now() - start).count() / 1000000.0; // s
+
+    m_recorder->finish();
+    m_physics->setReplayTicks(-1, -1);
+    m_asset_manager->setDigestCommands(false);
+    m_exit_code = printStats(wall_time);
+    terminate();
+}
+
+
+int HeadlessApp::getExitCode() const{
+    return m_exit_code;
+}
+
+
+int HeadlessApp::printStats(double wall_time) const{
+    std::vector<double> sorted(m_frame_times);
+    long frames = sorted.size();
+    double simulated = m_ticks / m_physics->getPhysicsRate();
+
+    if(!frames)
+        return EXIT_SUCCESS;
+    std::sort(sorted.begin(), sorted.end());
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "sim-headless: " << m_workload.num_vessels << " vessels of "
+              << m_workload.parts_per_vessel << " parts (" << m_workload.part_name << "), "
+              << frames << " frames, " << m_ticks << " ticks at " << m_physics->getPhysicsRate()
+              << " Hz, " << m_num_worlds << " worlds" << std::endl;
+    std::cout << "  wall time: " << wall_time << " s, simulated: " << simulated << " s ("
+              << simulated / wall_time << "x real time, " << m_ticks / wall_time
+              << " ticks/s)" << std::endl;
+    std::cout << "  frame (ms): min " << sorted.front() / 1000.0
+              << ", median " << sorted.at(frames / 2) / 1000.0
+              << ", p99 " << sorted.at(std::min(frames - 1, long(frames * 0.99))) / 1000.0
+              << ", max " << sorted.back() / 1000.0 << std::endl;
+    std::cout << "  physics per frame (ms): gravity " << m_acc_gravity / frames / 1000.0
+              << ", bullet " << m_acc_bullet / frames / 1000.0
+              << ", orbits " << m_acc_orbital / frames / 1000.0
+              << ", kinematics " << m_acc_kinematic / frames / 1000.0 << std::endl;
+
+    log("HeadlessApp::printStats: ", m_ticks, " ticks in ", wall_time, " s, median frame ",
+        sorted.at(frames / 2) / 1000.0, " ms");
+
+    if(m_workload.gravity_aggregation){
+        std::cout << std::scientific << std::setprecision(2)
+                  << "  gravity aggregation: max error " << m_max_aggregation_error
+                  << " m/s^2, threshold " << DEFAULT_TIDAL_THRESHOLD << " m/s^2" << std::endl;
+        if(m_max_aggregation_error > DEFAULT_TIDAL_THRESHOLD){
+            std::cerr << "HeadlessApp::printStats: the error of the gravity aggregation is above "
+                         "the tidal threshold" << std::endl;
+            log("HeadlessApp::printStats: gravity aggregation error ", m_max_aggregation_error,
+                " above the tidal threshold");
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
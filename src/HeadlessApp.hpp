@@ -0,0 +1,170 @@
+#ifndef HEADLESS_APP_HPP
+#define HEADLESS_APP_HPP
+
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "core/BaseApp.hpp"
+
+
+class Vessel;
+class BasePart;
+class Recorder;
+
+
+/* defaults of the workload, see HeadlessApp::HeadlessApp */
+#define HEADLESS_DEFAULT_VESSELS 8
+#define HEADLESS_DEFAULT_PARTS 6
+#define HEADLESS_DEFAULT_FRAMES 3600
+#define HEADLESS_DEFAULT_PART "tank2"
+#define HEADLESS_DEFAULT_SUB_TICKS 1
+
+/* the vessels are placed in a circular orbit at this altitude (m) over the launch site of the
+   game (GameSimulation::editorToSimulation), spaced along the orbit */
+#define HEADLESS_ALTITUDE 400000.0
+#define HEADLESS_VESSEL_SPACING 100.0
+
+/* --sweep runs the workload from HEADLESS_SWEEP_MIN to HEADLESS_SWEEP_MAX vessels. They are
+   HEADLESS_SWEEP_SPACING (m) apart, farther than the reach of the clusters (CLUSTER_MARGIN), so
+   every vessel can get its own world, and the residency is off so none of them is packed */
+#define HEADLESS_SWEEP_MIN 10
+#define HEADLESS_SWEEP_MAX 100
+#define HEADLESS_SWEEP_STEP 10
+#define HEADLESS_SWEEP_SPACING 5000.0
+
+
+/*
+ * Describes the workload of the headless app.
+ *
+ * @num_vessels: number of vessels.
+ * @parts_per_vessel: parts of every vessel, a stack of clones of the same part.
+ * @num_frames: logic frames to simulate.
+ * @part_name: name of the master part (part_name in parts.xml).
+ * @sub_ticks: physics ticks per logic frame (see Physics::setPhysicsWarp), the CoMs of the
+ * vessels are only updated once per frame.
+ * @gravity_aggregation: evaluate the gravity of the vessels at their CoM (see
+ * Physics::setGravityAggregation) and check its error against the tidal threshold.
+ * @gravity_culling: cull the gravity sources, see Physics::setGravityCulling.
+ * @vessel_spacing: distance between two consecutive vessels along the orbit, in m.
+ * @world_clusters: step the groups of vessels in separate worlds, see Physics::setWorldClusters.
+ * @residency: pack the vessels far from the first one, see Physics::setResidency.
+ */
+struct headless_workload{
+    int num_vessels, parts_per_vessel, sub_ticks;
+    long num_frames;
+    std::string part_name;
+    bool gravity_aggregation, gravity_culling, world_clusters, residency;
+    double vessel_spacing;
+
+    headless_workload(){
+        num_vessels = HEADLESS_DEFAULT_VESSELS;
+        parts_per_vessel = HEADLESS_DEFAULT_PARTS;
+        sub_ticks = HEADLESS_DEFAULT_SUB_TICKS;
+        num_frames = HEADLESS_DEFAULT_FRAMES;
+        part_name = HEADLESS_DEFAULT_PART;
+        gravity_aggregation = false;
+        gravity_culling = false;
+        world_clusters = true;
+        residency = true;
+        vessel_spacing = HEADLESS_VESSEL_SPACING;
+    }
+};
+
+
+/*
+ * Simulation without window, render context or GUI, built with "make sim-headless" (HEADLESS,
+ * see the Makefile). It loads the resources, the star system and the parts, builds the vessels
+ * of the workload and runs the same logic/physics loop as GameSimulation, but every frame simulates
+ * exactly sub_ticks physics ticks (Physics::setReplayTicks) and nothing sleeps, so it steps as fast
+ * as it can. When it ends it prints the frame times and the breakdown of the physics thread, it's
+ * meant to benchmark the throughput of the simulation on machines without a GPU. With the gravity
+ * aggregation the run fails if its error goes above the tidal threshold.
+ *
+ * It can record its run or replay a recording like GameSimulation (see Recorder), a replay runs
+ * until the recording ends and checks the digests frame by frame. The initial state is the one of
+ * the workload, so a recording only replays with the same --vessels, --parts and --part.
+ */
+
+class HeadlessApp : public BaseApp{
+    private:
+        headless_workload m_workload;
+        std::vector<double> m_frame_times; // us
+        double m_acc_gravity, m_acc_bullet, m_acc_orbital, m_acc_kinematic; // us
+        long m_ticks;
+        int m_exit_code, m_num_worlds;
+        double m_max_aggregation_error; // m/s^2
+
+        /* recording or replay of the run, see setRecording */
+        std::unique_ptr<Recorder> m_recorder;
+        std::string m_recording_path;
+        int m_recording_mode;
+
+        void init();
+        void terminate();
+
+        /*
+         * Builds a vessel as a stack of clones of the given master part, each one attached to
+         * the first attachment point of the previous one.
+         *
+         * @master: master part.
+         * @origin: position of the root in world coordinates.
+         * @velocity: initial velocity of the vessel.
+         */
+        void buildVessel(const BasePart* master, const btVector3& origin,
+                         const btVector3& velocity);
+
+        /*
+         * Builds the vessels of the workload, returns EXIT_FAILURE if the master part doesn't
+         * exist.
+         */
+        int buildVessels();
+
+        /*
+         * Accumulates the breakdown of the last frame of the physics thread.
+         */
+        void accumulatePhysicsTimes();
+
+        /*
+         * Start the recorder if a recording or a replay was requested, and record or feed the
+         * recorded frame before and after the physics step, like GameSimulation. recordPreStep
+         * returns false when the replay ended.
+         */
+        void startRecorder();
+        bool recordPreStep();
+        void recordPostStep();
+
+        /*
+         * Prints the stats of the run. Returns EXIT_FAILURE if the error of the gravity
+         * aggregation went above the tidal threshold.
+         */
+        int printStats(double wall_time) const;
+    public:
+        /*
+         * Constructor, loads everything and builds the vessels. Exits if anything fails to load.
+         *
+         * @workload: vessels and frames to simulate.
+         */
+        HeadlessApp(const headless_workload& workload);
+        ~HeadlessApp();
+
+        void run();
+
+        /*
+         * Returns EXIT_FAILURE if a check of the last run failed (see printStats).
+         */
+        int getExitCode() const;
+
+        /*
+         * Requests to record the run to a file or to replay a recording, it starts with the run.
+         * A replay ignores the number of frames of the workload and runs until the recording
+         * ends.
+         *
+         * @mode: RECORDER_RECORD or RECORDER_REPLAY (see core/Recorder.hpp).
+         * @path: path of the recording.
+         */
+        void setRecording(int mode, const std::string& path);
+};
+
+
+#endif
@@ -147,24 +147,15 @@ void Planetarium::renderParticles(){
 
 
 void Planetarium::renderOrbits(){
-    planet_map::const_iterator it;
-    const planet_map& planets = m_asset_manager->m_planetary_system->getPlanets();
+    m_asset_manager->m_planetary_system->renderOrbits(m_seconds_since_j2000 / SECONDS_IN_A_CENTURY,
+                                                      m_camera->getViewMatrix(),
+                                                      m_camera->getProjMatrix(),
+                                                      m_bodies.at(m_pick)->getId(), 1.0f);
 
     m_render_context->useProgram(SHADER_DEBUG);
     glUniformMatrix4fv(view_location, 1, GL_FALSE, m_camera->getViewMatrix().m);
     glUniformMatrix4fv(proj_location, 1, GL_FALSE, m_camera->getProjMatrix().m);
 
-    for(it=planets.begin();it!=planets.end();it++){
-        Planet* current = it->second.get();
-
-        if(current == m_bodies.at(m_pick))
-            glUniform3f(color_location, 1.0, 0.0, 0.0);
-        else
-            glUniform3f(color_location, 0.1, .75, 0.25);
-
-        current->renderOrbit();
-    }
-
     glUniform3f(color_location, 0.0, .75, 0.75);
     glUniform1f(alpha_location, 1.0f);
     m_render_context->bindVao(m_pred_vao);
@@ -227,43 +218,13 @@ void Planetarium::updatePredictionBuffer(){
 
     particle selected_particle = m_particles.at(which_particle);
 
-    double e, W, w, inc, a, L, p, M, v;
     double time = m_seconds_since_j2000 / SECONDS_IN_A_CENTURY;
     double predictor_delta_t_secs = (m_predictor_period * 24 * 60 * 60) / m_predictor_steps;
     double predictor_delta_t_cent = predictor_delta_t_secs / SECONDS_IN_A_CENTURY;
 
     // only once per prediction, probably doesn't affect too much the precision
     for(it=planets.begin();it!=planets.end();it++){
-        const orbital_data& data = it->second->getOrbitalData();
-        a = data.a_0 + data.a_d * time;
-        e = data.e_0 + data.e_d * time;
-        inc = data.i_0 + data.i_d * time;
-        L = data.L_0 + data.L_d * time;
-        p = data.p_0 + data.p_d * time;
-        W = data.W_0 + data.W_d * time;
-
-
-        M = L - p;
-        w = p - W;
-
-        double E = M;
-        double ecc_d = 10.8008135;
-        int iter = 0;
-        while(std::abs(ecc_d) > 1e-6 && iter < MAX_SOLVER_ITER){
-            ecc_d = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
-            E -= ecc_d;
-            iter++;
-        }
-
-        v = 2 * std::atan(std::sqrt((1 + e) / (1 - e)) * std::tan(E / 2));
-
-        double rad = a * (1 - e * std::cos(E)) * AU_TO_METERS;
-
-        planet_origin.v[0] = rad * (std::cos(W) * std::cos(w + v) -
-                             std::sin(W) * std::sin(w + v) * std::cos(inc));
-        planet_origin.v[1] = rad * (std::sin(inc) * std::sin(w + v));
-        planet_origin.v[2] = rad * (std::sin(W) * std::cos(w + v) +
-                             std::cos(W) * std::sin(w + v) *std::cos(inc));
+        it->second->computePosition(time, planet_origin);
     }
 
     for(int i=0; i < m_predictor_steps; i++){
@@ -472,7 +433,6 @@ void Planetarium::logic(){
     }
 
     // gui stuff...
-    m_asset_manager->m_planetary_system->updateRenderBuffers(centuries_since_j2000);
     m_planetarium_gui->setSelectedPlanet(m_bodies.at(m_pick)->getId());
     m_planetarium_gui->setSimulationDeltaT(m_delta_t);
     m_planetarium_gui->onFramebufferSizeUpdate(); // it's nasty to do this evey frame...
@@ -206,10 +206,16 @@ Vessel* BasePart::getVessel(){
 
 
 void BasePart::updateSubTreeVessel(Vessel* vessel){
+    updateSubTreeVessel(vessel, vessel ? vessel->getId() : m_unique_id);
+}
+
+
+void BasePart::updateSubTreeVessel(Vessel* vessel, std::uint32_t tag){
     m_vessel = vessel;
+    setCollisionTag(tag);
 
     for(uint i=0; i < m_childs.size(); i++){
-        m_childs.at(i)->updateSubTreeVessel(vessel);
+        m_childs.at(i)->updateSubTreeVessel(vessel, tag);
     }
 }
 
@@ -476,6 +482,44 @@ int BasePart::removeBodiesSubtree(){
 }
 
 
+void BasePart::removeSubTreeFromWorld(){
+    if(m_parent_constraint.get() != nullptr){
+        m_physics->removeConstraint(m_parent_constraint.get());
+    }
+
+    if(m_body){
+        const btBroadphaseProxy* proxy = m_body->getBroadphaseProxy();
+
+        if(proxy){ // the mask might have changed since the body was added
+            m_col_group = proxy->m_collisionFilterGroup;
+            m_col_filters = proxy->m_collisionFilterMask;
+        }
+        m_physics->removeBody(m_body.get());
+    }
+
+    for(uint i=0; i < m_childs.size(); i++){
+        m_childs.at(i)->removeSubTreeFromWorld();
+    }
+}
+
+
+void BasePart::addSubTreeToWorld(){
+    if(m_body){
+        m_physics->addRigidBody(m_body.get(), m_col_group, m_col_filters);
+        m_body->activate(true);
+    }
+
+    // the parent was added before us
+    if(m_parent_constraint.get() != nullptr){
+        m_physics->addConstraint(m_parent_constraint.get(), true);
+    }
+
+    for(uint i=0; i < m_childs.size(); i++){
+        m_childs.at(i)->addSubTreeToWorld();
+    }
+}
+
+
 void BasePart::cloneSubTree(std::shared_ptr<BasePart>& current, bool is_subtree_root,
                             bool m_radial_clone){
     btTransform transform;
@@ -114,6 +114,14 @@ class BasePart : public Object{
          * Called upon creating the object.
          */
         void init();
+
+        /*
+         * Recursive part of updateSubTreeVessel.
+         *
+         * @vessel: raw pointer to the Vessel this subtree has been attached to.
+         * @tag: collision tag of the subtree.
+         */
+        void updateSubTreeVessel(Vessel* vessel, std::uint32_t tag);
     public:
         /*
          * Constructor. Only to be called when we are building the master part list.
@@ -213,7 +221,8 @@ class BasePart : public Object{
          * When this part and its subtree are attached to a Vessel, m_vessel is be updated to the
          * value of the pointer to that Vessel. This method recursively updates this through all
          * the subtree. If the subtree doesn't belong to any Vessel (only in the editor!), this
-         * value should be nullptr.
+         * value should be nullptr. The collision tag of the subtree (see Object::setCollisionTag)
+         * is updated too, it's the id of the Vessel or the id of this part for editor subtrees.
          *
          * @vessel: raw pointer to the Vessel this subtree has been attached to.
          */
@@ -266,6 +275,20 @@ class BasePart : public Object{
          */
         int removeBodiesSubtree();
 
+        /*
+         * Takes the subtree out of the dynamics world without destroying anything, the bodies
+         * and the constraints stay owned by the parts so addSubTreeToWorld can put them back.
+         * The collision group and mask of each body are saved, as Bullet destroys the proxies.
+         * Used to put vessels on rails. Not thread safe.
+         */
+        void removeSubTreeFromWorld();
+
+        /*
+         * Puts back a subtree removed with removeSubTreeFromWorld. The bodies are added before
+         * the constraints that link them. Not thread safe.
+         */
+        void addSubTreeToWorld();
+
         /*
          * Clones this part and its subtree. Not thread-safe as it useses Physics::addBody.
          *
@@ -279,9 +302,8 @@ class BasePart : public Object{
                           bool m_radial_clone);
 
         /*
-         * Builds the constraints of this part's subtree. Not thread safe, use the buffer
-         * m_build_constraint_subtree_buffer to build the subtree, or its AssetManagerInterface
-         * equivalent.
+         * Builds the constraints of this part's subtree. Not thread safe, use
+         * AssetManagerInterface::buildConstraintSubtree to build the subtree.
          *
          * @parent: pointer to the parent. In the AssetManager call it passes nullptr in the first
          * call, so the tree won't be attached to anything. Pass the parent instead.
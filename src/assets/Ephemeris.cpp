@@ -0,0 +1,182 @@
+#include <cmath>
+
+#include "Ephemeris.hpp"
+#include "Planet.hpp"
+#include "../core/Physics.hpp"
+#include "../core/kepler.hpp"
+
+
+Ephemeris::Ephemeris(){
+    m_segment_span = 0.0;
+    m_num_segments = 0;
+    m_fitted = 0;
+}
+
+
+Ephemeris::~Ephemeris(){
+    for(std::size_t i=0; i < m_num_segments; i++)
+        delete m_segments[i].load(std::memory_order_relaxed);
+}
+
+
+void Ephemeris::init(const orbital_data& data){
+    double mean_motion = std::abs(data.L_d - data.p_d); // rad/century
+
+    for(std::size_t i=0; i < m_num_segments; i++)
+        delete m_segments[i].load(std::memory_order_relaxed);
+    m_segments.reset();
+    m_num_segments = 0;
+    m_fitted = 0;
+
+    m_elements.reset(new orbital_data(data));
+    if(mean_motion == 0.0)
+        return;
+
+    m_segment_span = 2 * M_PI / mean_motion / EPHEMERIS_SEGMENTS_PER_ORBIT;
+    m_num_segments = std::ceil((EPHEMERIS_END - EPHEMERIS_START) / m_segment_span);
+    m_segments.reset(new std::atomic<segment*>[m_num_segments]);
+    for(std::size_t i=0; i < m_num_segments; i++)
+        m_segments[i].store(nullptr, std::memory_order_relaxed);
+}
+
+
+void Ephemeris::fitSegment(double start, segment& seg) const{
+    const int n = EPHEMERIS_DEGREE + 1;
+    double half = m_segment_span / 2;
+    kepler_orbits orbit;
+    kepler_states samples;
+
+    // values at the Chebyshev nodes, the velocities are not used
+    orbit.add(*m_elements, 0.0);
+    for(int k=0; k < n; k++)
+        samples.add(0, start + half * (1 + std::cos(M_PI * (k + 0.5) / n)));
+    propagate_kepler(orbit, samples);
+
+    const std::vector<double>* coords[3] = {&samples.x, &samples.y, &samples.z};
+    for(int c=0; c < 3; c++){
+        for(int j=0; j < n; j++){
+            double sum = 0.0;
+
+            for(int k=0; k < n; k++)
+                sum += (*coords[c])[k] * std::cos(M_PI * j * (k + 0.5) / n);
+            seg.pos[c][j] = (2.0 / n) * sum;
+        }
+
+        // derivative, d_(j-1) = d_(j+1) + 2 * j * c_j
+        double next = 0.0, next2 = 0.0;
+        for(int j=n - 1; j > 0; j--){
+            double d = next2 + 2 * j * seg.pos[c][j];
+
+            seg.vel[c][j - 1] = d / half;
+            next2 = next;
+            next = d;
+        }
+
+        seg.pos[c][0] /= 2;
+        seg.vel[c][0] /= 2;
+    }
+}
+
+
+const Ephemeris::segment* Ephemeris::getSegment(double cent_since_j2000, double& x) const{
+    if(!m_num_segments || cent_since_j2000 < EPHEMERIS_START)
+        return nullptr;
+
+    double offset = (cent_since_j2000 - EPHEMERIS_START) / m_segment_span;
+    std::size_t index = offset;
+
+    if(index >= m_num_segments)
+        return nullptr;
+
+    x = 2 * (offset - index) - 1;
+
+    segment* seg = m_segments[index].load(std::memory_order_acquire);
+    if(seg)
+        return seg;
+
+    std::lock_guard<std::mutex> lock(m_fit_lock);
+    seg = m_segments[index].load(std::memory_order_relaxed);
+    if(!seg){ // nobody fitted it while we waited
+        seg = new segment();
+        fitSegment(EPHEMERIS_START + index * m_segment_span, *seg);
+        m_segments[index].store(seg, std::memory_order_release);
+        m_fitted++;
+    }
+
+    return seg;
+}
+
+
+void Ephemeris::computePosition(double cent_since_j2000, dmath::vec3& pos) const{
+    double x;
+    const segment* seg = getSegment(cent_since_j2000, x);
+
+    if(!seg){
+        kepler_position(*m_elements, cent_since_j2000, pos);
+        return;
+    }
+
+    // Clenshaw
+    for(int c=0; c < 3; c++){
+        double b1 = 0.0, b2 = 0.0;
+
+        for(int j=EPHEMERIS_DEGREE; j > 0; j--){
+            double b = 2 * x * b1 - b2 + seg->pos[c][j];
+
+            b2 = b1;
+            b1 = b;
+        }
+        pos.v[c] = x * b1 - b2 + seg->pos[c][0];
+    }
+}
+
+
+void Ephemeris::computePosVel(double cent_since_j2000, dmath::vec3& pos,
+                              dmath::vec3& vel) const{
+    double x;
+    const segment* seg = getSegment(cent_since_j2000, x);
+
+    if(!seg){
+        // central difference of the reference, one second apart
+        dmath::vec3 prev, next;
+        double dt = 1.0 / SECONDS_IN_A_CENTURY;
+
+        kepler_position(*m_elements, cent_since_j2000, pos);
+        kepler_position(*m_elements, cent_since_j2000 - dt, prev);
+        kepler_position(*m_elements, cent_since_j2000 + dt, next);
+        vel = (next - prev) / 2.0;
+        return;
+    }
+
+    for(int c=0; c < 3; c++){
+        double b1 = 0.0, b2 = 0.0, d1 = 0.0, d2 = 0.0;
+
+        for(int j=EPHEMERIS_DEGREE; j > 0; j--){
+            double b = 2 * x * b1 - b2 + seg->pos[c][j];
+
+            b2 = b1;
+            b1 = b;
+        }
+        pos.v[c] = x * b1 - b2 + seg->pos[c][0];
+
+        for(int j=EPHEMERIS_DEGREE - 1; j > 0; j--){
+            double d = 2 * x * d1 - d2 + seg->vel[c][j];
+
+            d2 = d1;
+            d1 = d;
+        }
+        // the derivative is per century
+        vel.v[c] = (x * d1 - d2 + seg->vel[c][0]) / SECONDS_IN_A_CENTURY;
+    }
+}
+
+
+void Ephemeris::computeOrbit(double cent_since_j2000, dmath::vec3& p_axis, dmath::vec3& q_axis,
+                             double& e, double& M) const{
+    kepler_orbit_axes(*m_elements, cent_since_j2000, p_axis, q_axis, e, M);
+}
+
+
+std::size_t Ephemeris::getNumFitted() const{
+    return m_fitted.load();
+}
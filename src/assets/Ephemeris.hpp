@@ -0,0 +1,120 @@
+#ifndef EPHEMERIS_HPP
+#define EPHEMERIS_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+
+#include "../core/maths_funcs.hpp"
+
+
+struct orbital_data;
+
+
+/* degree of the Chebyshev polynomials of each coordinate */
+#define EPHEMERIS_DEGREE 8
+/* number of segments (one polynomial per coordinate each) fitted per orbit */
+#define EPHEMERIS_SEGMENTS_PER_ORBIT 32
+/* time window covered by the tables, in centuries since j2000. Outside of it the positions are
+   computed by kepler_position (kepler.hpp) */
+#define EPHEMERIS_START -2.0
+#define EPHEMERIS_END 2.0
+
+
+/*
+ * Piecewise Chebyshev approximation of the position of a body with fixed orbital elements (the
+ * planets). The window [EPHEMERIS_START, EPHEMERIS_END] is split in segments of
+ * 1/EPHEMERIS_SEGMENTS_PER_ORBIT of the orbital period, and each segment is fitted the first time
+ * somebody asks for a position inside it by evaluating the nodes with propagate_kepler. From
+ * then on a lookup is a Clenshaw evaluation of three polynomials, no Newton iterations or trig.
+ * The velocity is the derivative of the same polynomials, so positions and velocities are
+ * consistent.
+ *
+ * The lookups are thread safe: the segments are published with atomic pointers, and only the
+ * fitting of a new segment takes a lock. The segments are never freed until the destructor.
+ */
+
+class Ephemeris{
+    private:
+        struct segment{
+            double pos[3][EPHEMERIS_DEGREE + 1]; // c_0 is already halved
+            double vel[3][EPHEMERIS_DEGREE]; // coefficients of the derivative
+        };
+
+        std::unique_ptr<orbital_data> m_elements;
+        double m_segment_span; // centuries
+        std::size_t m_num_segments;
+        // the segments are a cache, fitted by the const lookups
+        mutable std::unique_ptr<std::atomic<segment*>[]> m_segments;
+        mutable std::atomic<std::size_t> m_fitted;
+        mutable std::mutex m_fit_lock;
+
+        /*
+         * Returns the segment that contains the given time, fitting it if it doesn't exist.
+         * Returns nullptr if the time is outside of the window or the ephemeris is not initialized.
+         *
+         * @cent_since_j2000: time, in centuries.
+         * @x: will contain the time in the interval of the segment, [-1, 1].
+         */
+        const segment* getSegment(double cent_since_j2000, double& x) const;
+
+        /*
+         * Fits the segment that starts at the given time.
+         *
+         * @start: start of the segment, in centuries.
+         * @seg: output segment.
+         */
+        void fitSegment(double start, segment& seg) const;
+    public:
+        Ephemeris();
+        ~Ephemeris();
+
+        /*
+         * Initializes the table for the given orbital elements, which are copied. Nothing is
+         * fitted here. Has to be called before any lookup, if the orbit has no mean motion the
+         * lookups fall back to kepler_position.
+         *
+         * @data: orbital parameters of the body.
+         */
+        void init(const orbital_data& data);
+
+        /*
+         * Computes the position of the body at the given time.
+         *
+         * @cent_since_j2000: time, in centuries.
+         * @pos: will contain the position relative to the primary, in meters.
+         */
+        void computePosition(double cent_since_j2000, dmath::vec3& pos) const;
+
+        /*
+         * Computes the position and the velocity of the body at the given time.
+         *
+         * @cent_since_j2000: time, in centuries.
+         * @pos: will contain the position relative to the primary, in meters.
+         * @vel: will contain the velocity relative to the primary, in meters per second.
+         */
+        void computePosVel(double cent_since_j2000, dmath::vec3& pos, dmath::vec3& vel) const;
+
+        /*
+         * Computes the osculating ellipse of the body at the given time from the orbital
+         * elements, see kepler_orbit_axes (kepler.hpp). Thread safe, the elements are never
+         * modified after init.
+         *
+         * @cent_since_j2000: time, in centuries.
+         * @p_axis: will contain the semi-major axis pointing to the periapsis, in meters.
+         * @q_axis: will contain the semi-minor axis, in meters.
+         * @e: will contain the eccentricity.
+         * @M: will contain the mean anomaly, in [-pi, pi].
+         */
+        void computeOrbit(double cent_since_j2000, dmath::vec3& p_axis, dmath::vec3& q_axis,
+                          double& e, double& M) const;
+
+        /*
+         * Returns the number of segments fitted so far.
+         */
+        std::size_t getNumFitted() const;
+};
+
+
+#endif
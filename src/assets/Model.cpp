@@ -6,6 +6,7 @@
 #include "Model.hpp"
 #include "../core/RenderContext.hpp"
 #include "../core/maths_funcs.hpp"
+#include "../core/common.hpp"
 #include "../core/log.hpp"
 #include "../core/utils/gl_utils.hpp"
 
@@ -20,12 +21,17 @@ Model::Model(){
 
 Model::Model(const char* path_to_mesh, const char* path_to_texture, int shader, const math::vec3& mesh_color){
     m_shader = shader;
+    m_mesh_color = math::vec4(mesh_color, 1.0);
+    m_has_texture = false;
 
+#ifdef HEADLESS
+    // only the bounding data is kept, see loadScene
+    UNUSED(path_to_texture);
+    loadScene(std::string(path_to_mesh));
+#else
     m_model_mat_location = m_render_context->getUniformLocation(m_shader, "model");
     m_color_location = m_render_context->getUniformLocation(m_shader, "object_color");
 
-    m_mesh_color = math::vec4(mesh_color, 1.0);
-
     loadScene(std::string(path_to_mesh));
 
     if(path_to_texture != nullptr){
@@ -47,14 +53,13 @@ Model::Model(const char* path_to_mesh, const char* path_to_texture, int shader,
 
         stbi_image_free(data);
     }
-    else{
-        m_has_texture = false;
-    }
     check_gl_errors(true, "Model::Model");
+#endif
 }
 
 
 Model::~Model(){
+#ifndef HEADLESS
     glDeleteBuffers(1, &m_vbo_vert);
     glDeleteBuffers(1, &m_vbo_tex);
     glDeleteBuffers(1, &m_vbo_ind);
@@ -63,6 +68,7 @@ Model::~Model(){
     if(m_has_texture)
         glDeleteTextures(1, &m_tex_id);
     check_gl_errors(true, "Model::~Model");
+#endif
 }
 
 
@@ -107,6 +113,9 @@ int Model::loadScene(const std::string& pFile){
         }
         m_aabb = get_AABB(points.get(), num_vertices);
     }
+#ifdef HEADLESS
+    return EXIT_SUCCESS;
+#else
     if(mesh->HasNormals()){
         normals.reset(new GLfloat[num_vertices * 3]);
         for(int i = 0; i < num_vertices; i++){
@@ -172,10 +181,15 @@ int Model::loadScene(const std::string& pFile){
     check_gl_errors(true, msg.c_str());
 
     return EXIT_SUCCESS;
+#endif
 }
 
 
 int Model::render(const math::mat4& transform) const{
+#ifdef HEADLESS
+    UNUSED(transform);
+    return 0;
+#else
     if(Model::m_frustum->checkBox(m_aabb.vert, transform)){
     ///if(m_frustum->checkSphere(math::vec3(transform.m[12], transform.m[13], transform.m[14]), m_cs_radius)){
         m_render_context->useProgram(m_shader);
@@ -198,10 +212,14 @@ int Model::render(const math::mat4& transform) const{
         return 0;
     }
     return 0;
+#endif
 }
 
 
 void Model::render_terrain(const math::mat4& transform) const{
+#ifdef HEADLESS
+    UNUSED(transform);
+#else
     m_render_context->useProgram(m_shader);
     m_render_context->bindVao(m_vao);
 
@@ -216,6 +234,7 @@ void Model::render_terrain(const math::mat4& transform) const{
     glDrawElements(GL_TRIANGLES, m_num_faces * 3, GL_UNSIGNED_INT, NULL);
 
     check_gl_errors(true, "Model::render_terrain");
+#endif
 }
 
 
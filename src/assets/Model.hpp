@@ -13,7 +13,8 @@ class RenderContext;
 
 
 /*
- * Model class, holds a 3D model. Quite simple but ok for now.
+ * Model class, holds a 3D model. Quite simple but ok for now. In headless builds (HEADLESS) only
+ * the bounding data of the mesh (radius and AABB) is loaded and nothing is rendered.
  */
 class Model{
     private:
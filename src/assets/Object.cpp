@@ -26,6 +26,7 @@ Object::Object(Model* model, Physics* physics, btCollisionShape* col_shape, btSc
     m_alpha = 1.0;
     m_col_group = 1;
     m_col_filters = -1;
+    m_col_tag = NO_COLLISION_TAG;
 }
 
 
@@ -45,6 +46,7 @@ Object::Object(const Object& obj) : std::enable_shared_from_this<Object>(){
     m_alpha = 1.0;
     m_col_group = obj.m_col_group;
     m_col_filters = obj.m_col_filters;
+    m_col_tag = NO_COLLISION_TAG; // the clone doesn't belong to the vessel of obj
 
     m_body.reset(nullptr);
 }
@@ -78,6 +80,8 @@ void Object::addBody(const btVector3& origin, const btVector3& local_inertia, co
     if(!is_dynamic)
         m_body->setCollisionFlags(btCollisionObject::CF_KINEMATIC_OBJECT);
 
+    m_body->setUserIndex(m_col_tag); // the pairs are created when the body is added
+
     //m_body->setCcdMotionThreshold(0.2);
     //m_body->setCcdSweptSphereRadius(100.0);
 
@@ -265,6 +269,19 @@ short Object::getCollisionFilters() const{
 }
 
 
+void Object::setCollisionTag(int tag){
+    m_col_tag = tag;
+
+    if(m_body != nullptr)
+        m_body->setUserIndex(tag);
+}
+
+
+int Object::getCollisionTag() const{
+    return m_col_tag;
+}
+
+
 void Object::renderOther(){
 
 }
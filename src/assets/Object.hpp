@@ -31,6 +31,7 @@ class Object : public std::enable_shared_from_this<Object>{
         std::string m_object_name, m_fancy_name;
         float m_alpha;
         short m_col_group, m_col_filters;
+        int m_col_tag;
     public:
         std::unique_ptr<btRigidBody> m_body; // made public for convenience <- this should change lol
 
@@ -120,6 +121,11 @@ class Object : public std::enable_shared_from_this<Object>{
          */
         short getCollisionFilters() const;
 
+        /*
+         * Returns the collision tag of the rigid body of this object.
+         */
+        int getCollisionTag() const;
+
         /*
          * Returns the total mass of this object.
          */
@@ -233,6 +239,16 @@ class Object : public std::enable_shared_from_this<Object>{
          */
         void setCollisionFilters(short cg_filters);
 
+        /*
+         * Sets the collision tag of the rigid body (its user index), the broadphase doesn't
+         * create pairs between bodies with the same tag, see part_overlap_filter in
+         * core/Physics.hpp. Pairs that already exist are not removed until the proxy of the body
+         * is refreshed.
+         *
+         * @tag: collision tag, NO_COLLISION_TAG if the body collides with everything.
+         */
+        void setCollisionTag(int tag);
+
         virtual void onEditorRightMouseButton();
 };
 
@@ -20,15 +20,13 @@
 
 Planet::Planet(RenderContext* render_context) : m_planet_tree(render_context, this){
     m_render_context = render_context;
-    initBuffers();
+#ifndef HEADLESS
     buildSurface();
+#endif
 }
 
 
 Planet::~Planet(){
-    glDeleteBuffers(1, &m_vbo_vert);
-    glDeleteBuffers(1, &m_vbo_ind);
-    glDeleteVertexArrays(1, &m_vao);
 }
 
 
@@ -101,61 +99,48 @@ void Planet::destroySurface(){
 }
 
 
-void Planet::initBuffers(){
-    glGenVertexArrays(1, &m_vao);
-    m_render_context->bindVao(m_vao);
+void Planet::updateOrbitalElements(const double cent_since_j2000){
+    computeOrbitalElements(cent_since_j2000, m_orbital_data);
+}
+
+
+void Planet::computeOrbitalElements(const double cent_since_j2000, orbital_data& data) const{
+    if(&data != &m_orbital_data)
+        data = m_orbital_data;
 
-    glGenBuffers(1, &m_vbo_vert);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vert);
-    glVertexAttribPointer(0, 3,  GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+    data.a = data.a_0 + data.a_d * cent_since_j2000;
+    data.e = data.e_0 + data.e_d * cent_since_j2000;
+    data.i = data.i_0 + data.i_d * cent_since_j2000;
+    data.L = data.L_0 + data.L_d * cent_since_j2000;
+    data.p = data.p_0 + data.p_d * cent_since_j2000;
+    data.W = data.W_0 + data.W_d * cent_since_j2000;
 
-    glGenBuffers(1, &m_vbo_ind);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vbo_ind);
+    data.M = data.L - data.p;
+    data.w = data.p - data.W;
+
+    data.pos_prev = data.pos;
+    m_ephemeris.computePosition(cent_since_j2000, data.pos);
 }
 
 
-void Planet::updateOrbitalElements(const double cent_since_j2000){
-    m_orbital_data.a = m_orbital_data.a_0 + m_orbital_data.a_d * cent_since_j2000;
-    m_orbital_data.e = m_orbital_data.e_0 + m_orbital_data.e_d * cent_since_j2000;
-    m_orbital_data.i = m_orbital_data.i_0 + m_orbital_data.i_d * cent_since_j2000;
-    m_orbital_data.L = m_orbital_data.L_0 + m_orbital_data.L_d * cent_since_j2000;
-    m_orbital_data.p = m_orbital_data.p_0 + m_orbital_data.p_d * cent_since_j2000;
-    m_orbital_data.W = m_orbital_data.W_0 + m_orbital_data.W_d * cent_since_j2000;
-
-    m_orbital_data.M = m_orbital_data.L - m_orbital_data.p;
-    m_orbital_data.w = m_orbital_data.p - m_orbital_data.W;
-
-    m_orbital_data.E = m_orbital_data.M;
-    double ecc_d = 10.8008135;
-    int iter = 0;
-    while(std::abs(ecc_d) > 1e-6 && iter < MAX_SOLVER_ITER){
-        ecc_d = (m_orbital_data.E - m_orbital_data.e * std::sin(m_orbital_data.E) - 
-                 m_orbital_data.M) / (1 - m_orbital_data.e * std::cos(m_orbital_data.E));
-        m_orbital_data.E -= ecc_d;
-        iter++;
-    }
+void Planet::initEphemeris(){
+    m_ephemeris.init(m_orbital_data);
+}
 
-    m_orbital_data.v = 2 * std::atan(std::sqrt((1 + m_orbital_data.e) / (1 - m_orbital_data.e))
-                       * std::tan(m_orbital_data.E / 2));
 
-    m_orbital_data.pos_prev = m_orbital_data.pos;
+void Planet::computePosition(const double cent_since_j2000, dmath::vec3& pos) const{
+    m_ephemeris.computePosition(cent_since_j2000, pos);
+}
 
-    // results in a singularity as e -> 1
-    double v = 2 * std::atan(std::sqrt((1 + m_orbital_data.e) / (1 - m_orbital_data.e))
-                                        * std::tan(m_orbital_data.E / 2));
 
-    double rad = m_orbital_data.a * (1 - m_orbital_data.e * std::cos(m_orbital_data.E))
-                                     * AU_TO_METERS;
+void Planet::computePosVel(const double cent_since_j2000, dmath::vec3& pos,
+                           dmath::vec3& vel) const{
+    m_ephemeris.computePosVel(cent_since_j2000, pos, vel);
+}
 
-    m_orbital_data.pos.v[0] = rad * (std::cos(m_orbital_data.W) * std::cos(m_orbital_data.w + v)
-                                     - std::sin(m_orbital_data.W) * std::sin(m_orbital_data.w + v)
-                                     * std::cos(m_orbital_data.i));
-    m_orbital_data.pos.v[1] = rad * (std::sin(m_orbital_data.i) * std::sin(m_orbital_data.w + v));
-    m_orbital_data.pos.v[2] = rad * (std::sin(m_orbital_data.W) * std::cos(m_orbital_data.w + v) +
-                                     std::cos(m_orbital_data.W) * std::sin(m_orbital_data.w + v)
-                                     * std::cos(m_orbital_data.i));
 
+const Ephemeris& Planet::getEphemeris() const{
+    return m_ephemeris;
 }
 
 
@@ -188,74 +173,14 @@ m_orbital_data.pos.v[1] = std::sin(m_orbital_data.W) * xtemp +
 */
 
 
-void Planet::updateRenderBuffers(double current_time){
-    std::unique_ptr<GLfloat[]> vertex_buffer;
-    std::unique_ptr<GLushort[]> index_buffer;
-
-    vertex_buffer.reset(new GLfloat[3 * NUM_VERTICES]);
-    index_buffer.reset(new GLushort[2 * NUM_VERTICES]);
-
-    m_render_context->bindVao(m_vao);
-
-    double e, W, w, inc, a, L, p, M, v;
-    double time = current_time;
-    for(uint i=0; i < NUM_VERTICES; i++){
-        time += m_orbital_data.period / NUM_VERTICES;
-
-        a = m_orbital_data.a_0 + m_orbital_data.a_d * time;
-        e = m_orbital_data.e_0 + m_orbital_data.e_d * time;
-        inc = m_orbital_data.i_0 + m_orbital_data.i_d * time;
-        L = m_orbital_data.L_0 + m_orbital_data.L_d * time;
-        p = m_orbital_data.p_0 + m_orbital_data.p_d * time;
-        W = m_orbital_data.W_0 + m_orbital_data.W_d * time;
-
-        M = L - p;
-        w = p - W;
-
-        double E = M;
-        double ecc_d = 10.8008135;
-        int iter = 0;
-        while(std::abs(ecc_d) > 1e-6 && iter < MAX_SOLVER_ITER){
-            ecc_d = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
-            E -= ecc_d;
-        }
-
-        v = 2 * std::atan(std::sqrt((1 + e) / (1 - e)) * std::tan(E / 2));
-
-        double rad = a * (1 - e * std::cos(E)) * (AU_TO_METERS / PLANETARIUM_SCALE_FACTOR);
-
-        vertex_buffer[i * 3] = rad * (std::cos(W) * std::cos(w + v) -
-                               std::sin(W) * std::sin(w + v) * std::cos(inc));
-        vertex_buffer[i * 3 + 1] = rad * (std::sin(inc) * std::sin(w + v));
-        vertex_buffer[i * 3 + 2] = rad * (std::sin(W) * std::cos(w + v) +
-                                   std::cos(W) * std::sin(w + v) *std::cos(inc));
-
-        index_buffer[i * 2] = i;
-        index_buffer[i * 2 + 1] = i + 1;
-    }
-    index_buffer[(2 * NUM_VERTICES) - 1] = NUM_VERTICES - 1;
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vert);
-    glBufferData(GL_ARRAY_BUFFER, 3 * NUM_VERTICES * sizeof(GLfloat), vertex_buffer.get(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vbo_ind);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 2 * NUM_VERTICES * sizeof(GLushort), index_buffer.get(), GL_STATIC_DRAW);
-}
-
-
-void Planet::renderOrbit() const{
-    m_render_context->bindVao(m_vao);
-    glDrawElements(GL_LINES, NUM_VERTICES * 2, GL_UNSIGNED_SHORT, NULL);
-}
-
-
 void Planet::registerKinematic(Kinematic* kinematic){
     m_kinematics.emplace_back(kinematic);
 }
 
 
-void Planet::updateKinematics(){
-    btVector3 origin(m_orbital_data.pos.v[0], m_orbital_data.pos.v[1], m_orbital_data.pos.v[2]);
+void Planet::updateKinematics(const btVector3& world_origin){
+    btVector3 origin = btVector3(m_orbital_data.pos.v[0], m_orbital_data.pos.v[1],
+                                 m_orbital_data.pos.v[2]) - world_origin;
     for(uint i=0; i < m_kinematics.size(); i++){
         m_kinematics.at(i)->update(origin, btQuaternion::getIdentity());
     }
@@ -7,18 +7,15 @@
 
 #include "../core/maths_funcs.hpp"
 #include "PlanetTree.hpp"
+#include "Ephemeris.hpp"
 
 
 class RenderContext;
 class Kinematic;
+class btVector3;
 class Sprite;
 
 
-#define NUM_VERTICES 300
-
-#define MAX_SOLVER_ITER 10
-
-
 /* 
  * Struct with orbital data of a celestial body. These parameters are used to solve the two-body 
  * problem. Since we don't suppot moons yet, we solve the two-body problems between the planets and
@@ -47,8 +44,9 @@ class Sprite;
  * @W_d: derivative of the ascending node, in rads/century.
  * @M: mean anomaly. In rads.
  * @w: argument of the periapsis, in rads.
- * @E: eccentric anomaly, in rads.
- * @v: true anomaly, in rads.
+ * @E: eccentric anomaly, in rads. Not updated for the planets, their position comes from their
+ * ephemeris (see Ephemeris).
+ * @v: true anomaly, in rads. Not updated for the planets either.
  * @period: period of the orbit, in centuries.
  * @pos: current position of the body.
  * @pos_prev: position of the body in the previous tick.
@@ -74,11 +72,10 @@ struct orbital_data{
 class Planet{
     private:
         orbital_data m_orbital_data;
+        Ephemeris m_ephemeris;
         std::uint32_t m_id;
         std::string m_name;
 
-        /* orbit render buffers */
-        GLuint m_vao, m_vbo_vert, m_vbo_ind;
         RenderContext* m_render_context;
         std::string m_thumbnail_path;
         math::vec3 m_base_color;
@@ -86,8 +83,6 @@ class Planet{
         PlanetTree m_planet_tree;
 
         std::vector<Kinematic*> m_kinematics;
-
-        void initBuffers();
     public:
         /*
          * Constructor
@@ -114,12 +109,6 @@ class Planet{
          */
         void render(const dmath::vec3& cam_translation, const dmath::mat4 transform);
 
-        /*
-         * Renders the orbit of the planet, used in the planetarium view. The shaders has to have 
-         * been bound before calling this method.
-         */
-        void renderOrbit() const;
-
         /*
          * Builds the surface tree (contained in PlanetTree) used to render and, at some point in
          * the future, in the collision. This tree is quite big in memory (30MB+?), and should not
@@ -143,12 +132,46 @@ class Planet{
         void updateOrbitalElements(const double cent_since_j2000);
 
         /*
-         * Updates the render buffers for the drawing of the orbit (renderOrbit). We shouldn't need
-         * to call this method each tick, since the orbits barely change in a year.
+         * Computes the orbital elements of the planet at the given time without modifying the
+         * planet, the result is written in data (the constant fields are copied from the planet
+         * and pos_prev is set to the current position). The position comes from the ephemeris.
+         * Can be called from a worker thread as long as nobody is modifying this planet's orbital
+         * data.
+         *
+         * @cent_since_j2000: centuries passed since the reference epoch.
+         * @data: output orbital data.
+         */
+        void computeOrbitalElements(const double cent_since_j2000, orbital_data& data) const;
+
+        /*
+         * Builds the ephemeris of the planet (see Ephemeris) from its orbital parameters, has to
+         * be called once they are loaded and before any of the methods that compute positions.
+         */
+        void initEphemeris();
+
+        /*
+         * Computes the position of the planet at the given time with its ephemeris. Thread safe,
+         * this is the method every position query of the planets should go through.
          *
-         * @current_time: current time in centuries.
+         * @cent_since_j2000: centuries passed since the reference epoch.
+         * @pos: will contain the position of the planet, in meters.
          */
-        void updateRenderBuffers(double current_time);
+        void computePosition(const double cent_since_j2000, dmath::vec3& pos) const;
+
+        /*
+         * Same as computePosition, but it also computes the velocity of the planet.
+         *
+         * @cent_since_j2000: centuries passed since the reference epoch.
+         * @pos: will contain the position of the planet, in meters.
+         * @vel: will contain the velocity of the planet, in meters per second.
+         */
+        void computePosVel(const double cent_since_j2000, dmath::vec3& pos,
+                           dmath::vec3& vel) const;
+
+        /*
+         * Returns the ephemeris of the planet.
+         */
+        const Ephemeris& getEphemeris() const;
 
         /*
          * Sets the ID of the planet.
@@ -227,8 +250,11 @@ class Planet{
 
         /*
          * Updates the kinematic objects of the planet.
+         *
+         * @world_origin: absolute position of the origin of the dynamics world, the kinematics
+         * are placed in world coordinates.
          */
-        void updateKinematics();
+        void updateKinematics(const btVector3& world_origin);
 
         /*
          * Sets the line color to be used when rendering the planet orbit in the planetarium.
@@ -7,6 +7,7 @@
 #include "Planet.hpp"
 #include "Model.hpp"
 #include "../core/RenderContext.hpp"
+#include "../core/common.hpp"
 #include "../core/log.hpp"
 #include "../core/utils/gl_utils.hpp"
 
@@ -35,6 +36,7 @@ PlanetTree::PlanetTree(RenderContext* render_context, Planet* planet){
     m_render_context = render_context;
     m_planet = planet;
 
+#ifndef HEADLESS
     m_relative_planet_location = m_render_context->getUniformLocation(SHADER_PLANET, "relative_planet");
     m_texture_scale_location = m_render_context->getUniformLocation(SHADER_PLANET, "texture_scale");
     m_tex_shift_location = m_render_context->getUniformLocation(SHADER_PLANET, "tex_shift");
@@ -42,6 +44,7 @@ PlanetTree::PlanetTree(RenderContext* render_context, Planet* planet){
 
     m_planet_texture = m_render_context->getUniformLocation(SHADER_PLANET, "tex");
     m_elevation_texture = m_render_context->getUniformLocation(SHADER_PLANET, "elevation");
+#endif
 
     if(!warning_async_notified){
 #ifndef ASYNC_PLANET_TEXTURE_LOAD
@@ -54,11 +57,14 @@ PlanetTree::PlanetTree(RenderContext* render_context, Planet* planet){
         warning_async_notified = true;
     }
 
+#ifndef HEADLESS
     check_gl_errors(true, "PlanetTree::PlanetTree");
+#endif
 }
 
 
 PlanetTree::~PlanetTree(){
+#ifndef HEADLESS
     if(m_surface.is_built){
         //std::cout << "planet tree destructor disabled" << std::endl;
         for(uint i=0; i < 6; i++){
@@ -67,12 +73,32 @@ PlanetTree::~PlanetTree(){
         // still not checking if we have threads running in the background
         textureFree();
     }
+#endif
     m_surface.is_built = false;
 
+#ifndef HEADLESS
     check_gl_errors(true, "PlanetTree::~PlanetTree");
+#endif
 }
 
 
+#ifdef HEADLESS
+/* the surface is only used for rendering, headless builds never build it */
+void PlanetTree::buildSurface(){
+}
+
+
+void PlanetTree::render(const dmath::vec3& cam_translation, const dmath::mat4 transform){
+    UNUSED(cam_translation);
+    UNUSED(transform);
+}
+
+
+void PlanetTree::loadBases(){
+}
+#else
+
+
 
 void PlanetTree::setTransform(struct surface_node& node, const struct surface_node& parent, int sign_side_1, int sign_side_2){
     node.patch_translation = parent.patch_translation;
@@ -535,6 +561,4 @@ void PlanetTree::render(const dmath::vec3& cam_translation, const dmath::mat4 tr
 
     textureFree();
 }
-
-
-
+#endif
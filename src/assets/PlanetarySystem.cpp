@@ -1,14 +1,27 @@
+#include <iostream>
+
 #include "PlanetarySystem.hpp"
 #include "../core/AssetManagerInterface.hpp"
+#include "../core/RenderContext.hpp"
+#include "../core/log.hpp"
+#include "../core/common.hpp"
+#include "../core/utils/gl_utils.hpp"
+#include "../game_components/GameSimulation.hpp"
 
 
 
 PlanetarySystem::PlanetarySystem(RenderContext* render_context){
     m_render_context = render_context;
+    m_ephemeris_version = 0;
+    m_orbit_vao = 0;
 }
 
 
 PlanetarySystem::~PlanetarySystem(){
+#ifndef HEADLESS
+    if(m_orbit_vao)
+        glDeleteVertexArrays(1, &m_orbit_vao);
+#endif
 }
 
 
@@ -54,32 +67,135 @@ void PlanetarySystem::updateOrbitalElements(const double cent_since_j2000){
     for(it=m_planets->begin();it!=m_planets->end();it++){
         it->second->updateOrbitalElements(cent_since_j2000);
     }
+    m_ephemeris_version++; // snapshots computed before this are outdated
 }
 
 
-void PlanetarySystem::updateRenderBuffers(const double current_time){
-    planet_map::iterator it;
+void PlanetarySystem::computeEphemeris(const double cent_since_j2000,
+                                       ephemeris_snapshot& snapshot) const{
+    planet_map::const_iterator it;
+    uint i = 0;
 
-    for(it=m_planets->begin();it!=m_planets->end();it++){
-        it->second->updateRenderBuffers(current_time);
+    snapshot.version = m_ephemeris_version + 1;
+    snapshot.cent_since_j2000 = cent_since_j2000;
+    snapshot.planets.resize(m_planets->size());
+    snapshot.data.resize(m_planets->size());
+
+    for(it=m_planets->begin();it!=m_planets->end();it++, i++){
+        snapshot.planets.at(i) = it->second.get();
+        it->second->computeOrbitalElements(cent_since_j2000, snapshot.data.at(i));
     }
 }
 
 
-void PlanetarySystem::renderOrbits() const{
-    planet_map::iterator it;
+int PlanetarySystem::publishEphemeris(const ephemeris_snapshot& snapshot){
+    if(snapshot.version != m_ephemeris_version + 1){
+        log("PlanetarySystem::publishEphemeris: snapshot version ", snapshot.version,
+            " can't be published on top of version ", m_ephemeris_version);
+        std::cerr << "PlanetarySystem::publishEphemeris: snapshot version " << snapshot.version
+                  << " can't be published on top of version " << m_ephemeris_version
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for(uint i=0; i < snapshot.planets.size(); i++){
+        snapshot.planets.at(i)->getOrbitalData() = snapshot.data.at(i);
+    }
+    m_ephemeris_version = snapshot.version;
+
+    return EXIT_SUCCESS;
+}
+
+
+std::uint64_t PlanetarySystem::getEphemerisVersion() const{
+    return m_ephemeris_version;
+}
+
+
+void PlanetarySystem::initOrbitRender(){
+#ifndef HEADLESS
+    glGenVertexArrays(1, &m_orbit_vao);
+
+    m_orbit_view_mat = m_render_context->getUniformLocation(SHADER_ORBIT, "view");
+    m_orbit_proj_mat = m_render_context->getUniformLocation(SHADER_ORBIT, "proj");
+    m_orbit_vertices = m_render_context->getUniformLocation(SHADER_ORBIT, "vertices");
+    m_orbit_p_axis = m_render_context->getUniformLocation(SHADER_ORBIT, "p_axis");
+    m_orbit_q_axis = m_render_context->getUniformLocation(SHADER_ORBIT, "q_axis");
+    m_orbit_color = m_render_context->getUniformLocation(SHADER_ORBIT, "color");
+
+    m_orbit_p.resize(4 * ORBIT_MAX_LINES);
+    m_orbit_q.resize(4 * ORBIT_MAX_LINES);
+    m_orbit_colors.resize(4 * ORBIT_MAX_LINES);
+#endif
+}
+
+
+void PlanetarySystem::renderOrbits(const double cent_since_j2000, const math::mat4& view,
+                                   const math::mat4& proj, std::uint32_t selected, float alpha){
+#ifdef HEADLESS
+    UNUSED(cent_since_j2000);
+    UNUSED(view);
+    UNUSED(proj);
+    UNUSED(selected);
+    UNUSED(alpha);
+#else
+    planet_map::const_iterator it;
+    uint count = 0;
+
+    if(!m_orbit_vao)
+        initOrbitRender();
+
+    m_render_context->useProgram(SHADER_ORBIT);
+    m_render_context->bindVao(m_orbit_vao);
+
+    glUniformMatrix4fv(m_orbit_view_mat, 1, GL_FALSE, view.m);
+    glUniformMatrix4fv(m_orbit_proj_mat, 1, GL_FALSE, proj.m);
+    glUniform1i(m_orbit_vertices, ORBIT_VERTICES);
 
     for(it=m_planets->begin();it!=m_planets->end();it++){
-        it->second->renderOrbit();
+        const Planet* current = it->second.get();
+        const math::vec3& color = current->getBaseColor();
+        float shade = current->getId() == selected ? 1.0 : 0.5;
+        dmath::vec3 p_axis, q_axis;
+        double e, M;
+
+        current->getEphemeris().computeOrbit(cent_since_j2000, p_axis, q_axis, e, M);
+
+        for(uint j=0; j < 3; j++){
+            m_orbit_p.at(count * 4 + j) = p_axis.v[j] / PLANETARIUM_SCALE_FACTOR;
+            m_orbit_q.at(count * 4 + j) = q_axis.v[j] / PLANETARIUM_SCALE_FACTOR;
+            m_orbit_colors.at(count * 4 + j) = color.v[j] * shade;
+        }
+        m_orbit_p.at(count * 4 + 3) = e;
+        m_orbit_q.at(count * 4 + 3) = M;
+        m_orbit_colors.at(count * 4 + 3) = alpha;
+
+        if(++count == ORBIT_MAX_LINES){ // only with huge systems
+            glUniform4fv(m_orbit_p_axis, count, m_orbit_p.data());
+            glUniform4fv(m_orbit_q_axis, count, m_orbit_q.data());
+            glUniform4fv(m_orbit_color, count, m_orbit_colors.data());
+            glDrawArrays(GL_LINES, 0, count * 2 * ORBIT_VERTICES);
+            count = 0;
+        }
     }
+
+    if(count){
+        glUniform4fv(m_orbit_p_axis, count, m_orbit_p.data());
+        glUniform4fv(m_orbit_q_axis, count, m_orbit_q.data());
+        glUniform4fv(m_orbit_color, count, m_orbit_colors.data());
+        glDrawArrays(GL_LINES, 0, count * 2 * ORBIT_VERTICES);
+    }
+
+    check_gl_errors(true, "PlanetarySystem::renderOrbits");
+#endif
 }
 
 
-void PlanetarySystem::updateKinematics(){
+void PlanetarySystem::updateKinematics(const btVector3& world_origin){
     planet_map::iterator it;
 
     for(it=m_planets->begin();it!=m_planets->end();it++){
-        it->second->updateKinematics();
+        it->second->updateKinematics(world_origin);
     }
 }
 
@@ -4,6 +4,8 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
+#include <cstdint>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -18,6 +20,12 @@ class AssetManagerInterface;
 typedef std::unordered_map<std::uint32_t, std::unique_ptr<Planet>> planet_map;
 
 
+/* vertices of each orbit line */
+#define ORBIT_VERTICES 300
+/* orbits drawn per draw call, has to match MAX_ORBITS in orbit_vs.glsl */
+#define ORBIT_MAX_LINES 32
+
+
 // simple star
 struct star{
     std::string star_name;
@@ -26,6 +34,29 @@ struct star{
 };
 
 
+/*
+ * Snapshot of the orbital data of the planets at a given time, computed by computeEphemeris and
+ * made visible to everybody by publishEphemeris. The version is used to make sure that snapshots
+ * are published in order, a snapshot can only be published on top of version - 1.
+ *
+ * @version: version of the snapshot, set by computeEphemeris.
+ * @cent_since_j2000: time of the snapshot, in centuries.
+ * @planets: planets in the snapshot, data.at(i) belongs to planets.at(i).
+ * @data: orbital data of each planet.
+ */
+struct ephemeris_snapshot{
+    std::uint64_t version;
+    double cent_since_j2000;
+    std::vector<Planet*> planets;
+    std::vector<orbital_data> data;
+
+    ephemeris_snapshot(){
+        version = 0;
+        cent_since_j2000 = 0.0;
+    }
+};
+
+
 class PlanetarySystem{
     private:
         std::unique_ptr<planet_map> m_planets;
@@ -34,6 +65,16 @@ class PlanetarySystem{
 
         RenderContext* m_render_context;
         AssetManagerInterface* m_asset_manager;
+
+        std::uint64_t m_ephemeris_version;
+
+        // orbit render, the vao is empty (the orbit shader doesn't read vertex attributes)
+        GLuint m_orbit_vao;
+        GLint m_orbit_view_mat, m_orbit_proj_mat, m_orbit_vertices;
+        GLint m_orbit_p_axis, m_orbit_q_axis, m_orbit_color;
+        std::vector<GLfloat> m_orbit_p, m_orbit_q, m_orbit_colors;
+
+        void initOrbitRender();
     public:
         /*
          * Constructor
@@ -68,28 +109,63 @@ class PlanetarySystem{
         void setStar(star& system_star);
 
         /*
-         * Calls the orbit render buffer update methods of each individual planet.
+         * Calls the orbital elements update methods of each individual planet. Bumps the ephemeris
+         * version, so snapshots computed before calling this method can't be published.
          *
          * @current_time: current time in centuries.
          */
-        void updateRenderBuffers(const double current_time);
+        void updateOrbitalElements(const double cent_since_j2000);
+        
+        /*
+         * Computes the orbital elements of all the planets at the given time and stores them in
+         * the snapshot, the planets are not modified. Meant to be called by a worker thread while
+         * the physics thread steps, but nobody can call updateOrbitalElements or publishEphemeris
+         * in the meantime.
+         *
+         * @cent_since_j2000: time of the snapshot, in centuries.
+         * @snapshot: output snapshot, its buffers are reused.
+         */
+        void computeEphemeris(const double cent_since_j2000, ephemeris_snapshot& snapshot) const;
 
         /*
-         * Calls the orbital elements update methods of each individual planet.
+         * Copies the orbital data of the snapshot to the planets. Returns EXIT_FAILURE if the
+         * snapshot is not the next version (in which case nothing is published), EXIT_SUCCESS
+         * otherwise. Should only be called when nobody is reading the planets (in the physics
+         * thread, between stepping the world and updating the kinematics).
          *
-         * @current_time: current time in centuries.
+         * @snapshot: snapshot computed with computeEphemeris.
          */
-        void updateOrbitalElements(const double cent_since_j2000);
-        
+        int publishEphemeris(const ephemeris_snapshot& snapshot);
+
+        /*
+         * Returns the version of the last published ephemeris snapshot.
+         */
+        std::uint64_t getEphemerisVersion() const;
+
         /*
          * Calls the update method of each planet that updates their registered kinematics.
+         *
+         * @world_origin: absolute position of the origin of the dynamics world, see
+         * Physics::getWorldOrigin.
          */
-        void updateKinematics();
+        void updateKinematics(const btVector3& world_origin);
 
         /*
-         * Calls the orbit render method of each one of the planets of the system.
+         * Renders the orbits of the planets, used in the planetarium views. The points of the
+         * orbits are generated by the orbit shader (SHADER_ORBIT) from the ellipse of each planet
+         * (Ephemeris::computeOrbit), so the only per frame work on the CPU is setting a few
+         * uniforms, and all the orbits are drawn with a single draw call (one per ORBIT_MAX_LINES
+         * planets). Binds the orbit shader. Has to be called from the render thread.
+         *
+         * @cent_since_j2000: time of the orbits, in centuries.
+         * @view: view matrix.
+         * @proj: projection matrix.
+         * @selected: ID of the planet whose orbit is highlighted, the rest are drawn with half of
+         * their base color.
+         * @alpha: alpha of the orbit lines.
          */
-        void renderOrbits() const;
+        void renderOrbits(const double cent_since_j2000, const math::mat4& view,
+                          const math::mat4& proj, std::uint32_t selected, float alpha);
 
         /*
          * Returns a constant reference to the planets map of the system.
@@ -1,5 +1,9 @@
+#include <limits>
+
 #define BT_USE_DOUBLE_PRECISION
 #include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBody.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
 
 #include "Vessel.hpp"
 #include "BasePart.hpp"
@@ -8,6 +12,8 @@
 #include "../core/id_manager.hpp"
 #include "../core/log.hpp"
 #include "../core/Input.hpp"
+#include "Planet.hpp"
+#include "subcomponents/EngineComponent.hpp"
 
 
 Vessel::Vessel() : m_com(btVector3(0.0, 0.0, 0.0)){
@@ -18,19 +24,31 @@ Vessel::Vessel() : m_com(btVector3(0.0, 0.0, 0.0)){
     m_yaw = 0.0f;
     m_pitch = 0.0f;
     m_total_mass = 0.0;
+    m_on_rails = false;
+    m_packed = false;
+    m_rails_body = 0;
+    m_physics = nullptr;
+    m_body_outdated = false;
+    m_mass_outdated = false;
 }
 
 
 Vessel::Vessel(std::shared_ptr<BasePart>&& vessel_root, const Input* input) : m_vessel_root(std::move(vessel_root)), 
                m_com(btVector3(0.0, 0.0, 0.0)){
     m_vessel_root->setRoot(true);
+    create_id(m_vessel_id, VESSEL_SET); // used by updateSubTreeVessel
     m_vessel_root->updateSubTreeVessel(this);
-    create_id(m_vessel_id, VESSEL_SET);
     m_player = nullptr;
     m_input = input;
     m_yaw = 0.0f;
     m_pitch = 0.0f;
     m_vessel_name = "unnamed vessel";
+    m_on_rails = false;
+    m_packed = false;
+    m_rails_body = 0;
+    m_physics = nullptr;
+    m_body_outdated = false;
+    m_mass_outdated = false;
 
     updateNodes();
     updateMass();
@@ -39,6 +57,11 @@ Vessel::Vessel(std::shared_ptr<BasePart>&& vessel_root, const Input* input) : m_
 
 
 Vessel::~Vessel(){
+    if(m_rigid_body)
+        m_physics->removeBody(m_rigid_body.get());
+    if(m_multibody)
+        m_physics->removeMultiBody(m_multibody.get());
+
     if(m_player){
         m_player->onVesselDestroy();
     }
@@ -66,6 +89,7 @@ void Vessel::onTreeUpdate(){
     updateNodes();
     updateMass();
     updateStaging();
+    m_body_outdated = true;
 }
 
 
@@ -358,8 +382,8 @@ void Vessel::update(){
         }
     }
 
-    // engage current active stage
-    if(m_input->pressed_keys[GLFW_KEY_SPACE] & INPUT_KEY_DOWN){
+    // engage current active stage, not while on rails because the parts are out of the world
+    if(m_input->pressed_keys[GLFW_KEY_SPACE] & INPUT_KEY_DOWN && !m_on_rails){
         if(m_stages.size() > 0){
             activateNextStage();
         }
@@ -393,6 +417,8 @@ void Vessel::updateMass(){
     for(uint i=0; i < m_node_list.size(); i++){
          temp_mass += m_node_list.at(i)->getMass();
     }
+    if(temp_mass != m_total_mass)
+        m_mass_outdated = true;
     m_total_mass = temp_mass;
 }
 
@@ -404,6 +430,11 @@ double Vessel::getTotalMass() const{
 
 void Vessel::setVesselVelocity(const btVector3& velocity){
     m_vessel_root->setSubTreeVelocity(velocity);
+
+    if(m_rigid_body)
+        m_rigid_body->setLinearVelocity(velocity);
+    if(m_multibody)
+        m_multibody->setBaseVel(velocity);
 }
 
 
@@ -555,6 +586,7 @@ void Vessel::setSubTreeMotionState(const btVector3& origin, const btQuaternion&
     disp = origin - from;
 
     m_vessel_root->updateSubTreeMotionState(disp, from, rotation);
+    m_body_outdated = true; // the parts are moved by a command buffer
 }
 
 
@@ -581,3 +613,499 @@ void Vessel::removeEmptyStage(uint stage_num){
     if(m_stages.at(stage_num).size() == 0)
         m_stages.erase(m_stages.begin() + stage_num);
 }
+
+
+bool Vessel::hasActiveEngines() const{
+    for(uint i=0; i < m_node_list.size(); i++){
+        const std::vector<EngineComponent*>& engines = m_node_list.at(i)->getEngineList();
+
+        for(uint j=0; j < engines.size(); j++){
+            if(engines.at(j)->getStatus() == ENGINE_STATUS_ON)
+                return true;
+        }
+    }
+    return false;
+}
+
+
+void Vessel::packRails(const orbital_data& orbit, std::uint32_t body_target){
+    if(m_on_rails)
+        return;
+
+    if(m_rigid_body)
+        unpackRigid();
+    if(m_multibody)
+        unpackArticulated();
+
+    m_rails_offsets.clear();
+    for(uint i=0; i < m_node_list.size(); i++){
+        const btRigidBody* body = m_node_list.at(i)->m_body.get();
+
+        if(body)
+            m_rails_offsets.emplace_back(body->getWorldTransform().getOrigin() - m_com);
+        else
+            m_rails_offsets.emplace_back(0.0, 0.0, 0.0);
+    }
+
+    setRailsOrbit(orbit, body_target);
+    m_vessel_root->removeSubTreeFromWorld();
+    m_on_rails = true;
+}
+
+
+void Vessel::unpackRails(){
+    if(!m_on_rails)
+        return;
+
+    m_vessel_root->addSubTreeToWorld();
+    m_on_rails = false;
+}
+
+
+void Vessel::setRailsState(const btVector3& com, const btVector3& velocity){
+    for(uint i=0; i < m_node_list.size() && i < m_rails_offsets.size(); i++){
+        btRigidBody* body = m_node_list.at(i)->m_body.get();
+
+        if(!body)
+            continue;
+
+        btTransform transform = body->getWorldTransform();
+        transform.setOrigin(com + m_rails_offsets.at(i));
+
+        body->setWorldTransform(transform);
+        body->setInterpolationWorldTransform(transform);
+        body->getMotionState()->setWorldTransform(transform);
+        body->setLinearVelocity(velocity);
+    }
+
+    // the offsets are relative to the CoM, no need to compute it again (see updateCoMs)
+    m_com = com;
+}
+
+
+void Vessel::setRailsOrbit(const orbital_data& orbit, std::uint32_t body_target){
+    if(!m_rails_orbit)
+        m_rails_orbit.reset(new orbital_data);
+
+    *m_rails_orbit = orbit;
+    m_rails_body = body_target;
+}
+
+
+bool Vessel::isOnRails() const{
+    return m_on_rails;
+}
+
+
+void Vessel::setPacked(bool packed){
+    m_packed = packed;
+}
+
+
+bool Vessel::isPacked() const{
+    return m_packed;
+}
+
+
+const orbital_data& Vessel::getRailsOrbit() const{
+    return *m_rails_orbit;
+}
+
+
+std::uint32_t Vessel::getRailsBody() const{
+    return m_rails_body;
+}
+
+
+double Vessel::computeRigidMass(btTransform& principal, btVector3& inertia){
+    std::vector<btScalar> masses;
+    double total_mass = 0.0;
+    btTransform inverse;
+
+    for(uint i=0; i < m_rigid_parts.size(); i++){
+        const btRigidBody* body = m_rigid_parts.at(i)->m_body.get();
+
+        masses.push_back(body->getInvMass() != 0.0 ? 1.0 / body->getInvMass() : 0.0);
+        total_mass += masses.back();
+    }
+
+    if(total_mass <= 0.0)
+        return 0.0;
+
+    m_rigid_shape->calculatePrincipalAxisTransform(masses.data(), principal, inertia);
+
+    inverse = principal.inverse();
+    for(uint i=0; i < m_rigid_transforms.size(); i++){
+        m_rigid_transforms.at(i) = inverse * m_rigid_transforms.at(i);
+        m_rigid_shape->updateChildTransform(i, m_rigid_transforms.at(i), false);
+    }
+    m_rigid_shape->recalculateLocalAabb();
+
+    return total_mass;
+}
+
+
+void Vessel::packRigid(Physics* physics){
+    btVector3 momentum(0.0, 0.0, 0.0), inertia;
+    btTransform principal;
+    double mass;
+
+    if(m_rigid_body || m_on_rails)
+        return;
+
+    m_rigid_shape.reset(new btCompoundShape());
+    m_rigid_parts.clear();
+    m_rigid_transforms.clear();
+
+    // the children start in world coordinates, computeRigidMass moves them to the principal frame
+    for(uint i=0; i < m_node_list.size(); i++){
+        btRigidBody* body = m_node_list.at(i)->m_body.get();
+
+        if(!body)
+            continue;
+
+        m_rigid_parts.push_back(m_node_list.at(i));
+        m_rigid_transforms.push_back(body->getWorldTransform());
+        m_rigid_shape->addChildShape(body->getWorldTransform(), body->getCollisionShape());
+
+        if(body->getInvMass() != 0.0)
+            momentum += body->getLinearVelocity() / body->getInvMass();
+    }
+
+    mass = computeRigidMass(principal, inertia);
+    if(mass <= 0.0){
+        m_rigid_shape.reset(nullptr);
+        m_rigid_parts.clear();
+        m_rigid_transforms.clear();
+        return;
+    }
+
+    m_physics = physics;
+    m_vessel_root->removeSubTreeFromWorld(); // saves the collision group of the root
+
+    m_rigid_motion_state.reset(new btDefaultMotionState(principal));
+    btRigidBody::btRigidBodyConstructionInfo rb_info(mass, m_rigid_motion_state.get(),
+                                                     m_rigid_shape.get(), inertia);
+    m_rigid_body.reset(new btRigidBody(rb_info));
+    m_rigid_body->setLinearVelocity(momentum / mass);
+    m_rigid_body->setAngularVelocity(m_vessel_root->m_body->getAngularVelocity());
+    m_rigid_body->setActivationState(DISABLE_DEACTIVATION);
+
+    // rays and contacts see the root, the tag and the cluster are the ones of the parts
+    m_rigid_body->setUserPointer((void*)static_cast<Object*>(m_vessel_root.get()));
+    m_rigid_body->setUserIndex(m_vessel_root->getCollisionTag());
+    m_rigid_body->setUserIndex2(m_vessel_root->m_body->getUserIndex2());
+    m_physics->addRigidBody(m_rigid_body.get(), m_vessel_root->getCollisionGroup(),
+                            m_vessel_root->getCollisionFilters());
+
+    m_body_outdated = false;
+    m_mass_outdated = false;
+    updateRigidParts();
+}
+
+
+void Vessel::unpackRigid(){
+    if(!m_rigid_body)
+        return;
+
+    m_physics->removeBody(m_rigid_body.get());
+    m_rigid_body.reset(nullptr);
+    m_rigid_motion_state.reset(nullptr);
+    m_rigid_shape.reset(nullptr);
+    m_rigid_parts.clear();
+    m_rigid_transforms.clear();
+
+    // the parts that were decoupled belong to other vessels now
+    m_vessel_root->addSubTreeToWorld();
+}
+
+
+void Vessel::updateRigidMass(){
+    btVector3 inertia, velocity;
+    btTransform principal, transform;
+    double mass;
+
+    if(!m_rigid_body)
+        return;
+
+    mass = computeRigidMass(principal, inertia);
+    if(mass <= 0.0)
+        return;
+
+    // the CoM moves, the velocity of the new CoM includes the rotation
+    const btTransform& old_transform = m_rigid_body->getWorldTransform();
+    transform = old_transform * principal;
+    velocity = m_rigid_body->getLinearVelocity() +
+               m_rigid_body->getAngularVelocity().cross(transform.getOrigin() -
+                                                        old_transform.getOrigin());
+
+    m_rigid_body->setMassProps(mass, inertia);
+    m_rigid_body->setCenterOfMassTransform(transform);
+    m_rigid_motion_state->setWorldTransform(transform);
+    m_rigid_body->updateInertiaTensor();
+    m_rigid_body->setLinearVelocity(velocity);
+
+    m_mass_outdated = false;
+}
+
+
+void Vessel::applyRigidForces(){
+    const btVector3& com = m_rigid_body->getWorldTransform().getOrigin();
+
+    for(uint i=0; i < m_rigid_parts.size(); i++){
+        btRigidBody* body = m_rigid_parts.at(i)->m_body.get();
+
+        if(body->getTotalForce().isZero() && body->getTotalTorque().isZero())
+            continue;
+
+        m_rigid_body->applyForce(body->getTotalForce(), body->getWorldTransform().getOrigin() - com);
+        m_rigid_body->applyTorque(body->getTotalTorque());
+        body->clearForces(); // the world doesn't clear them, the part is not in it
+    }
+}
+
+
+void Vessel::updateRigidParts(){
+    const btTransform& rigid_transform = m_rigid_body->getWorldTransform();
+    const btVector3& velocity = m_rigid_body->getLinearVelocity();
+    const btVector3& angular_velocity = m_rigid_body->getAngularVelocity();
+
+    for(uint i=0; i < m_rigid_parts.size(); i++){
+        btRigidBody* body = m_rigid_parts.at(i)->m_body.get();
+        btTransform transform = rigid_transform * m_rigid_transforms.at(i);
+
+        body->setWorldTransform(transform);
+        body->setInterpolationWorldTransform(transform);
+        body->getMotionState()->setWorldTransform(transform);
+        body->setLinearVelocity(velocity + angular_velocity.cross(transform.getOrigin() -
+                                                                 rigid_transform.getOrigin()));
+        body->setAngularVelocity(angular_velocity);
+    }
+}
+
+
+bool Vessel::isRigid() const{
+    return m_rigid_body != nullptr;
+}
+
+
+bool Vessel::isBodyOutdated() const{
+    return m_body_outdated;
+}
+
+
+bool Vessel::isMassOutdated() const{
+    return m_mass_outdated;
+}
+
+
+btRigidBody* Vessel::getRigidBody(){
+    return m_rigid_body.get();
+}
+
+
+BasePart* Vessel::getRigidPart(const btVector3& point){
+    BasePart* closest = m_vessel_root.get();
+    double min_dist2 = std::numeric_limits<double>::infinity();
+
+    for(uint i=0; i < m_rigid_parts.size(); i++){
+        const btRigidBody* body = m_rigid_parts.at(i)->m_body.get();
+        btVector3 aabb_min, aabb_max;
+        double dist2;
+
+        body->getAabb(aabb_min, aabb_max);
+        if(point.getX() < aabb_min.getX() || point.getX() > aabb_max.getX() ||
+           point.getY() < aabb_min.getY() || point.getY() > aabb_max.getY() ||
+           point.getZ() < aabb_min.getZ() || point.getZ() > aabb_max.getZ())
+            continue;
+
+        // the AABBs overlap, keep the part whose center is closer
+        dist2 = body->getWorldTransform().getOrigin().distance2(point);
+        if(dist2 < min_dist2){
+            min_dist2 = dist2;
+            closest = m_rigid_parts.at(i);
+        }
+    }
+    return closest;
+}
+
+
+void Vessel::packArticulated(Physics* physics){
+    std::unordered_map<const BasePart*, int> part_link;
+    double base_mass;
+
+    if(m_multibody || m_on_rails || !m_vessel_root->m_body || !physics->isMultiBodyWorld())
+        return;
+
+    // the parents are before their children in m_node_list, the root is the base
+    m_articulated_parts.clear();
+    for(uint i=0; i < m_node_list.size(); i++){
+        const btRigidBody* body = m_node_list.at(i)->m_body.get();
+
+        // the multibody can't have parts with infinite mass
+        if(!body || body->getInvMass() == 0.0){
+            if(body){
+                m_articulated_parts.clear();
+                return;
+            }
+            continue;
+        }
+
+        part_link[m_node_list.at(i)] = (int)m_articulated_parts.size() - 1;
+        m_articulated_parts.push_back(m_node_list.at(i));
+    }
+
+    const btRigidBody* root_body = m_vessel_root->m_body.get();
+    base_mass = 1.0 / root_body->getInvMass();
+    m_multibody.reset(new btMultiBody(m_articulated_parts.size() - 1, base_mass,
+                                      root_body->getLocalInertia(), false, false));
+
+    for(uint i=1; i < m_articulated_parts.size(); i++){
+        const BasePart* part = m_articulated_parts.at(i);
+        const BasePart* parent = part->getParent();
+        std::unordered_map<const BasePart*, int>::const_iterator it = part_link.find(parent);
+        int parent_link = it != part_link.end() ? it->second : -1;
+
+        // the parts without body are skipped, their children are attached to the base
+        if(parent_link == -1)
+            parent = m_vessel_root.get();
+
+        const btRigidBody* body = part->m_body.get();
+        btTransform relative = parent->m_body->getWorldTransform().inverse() *
+                               body->getWorldTransform();
+
+        m_multibody->setupFixed(i - 1, 1.0 / body->getInvMass(), body->getLocalInertia(),
+                                parent_link, relative.getRotation().inverse(),
+                                relative.getOrigin(), btVector3(0.0, 0.0, 0.0));
+    }
+
+    m_multibody->setLinearDamping(0.0);
+    m_multibody->setAngularDamping(0.0);
+    m_multibody->setHasSelfCollision(false);
+    m_multibody->setCanSleep(false);
+    m_multibody->finalizeMultiDof();
+    m_multibody->setBaseWorldTransform(root_body->getWorldTransform());
+    m_multibody->setBaseVel(root_body->getLinearVelocity());
+    m_multibody->setBaseOmega(root_body->getAngularVelocity());
+
+    // rays and contacts see the parts, the tag and the cluster are the ones of the parts
+    m_link_colliders.clear();
+    for(uint i=0; i < m_articulated_parts.size(); i++){
+        BasePart* part = m_articulated_parts.at(i);
+        btMultiBodyLinkCollider* collider = new btMultiBodyLinkCollider(m_multibody.get(),
+                                                                        (int)i - 1);
+
+        collider->setCollisionShape(part->m_body->getCollisionShape());
+        collider->setWorldTransform(part->m_body->getWorldTransform());
+        collider->setUserPointer((void*)static_cast<Object*>(part));
+        collider->setUserIndex(part->getCollisionTag());
+        collider->setUserIndex2(root_body->getUserIndex2());
+        m_link_colliders.emplace_back(collider);
+
+        if(i == 0)
+            m_multibody->setBaseCollider(collider);
+        else
+            m_multibody->getLink(i - 1).m_collider = collider;
+    }
+
+    m_physics = physics;
+    m_vessel_root->removeSubTreeFromWorld(); // saves the collision group of the root
+    m_physics->addMultiBody(m_multibody.get(), m_vessel_root->getCollisionGroup(),
+                            m_vessel_root->getCollisionFilters());
+
+    m_body_outdated = false;
+    m_mass_outdated = false;
+    updateArticulatedParts();
+}
+
+
+void Vessel::unpackArticulated(){
+    if(!m_multibody)
+        return;
+
+    m_physics->removeMultiBody(m_multibody.get());
+    m_multibody.reset(nullptr);
+    m_link_colliders.clear();
+    m_articulated_parts.clear();
+
+    // the parts that were decoupled belong to other vessels now
+    m_vessel_root->addSubTreeToWorld();
+}
+
+
+void Vessel::updateArticulatedMass(){
+    if(!m_multibody)
+        return;
+
+    // the frames of the links are the CoMs of the parts, only the mass properties change
+    for(uint i=0; i < m_articulated_parts.size(); i++){
+        const btRigidBody* body = m_articulated_parts.at(i)->m_body.get();
+
+        if(body->getInvMass() == 0.0)
+            continue;
+
+        if(i == 0){
+            m_multibody->setBaseMass(1.0 / body->getInvMass());
+            m_multibody->setBaseInertia(body->getLocalInertia());
+        }
+        else{
+            m_multibody->setLinkMass(i - 1, 1.0 / body->getInvMass());
+            m_multibody->setLinkInertia(i - 1, body->getLocalInertia());
+        }
+    }
+
+    m_mass_outdated = false;
+}
+
+
+void Vessel::applyArticulatedForces(){
+    m_multibody->clearForcesAndTorques();
+
+    for(uint i=0; i < m_articulated_parts.size(); i++){
+        btRigidBody* body = m_articulated_parts.at(i)->m_body.get();
+
+        if(body->getTotalForce().isZero() && body->getTotalTorque().isZero())
+            continue;
+
+        // the forces of the parts are already at their CoM, the origin of the link
+        if(i == 0){
+            m_multibody->addBaseForce(body->getTotalForce());
+            m_multibody->addBaseTorque(body->getTotalTorque());
+        }
+        else{
+            m_multibody->addLinkForce(i - 1, body->getTotalForce());
+            m_multibody->addLinkTorque(i - 1, body->getTotalTorque());
+        }
+        body->clearForces(); // the world doesn't clear them, the part is not in it
+    }
+}
+
+
+void Vessel::updateArticulatedParts(){
+    const btVector3& base_origin = m_link_colliders.at(0)->getWorldTransform().getOrigin();
+    btVector3 velocity = m_multibody->getBaseVel();
+    btVector3 angular_velocity = m_multibody->getBaseOmega();
+
+    // the joints are fixed, the whole multibody moves like a rigid body
+    for(uint i=0; i < m_articulated_parts.size(); i++){
+        btRigidBody* body = m_articulated_parts.at(i)->m_body.get();
+        const btTransform& transform = m_link_colliders.at(i)->getWorldTransform();
+
+        body->setWorldTransform(transform);
+        body->setInterpolationWorldTransform(transform);
+        body->getMotionState()->setWorldTransform(transform);
+        body->setLinearVelocity(velocity + angular_velocity.cross(transform.getOrigin() -
+                                                                 base_origin));
+        body->setAngularVelocity(angular_velocity);
+    }
+}
+
+
+bool Vessel::isArticulated() const{
+    return m_multibody != nullptr;
+}
+
+
+btMultiBody* Vessel::getMultiBody(){
+    return m_multibody.get();
+}
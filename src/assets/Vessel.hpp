@@ -11,7 +11,16 @@
 class Player;
 class BasePart;
 class Input;
+class Physics;
 class btVector3;
+class btTransform;
+class btRigidBody;
+class btCompoundShape;
+class btMotionState;
+class btMultiBody;
+class btMultiBodyLinkCollider;
+
+struct orbital_data;
 
 
 /*
@@ -53,6 +62,42 @@ class Vessel{
         Player* m_player; // player controlling the vessel
         const Input* m_input;
 
+        /* on-rails state, see packRails */
+        bool m_on_rails, m_packed;
+        std::uint32_t m_rails_body;
+        std::unique_ptr<orbital_data> m_rails_orbit;
+        std::vector<btVector3> m_rails_offsets; // origin of each part relative to the CoM
+
+        /* rigid representation, see packRigid. m_rigid_transforms[i] is the transform of
+           m_rigid_parts[i] relative to the body */
+        Physics* m_physics;
+        std::unique_ptr<btCompoundShape> m_rigid_shape;
+        std::unique_ptr<btMotionState> m_rigid_motion_state;
+        std::unique_ptr<btRigidBody> m_rigid_body;
+        std::vector<BasePart*> m_rigid_parts;
+        std::vector<btTransform> m_rigid_transforms;
+
+        /* articulated representation, see packArticulated. m_articulated_parts[0] is the base
+           (the root) and m_articulated_parts[i + 1] is the link i */
+        std::unique_ptr<btMultiBody> m_multibody;
+        std::vector<std::unique_ptr<btMultiBodyLinkCollider>> m_link_colliders;
+        std::vector<BasePart*> m_articulated_parts;
+
+        /* the rigid body or the multibody have to be built again or their mass updated */
+        bool m_body_outdated, m_mass_outdated;
+
+        /*
+         * Computes the mass, the inertia and the principal axes of the compound shape from the
+         * masses of the bodies of m_rigid_parts. The child transforms are moved to the new
+         * principal frame, so the body has to be moved to the returned transform.
+         *
+         * @principal: returns the principal transform relative to the current frame of the
+         * children.
+         * @inertia: returns the principal moments of inertia.
+         * Returns the total mass.
+         */
+        double computeRigidMass(btTransform& principal, btVector3& inertia);
+
         /*
          * Updates m_node_list and m_node_map_by_id by traveling through the vessel tree.
          */
@@ -298,6 +343,193 @@ class Vessel{
          */
         void removeEmptyStage(uint stage_num);
 
+        /*
+         * Returns true if any engine of the vessel is on.
+         */
+        bool hasActiveEngines() const;
+
+        /*
+         * Puts the vessel on rails. The parts are taken out of the dynamics world (nothing is
+         * destroyed) and from now on the vessel is moved as a rigid whole along a fixed conic,
+         * see setRailsState. The orientation of the parts is frozen while on rails. Should be
+         * called by the physics thread, the CoM must be up to date.
+         *
+         * @orbit: orbital elements of the CoM, see Predictor::computeOrbitalElements.
+         * @body_target: id of the body the orbit is relative to, 0 for the star.
+         */
+        void packRails(const orbital_data& orbit, std::uint32_t body_target);
+
+        /*
+         * Takes the vessel off rails, the parts are added back to the dynamics world with the
+         * state given by the last call to setRailsState. Should be called by the physics thread.
+         */
+        void unpackRails();
+
+        /*
+         * Moves the parts of a vessel on rails so the CoM is at the given origin, and sets their
+         * velocity. The CoM of the vessel is set too. Should be called by the physics thread.
+         *
+         * @com: new center of mass of the vessel.
+         * @velocity: new velocity of the vessel.
+         */
+        void setRailsState(const btVector3& com, const btVector3& velocity);
+
+        /*
+         * Replaces the orbit of a vessel on rails, used when it changes its dominant body.
+         *
+         * @orbit: new orbital elements of the CoM.
+         * @body_target: id of the new dominant body.
+         */
+        void setRailsOrbit(const orbital_data& orbit, std::uint32_t body_target);
+
+        /*
+         * Returns true if the vessel is on rails.
+         */
+        bool isOnRails() const;
+
+        /*
+         * Marks the vessel as packed, a vessel on rails because it's far from the player (see
+         * Physics::updateResidency) rather than because of the time warp. Packed vessels stay on
+         * rails when the warp ends, and their update and rendering are skipped. Should be called
+         * by the physics thread.
+         *
+         * @packed: true if the vessel is packed.
+         */
+        void setPacked(bool packed);
+
+        /*
+         * Returns true if the vessel is packed.
+         */
+        bool isPacked() const;
+
+        /*
+         * Returns the orbital elements of a vessel on rails. Only valid if isOnRails is true.
+         */
+        const orbital_data& getRailsOrbit() const;
+
+        /*
+         * Returns the id of the body the vessel on rails orbits, 0 for the star.
+         */
+        std::uint32_t getRailsBody() const;
+
+        /*
+         * Fuses the parts of the vessel into a single rigid body with a btCompoundShape, with the
+         * combined mass and inertia. The bodies of the parts are taken out of the dynamics world
+         * (nothing is destroyed), they are moved with the rigid body by updateRigidParts. The
+         * constraints between parts are not solved, and the forces applied to the parts are moved
+         * to the rigid body by applyRigidForces. Should be called by the physics thread.
+         *
+         * @physics: raw pointer to the physics object, the rigid body is added to the world of
+         * the cluster of the root.
+         */
+        void packRigid(Physics* physics);
+
+        /*
+         * Destroys the rigid body, the parts are added back to the dynamics world with the state
+         * given by the last call to updateRigidParts. Should be called by the physics thread.
+         */
+        void unpackRigid();
+
+        /*
+         * Updates the mass, inertia and CoM of the rigid body after the mass of some part has
+         * changed, without taking the body out of the world. Should be called by the physics
+         * thread.
+         */
+        void updateRigidMass();
+
+        /*
+         * Moves the forces and torques accumulated by the bodies of the parts (engines, gravity,
+         * separators) to the rigid body, applied at the offset of each part. Should be called by
+         * the physics thread before stepping.
+         */
+        void applyRigidForces();
+
+        /*
+         * Places the bodies of the parts (transform, motion state and velocity) following the
+         * rigid body, so everything that reads the parts (rendering, CoM, rails...) works as
+         * usual. Should be called by the physics thread after stepping.
+         */
+        void updateRigidParts();
+
+        /*
+         * Returns true if the vessel is represented by a single rigid body, see packRigid.
+         */
+        bool isRigid() const;
+
+        /*
+         * Returns true if the rigid body or the multibody have to be built again because the
+         * tree, the velocity or the position of the parts have changed (see onTreeUpdate).
+         */
+        bool isBodyOutdated() const;
+
+        /*
+         * Returns true if the mass of the rigid body or the multibody has to be updated, see
+         * updateRigidMass and updateArticulatedMass.
+         */
+        bool isMassOutdated() const;
+
+        /*
+         * Returns the rigid body of the vessel, nullptr if it's not rigid.
+         */
+        btRigidBody* getRigidBody();
+
+        /*
+         * Returns the part of a rigid vessel at the given point (e.g. the hit point of a ray), or
+         * the root if the point is not inside any part.
+         *
+         * @point: point in world coordinates.
+         */
+        BasePart* getRigidPart(const btVector3& point);
+
+        /*
+         * Builds a btMultiBody from the vessel tree, the root is the base and every other part is
+         * a link attached to its parent by a fixed joint, with the current relative transform.
+         * The joints are solved by the Featherstone algorithm, so the error doesn't build up like
+         * with the constraints between parts. Every part has a collider, the bodies of the parts
+         * are taken out of the dynamics world and moved with the links by
+         * updateArticulatedParts. Needs the multibody world (Physics::isMultiBodyWorld), should be
+         * called by the physics thread.
+         *
+         * @physics: raw pointer to the physics object, the multibody is added to the world of
+         * the cluster of the root.
+         */
+        void packArticulated(Physics* physics);
+
+        /*
+         * Destroys the multibody, the parts are added back to the dynamics world with the state
+         * given by the last call to updateArticulatedParts. Should be called by the physics
+         * thread.
+         */
+        void unpackArticulated();
+
+        /*
+         * Updates the masses and inertias of the base and the links after the mass of some part
+         * has changed. Should be called by the physics thread.
+         */
+        void updateArticulatedMass();
+
+        /*
+         * Moves the forces and torques accumulated by the bodies of the parts to the base and
+         * the links of the multibody. Should be called by the physics thread before stepping.
+         */
+        void applyArticulatedForces();
+
+        /*
+         * Places the bodies of the parts following the colliders of the multibody. Should be
+         * called by the physics thread after stepping.
+         */
+        void updateArticulatedParts();
+
+        /*
+         * Returns true if the vessel is represented by a btMultiBody, see packArticulated.
+         */
+        bool isArticulated() const;
+
+        /*
+         * Returns the multibody of the vessel, nullptr if it's not articulated.
+         */
+        btMultiBody* getMultiBody();
+
 
 };
 
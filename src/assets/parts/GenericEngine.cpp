@@ -8,6 +8,7 @@
 #include "../../core/maths_funcs.hpp"
 #include "../../core/log.hpp"
 #include "../../core/AssetManagerInterface.hpp"
+#include "../../core/Physics.hpp"
 
 GenericEngine::GenericEngine(Model* model, Physics* physics, btCollisionShape* col_shape,
                              btScalar mass, int baseID, AssetManagerInterface* asset_manager) : 
@@ -98,7 +99,7 @@ void GenericEngine::renderOther(){
 
 void GenericEngine::update(){
     if(m_main_engine->getStatus() == ENGINE_STATUS_ON && m_parent){
-        const btVector3 force = m_main_engine->update();
+        const btVector3 force = m_main_engine->update(m_physics->getFrameDeltaT());
         m_asset_manager->applyForce(this, force, btVector3(0.0, 0.0, 0.0));
     }
 }
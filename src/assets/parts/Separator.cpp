@@ -96,23 +96,23 @@ void Separator::update(){
 
         if(m_behaviour == BEHAVIOUR_SEPARATES_SELF){
             if(m_parent){
-                m_asset_manager->applyForce(m_parent, force, btVector3(0.0, 0.0, 0.0));
-                m_asset_manager->applyForce(this, -1 * force, btVector3(0.0, 0.0, 0.0));
+                m_asset_manager->applyForceOnce(m_parent, force, btVector3(0.0, 0.0, 0.0));
+                m_asset_manager->applyForceOnce(this, -1 * force, btVector3(0.0, 0.0, 0.0));
             }
 
             decoupleSelf();
         }
         if(m_behaviour == BEHAVIOUR_SEPARATES_CHILDS || m_behaviour == BEHAVIOUR_SEPARATES_ALL){
             for(uint i=0; i < m_childs.size(); i++){
-                m_asset_manager->applyForce(m_childs.at(i).get(), -1.0 * force, btVector3(0.0, 0.0, 0.0));
+                m_asset_manager->applyForceOnce(m_childs.at(i).get(), -1.0 * force, btVector3(0.0, 0.0, 0.0));
             }
 
             if(m_behaviour == BEHAVIOUR_SEPARATES_CHILDS){
-                m_asset_manager->applyForce(this, force, btVector3(0.0, 0.0, 0.0));
+                m_asset_manager->applyForceOnce(this, force, btVector3(0.0, 0.0, 0.0));
             }
             else{
                 if(m_parent){
-                    m_asset_manager->applyForce(m_parent, force, btVector3(0.0, 0.0, 0.0));
+                    m_asset_manager->applyForceOnce(m_parent, force, btVector3(0.0, 0.0, 0.0));
                 }
                 decoupleSelf();
             }
@@ -9,6 +9,7 @@
 #include "../Model.hpp"
 #include "../Vessel.hpp"
 #include "../../core/AssetManagerInterface.hpp"
+#include "../../core/Physics.hpp"
 #include "../../core/maths_funcs.hpp"
 #include "../../core/log.hpp"
 #include "../../core/RenderContext.hpp"
@@ -125,9 +126,6 @@ void VegaSolidEngine::renderOther(){
 }
 
 
-// temp vvv
-#define TIME_STEP (1. / 60.)
-
 void VegaSolidEngine::update(){
     double temp_mass = m_dry_mass;
     for(uint i=0; i < m_resources.size(); i++){
@@ -140,7 +138,7 @@ void VegaSolidEngine::update(){
     }
 
     if(m_main_engine->getStatus() == ENGINE_STATUS_ON){
-        const btVector3 force = m_main_engine->update();
+        const btVector3 force = m_main_engine->update(m_physics->getFrameDeltaT());
         m_asset_manager->applyForce(this, force, btVector3(0.0, 0.0, 0.0));
     }
 
@@ -152,8 +150,8 @@ void VegaSolidEngine::update(){
 
         m_separate = false;
 
-        m_asset_manager->applyForce(m_parent, force, btVector3(0.0, 0.0, 0.0));
-        m_asset_manager->applyForce(this, -1 * force, btVector3(0.0, 0.0, 0.0));
+        m_asset_manager->applyForceOnce(m_parent, force, btVector3(0.0, 0.0, 0.0));
+        m_asset_manager->applyForceOnce(this, -1 * force, btVector3(0.0, 0.0, 0.0));
 
         decoupleSelf();
     }
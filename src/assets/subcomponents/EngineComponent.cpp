@@ -158,9 +158,7 @@ double EngineComponent::getThrottle() const{
 }
 
 
-// temp vvv
-#define TIME_STEP (1. / 60.)
-double EngineComponent::updateResourceFlow(){
+double EngineComponent::updateResourceFlow(double delta_t){
     BasePart* requested;
     double min_ratio = 1.0;
 
@@ -175,7 +173,7 @@ double EngineComponent::updateResourceFlow(){
     for(uint i=0; i < m_propellants.size(); i++){
         required_propellant& prop = m_propellants.at(i);
 
-        double ideal_flow_rate = prop.max_flow_rate * m_throttle * TIME_STEP;
+        double ideal_flow_rate = prop.max_flow_rate * m_throttle * delta_t;
         prop.current_flow_rate = ideal_flow_rate;
         // request and update the flow rate
         requested->requestResource(m_owner_part, prop.resource_id, prop.current_flow_rate);
@@ -191,8 +189,8 @@ void EngineComponent::setOwner(BasePart* owner_part){
 }
 
 
-const btVector3 EngineComponent::update(){
-    double min_flow = updateResourceFlow();
+const btVector3 EngineComponent::update(double delta_t){
+    double min_flow = updateResourceFlow(delta_t);
     btVector3 thrust_direction = getFinalThrustDirection();
     thrust_direction.normalize();
     double thrust = min_flow * m_throttle * m_max_avg_thrust;
@@ -187,8 +187,10 @@ class EngineComponent{
          * the owner engine in a derived class. Depends on the requires resources and the current
          * throttle. Returns the minimum ratio among the all requested resources (this ratio is the 
          * division between the desired and the actual flow).
+         *
+         * @delta_t: simulated time (s) the flow is requested for.
          */
-        double updateResourceFlow();
+        double updateResourceFlow(double delta_t);
 
         /*
          * Sets the owner part of this engine.
@@ -200,8 +202,11 @@ class EngineComponent{
         /*
          * Updates the status of the engine. Request resources, computes the forces, and returns
          * the force that should be applied on the parent part.
+         *
+         * @delta_t: simulated time (s) per logic frame, more than one physics tick if the physics
+         * warp is on (see Physics::getFrameDeltaT). Only affects the propellant consumption.
          */
-        const btVector3 update();
+        const btVector3 update(double delta_t);
 
         /*
          * Sets the m_request_owner to true, which means that the resources are requested to the
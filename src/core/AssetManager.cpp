@@ -1,5 +1,6 @@
 #include <iostream>
 #include <functional>
+#include <algorithm>
 
 #define BT_USE_DOUBLE_PRECISION
 #include <bullet/BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
@@ -14,6 +15,8 @@
 #include "BaseApp.hpp"
 #include "Camera.hpp"
 #include "log.hpp"
+#include "CommandQueue.hpp"
+#include "Recorder.hpp"
 #include "../assets/Resource.hpp"
 #include "../assets/Model.hpp"
 #include "../assets/Object.hpp"
@@ -37,6 +40,9 @@ AssetManager::AssetManager(BaseApp* app){
     m_buffers = app->getRenderBuffers();
     m_camera = app->getCamera();
     m_app = app;
+    m_digest_commands = false;
+    m_num_commands = 0;
+    m_commands_digest = DIGEST_OFFSET_BASIS;
 
     objectsInit();
 }
@@ -116,72 +122,192 @@ void AssetManager::objectsInit(){
 
 
 void AssetManager::processCommandBuffers(bool physics_pause){
-    // process buffers
-    for(uint i=0; i < m_add_body_buffer.size(); i++){
-        struct add_body_msg& msg = m_add_body_buffer.at(i);
-        msg.part->addBody(msg.origin, msg.inertia, msg.rotation);
-    }
-    m_add_body_buffer.clear();
+    command cmd;
+    bool empty = false;
+
+    m_num_commands = 0;
+    m_commands_digest = DIGEST_OFFSET_BASIS;
+
+    while(!empty){
+        while(m_commands->pop(cmd)){
+            if(m_digest_commands){
+                m_commands_digest = digest_bytes(m_commands_digest, &cmd.type, sizeof(cmd.type));
+                m_commands_digest = digest_bytes(m_commands_digest, cmd.data, sizeof(cmd.data));
+                m_num_commands++;
+            }
+            m_command_batches[cmd.type].push_back(cmd);
+        }
 
-    for(uint i=0; i < m_apply_force_buffer.size(); i++){
-        struct apply_force_msg& msg = m_apply_force_buffer.at(i);
-        msg.part->m_body->applyForce(msg.force, msg.rel_pos);
+        empty = true;
+        for(uint i=0; i < CMD_NUM_TYPES; i++){
+            if(m_command_batches[i].size()){
+                applyCommandBatch(m_command_batches[i], physics_pause);
+                empty = false;
+            }
+        }
     }
-    m_apply_force_buffer.clear();
 
-    for(uint i=0; i < m_set_motion_state_buffer.size(); i++){
-        struct set_motion_state_msg& msg = m_set_motion_state_buffer.at(i);
-        msg.object->setMotionState(msg.origin, msg.initial_rotation);
-        if(physics_pause){
-            m_physics->updateCollisionWorldSingleAABB(msg.object->m_body.get());
+    // all the payloads have been taken
+    m_commands->resetArena();
+}
+
+
+void AssetManager::setDigestCommands(bool digest){
+    m_digest_commands = digest;
+}
+
+
+void AssetManager::getCommandsDigest(std::uint32_t& num_commands, std::uint64_t& digest) const{
+    num_commands = m_num_commands;
+    digest = m_commands_digest;
+}
+
+
+std::uint64_t AssetManager::getStateDigest() const{
+    VesselMap::const_iterator it;
+    std::uint64_t digest = 0;
+
+    for(it=m_active_vessels.begin(); it != m_active_vessels.end(); it++){
+        const btRigidBody* body = it->second->getRoot()->m_body.get();
+        std::uint64_t vessel_digest = DIGEST_OFFSET_BASIS;
+        btVector3 values[3] = {it->second->getCoM(), btVector3(0.0, 0.0, 0.0),
+                               btVector3(0.0, 0.0, 0.0)};
+
+        if(body){
+            values[1] = body->getWorldTransform().getOrigin();
+            values[2] = body->getLinearVelocity();
+        }
+        for(uint i=0; i < 3; i++){
+            vessel_digest = digest_bytes(vessel_digest, &values[i].x(), sizeof(btScalar));
+            vessel_digest = digest_bytes(vessel_digest, &values[i].y(), sizeof(btScalar));
+            vessel_digest = digest_bytes(vessel_digest, &values[i].z(), sizeof(btScalar));
         }
+        digest += vessel_digest; // the order of the vessels doesn't matter
     }
-    m_set_motion_state_buffer.clear();
 
-    for(uint i=0; i < m_build_constraint_subtree_buffer.size(); i++){
-        m_build_constraint_subtree_buffer.at(i)->buildSubTreeConstraints(nullptr);
+    return digest;
+}
+
+
+void AssetManager::applyCommandBatch(std::vector<command>& batch, bool physics_pause){
+    switch(batch.front().type){
+        case CMD_APPLY_FORCE:
+            applyForceBatch(batch);
+            break;
+        case CMD_SET_MASS:
+            applyMassBatch(batch);
+            break;
+        default:
+            break;
     }
-    m_build_constraint_subtree_buffer.clear();
 
-    for(uint i=0; i < m_add_constraint_buffer.size(); i++){
-        struct add_contraint_msg& msg = m_add_constraint_buffer.at(i);
-        msg.part->setParentConstraint(std::move(msg.constraint_uptr));
+    for(uint i=0; i < batch.size(); i++){
+        command& cmd = batch.at(i);
+
+        switch(cmd.type){
+            case CMD_ADD_BODY:
+                static_cast<BasePart*>(cmd.target)->addBody(cmd.getVector(0), cmd.getVector(3),
+                                                            cmd.getRotation(6));
+                break;
+            case CMD_SET_MOTION_STATE:{
+                Object* object = static_cast<Object*>(cmd.target);
+
+                object->setMotionState(cmd.getVector(0), cmd.getRotation(3));
+                if(physics_pause){
+                    m_physics->updateCollisionWorldSingleAABB(object->m_body.get());
+                }
+                break;
+            }
+            case CMD_BUILD_CONSTRAINT_SUBTREE:
+                static_cast<BasePart*>(cmd.target)->buildSubTreeConstraints(nullptr);
+                break;
+            case CMD_ADD_CONSTRAINT:
+                static_cast<BasePart*>(cmd.target)->setParentConstraint(
+                    m_commands->take<std::unique_ptr<btTypedConstraint>>(cmd));
+                break;
+            case CMD_REMOVE_PART_CONSTRAINT:
+                static_cast<BasePart*>(cmd.target)->removeParentConstraint();
+                break;
+            case CMD_ADD_VESSEL:{
+                std::shared_ptr<Vessel> vessel = m_commands->take<std::shared_ptr<Vessel>>(cmd);
+
+                m_active_vessels.insert({vessel->getId(), vessel});
+                // the parts have a new collision tag (decoupling), the pairs with the old vessel are missing
+                m_physics->refreshVesselPairs(vessel.get());
+                break;
+            }
+            case CMD_DELETE_SUBTREE:
+                m_commands->take<std::shared_ptr<BasePart>>(cmd)->removeBodiesSubtree();
+                break;
+            case CMD_SET_VESSEL_VELOCITY:
+                static_cast<Vessel*>(cmd.target)->setVesselVelocity(cmd.getVector(0));
+                break;
+            default: // CMD_APPLY_FORCE and CMD_SET_MASS were applied as a whole
+                break;
+        }
     }
-    m_add_constraint_buffer.clear();
+    batch.clear();
+}
 
-    for(uint i=0; i < m_set_mass_buffer.size(); i++){
-        // this should be enough, also the constraints don't get removed
-        btDiscreteDynamicsWorld* dynamics_world = m_physics->getDynamicsWorld();
-        btVector3 inertia;
-        btRigidBody* body = m_set_mass_buffer.at(i).part->m_body.get();
 
-        dynamics_world->removeRigidBody(body);
+static bool command_target_less(const command& a, const command& b){
+    return std::less<void*>()(a.target, b.target);
+}
 
-        body->getCollisionShape()->calculateLocalInertia(m_set_mass_buffer.at(i).mass, inertia);
-        body->setMassProps(m_set_mass_buffer.at(i).mass, inertia);
 
-        dynamics_world->addRigidBody(body);
-    }
-    m_set_mass_buffer.clear();
+void AssetManager::applyForceBatch(std::vector<command>& batch){
+    uint i = 0;
+
+    // stable, the forces of a part are summed in the same order when replaying a recording
+    std::stable_sort(batch.begin(), batch.end(), command_target_less);
+
+    // same as btRigidBody::applyForce for each force, the linear factor of the parts is 1
+    while(i < batch.size()){
+        btRigidBody* body = static_cast<BasePart*>(batch.at(i).target)->m_body.get();
+        btVector3 force(0.0, 0.0, 0.0), torque(0.0, 0.0, 0.0);
+        btVector3 once_force(0.0, 0.0, 0.0), once_torque(0.0, 0.0, 0.0);
+        bool once = false;
+        void* target = batch.at(i).target;
+
+        for(; i < batch.size() && batch.at(i).target == target; i++){
+            btVector3 f = batch.at(i).getVector(0);
+
+            if(batch.at(i).data[6] != 0.0){
+                once_force += f;
+                once_torque += batch.at(i).getVector(3).cross(f);
+                once = true;
+            }
+            else{
+                force += f;
+                torque += batch.at(i).getVector(3).cross(f);
+            }
+        }
 
-    for(uint i=0; i < m_remove_part_constraint_buffer.size(); i++){
-        m_remove_part_constraint_buffer.at(i)->removeParentConstraint();
+        // the physics thread takes these out of the body when the frame ends
+        body->applyCentralForce(force);
+        body->applyTorque(torque);
+        if(once)
+            m_physics->addOneShotForce(body, once_force, once_torque);
     }
-    m_remove_part_constraint_buffer.clear();
+}
 
-    for(uint i=0; i < m_add_vessel_buffer.size(); i++){
-        m_active_vessels.insert({m_add_vessel_buffer.at(i)->getId(), m_add_vessel_buffer.at(i)});
-    }
-    m_add_vessel_buffer.clear();
 
-    for(uint i=0; i < m_delete_subtree_buffer.size(); i++){
-        m_delete_subtree_buffer.at(i)->removeBodiesSubtree();
-    }
-    m_delete_subtree_buffer.clear();
+void AssetManager::applyMassBatch(std::vector<command>& batch){
+    uint i = 0;
+
+    std::stable_sort(batch.begin(), batch.end(), command_target_less);
+
+    while(i < batch.size()){
+        void* target = batch.at(i).target;
 
-    for(uint i=0; i < m_set_vessel_velocity_buffer.size(); i++){
-        const btVector3& velocity = m_set_vessel_velocity_buffer.at(i).velocity;
-        m_set_vessel_velocity_buffer.at(i).vessel->setVesselVelocity(velocity);
+        while(i + 1 < batch.size() && batch.at(i + 1).target == target)
+            i++; // the last one wins
+
+        // in place, the constraints don't get removed and the proxy is kept
+        BasePart* part = static_cast<BasePart*>(target);
+        m_physics->updateMassProps(part->m_body.get(), batch.at(i).data[0],
+                                   part->getCollisionGroup(), part->getCollisionFilters());
+        i++;
     }
 }
 
@@ -190,19 +316,19 @@ void AssetManager::clearSceneEditor(){
     SubTreeIterator it;
 
     for(it=m_editor_subtrees.begin(); it != m_editor_subtrees.end(); it++){
-        m_delete_subtree_buffer.emplace_back(std::static_pointer_cast<BasePart>(it->second->getSharedPtr()));
+        deleteSubtree(std::static_pointer_cast<BasePart>(it->second->getSharedPtr()));
     }
     m_editor_subtrees.clear();
 
     if(m_editor_vessel.get()){
-        m_delete_subtree_buffer.emplace_back(std::static_pointer_cast<BasePart>(m_editor_vessel->getRoot()->getSharedPtr()));
+        deleteSubtree(std::static_pointer_cast<BasePart>(m_editor_vessel->getRoot()->getSharedPtr()));
         m_editor_vessel.reset();
     }
 }
 
 
 void AssetManager::deleteObjectEditor(BasePart* part, std::uint32_t& vessel_id){
-    m_delete_subtree_buffer.emplace_back(std::static_pointer_cast<BasePart>(part->getSharedPtr()));
+    deleteSubtree(std::static_pointer_cast<BasePart>(part->getSharedPtr()));
     if(part->getVessel()){
         std::uint32_t vid = part->getVessel()->getId();
 
@@ -235,7 +361,8 @@ void AssetManager::updateObjectBuffer(std::vector<object_transform>& buffer_, co
             updateObjectBufferEditor(buffer_, btv_cam_origin);
             break;
         case RENDER_SIMULATION:
-            updateObjectBufferUniverse(buffer_, btv_cam_origin);
+            // the camera is in absolute coordinates and the bodies in world coordinates
+            updateObjectBufferUniverse(buffer_, btv_cam_origin - m_physics->getWorldOrigin());
             break;
         case RENDER_PLANETARIUM:
             break;
@@ -270,7 +397,8 @@ void AssetManager::updateObjectBufferUniverse(std::vector<object_transform>& buf
     VesselIterator it;
 
     for(it=m_active_vessels.begin(); it != m_active_vessels.end(); it++){
-        it->second->getRoot()->addSubTreeToRenderBuffer(buffer_, btv_cam_origin);;
+        if(!it->second->isPacked()) // too far away to be seen
+            it->second->getRoot()->addSubTreeToRenderBuffer(buffer_, btv_cam_origin);
     }
 
     for(uint i=0; i < m_kinematics.size(); i++){
@@ -335,37 +463,35 @@ void AssetManager::updateBuffers(){
     const dmath::vec3& cam_origin = m_camera->getCamPosition();
     struct render_buffer* rbuf;
     buffer_manager which_buffer;
+    const time_point state_time = m_physics->getStateTime();
 
-    if(m_buffers->last_updated == buffer_2 || m_buffers->last_updated == none){
-        if(m_buffers->buffer_1.buffer_lock.try_lock()){
-            rbuf = &m_buffers->buffer_1;
-            which_buffer = buffer_1;
-        }
-        else{
-            m_buffers->buffer_2.buffer_lock.lock();
-            rbuf = &m_buffers->buffer_2;
-            which_buffer = buffer_2;
-        }
-    }
-    else{
-        if(m_buffers->buffer_2.buffer_lock.try_lock()){
-            rbuf = &m_buffers->buffer_2;
-            which_buffer = buffer_2;
-        }
-        else{
-            m_buffers->buffer_1.buffer_lock.lock();
-            rbuf = &m_buffers->buffer_1;
-            which_buffer = buffer_1;
-        }
+    // the render thread only reads the last updated and the previous buffers
+    m_buffers->manager_lock.lock();
+    for(which_buffer = buffer_1; which_buffer <= buffer_3;
+        which_buffer = buffer_manager(which_buffer + 1)){
+        if(which_buffer != m_buffers->last_updated && which_buffer != m_buffers->previous)
+            break;
     }
+    m_buffers->manager_lock.unlock();
 
+    rbuf = m_buffers->getBuffer(which_buffer);
+    rbuf->buffer_lock.lock();
     updateViewMat(rbuf);
     updateObjectBuffer(rbuf->buffer, cam_origin);
     updatePlanetBuffer(rbuf->planet_buffer);
     rbuf->cam_origin = cam_origin;
-    m_buffers->last_updated = which_buffer;
+    rbuf->timestamp = state_time;
     rbuf->buffer_lock.unlock();
 
+    /* if physics didn't tick this frame the state is as old as the last buffer, which is
+       replaced so the render thread keeps interpolating from the previous one */
+    m_buffers->manager_lock.lock();
+    if(m_buffers->last_updated == none ||
+       state_time > m_buffers->getBuffer(m_buffers->last_updated)->timestamp)
+        m_buffers->previous = m_buffers->last_updated;
+    m_buffers->last_updated = which_buffer;
+    m_buffers->manager_lock.unlock();
+
     /*end = std::chrono::steady_clock::now();
     time = end - start;
     std::cout << "copy time: " << time.count() << std::endl;*/
@@ -376,7 +502,8 @@ void AssetManager::updateVessels(){
     VesselIterator it;
 
     for(it=m_active_vessels.begin(); it != m_active_vessels.end(); it++){
-        it->second->update();
+        if(!it->second->isPacked()) // far from the player, nothing to do
+            it->second->update();
     }
 }
 
@@ -414,7 +541,8 @@ void AssetManager::updateCoMs(){
     VesselIterator it;
 
     for(it=m_active_vessels.begin(); it != m_active_vessels.end(); it++){
-        it->second->updateCoM();
+        if(!it->second->isOnRails()) // set by Vessel::setRailsState
+            it->second->updateCoM();
     }
 }
 
@@ -78,6 +78,40 @@ class AssetManager : public AssetManagerInterface{
         void updateObjectBufferUniverse(std::vector<object_transform>& buffer_, const btVector3& btv_cam_origin);
         void addObjectBuffer(Object* obj, std::vector<object_transform>& buffer_, const btVector3& btv_cam_origin);
         void updateViewMat(struct render_buffer* rbuf) const;
+
+        /* commands popped from the queue grouped by type, the vectors keep their capacity */
+        std::vector<command> m_command_batches[CMD_NUM_TYPES];
+
+        /* digest of the commands of the last processCommandBuffers, only computed when
+           m_digest_commands is set (see Recorder) */
+        bool m_digest_commands;
+        std::uint32_t m_num_commands;
+        std::uint64_t m_commands_digest;
+
+        /*
+         * Applies the commands of a batch, see processCommandBuffers.
+         *
+         * @batch: commands of the same type, the vector is cleared.
+         * @physics_pause: see processCommandBuffers.
+         */
+        void applyCommandBatch(std::vector<command>& batch, bool physics_pause);
+
+        /*
+         * Applies a batch of CMD_APPLY_FORCE. The batch is sorted by part and the forces of each
+         * part are summed, so every body gets a single central force and torque. The one-shot
+         * forces (see applyForceOnce) are summed apart and handed to Physics::addOneShotForce.
+         *
+         * @batch: forces, the vector is not cleared.
+         */
+        void applyForceBatch(std::vector<command>& batch);
+
+        /*
+         * Applies a batch of CMD_SET_MASS. Only the last mass of each part is set, in place (see
+         * Physics::updateMassProps).
+         *
+         * @batch: masses, the vector is not cleared.
+         */
+        void applyMassBatch(std::vector<command>& batch);
     public:
         std::vector<std::unique_ptr<btCollisionShape>> m_collision_shapes;
         std::vector<std::unique_ptr<Model>> m_models;
@@ -99,14 +133,40 @@ class AssetManager : public AssetManagerInterface{
         ~AssetManager();
 
         /* 
-         * Used to process the command buffers, must be called by the app from the main thread
-         * when the physics thread is not running.
+         * Used to process the commands of the queue, must be called by the app from the main
+         * thread when the physics thread is not running and nothing else is pushing commands.
+         * The commands are grouped by type and applied in the order of command_type (see
+         * core/buffers.hpp), the commands pushed while applying (e.g. the constraints of a
+         * subtree) are applied in the next round of the same call.
          * 
          * @physics_pause: wether the physics is paused (and thus Bullet has not stepped), in order
          * to update AABBs.
          */
         void processCommandBuffers(bool physics_pause);
 
+        /*
+         * Enables the digest of the commands, see getCommandsDigest.
+         *
+         * @digest: true to compute the digest.
+         */
+        void setDigestCommands(bool digest);
+
+        /*
+         * Returns the number of commands applied by the last call to processCommandBuffers and
+         * the digest of their types and data, used to check that a replay is deterministic.
+         *
+         * @num_commands: returns the number of commands.
+         * @digest: returns the digest.
+         */
+        void getCommandsDigest(std::uint32_t& num_commands, std::uint64_t& digest) const;
+
+        /*
+         * Returns a digest of the state of the active vessels (center of mass, transform and
+         * velocity of the root), it doesn't depend on the order of the vessels or on their ids.
+         * Must be called when the physics thread is not running.
+         */
+        std::uint64_t getStateDigest() const;
+
         /* 
          * Called to update the render buffers, must be called when the physics thread is not 
          * running.
@@ -142,6 +202,7 @@ class AssetManager : public AssetManagerInterface{
         /*
          * Updates the center of mass of all the active vessels, should be called when the physics
          * thread is stopped to avoid data races while retrieving the position of the objects.
+         * Vessels on rails are skipped, their CoM is set by Vessel::setRailsState.
          */
         void updateCoMs();
 
@@ -5,11 +5,12 @@
 
 #include "AssetManagerInterface.hpp"
 #include "AssetManager.hpp"
+#include "CommandQueue.hpp"
 #include "../assets/Model.hpp"
 
 
 AssetManagerInterface::AssetManagerInterface(){
-
+    m_commands.reset(new CommandQueue());
 }
 
 
@@ -19,55 +20,94 @@ AssetManagerInterface::~AssetManagerInterface(){
 
 
 void AssetManagerInterface::addVessel(std::shared_ptr<Vessel>&& vessel){
-    m_add_vessel_buffer.emplace_back(std::move(vessel));
+    command cmd(CMD_ADD_VESSEL, nullptr);
+
+    cmd.payload = m_commands->allocate(std::move(vessel));
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::removePartConstraint(BasePart* part){
-    m_remove_part_constraint_buffer.emplace_back(part);
+    m_commands->push(command(CMD_REMOVE_PART_CONSTRAINT, part));
 }
 
 
 void AssetManagerInterface::applyForce(BasePart* ptr, const btVector3& f,
                                        const btVector3& r_pos){
-    m_apply_force_buffer.emplace_back(ptr, f, r_pos);
+    command cmd(CMD_APPLY_FORCE, ptr);
+
+    cmd.setVector(0, f);
+    cmd.setVector(3, r_pos);
+    m_commands->push(cmd);
+}
+
+
+void AssetManagerInterface::applyForceOnce(BasePart* ptr, const btVector3& f,
+                                           const btVector3& r_pos){
+    command cmd(CMD_APPLY_FORCE, ptr);
+
+    cmd.setVector(0, f);
+    cmd.setVector(3, r_pos);
+    cmd.data[6] = 1.0;
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::setMassProps(BasePart* ptr, double m){
-    m_set_mass_buffer.emplace_back(ptr, m);
+    command cmd(CMD_SET_MASS, ptr);
+
+    cmd.data[0] = m;
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::addBody(BasePart* ptr, const btVector3& orig,
                                     const btVector3& iner, const btQuaternion& rot){
-    m_add_body_buffer.emplace_back(ptr, orig, iner, rot);
+    command cmd(CMD_ADD_BODY, ptr);
+
+    cmd.setVector(0, orig);
+    cmd.setVector(3, iner);
+    cmd.setRotation(6, rot);
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::addConstraint(BasePart* ptr,
                                           std::unique_ptr<btTypedConstraint>&& c_uptr){
-    m_add_constraint_buffer.emplace_back(ptr, std::move(c_uptr));
+    command cmd(CMD_ADD_CONSTRAINT, ptr);
+
+    cmd.payload = m_commands->allocate(std::move(c_uptr));
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::buildConstraintSubtree(BasePart* part){
-    m_build_constraint_subtree_buffer.emplace_back(part);
+    m_commands->push(command(CMD_BUILD_CONSTRAINT_SUBTREE, part));
 }
 
 
 void AssetManagerInterface::deleteSubtree(std::shared_ptr<BasePart>&& root){
-    m_delete_subtree_buffer.emplace_back(root);
+    command cmd(CMD_DELETE_SUBTREE, nullptr);
+
+    cmd.payload = m_commands->allocate(std::move(root));
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::setMotionState(Object* obj, const btVector3& orig, const btQuaternion& rot){
-    m_set_motion_state_buffer.emplace_back(obj, orig, rot);
+    command cmd(CMD_SET_MOTION_STATE, obj);
+
+    cmd.setVector(0, orig);
+    cmd.setRotation(3, rot);
+    m_commands->push(cmd);
 }
 
 
 void AssetManagerInterface::setVesselVelocity(Vessel* vessel, const btVector3& vel){
-    m_set_vessel_velocity_buffer.emplace_back(vessel, vel);
+    command cmd(CMD_SET_VESSEL_VELOCITY, vessel);
+
+    cmd.setVector(0, vel);
+    m_commands->push(cmd);
 }
 
 
@@ -11,30 +11,23 @@ class BasePart;
 class btTypedConstraint;
 class Object;
 class Model;
+class CommandQueue;
 
 
 /*
  * This class is used as an interface between the asset manager and the vessels/parts, this is
- * mainly used to add commands to the command buffers. Command buffers are usually used by the
- * update methods, as the physics thread is most likely stepping. Command buffers can be used,
- * for example, to change the motion state of a part or to add/remove constraints. The commands in
- * the buffers are applied before the new engine step, but NOT durnig the current one. This class
- * is inherited by AssetManager.
+ * mainly used to add commands to the command queue. Commands are usually used by the update
+ * methods, as the physics thread is most likely stepping. Commands can be used, for example, to
+ * change the motion state of a part or to add/remove constraints. The commands are applied before
+ * the new engine step, but NOT durnig the current one. The queue is lock-free (see CommandQueue),
+ * so these methods can be called from several threads at the same time. This class is inherited
+ * by AssetManager.
  */
 
 class AssetManagerInterface{
     protected:
-        /* command buffers */
-        std::vector<struct set_motion_state_msg> m_set_motion_state_buffer;
-        std::vector<BasePart*> m_remove_part_constraint_buffer;
-        std::vector<struct add_contraint_msg> m_add_constraint_buffer;
-        std::vector<struct add_body_msg> m_add_body_buffer;
-        std::vector<std::shared_ptr<Vessel>> m_add_vessel_buffer;
-        std::vector<struct apply_force_msg> m_apply_force_buffer;
-        std::vector<struct set_mass_props_msg> m_set_mass_buffer;
-        std::vector<std::shared_ptr<BasePart>> m_delete_subtree_buffer;
-        std::vector<BasePart*> m_build_constraint_subtree_buffer;
-        std::vector<struct set_vessel_velocity_msg> m_set_vessel_velocity_buffer;
+        /* commands, applied by AssetManager::processCommandBuffers */
+        std::unique_ptr<CommandQueue> m_commands;
         std::vector<std::unique_ptr<Model>> m_public_models;
     public:
         AssetManagerInterface();
@@ -46,7 +39,7 @@ class AssetManagerInterface{
          * only reason I can think of is that we might be iterating over m_active_vessels when we
          * add the new vessel, but I still think it doesn't matter.
          * 
-         * @vessel: rvalue reference to the unique ptr of the vessel, the buffer will take 
+         * @vessel: rvalue reference to the unique ptr of the vessel, the command will take 
          * ownership of this pointer.
          */
         void addVessel(std::shared_ptr<Vessel>&& vessel);
@@ -70,6 +63,18 @@ class AssetManagerInterface{
          */
         void applyForce(BasePart* ptr, const btVector3& f, const btVector3& r_pos);
 
+        /*
+         * Same as applyForce, but the force is applied in a single tick, the first one that runs
+         * after the commands are processed. The forces of applyForce are applied in every tick
+         * until the next logic frame, which is right for the thrust of an engine (pushed every
+         * frame) but would multiply a kick that is pushed once, like a decoupling.
+         *
+         * @ptr: pointer to the part we want to apply the force to.
+         * @f: force vector, in newtons.
+         * @r_pos: relative application point of the force, in meters.
+         */
+        void applyForceOnce(BasePart* ptr, const btVector3& f, const btVector3& r_pos);
+
         /*
          * Sets the mass of a part. I don't know what "Props" is supposed to mean.
          *
@@ -90,19 +95,18 @@ class AssetManagerInterface{
 
         /*
          * Adds a constraint to the part, note that the part should already be in the dynamics 
-         * world. The buffer will take ownership of the constraint, which will eventually be
+         * world. The command will take ownership of the constraint, which will eventually be
          * passed to the part.
          *
          * @ptr: pointer to the part we want to add the constraint to.
-         * @c_uptr: rvalue reference to the unique pointer to the constraint. The buffer message 
-         * takes ownership of the pointer.
+         * @c_uptr: rvalue reference to the unique pointer to the constraint. The command takes
+         * ownership of the pointer.
          */
         void addConstraint(BasePart* ptr, std::unique_ptr<btTypedConstraint>&& c_uptr);
 
         /* 
-         * Adds parts to the m_build_constraint_subtree_buffer. All the parts in this buffer will
-         * have the constraints of their subtrees built by recursively calling the parts
-         * buildSubTreeConstraints method.
+         * Adds a command to build the constraints of the subtree of a part, by recursively
+         * calling the parts buildSubTreeConstraints method.
          *
          * This method should be used when a subtree is cloned (for example in the editor) or when
          * a vessel is spawned in the middle of the simulation, as the constraints can't be added
@@ -113,10 +117,10 @@ class AssetManagerInterface{
         void buildConstraintSubtree(BasePart* part);
 
         /*
-         * Adds the subtree under root in the delete subtree buffer. The whole subtree will be 
-         * deleted, this includes removing the rigid bodies from the dynamics world.
+         * Adds a command to delete the subtree under root. The whole subtree will be deleted,
+         * this includes removing the rigid bodies from the dynamics world.
          *
-         * @root: rvalue reference of the shared pointer to the root of the tree, this buffer will
+         * @root: rvalue reference of the shared pointer to the root of the tree, the command will
          * take ownership of this pointer and the rest of the subtree.
          */
         void deleteSubtree(std::shared_ptr<BasePart>&& root);
@@ -31,6 +31,7 @@ BaseApp::~BaseApp(){
 }
 
 
+#ifndef HEADLESS
 GLuint m_vao, m_vbo_vert, m_vbo_clr, m_vbo_tex, m_loading_texture, m_disp_location;
 
 void BaseApp::displayLoadingScreen(){
@@ -111,6 +112,7 @@ void BaseApp::displayLoadingScreen(){
 
     check_gl_errors(true, "BaseApp::displayLoadingScreen");
 }
+#endif
 
 
 
@@ -120,6 +122,12 @@ void BaseApp::init(int gl_width, int gl_height){
                               (float)gl_width / (float)gl_height, 0.01f, 6300000000.0f,
                               m_input.get()));
     m_camera->setSpeed(10.f);
+#ifdef HEADLESS
+    // null render backend, there's no window or render context and the models only keep their
+    // bounding data
+    m_camera->setWindowHandler(nullptr);
+    m_frustum.reset(new Frustum());
+#else
     m_window_handler.reset(new WindowHandler(gl_width, gl_height, m_input.get(),
                                              m_camera.get()));
     m_camera->setWindowHandler(m_window_handler.get());
@@ -127,14 +135,16 @@ void BaseApp::init(int gl_width, int gl_height){
     m_render_context.reset(new RenderContext(this));
     m_window_handler->setRenderContext(m_render_context.get());
     displayLoadingScreen();
+#endif
     m_physics.reset(new Physics(this));
     m_asset_manager.reset(new AssetManager(this));
     m_player.reset(new Player(m_camera.get(), m_asset_manager.get(), m_input.get()));
     m_predictor.reset(new Predictor(this));
 
-    Model::setStaticMembers(m_frustum.get(), m_render_context.get());
+    Model::setStaticMembers(m_frustum.get(), getRenderContext());
 
     m_buffers.last_updated = none;
+    m_buffers.previous = none;
 
     m_gui_mode = 0;
     m_render_state = 0;
@@ -142,6 +152,7 @@ void BaseApp::init(int gl_width, int gl_height){
 
 
 void BaseApp::run(){
+#ifndef HEADLESS
     while (!glfwWindowShouldClose(m_window_handler->getWindow())){
         m_input->update();
         m_window_handler->update();
@@ -149,6 +160,7 @@ void BaseApp::run(){
        // glfwSwapBuffers(m_window_handler->getWindow());
     }
     m_window_handler->terminate();
+#endif
 }
 
 short BaseApp::getGUIMode() const{
@@ -192,12 +204,20 @@ Camera* BaseApp::getCamera(){
 
 
 const WindowHandler* BaseApp::getWindowHandler() const{
+#ifdef HEADLESS
+    return nullptr;
+#else
     return m_window_handler.get();
+#endif
 }
 
 
 WindowHandler* BaseApp::getWindowHandler(){
+#ifdef HEADLESS
+    return nullptr;
+#else
     return m_window_handler.get();
+#endif
 }
 
 
@@ -212,12 +232,20 @@ Frustum* BaseApp::getFrustum(){
 
 
 const RenderContext* BaseApp::getRenderContext() const{
+#ifdef HEADLESS
+    return nullptr;
+#else
     return m_render_context.get();
+#endif
 }
 
 
 RenderContext* BaseApp::getRenderContext(){
+#ifdef HEADLESS
+    return nullptr;
+#else
     return m_render_context.get();
+#endif
 }
 
 
@@ -256,11 +284,6 @@ struct render_buffers* BaseApp::getRenderBuffers(){
 }
 
 
-struct thread_monitor* BaseApp::getThreadMonitor(){
-    return &m_thread_monitor;
-}
-
-
 const Predictor* BaseApp::getPredictor() const{
     return m_predictor.get();
 }
@@ -24,20 +24,25 @@ class Predictor;
 
 /*
  * Base application class, should be inherited by any application class. Has most of the essential
- * stuff to display, render, and manage whatever we need.
+ * stuff to display, render, and manage whatever we need. Headless builds (HEADLESS) have no window
+ * handler or render context, getWindowHandler and getRenderContext return nullptr.
  */
 
 class BaseApp{
     private:
+#ifndef HEADLESS
         void displayLoadingScreen();
+#endif
 
         void init(int gl_width, int gl_height);
     protected:
         std::unique_ptr<Input> m_input;
         std::unique_ptr<Camera> m_camera;
-        std::unique_ptr<WindowHandler> m_window_handler;
         std::unique_ptr<Frustum> m_frustum;
+#ifndef HEADLESS
+        std::unique_ptr<WindowHandler> m_window_handler;
         std::unique_ptr<RenderContext> m_render_context;
+#endif
         std::unique_ptr<Physics> m_physics;
         std::unique_ptr<AssetManager> m_asset_manager;
         std::unique_ptr<Player> m_player;
@@ -47,7 +52,6 @@ class BaseApp{
 
         /* buffers used to synchronize the physics and rendering */
         struct render_buffers m_buffers;
-        struct thread_monitor m_thread_monitor;
     public:
         BaseApp();
         BaseApp(int gl_width, int gl_height);
@@ -84,11 +88,6 @@ class BaseApp{
          */
         struct render_buffers* getRenderBuffers();
 
-        /*
-         * Returns a pointer to the thread monitor of the app.
-         */
-        struct thread_monitor* getThreadMonitor();
-
         /*
          * Returns a constant pointer to the Input object of the app.
          */
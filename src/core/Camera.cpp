@@ -9,6 +9,19 @@
 #include "WindowHandler.hpp"
 #include "log.hpp"
 #include "Input.hpp"
+#include "timing.hpp"
+
+
+/*
+ * Returns the time in seconds, headless builds (HEADLESS) have no GLFW.
+ */
+static double get_time(){
+#ifdef HEADLESS
+    return std::chrono::duration<double>(sch_now().time_since_epoch()).count();
+#else
+    return glfwGetTime();
+#endif
+}
 
 
 Camera::Camera(){
@@ -22,7 +35,7 @@ Camera::Camera(){
     m_input = nullptr;
     m_cam_speed = 3.5f;
     m_cam_heading_speed = 3.5f;
-    m_previous_frame_time = glfwGetTime();
+    m_previous_frame_time = get_time();
     m_near = 0.1f;
     m_far = 100.f;
     m_fovy = 67.f;
@@ -50,7 +63,7 @@ Camera::Camera(const dmath::vec3& pos, float fovy, float ar, float near, float f
     m_input = input_ptr;
     m_cam_speed = 3.5f;
     m_cam_heading_speed = 3.5f;
-    m_previous_frame_time = glfwGetTime();
+    m_previous_frame_time = get_time();
     m_near = near;
     m_far = far;
     m_fovy = fovy;
@@ -83,14 +96,16 @@ void Camera::setCameraOrientationFromAxisRad(float cam_heading, const dmath::vec
 
 
 void Camera::createProjMat(float near, float far, float fovy){
+#ifndef HEADLESS
     int fb_width, fb_height;
 
     m_window_handler->getFramebufferSize(fb_width, fb_height);
+    m_ar = float(fb_width) / float(fb_height);
+#endif // headless builds have no framebuffer, the aspect ratio is kept
 
     m_near = near;
     m_far = far;
     m_fovy = fovy;
-    m_ar = float(fb_width) / float(fb_height);
     m_proj_mat = math::perspective(m_fovy, m_ar, m_near, m_far);
 }
 
@@ -182,7 +197,7 @@ void Camera::updateViewMatrix(){
 
 
 void Camera::update(){
-    double current_frame_time = glfwGetTime();
+    double current_frame_time = get_time();
 
     m_elapsed_time = current_frame_time - m_previous_frame_time;
     m_previous_frame_time = current_frame_time;
@@ -222,7 +237,12 @@ void Camera::castRayMousePos(float dist, dmath::vec3& ray_start_world, dmath::ve
                              m_proj_mat.m[8], m_proj_mat.m[9], m_proj_mat.m[10], m_proj_mat.m[11], 
                              m_proj_mat.m[12], m_proj_mat.m[13], m_proj_mat.m[14], m_proj_mat.m[15]);
 
+#ifdef HEADLESS
+    fb_width = 1; // no window, the mouse position is taken as normalized
+    fb_height = 1;
+#else
     m_window_handler->getFramebufferSize(fb_width, fb_height);
+#endif
 
     m_input->getMousePos(mouse_x, mouse_y);
     mouse_y = fb_height - mouse_y; // y is inverted
@@ -280,11 +300,15 @@ void Camera::freeCameraUpdate(){
 
     m_prev_cam_input_mode = m_cam_input_mode;
     if(m_input->pressed_mbuttons[GLFW_MOUSE_BUTTON_2] && m_cam_input_mode == GLFW_CURSOR_NORMAL){
+#ifndef HEADLESS
         glfwSetInputMode(m_window_handler->getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#endif
         m_cam_input_mode = GLFW_CURSOR_DISABLED;
     }
     else if(!m_input->pressed_mbuttons[GLFW_MOUSE_BUTTON_2] && m_cam_input_mode == GLFW_CURSOR_DISABLED){
+#ifndef HEADLESS
         glfwSetInputMode(m_window_handler->getWindow(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+#endif
         m_cam_input_mode = GLFW_CURSOR_NORMAL;
     }
 
@@ -353,11 +377,15 @@ void Camera::orbitalCameraUpdate(){
     if(m_input->keyboardPressed() || m_input->mouseMoved()){
         m_prev_cam_input_mode = m_cam_input_mode;
         if(m_input->pressed_mbuttons[GLFW_MOUSE_BUTTON_2] && m_cam_input_mode == GLFW_CURSOR_NORMAL){
+#ifndef HEADLESS
             glfwSetInputMode(m_window_handler->getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#endif
             m_cam_input_mode = GLFW_CURSOR_DISABLED;
         }
         else if(!m_input->pressed_mbuttons[GLFW_MOUSE_BUTTON_2] && m_cam_input_mode == GLFW_CURSOR_DISABLED){
+#ifndef HEADLESS
             glfwSetInputMode(m_window_handler->getWindow(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+#endif
             m_cam_input_mode = GLFW_CURSOR_NORMAL;
         }
     }
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <cstdint>
+
+#include "CommandQueue.hpp"
+#include "log.hpp"
+
+
+CommandQueue::CommandQueue(){
+    m_ring.reset(new slot[COMMAND_RING_SIZE]);
+    for(std::size_t i=0; i < COMMAND_RING_SIZE; i++)
+        m_ring[i].sequence.store(i, std::memory_order_relaxed);
+
+    m_enqueue_pos.store(0, std::memory_order_relaxed);
+    m_dequeue_pos = 0;
+
+    m_arena.reset(new unsigned char[COMMAND_ARENA_SIZE]);
+    m_arena_offset.store(0, std::memory_order_relaxed);
+
+    m_has_overflow.store(false, std::memory_order_relaxed);
+    m_overflow_index = 0;
+    m_overflow_count = 0;
+    m_heap_payloads = 0;
+}
+
+
+CommandQueue::~CommandQueue(){
+}
+
+
+bool CommandQueue::pushRing(const command& cmd){
+    std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    slot* cell;
+
+    for(;;){
+        cell = &m_ring[pos & (COMMAND_RING_SIZE - 1)];
+        std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)pos;
+
+        if(diff == 0){
+            if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0){
+            return false; // the consumer hasn't freed this slot yet
+        }
+        else{
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->cmd = cmd;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+bool CommandQueue::popRing(command& cmd){
+    slot* cell = &m_ring[m_dequeue_pos & (COMMAND_RING_SIZE - 1)];
+    std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+    if((std::intptr_t)sequence - (std::intptr_t)(m_dequeue_pos + 1) < 0)
+        return false;
+
+    cmd = cell->cmd;
+    cell->sequence.store(m_dequeue_pos + COMMAND_RING_SIZE, std::memory_order_release);
+    m_dequeue_pos++;
+    return true;
+}
+
+
+void CommandQueue::push(const command& cmd){
+    if(pushRing(cmd))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_overflow_lock);
+    m_overflow.push_back(cmd);
+    m_has_overflow.store(true, std::memory_order_release);
+}
+
+
+bool CommandQueue::pop(command& cmd){
+    if(popRing(cmd))
+        return true;
+
+    // the ring was full when these were pushed, so they come after the ones in the ring
+    if(m_overflow_index == m_overflow_drain.size() &&
+       m_has_overflow.load(std::memory_order_acquire)){
+        std::lock_guard<std::mutex> lock(m_overflow_lock);
+
+        m_overflow_drain.clear();
+        m_overflow_drain.swap(m_overflow);
+        m_overflow_index = 0;
+        m_overflow_count += m_overflow_drain.size();
+        m_has_overflow.store(false, std::memory_order_relaxed);
+    }
+
+    if(m_overflow_index < m_overflow_drain.size()){
+        cmd = m_overflow_drain.at(m_overflow_index++);
+        return true;
+    }
+    return false;
+}
+
+
+bool CommandQueue::inArena(const void* payload) const{
+    const unsigned char* ptr = static_cast<const unsigned char*>(payload);
+
+    return ptr >= m_arena.get() && ptr < m_arena.get() + COMMAND_ARENA_SIZE;
+}
+
+
+void* CommandQueue::reserve(std::size_t bytes){
+    std::size_t offset = m_arena_offset.fetch_add(bytes, std::memory_order_relaxed);
+
+    if(offset + bytes > COMMAND_ARENA_SIZE)
+        return nullptr;
+    return m_arena.get() + offset;
+}
+
+
+void CommandQueue::resetArena(){
+    if(m_overflow_count || m_heap_payloads){
+        log("CommandQueue::resetArena: ", m_overflow_count, " commands didn't fit in the ring and ",
+            m_heap_payloads, " payloads didn't fit in the arena");
+        std::cerr << "CommandQueue::resetArena: " << m_overflow_count
+                  << " commands didn't fit in the ring and " << m_heap_payloads
+                  << " payloads didn't fit in the arena" << std::endl;
+        m_overflow_count = 0;
+        m_heap_payloads = 0;
+    }
+
+    m_arena_offset.store(0, std::memory_order_relaxed);
+}
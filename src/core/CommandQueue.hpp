@@ -0,0 +1,125 @@
+#ifndef COMMAND_QUEUE_HPP
+#define COMMAND_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+#include "buffers.hpp"
+
+
+/* number of commands of the ring, has to be a power of two */
+#define COMMAND_RING_SIZE 16384
+/* size of the arena of the payloads in bytes, reset after every processCommandBuffers */
+#define COMMAND_ARENA_SIZE 262144
+/* the payloads in the arena are aligned to this */
+#define COMMAND_ARENA_ALIGN 16
+
+
+/*
+ * Bounded lock-free multi-producer/single-consumer queue of command records, it replaces the
+ * command buffers (one std::vector per message) of the AssetManager. The ring is the one by
+ * Dmitry Vyukov: every slot has a sequence number, the producers claim a position with a CAS and
+ * publish the slot by writing its sequence, so any number of threads can push commands while the
+ * vessels are updated. The commands that own an object (constraints, vessels and subtrees) keep
+ * it in an arena that is reset once all the commands have been applied, so nothing grows or gets
+ * allocated per command in the common case.
+ *
+ * If the ring is full the commands go to an overflow vector protected by a lock, if the arena is
+ * full the payloads are allocated in the heap, so pushing never fails. Both cases are slow paths
+ * and are logged by the consumer.
+ *
+ * The consumer (AssetManager::processCommandBuffers) has to run while no thread is pushing,
+ * resetArena invalidates the payloads that have not been taken.
+ */
+
+class CommandQueue{
+    private:
+        struct slot{
+            std::atomic<std::size_t> sequence;
+            command cmd;
+        };
+
+        std::unique_ptr<slot[]> m_ring;
+        std::atomic<std::size_t> m_enqueue_pos;
+        std::size_t m_dequeue_pos;
+
+        std::unique_ptr<unsigned char[]> m_arena;
+        std::atomic<std::size_t> m_arena_offset;
+
+        /* slow path, see push */
+        std::mutex m_overflow_lock;
+        std::vector<command> m_overflow;
+        std::vector<command> m_overflow_drain; // only accessed by the consumer
+        std::atomic<bool> m_has_overflow;
+        std::size_t m_overflow_index;
+        long m_overflow_count, m_heap_payloads;
+
+        /*
+         * Tries to push the command to the ring, returns false if it's full.
+         */
+        bool pushRing(const command& cmd);
+
+        /*
+         * Tries to pop a command from the ring, returns false if it's empty.
+         */
+        bool popRing(command& cmd);
+
+        /*
+         * Returns true if the payload was allocated in the arena.
+         */
+        bool inArena(const void* payload) const;
+
+        /*
+         * Reserves bytes in the arena, returns nullptr if it's full. Thread safe.
+         */
+        void* reserve(std::size_t bytes);
+    public:
+        CommandQueue();
+        ~CommandQueue();
+
+        /*
+         * Pushes a command, thread safe and lock-free unless the ring is full.
+         *
+         * @cmd: the command, copied to the ring.
+         */
+        void push(const command& cmd);
+
+        /*
+         * Pops the oldest command, should only be called by the consumer.
+         *
+         * @cmd: returns the command.
+         * Returns false if there are no commands left.
+         */
+        bool pop(command& cmd);
+
+        /*
+         * Constructs a payload in the arena (or in the heap if the arena is full) by moving the
+         * given object, the returned pointer should be stored in command::payload. Thread safe.
+         *
+         * @object: rvalue reference to the object, e.g. a unique_ptr or a shared_ptr.
+         * Returns a pointer to the payload.
+         */
+        template<typename T> void* allocate(T&& object);
+
+        /*
+         * Moves the payload out of a command and destroys what's left of it, should only be
+         * called by the consumer and only once per command.
+         *
+         * @cmd: the command, its payload has to be of type T.
+         * Returns the object.
+         */
+        template<typename T> T take(command& cmd);
+
+        /*
+         * Resets the arena, all the payloads should have been taken. Should only be called by the
+         * consumer, while nobody pushes. It also logs the slow paths taken since the last reset.
+         */
+        void resetArena();
+};
+
+#include "CommandQueue.tpp"
+
+#endif
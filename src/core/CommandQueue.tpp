@@ -0,0 +1,32 @@
+#include <new>
+#include <utility>
+#include <type_traits>
+
+
+template<typename T> void* CommandQueue::allocate(T&& object){
+    typedef typename std::remove_reference<T>::type payload_type;
+    std::size_t bytes = (sizeof(payload_type) + COMMAND_ARENA_ALIGN - 1) &
+                        ~(std::size_t)(COMMAND_ARENA_ALIGN - 1);
+    void* memory = reserve(bytes);
+
+    if(memory)
+        return new(memory) payload_type(std::move(object));
+    return new payload_type(std::move(object));
+}
+
+
+template<typename T> T CommandQueue::take(command& cmd){
+    T* payload = static_cast<T*>(cmd.payload);
+    T object(std::move(*payload));
+
+    if(inArena(payload)){
+        payload->~T();
+    }
+    else{
+        delete payload;
+        m_heap_payloads++;
+    }
+    cmd.payload = nullptr;
+
+    return object;
+}
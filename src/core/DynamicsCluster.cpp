@@ -0,0 +1,67 @@
+#define BT_USE_DOUBLE_PRECISION
+#include <bullet/BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+
+#include "DynamicsCluster.hpp"
+#include "Physics.hpp"
+
+
+DynamicsCluster::DynamicsCluster(const btVector3& gravity, bool part_filter, bool multibody){
+    m_collision_configuration.reset(new btDefaultCollisionConfiguration());
+    m_dispatcher.reset(new btCollisionDispatcher(m_collision_configuration.get()));
+    m_overlapping_pair_cache.reset(new btDbvtBroadphase());
+    if(multibody){
+        btMultiBodyConstraintSolver* solver = new btMultiBodyConstraintSolver;
+
+        m_solver.reset(solver);
+        m_dynamics_world.reset(new btMultiBodyDynamicsWorld(m_dispatcher.get(),
+                                                            m_overlapping_pair_cache.get(),
+                                                            solver,
+                                                            m_collision_configuration.get()));
+    }
+    else{
+        m_solver.reset(new btSequentialImpulseConstraintSolver);
+        m_dynamics_world.reset(new btDiscreteDynamicsWorld(m_dispatcher.get(),
+                                                           m_overlapping_pair_cache.get(),
+                                                           m_solver.get(),
+                                                           m_collision_configuration.get()));
+    }
+    btGImpactCollisionAlgorithm::registerAlgorithm(m_dispatcher.get());
+
+    m_overlap_filter.reset(new part_overlap_filter());
+    m_overlap_filter->enabled = part_filter;
+    m_dynamics_world->getPairCache()->setOverlapFilterCallback(m_overlap_filter.get());
+
+    m_dynamics_world->setGravity(gravity);
+}
+
+
+DynamicsCluster::~DynamicsCluster(){
+    m_dynamics_world.reset(nullptr);
+    m_solver.reset(nullptr);
+    m_overlapping_pair_cache.reset(nullptr);
+    m_dispatcher.reset(nullptr);
+    m_collision_configuration.reset(nullptr);
+    m_overlap_filter.reset(nullptr);
+}
+
+
+const btDiscreteDynamicsWorld* DynamicsCluster::getDynamicsWorld() const{
+    return m_dynamics_world.get();
+}
+
+
+btDiscreteDynamicsWorld* DynamicsCluster::getDynamicsWorld(){
+    return m_dynamics_world.get();
+}
+
+
+part_overlap_filter* DynamicsCluster::getOverlapFilter(){
+    return m_overlap_filter.get();
+}
+
+
+bool DynamicsCluster::isEmpty() const{
+    return m_dynamics_world->getNumCollisionObjects() == 0;
+}
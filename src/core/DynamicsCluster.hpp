@@ -0,0 +1,57 @@
+#ifndef DYNAMICS_CLUSTER_HPP
+#define DYNAMICS_CLUSTER_HPP
+
+#include <memory>
+
+#define BT_USE_DOUBLE_PRECISION
+#include <bullet/btBulletDynamicsCommon.h>
+
+
+struct part_overlap_filter;
+
+/*
+ * Independent Bullet world that simulates a group of vessels that are far away from everything
+ * else, see Physics::updateClusters. Each cluster has its own broadphase, dispatcher and solver,
+ * so different clusters can be stepped concurrently. Clusters are never destroyed by Physics, an
+ * empty cluster is reused by the next group of vessels that needs one. The overlap filter is
+ * owned by the cluster too, its counter is written while the world is stepped.
+ */
+
+class DynamicsCluster{
+    private:
+        std::unique_ptr<btDefaultCollisionConfiguration> m_collision_configuration;
+        std::unique_ptr<btCollisionDispatcher> m_dispatcher;
+        std::unique_ptr<btBroadphaseInterface> m_overlapping_pair_cache;
+        std::unique_ptr<btSequentialImpulseConstraintSolver> m_solver;
+        std::unique_ptr<btDiscreteDynamicsWorld> m_dynamics_world;
+        std::unique_ptr<part_overlap_filter> m_overlap_filter;
+    public:
+        /*
+         * Constructor.
+         *
+         * @gravity: gravity of the world, should be the same as the gravity of the main world.
+         * @part_filter: initial state of the part filter, see Physics::setPartCollisionFilter.
+         * @multibody: if true the world is a btMultiBodyDynamicsWorld, like the main world.
+         */
+        DynamicsCluster(const btVector3& gravity, bool part_filter, bool multibody);
+        ~DynamicsCluster();
+
+        /*
+         * Methods to get a pointer to the dynamics world of the cluster.
+         */
+        const btDiscreteDynamicsWorld* getDynamicsWorld() const;
+        btDiscreteDynamicsWorld* getDynamicsWorld();
+
+        /*
+         * Returns a pointer to the broadphase filter of the cluster.
+         */
+        part_overlap_filter* getOverlapFilter();
+
+        /*
+         * Returns true if there's no collision object in the world.
+         */
+        bool isEmpty() const;
+};
+
+
+#endif
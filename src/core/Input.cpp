@@ -20,6 +20,34 @@ Input::Input(){
 Input::~Input(){}
 
 
+void Input::getState(input_state& state) const{
+    std::memcpy(state.pressed_keys, pressed_keys, (GLFW_KEY_LAST + 1));
+    std::memcpy(state.pressed_mbuttons, pressed_mbuttons, (GLFW_MOUSE_BUTTON_LAST + 1));
+    state.mouse_posx = m_mouse_posx;
+    state.mouse_posy = m_mouse_posy;
+    state.mouse_posx_prev = m_mouse_posx_prev;
+    state.mouse_posy_prev = m_mouse_posy_prev;
+    state.xoffset = m_xoffset;
+    state.yoffset = m_yoffset;
+    state.mouse_moved = m_mouse_moved;
+    state.keys_pressed = m_keys_pressed;
+}
+
+
+void Input::setState(const input_state& state){
+    std::memcpy(pressed_keys, state.pressed_keys, (GLFW_KEY_LAST + 1));
+    std::memcpy(pressed_mbuttons, state.pressed_mbuttons, (GLFW_MOUSE_BUTTON_LAST + 1));
+    m_mouse_posx = state.mouse_posx;
+    m_mouse_posy = state.mouse_posy;
+    m_mouse_posx_prev = state.mouse_posx_prev;
+    m_mouse_posy_prev = state.mouse_posy_prev;
+    m_xoffset = state.xoffset;
+    m_yoffset = state.yoffset;
+    m_mouse_moved = state.mouse_moved;
+    m_keys_pressed = state.keys_pressed;
+}
+
+
 void Input::onKeyboardInput(int key, int scancode, int action, int mods){
     UNUSED(scancode);
     UNUSED(mods);
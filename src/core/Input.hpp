@@ -16,6 +16,21 @@
 #define INPUT_KEY_RELEASE   0x08
 
 
+/*
+ * Complete state of the Input class, used to record and replay the input of the simulation (see
+ * Recorder).
+ */
+struct input_state{
+    char pressed_keys[GLFW_KEY_LAST + 1];
+    char pressed_mbuttons[GLFW_MOUSE_BUTTON_LAST + 1];
+    double mouse_posx, mouse_posy;
+    double mouse_posx_prev, mouse_posy_prev;
+    double xoffset, yoffset;
+    bool mouse_moved;
+    std::vector<int> keys_pressed;
+};
+
+
 /*
  * Class used to manage the input as an interface to glfw. 
  */
@@ -66,6 +81,15 @@ class Input{
          */
         void getScroll(double& xoffset, double& yoffset) const;
 
+        /*
+         * Copies the state of the input to the given struct, or overwrites it with the given one.
+         * The state should be set after polling the events, so the live input is discarded.
+         *
+         * @state: input state.
+         */
+        void getState(input_state& state) const;
+        void setState(const input_state& state);
+
         /*
          * These functions are called by the windows handler's input callback functions.
          */
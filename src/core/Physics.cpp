@@ -1,7 +1,20 @@
 #include <mutex>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <omp.h>
 
 #define BT_USE_DOUBLE_PRECISION
 #include <bullet/BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
+#include <bullet/BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
+#include <bullet/LinearMath/btThreads.h>
 
 #include "Physics.hpp"
 #include "BaseApp.hpp"
@@ -9,9 +22,14 @@
 #include "log.hpp"
 #include "multithreading.hpp"
 #include "timing.hpp"
+#include "gravity.hpp"
 #include "RenderContext.hpp"
+#include "Predictor.hpp"
+#include "Player.hpp"
+#include "DynamicsCluster.hpp"
 #include "../GUI/DebugOverlay.hpp"
 #include "../assets/Object.hpp"
+#include "../assets/Kinematic.hpp"
 #include "../assets/PlanetarySystem.hpp"
 #include "../assets/Planet.hpp"
 #include "../assets/Vessel.hpp"
@@ -22,19 +40,117 @@ Physics::Physics(){
 }
 
 Physics::Physics(BaseApp* app){
-    m_thread_monitor = app->getThreadMonitor();
     m_app = app;
-    m_delta_t = REAL_TIME_S;
+    m_delta_t = 1.0 / DEFAULT_PHYSICS_RATE;
     m_secs_since_j2000 = 0.0;
+    m_gravity_aggregation = false;
+    m_tidal_threshold = DEFAULT_TIDAL_THRESHOLD;
+    m_gravity_aggregated_vessels = 0;
+    m_gravity_aggregation_error = 0.0;
+    m_aggregation_check_ticks = 0;
+    m_gravity_culling = false;
+    m_cull_threshold = DEFAULT_GRAVITY_CULL_THRESHOLD;
+    m_sets_threshold = DEFAULT_GRAVITY_CULL_THRESHOLD;
+    m_gravity_tick = 0;
+    m_gravity_cull_error = 0.0;
+    m_gravity_evaluations = 0;
+    m_time_warp = 1.0;
+    m_requested_warp = 1.0;
+    m_vessels_on_rails = 0;
+    m_packed_vessels = 0;
+    m_residency_focus = btVector3(0.0, 0.0, 0.0);
+    m_requested_focus = m_residency_focus;
+    m_residency = true;
+    m_residency_ticks = 0;
+    m_physics_warp = 1;
+    m_physics_substeps = 1;
+    m_state_time = sch_now();
+    m_physics_rate = DEFAULT_PHYSICS_RATE;
+    m_requested_rate = DEFAULT_PHYSICS_RATE;
+    m_due_ticks = 0;
+    m_frame_sub_ticks = 0;
+    m_frame_delta_t = 0.0;
+    m_sync_due_ticks = 0;
+    m_sync_sub_ticks = 0;
+    m_sync_delta_t = 0.0;
+    m_logic_sync = true; // until the first frame of the logic thread is ready
+    m_physics_busy = false;
+    m_frame_requested = false;
+    m_lockstep = false;
+    m_replay_due_ticks = -1;
+    m_replay_sub_ticks = -1;
+    m_world_origin = btVector3(0.0, 0.0, 0.0);
+    m_world_clusters = true;
+    m_debug_drawer = nullptr;
+    m_vessel_bodies = VESSEL_BODIES_PARTS;
+    m_multibody_world = false;
+    m_part_filter = true;
+    m_requested_part_filter = true;
+    m_proxy_creations = 0;
+    m_bullet_multithreaded = false;
+    m_bullet_threads = omp_get_max_threads();
+    m_requested_threads = m_bullet_threads.load();
+    m_acc_bullet_time = 0.0;
+    m_acc_bullet_ticks = 0;
+    m_ephemeris_snapshot.reset(new ephemeris_snapshot);
+    m_ephemeris_time = 0.0;
+    m_end_ephemeris = false;
 }
 
 
-void Physics::initDynamicsWorld(const btVector3& gravity){
+void Physics::initDynamicsWorld(const btVector3& gravity, bool multithreaded, bool multibody){
+    btITaskScheduler* scheduler = nullptr;
+
+    if(multithreaded){
+        scheduler = btGetOpenMPTaskScheduler();
+
+        if(!scheduler){
+            log("Physics::initDynamicsWorld: Bullet was built without OpenMP support "
+                "(BULLET2_USE_OPEN_MP_MULTITHREADING), using the sequential world");
+            std::cerr << "Physics::initDynamicsWorld: Bullet was built without OpenMP support "
+                         "(BULLET2_USE_OPEN_MP_MULTITHREADING), using the sequential world"
+                      << std::endl;
+        }
+    }
+
     m_collision_configuration.reset(new btDefaultCollisionConfiguration());
-    m_dispatcher.reset(new btCollisionDispatcher(m_collision_configuration.get()));
     m_overlapping_pair_cache.reset(new btDbvtBroadphase());
-    m_solver.reset(new btSequentialImpulseConstraintSolver);
-    m_dynamics_world.reset(new btDiscreteDynamicsWorld(m_dispatcher.get(), m_overlapping_pair_cache.get(), m_solver.get(), m_collision_configuration.get()));
+
+    if(scheduler){
+        btSetTaskScheduler(scheduler);
+        m_dispatcher.reset(new btCollisionDispatcherMt(m_collision_configuration.get()));
+        m_solver_pool.reset(new btConstraintSolverPoolMt(scheduler->getMaxNumThreads()));
+        // solves big islands (vessels with many parts) in parallel
+        m_solver.reset(new btSequentialImpulseConstraintSolverMt);
+        m_dynamics_world.reset(new btDiscreteDynamicsWorldMt(m_dispatcher.get(),
+                                                             m_overlapping_pair_cache.get(),
+                                                             m_solver_pool.get(), m_solver.get(),
+                                                             m_collision_configuration.get()));
+        m_bullet_multithreaded = true;
+        m_bullet_threads = scheduler->getNumThreads();
+        m_requested_threads = m_bullet_threads.load();
+
+        log("Physics::initDynamicsWorld: multithreaded world, task scheduler ",
+            scheduler->getName(), " with ", m_bullet_threads.load(), " threads");
+    }
+    else if(multibody){
+        btMultiBodyConstraintSolver* solver = new btMultiBodyConstraintSolver;
+
+        m_dispatcher.reset(new btCollisionDispatcher(m_collision_configuration.get()));
+        m_solver.reset(solver);
+        m_dynamics_world.reset(new btMultiBodyDynamicsWorld(m_dispatcher.get(),
+                                                            m_overlapping_pair_cache.get(),
+                                                            solver,
+                                                            m_collision_configuration.get()));
+        m_multibody_world = true;
+
+        log("Physics::initDynamicsWorld: multibody world, vessels can be articulated");
+    }
+    else{
+        m_dispatcher.reset(new btCollisionDispatcher(m_collision_configuration.get()));
+        m_solver.reset(new btSequentialImpulseConstraintSolver);
+        m_dynamics_world.reset(new btDiscreteDynamicsWorld(m_dispatcher.get(), m_overlapping_pair_cache.get(), m_solver.get(), m_collision_configuration.get()));
+    }
     btGImpactCollisionAlgorithm::registerAlgorithm(m_dispatcher.get());
 
     m_simulation_paused = true;
@@ -43,16 +159,18 @@ void Physics::initDynamicsWorld(const btVector3& gravity){
     log("Physics::initDynamicsWorld: starting dynamics world");
     std::cout << "Physics::initDynamicsWorld: starting dynamics world" << std::endl;
 
-    //btOverlapFilterCallback*filtercbk=new myFilterCallback();
-    //m_dynamics_world->getPairCache()->setOverlapFilterCallback(filtercbk);
-    
+    m_overlap_filter.enabled = m_part_filter;
+    m_dynamics_world->getPairCache()->setOverlapFilterCallback(&m_overlap_filter);
+
     m_dynamics_world->setGravity(gravity);
 }
 
 
 Physics::~Physics(){
+    m_clusters.clear();
     m_dynamics_world.reset(nullptr);
     m_solver.reset(nullptr);
+    m_solver_pool.reset(nullptr);
     m_overlapping_pair_cache.reset(nullptr);
     m_dispatcher.reset(nullptr);
     m_collision_configuration.reset(nullptr);
@@ -60,58 +178,123 @@ Physics::~Physics(){
 
 
 void Physics::addRigidBody(btRigidBody* body, short group, short mask){
-    m_dynamics_world->addRigidBody(body, group, mask);
+    getBodyWorld(body)->addRigidBody(body, group, mask);
+    m_proxy_creations++;
 }
 
 
 void Physics::removeBody(btRigidBody* body){
+    std::vector<external_force>::iterator it;
+
+    // a one-shot force may wait for the next tick
+    for(it = m_one_shot_forces.begin(); it != m_one_shot_forces.end();){
+        if(it->body == body)
+            it = m_one_shot_forces.erase(it);
+        else
+            it++;
+    }
+
     // this leaks vvvv, not sure why
-    m_dynamics_world->removeRigidBody(body);  // the instance of the object still has to be deleted
+    getBodyWorld(body)->removeRigidBody(body);  // the instance of the object still has to be deleted
 }
 
 
-Object* Physics::testRay(const math::vec3& ray_start_world, const math::vec3& ray_end_world) const{
-    btCollisionWorld::ClosestRayResultCallback ray_callback(
-            btVector3(ray_start_world.v[0], ray_start_world.v[1], ray_start_world.v[2]),
-            btVector3(ray_end_world.v[0], ray_end_world.v[1], ray_end_world.v[2]));
-    m_dynamics_world->rayTest(
-            btVector3(ray_start_world.v[0], ray_start_world.v[1], ray_start_world.v[2]), 
-            btVector3(ray_end_world.v[0], ray_end_world.v[1], ray_end_world.v[2]),
-            ray_callback);
+void Physics::updateMassProps(btRigidBody* body, double mass, short group, short mask){
+    const btBroadphaseProxy* proxy = body->getBroadphaseProxy(); // nullptr if not in the world
+    bool was_static = body->isStaticOrKinematicObject();
+    btVector3 inertia;
 
-    if(ray_callback.hasHit()) {
-        Object* obj = static_cast<Object*>(ray_callback.m_collisionObject->getUserPointer());
-        return obj;
-    }else{
-        return nullptr;
+    if(body->getInvMass() != 0.0 && mass != 0.0)
+        inertia = body->getLocalInertia() * (mass * body->getInvMass());
+    else
+        body->getCollisionShape()->calculateLocalInertia(mass, inertia);
+
+    body->setMassProps(mass, inertia);
+    body->updateInertiaTensor();
+
+    // the world keeps a list of the dynamic bodies, and the proxy has the group and the mask
+    if(proxy && (was_static != body->isStaticOrKinematicObject() ||
+                 proxy->m_collisionFilterGroup != group || proxy->m_collisionFilterMask != mask)){
+        removeBody(body);
+        addRigidBody(body, group, mask);
     }
 }
 
 
+long Physics::getProxyCreations() const{
+    return m_proxy_creations;
+}
+
+
+static Object* ray_hit_object(const btCollisionWorld::ClosestRayResultCallback& ray_callback){
+    Object* obj = static_cast<Object*>(ray_callback.m_collisionObject->getUserPointer());
+
+    // the user pointer of the body of a rigid vessel is its root
+    if(obj && obj->m_body.get() != ray_callback.m_collisionObject &&
+       static_cast<BasePart*>(obj)->getVessel()->isRigid())
+        return static_cast<BasePart*>(obj)->getVessel()->getRigidPart(ray_callback.m_hitPointWorld);
+    return obj;
+}
+
+
+Object* Physics::testRay(const math::vec3& ray_start_world, const math::vec3& ray_end_world) const{
+    btVector3 ray_start(ray_start_world.v[0], ray_start_world.v[1], ray_start_world.v[2]);
+    btVector3 ray_end(ray_end_world.v[0], ray_end_world.v[1], ray_end_world.v[2]);
+    btCollisionWorld::ClosestRayResultCallback ray_callback(ray_start, ray_end);
+
+    return testRay(ray_callback, ray_start, ray_end);
+}
+
+
 Object* Physics::testRay(btCollisionWorld::ClosestRayResultCallback& ray_callback, const btVector3& ray_start, const btVector3& ray_end) const{
+    std::lock_guard<std::mutex> lock(m_clusters_lock);
+
+    // the callback only takes hits closer than the ones it already has
     m_dynamics_world->rayTest(ray_start, ray_end, ray_callback);
+    for(uint i=0; i < m_clusters.size(); i++)
+        m_clusters.at(i)->getDynamicsWorld()->rayTest(ray_start, ray_end, ray_callback);
 
     if(ray_callback.hasHit()) {
-        Object* obj = static_cast<Object*>(ray_callback.m_collisionObject->getUserPointer());
-        return obj;
+        return ray_hit_object(ray_callback);
     }else{
         return nullptr;
     }
 }
 
 
+void Physics::setDebugDrawer(btIDebugDraw* drawer){
+    std::lock_guard<std::mutex> lock(m_clusters_lock);
+
+    m_debug_drawer = drawer;
+    m_dynamics_world->setDebugDrawer(drawer);
+    for(uint i=0; i < m_clusters.size(); i++)
+        m_clusters.at(i)->getDynamicsWorld()->setDebugDrawer(drawer);
+}
+
+
+void Physics::debugDrawWorlds(){
+    std::lock_guard<std::mutex> lock(m_clusters_lock);
+
+    m_dynamics_world->debugDrawWorld();
+    for(uint i=0; i < m_clusters.size(); i++)
+        m_clusters.at(i)->getDynamicsWorld()->debugDrawWorld();
+}
+
+
 void Physics::addConstraint(btTypedConstraint *constraint, bool disable_collision_between_bodies){
-    m_dynamics_world->addConstraint(constraint, disable_collision_between_bodies);
+    // both bodies are always in the same world
+    getBodyWorld(&constraint->getRigidBodyA())->addConstraint(constraint,
+                                                              disable_collision_between_bodies);
 }
 
 
 void Physics::removeConstraint(btTypedConstraint *constraint){
-    m_dynamics_world->removeConstraint(constraint);
+    getBodyWorld(&constraint->getRigidBodyA())->removeConstraint(constraint);
 }
 
 
 void Physics::updateCollisionWorldSingleAABB(btRigidBody* body){
-    m_dynamics_world->getCollisionWorld()->updateSingleAabb(body);
+    getBodyWorld(body)->getCollisionWorld()->updateSingleAabb(body);
 }
 
 
@@ -120,19 +303,28 @@ void Physics::startSimulation(int max_sub_steps){
     double cents_since_j2000 = m_secs_since_j2000 / SECONDS_IN_A_CENTURY;
     m_app->getAssetManager()->m_planetary_system->updateOrbitalElements(cents_since_j2000);
 
+    m_end_ephemeris = false;
+    m_thread_ephemeris = std::thread(&Physics::runEphemeris, this);
     m_thread_simulation = std::thread(&Physics::runSimulation, this, max_sub_steps);
     log("Physics::startSimulation: starting simulation, thread launched");
 }
 
 
 void Physics::stopSimulation(){
-    m_end_simulation = true;
     {
-        std::unique_lock<std::mutex> lck2(m_thread_monitor->mtx_start);
-        m_thread_monitor->worker_start = true;
-        m_thread_monitor->cv_start.notify_all();
+        std::unique_lock<std::mutex> lck(m_sync_lock);
+        m_end_simulation = true;
+        m_sync_cv.notify_all();
     }
     m_thread_simulation.join();
+
+    m_end_ephemeris = true;
+    {
+        std::unique_lock<std::mutex> lck2(m_ephemeris_monitor.mtx_start);
+        m_ephemeris_monitor.worker_start = true;
+        m_ephemeris_monitor.cv_start.notify_all();
+    }
+    m_thread_ephemeris.join();
     log("Physics::stopSimulation: simulation stopped, thread joined");
 }
 
@@ -142,62 +334,333 @@ void Physics::pauseSimulation(bool stop_simulation){
 }
 
 
-void Physics::noticeLogic(){
-    // logic thread notice
-    std::unique_lock<std::mutex> lck2(m_thread_monitor->mtx_end);
-    m_thread_monitor->worker_ended = true;
-    m_thread_monitor->cv_end.notify_all();
+void Physics::waitSimulation(){
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+
+    m_logic_sync = true;
+    while(m_physics_busy || m_frame_requested)
+        m_sync_cv.wait(lck);
+
+    m_due_ticks = m_sync_due_ticks;
+    m_frame_sub_ticks = m_sync_sub_ticks;
+    m_frame_delta_t = m_sync_delta_t;
+    m_sync_due_ticks = 0;
+    m_sync_sub_ticks = 0;
+    m_sync_delta_t = 0.0;
+}
+
+
+void Physics::wakeSimulation(){
+    // the physics thread is idle, nobody else touches the bodies
+    takeExternalForces();
+
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+    m_logic_sync = false;
+    m_frame_requested = m_lockstep || m_replay_due_ticks >= 0;
+    m_sync_cv.notify_all();
 }
 
 
-void Physics::waitLogic(){
-    // logic thread wait
-    std::unique_lock<std::mutex> lck(m_thread_monitor->mtx_start);
-    while(!m_thread_monitor->worker_start){
-        m_thread_monitor->cv_start.wait(lck);
+bool Physics::waitFrame(){
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+    const std::chrono::duration<double> tick(m_delta_t);
+    time_point next_tick = m_state_time + std::chrono::duration_cast<time_point::duration>(tick);
+
+    m_physics_busy = false;
+    m_sync_cv.notify_all();
+
+    while(!m_end_simulation){
+        bool lockstep = m_lockstep || m_replay_due_ticks >= 0;
+
+        if(lockstep && m_frame_requested)
+            break;
+        if(!lockstep && !m_logic_sync && (m_simulation_paused || sch_now() >= next_tick))
+            break;
+
+        if(lockstep || m_logic_sync)
+            m_sync_cv.wait(lck);
+        else if(m_simulation_paused)
+            m_sync_cv.wait_for(lck, tick);
+        else
+            m_sync_cv.wait_until(lck, next_tick);
     }
-    m_thread_monitor->worker_start = false;
+
+    m_frame_requested = false;
+    m_residency_focus = m_requested_focus;
+    m_physics_busy = !m_end_simulation;
+    return !m_end_simulation;
 }
 
 
 void Physics::runSimulation(int max_sub_steps){
     physics_timing timing;
+
+    applyBulletThreads();
+    {
+        // the first frame of the logic thread (the commands of the launch...) goes first
+        std::unique_lock<std::mutex> lck(m_sync_lock);
+        while(m_logic_sync && !m_end_simulation)
+            m_sync_cv.wait(lck);
+    }
+    m_state_time = sch_now();
+    while(waitFrame())
+        runFrame(max_sub_steps, timing);
+}
+
+
+void Physics::runFrame(int max_sub_steps, physics_timing& timing){
     double cents_since_j2000;
+    int due_ticks;
+    bool residency_check;
+#ifndef HEADLESS
+    int broadphase_pairs;
+    long rejected_pairs;
     DebugOverlay* debug_overlay = m_app->getRenderContext()->getDebugOverlay();
+#endif
     PlanetarySystem* planetary_system = m_app->getAssetManager()->m_planetary_system.get();
 
-    waitLogic();
-    while(!m_end_simulation){
-        timing.register_tp(TP_PHYSICS_START);
-        cents_since_j2000 = m_secs_since_j2000 / SECONDS_IN_A_CENTURY;
+    timing.register_tp(TP_PHYSICS_START);
+    if(m_requested_threads != m_bullet_threads)
+        applyBulletThreads();
+    if(m_requested_part_filter != m_part_filter)
+        applyPartFilter();
+    if(m_requested_rate != m_physics_rate){
+        double rate = m_requested_rate;
+
+        m_physics_rate = rate;
+        m_delta_t = 1.0 / rate;
+    }
+
+    cents_since_j2000 = m_secs_since_j2000 / SECONDS_IN_A_CENTURY;
 
-        if(!m_simulation_paused){
-            /* updating the orbital elements could be done in a different thread while the thigs
-               below are updating, a buffering system could be used 
+    due_ticks = 0;
+    m_physics_substeps = 0;
+    if(m_simulation_paused){
+        m_state_time = sch_now();
+    }
+    else if((due_ticks = advanceStateTime())){
+        /* the ephemeris worker computes the positions of the planets at the start time of this
+           tick while we apply gravity and step bullet. Gravity uses the snapshot published in
+           the previous tick (its start time), so the planets lag one tick behind the vessels.
+           The new snapshot is published before updating the kinematics, so they always follow
+           the planets */
+        wakeEphemeris(cents_since_j2000);
+
+        /* the vessels on rails are placed at the start time of the tick, like the planets.
+           When warping every vessel is on rails so there's nothing for bullet to do. The
+           packed vessels are far away, they are only moved when the residency is checked */
+        updateRails();
+        residency_check = m_time_warp == 1.0 && ++m_residency_ticks >= RESIDENCY_CHECK_TICKS;
+        propagateRails(m_secs_since_j2000, m_time_warp > 1.0 || residency_check);
+        if(residency_check){
+            updateResidency();
+            m_residency_ticks = 0;
+        }
+        countRailsVessels();
 
-               and the same for the kinematics :)
-               */
+        if(m_time_warp == 1.0){
+            updateVesselBodies();
+            updateClusters();
+            m_physics_substeps = stepSubTicks(max_sub_steps, timing, due_ticks);
+            timing.register_tp(TP_BULLET_END);
 
-            // WARNING! THE ORDER OF THESE UPDATES IS IMPORTANT, WE NEED TO REVISE THEM
-            applyGravity();
+            m_acc_bullet_time += duration(timing.end_bullet - timing.end_gravity).count();
+            m_acc_bullet_ticks++;
+            if(m_acc_bullet_ticks == BULLET_THREAD_STATS_TICKS){
+#ifndef HEADLESS
+                debug_overlay->setBulletThreadTime(m_bullet_threads,
+                                                   m_acc_bullet_time / m_acc_bullet_ticks /
+                                                   1000.0);
+#endif
+                m_acc_bullet_time = 0.0;
+                m_acc_bullet_ticks = 0;
+            }
+        }
+        else{
+            m_physics_substeps = due_ticks;
             timing.register_tp(TP_GRAV_END);
-            m_dynamics_world->stepSimulation(m_delta_t, max_sub_steps);
             timing.register_tp(TP_BULLET_END);
-            planetary_system->updateOrbitalElements(cents_since_j2000);
-            timing.register_tp(TP_ORBIT_END);
-            planetary_system->updateKinematics();
+        }
+        waitEphemeris();
+        planetary_system->publishEphemeris(*m_ephemeris_snapshot.get());
+        timing.register_tp(TP_ORBIT_END);
+        planetary_system->updateKinematics(m_world_origin);
+
+        m_secs_since_j2000 = m_secs_since_j2000 + m_delta_t * m_physics_substeps * m_time_warp;
+        m_sync_delta_t += m_delta_t * m_physics_substeps * m_time_warp;
+    }
+    // otherwise the logic thread is ahead of the physics rate (lockstep), nothing to simulate
+    m_sync_due_ticks += due_ticks;
+    m_sync_sub_ticks += m_physics_substeps;
+
+    timing.register_tp(TP_PHYSICS_END);
+    timing.update(m_simulation_paused);
+    m_timing = timing;
+#ifndef HEADLESS
+    debug_overlay->setPhysicsTimes(timing);
+    debug_overlay->setGravityStats(m_gravity_targets.size(), m_gravity_sources.size(),
+                                   m_gravity_aggregated_vessels, gravity_kernel_name(),
+                                   m_gravity_evaluations, m_gravity_cull_error);
+    debug_overlay->setRailsStats(m_time_warp, m_vessels_on_rails, m_packed_vessels);
+    debug_overlay->setPhysicsWarpStats(m_physics_substeps, m_physics_warp);
+    debug_overlay->setClusterStats(m_step_worlds.size(), m_bullet_threads,
+                                   m_bullet_multithreaded);
+    countBroadphasePairs(broadphase_pairs, rejected_pairs);
+    debug_overlay->setBroadphaseStats(broadphase_pairs, rejected_pairs, m_part_filter,
+                                      m_proxy_creations);
+#endif
+}
+
+
+int Physics::stepSubTicks(int max_sub_steps, physics_timing& timing, int due_ticks){
+    time_point start = sch_now();
+    double budget = PHYSICS_WARP_BUDGET * due_ticks * m_delta_t * 1000000.0; // us
+    double last_sub_tick = 0.0;
+    int sub_ticks = 0, total_ticks = due_ticks * m_physics_warp;
+    bool replay = m_replay_sub_ticks >= 0;
+
+    if(replay)
+        total_ticks = std::min(total_ticks, m_replay_sub_ticks);
+
+    while(sub_ticks < total_ticks){
+        time_point sub_tick_start = sch_now();
+
+        // assume the next sub-tick takes as long as the last one
+        if(sub_ticks > 0 && !replay &&
+           duration(sub_tick_start - start).count() + last_sub_tick > budget)
+            break;
+
+        applyExternalForces();
+        if(sub_ticks == 0)
+            applyOneShotForces();
+        applyGravity();
+        applyVesselForces();
+        if(sub_ticks == 0)
+            timing.register_tp(TP_GRAV_END);
+        stepWorlds(max_sub_steps);
+        updateVesselParts();
+
+        last_sub_tick = duration(sch_now() - sub_tick_start).count();
+        sub_ticks++;
+    }
+
+    return sub_ticks;
+}
+
+
+void Physics::takeExternalForces(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    m_external_forces.clear();
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        const std::vector<BasePart*>& parts = it->second->getParts();
+        bool on_rails = it->second->isOnRails();
+
+        for(uint i=0; i < parts.size(); i++){
+            btRigidBody* body = parts.at(i)->m_body.get();
+
+            if(!body)
+                continue;
+
+            if(!on_rails && (!body->getTotalForce().isZero() || !body->getTotalTorque().isZero()))
+                m_external_forces.emplace_back(body, body->getTotalForce(),
+                                               body->getTotalTorque());
+            body->clearForces();
+        }
+    }
+}
 
 
-            m_secs_since_j2000 += m_delta_t;
+int Physics::advanceStateTime(){
+    const time_point now = sch_now();
+    const std::chrono::duration<double> tick(m_delta_t);
+    int due_ticks;
+
+    if(m_replay_due_ticks >= 0){
+        m_state_time += std::chrono::duration_cast<time_point::duration>(tick *
+                                                                         m_replay_due_ticks);
+        return m_replay_due_ticks;
+    }
+
+    if(now - m_state_time > tick * MAX_CATCH_UP_TICKS)
+        m_state_time = now - std::chrono::duration_cast<time_point::duration>(
+            tick * MAX_CATCH_UP_TICKS);
+
+    due_ticks = std::chrono::duration<double>(now - m_state_time).count() / m_delta_t;
+    m_state_time += std::chrono::duration_cast<time_point::duration>(tick * due_ticks);
+
+    return due_ticks;
+}
+
+
+void Physics::applyExternalForces(){
+    for(uint i=0; i < m_external_forces.size(); i++){
+        external_force& ext = m_external_forces.at(i);
+
+        ext.body->applyCentralForce(ext.force);
+        ext.body->applyTorque(ext.torque);
+    }
+}
+
+
+void Physics::applyOneShotForces(){
+    for(uint i=0; i < m_one_shot_forces.size(); i++){
+        external_force& ext = m_one_shot_forces.at(i);
+
+        ext.body->applyCentralForce(ext.force);
+        ext.body->applyTorque(ext.torque);
+    }
+    m_one_shot_forces.clear();
+}
+
+
+void Physics::addOneShotForce(btRigidBody* body, const btVector3& force,
+                              const btVector3& torque){
+    m_one_shot_forces.emplace_back(body, force, torque);
+}
+
+
+void Physics::runEphemeris(){
+    const PlanetarySystem* planetary_system = m_app->getAssetManager()->m_planetary_system.get();
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lck(m_ephemeris_monitor.mtx_start);
+            while(!m_ephemeris_monitor.worker_start){
+                m_ephemeris_monitor.cv_start.wait(lck);
+            }
+            m_ephemeris_monitor.worker_start = false;
         }
 
-        timing.register_tp(TP_PHYSICS_END);
-        timing.update(m_simulation_paused);
-        debug_overlay->setPhysicsTimes(timing);
+        if(m_end_ephemeris)
+            break;
+
+        planetary_system->computeEphemeris(m_ephemeris_time, *m_ephemeris_snapshot.get());
+
+        std::unique_lock<std::mutex> lck2(m_ephemeris_monitor.mtx_end);
+        m_ephemeris_monitor.worker_ended = true;
+        m_ephemeris_monitor.cv_end.notify_all();
+    }
+}
+
+
+void Physics::wakeEphemeris(double cent_since_j2000){
+    m_ephemeris_time = cent_since_j2000;
+
+    std::unique_lock<std::mutex> lck(m_ephemeris_monitor.mtx_start);
+    m_ephemeris_monitor.worker_start = true;
+    m_ephemeris_monitor.cv_start.notify_all();
+}
+
 
-        noticeLogic();
-        waitLogic();
+void Physics::waitEphemeris(){
+    std::unique_lock<std::mutex> lck(m_ephemeris_monitor.mtx_end);
+    while(!m_ephemeris_monitor.worker_ended){
+        m_ephemeris_monitor.cv_end.wait(lck);
     }
+    m_ephemeris_monitor.worker_ended = false;
 }
 
 
@@ -216,12 +679,25 @@ btDiscreteDynamicsWorld* Physics::getDynamicsWorld(){
 }
 
 
-void Physics::applyGravityStar(double star_mass, btRigidBody* rbody, 
-                               const btVector3& rbody_origin){
-    double Rh = rbody_origin.norm(); // star is in the center of the space
-    double acceleration = GRAVITATIONAL_CONSTANT * (star_mass / (Rh*Rh));
-    btVector3 f = (1 / rbody->getInvMass()) * (-rbody_origin).normalize() * acceleration;
-    rbody->applyCentralForce(f);
+btDiscreteDynamicsWorld* Physics::getBodyWorld(const btCollisionObject* body){
+    return getClusterWorld(getBodyCluster(body));
+}
+
+
+btDiscreteDynamicsWorld* Physics::getClusterWorld(int cluster){
+    if(cluster <= MAIN_CLUSTER || cluster > (int)m_clusters.size())
+        return m_dynamics_world.get();
+    return m_clusters.at(cluster - 1)->getDynamicsWorld();
+}
+
+
+int Physics::getBodyCluster(const btCollisionObject* body) const{
+    // the user index 2 of the new bodies is -1
+    int cluster = body->getUserIndex2();
+
+    if(cluster <= MAIN_CLUSTER || cluster > (int)m_clusters.size())
+        return MAIN_CLUSTER;
+    return cluster;
 }
 
 
@@ -233,11 +709,12 @@ void Physics::applyGravityStar(double star_mass, btRigidBody* rbody,
 
         https://scicomp.stackexchange.com/questions/29149/what-does-symplectic-mean-in-reference-to-numerical-integrators-and-does-scip
 
-    - this method might be critical to optimize, so much work can be done here
-    - one possible optimization can be to calculate the total force applied to the vessel by using the CoM + total vessel mass. Then we can propotionally apply the force
-    using the part's mass.
-    - the planet's origin is stored as dmath::vec3, should be btVector3 to avoid conversions.
-    - the gravity of the star is applied separately, which is weird but ok for single starts.
+    - optionally, the total force applied to the vessel can be calculated by using the CoM, then we propotionally apply the force using the part's mass (see
+      setGravityAggregation). We fall back to evaluating every part when the vessel is too big or too close to a planet.
+
+    The gravity is computed in three stages. First the sources (star + planets) and the bodies are packed into contiguous arrays (see core/gravity.hpp), then the
+    vectorized kernel computes the accelerations and finally the forces are scattered back to the rigid bodies. The star is just another source placed in the origin.
+    With the culling (setGravityCulling) each body has a cached set of sources, Neptune doesn't pull a rocket that sits on the earth.
 
     I've verified that when the vessel is close to the earth the acceleration is 1.2, which is not 1 but close enough, this is because the earth is moving while our
     object starts stationary. 1.2 is close enough though. The next steps will be to verify that the simulation works more or less, also I'll try to implement orbital
@@ -246,51 +723,1297 @@ void Physics::applyGravityStar(double star_mass, btRigidBody* rbody,
 void Physics::applyGravity(){
     AssetManager* asset_manager = m_app->getAssetManager();
     const planet_map& planets = asset_manager->m_planetary_system->getPlanets();
+    double star_mass = asset_manager->m_planetary_system->getStar().mass;
     planet_map::const_iterator it;
     VesselMap::iterator it2;
-    double star_mass = asset_manager->m_planetary_system->getStar().mass;
+    bool aggregation = m_gravity_aggregation, culling = m_gravity_culling;
+    double tidal_threshold = m_tidal_threshold;
+
+    // pack sources
+    // the sources are in absolute coordinates, the bodies in world coordinates
+    m_gravity_sources.clear();
+    m_gravity_sources.add(-m_world_origin.getX(), -m_world_origin.getY(), -m_world_origin.getZ(),
+                          GRAVITATIONAL_CONSTANT * star_mass);
+
+    for(it = planets.begin(); it != planets.end(); it++){
+        const orbital_data& data =  it->second->getOrbitalData();
+        m_gravity_sources.add(data.pos.v[0] - m_world_origin.getX(),
+                              data.pos.v[1] - m_world_origin.getY(),
+                              data.pos.v[2] - m_world_origin.getZ(),
+                              GRAVITATIONAL_CONSTANT * data.m,
+                              sphere_of_influence(data.a_0 * AU_TO_METERS, data.m, star_mass));
+    }
+
+    // pack bodies
+    m_gravity_bodies.clear();
+    m_gravity_targets.clear();
+
+    for(uint i=0; i < asset_manager->m_objects.size(); i++)
+        packGravityBody(asset_manager->m_objects.at(i)->m_body.get());
+
+    m_gravity_aggregated_vessels = 0;
+    for(it2 = asset_manager->m_active_vessels.begin(); it2 != asset_manager->m_active_vessels.end(); it2++){
+        Vessel* vessel = it2->second.get();
+        std::vector<BasePart*>& parts = vessel->getParts();
+
+        if(vessel->isOnRails()) // moved analytically
+            continue;
+
+        /* the CoM of the vessel is only updated by the logic thread, after several sub-ticks it
+           lags behind the parts, so it's computed from their current transforms */
+        btVector3 com;
+
+        if(aggregation && parts.size() > 1 && computeVesselCoM(vessel, com) > 0.0 &&
+           vesselTidalError(vessel, com) < tidal_threshold){
+            m_gravity_bodies.add(com.getX(), com.getY(), com.getZ());
+            m_gravity_targets.emplace_back(nullptr, vessel, vessel);
+            m_gravity_aggregated_vessels++;
+            continue;
+        }
 
-    // objects...
-    for(uint i=0; i < asset_manager->m_objects.size(); i++){
-        btRigidBody* body = asset_manager->m_objects.at(i)->m_body.get();
-        const btVector3& object_origin = body->getWorldTransform().getOrigin();
+        for(uint i=0; i < parts.size(); i++)
+            packGravityBody(parts.at(i)->m_body.get(), vessel);
+    }
+
+    if(culling)
+        selectGravitySources();
+    else{
+        compute_gravity(m_gravity_sources, m_gravity_bodies);
+        m_gravity_sets.clear();
+        m_gravity_cull_error = 0.0;
+        m_gravity_evaluations = m_gravity_sources.size() * m_gravity_bodies.size();
+    }
+
+    // scatter
+    for(uint i=0; i < m_gravity_targets.size(); i++){
+        const gravity_target& target = m_gravity_targets.at(i);
+        btVector3 acceleration(m_gravity_bodies.ax[i], m_gravity_bodies.ay[i],
+                               m_gravity_bodies.az[i]);
 
-        applyGravityStar(star_mass, body, object_origin);
+        if(target.body){
+            target.body->applyCentralForce((1 / target.body->getInvMass()) * acceleration);
+        }
+        else{
+            std::vector<BasePart*>& parts = target.vessel->getParts();
 
-        for(it = planets.begin(); it != planets.end(); it++){
-            const orbital_data& data =  it->second->getOrbitalData();
-            btVector3 pos_planet(data.pos.v[0], data.pos.v[1], data.pos.v[2]); // stupid conversion from dmath::vec3 to btVector3, just store pos as a btVector3 god damn it...
-            double Rh = pos_planet.distance(object_origin);
+            for(uint j=0; j < parts.size(); j++){
+                btRigidBody* body = parts.at(j)->m_body.get();
 
-            double acceleration = GRAVITATIONAL_CONSTANT * (data.m / (Rh*Rh));
-            btVector3 f = (1 / body->getInvMass()) * (pos_planet - object_origin).normalize()
-                          * acceleration;
-            body->applyCentralForce(f);
+                if(body->getInvMass() != 0.0)
+                    body->applyCentralForce((1 / body->getInvMass()) * acceleration);
+            }
         }
     }
 
-    for(it2 = asset_manager->m_active_vessels.begin(); it2 != asset_manager->m_active_vessels.end(); it2++){
-        std::vector<BasePart*>& parts = it2->second->getParts();
+    if(aggregation && ++m_aggregation_check_ticks >= GRAVITY_AGGREGATION_CHECK_TICKS){
+        checkGravityAggregation(culling);
+        m_aggregation_check_ticks = 0;
+    }
+}
+
+
+void Physics::checkGravityAggregation(bool culling){
+    m_aggregation_check.clear();
+    m_aggregation_masks.clear();
+    m_aggregation_index.clear();
+
+    for(uint i=0; i < m_gravity_targets.size(); i++){
+        const gravity_target& target = m_gravity_targets.at(i);
+
+        if(target.body)
+            continue;
+
+        const std::vector<BasePart*>& parts = target.vessel->getParts();
+
+        for(uint j=0; j < parts.size(); j++){
+            const btRigidBody* body = parts.at(j)->m_body.get();
+
+            if(body->getInvMass() == 0.0)
+                continue;
+
+            const btVector3& origin = body->getWorldTransform().getOrigin();
+
+            m_aggregation_check.add(origin.getX(), origin.getY(), origin.getZ());
+            // same sources as the vessel, so the error of the culling is left out
+            m_aggregation_masks.push_back(culling ? m_gravity_masks.at(i) : ~std::uint64_t(0));
+            m_aggregation_index.push_back(i);
+        }
+    }
+
+    compute_gravity_selected(m_gravity_sources, m_aggregation_check, m_aggregation_masks);
+
+    m_gravity_aggregation_error = 0.0;
+    for(uint j=0; j < m_aggregation_index.size(); j++){
+        uint i = m_aggregation_index.at(j);
+        btVector3 diff(m_aggregation_check.ax[j] - m_gravity_bodies.ax[i],
+                       m_aggregation_check.ay[j] - m_gravity_bodies.ay[i],
+                       m_aggregation_check.az[j] - m_gravity_bodies.az[i]);
+
+        m_gravity_aggregation_error = std::max(m_gravity_aggregation_error,
+                                               (double)diff.length());
+    }
+}
+
+
+void Physics::selectGravitySources(){
+    std::unordered_map<const void*, cached_gravity_set>::iterator it;
+    cached_gravity_set* cached = nullptr;
+    std::size_t num_sources = m_gravity_sources.size();
+    // to count the evaluated pairs, the sources past GRAVITY_MAX_SOURCES are not in the masks
+    double threshold = m_cull_threshold;
+    std::uint64_t valid = num_sources < GRAVITY_MAX_SOURCES ?
+                          (std::uint64_t(1) << num_sources) - 1 : ~std::uint64_t(0);
+    int unmasked = std::max(0, (int)num_sources - GRAVITY_MAX_SOURCES);
+
+    // the threshold is set by the logic thread, the sets computed with the old one are dropped
+    if(m_sets_threshold != threshold){
+        m_gravity_sets.clear();
+        m_sets_threshold = threshold;
+    }
+
+    m_gravity_tick++;
+    m_gravity_masks.resize(m_gravity_targets.size());
+    m_gravity_cull_error = 0.0;
+    m_gravity_evaluations = 0;
+
+    for(uint i=0; i < m_gravity_targets.size(); i++){
+        const void* owner = m_gravity_targets.at(i).owner;
+
+        // one lookup and selection per owner, a vessel is small compared to the spheres
+        if(!i || owner != m_gravity_targets.at(i - 1).owner){
+            cached = &m_gravity_sets[owner];
+            select_gravity_sources(m_gravity_sources, m_gravity_bodies.x[i],
+                                   m_gravity_bodies.y[i], m_gravity_bodies.z[i], threshold,
+                                   cached->set);
+            cached->tick = m_gravity_tick;
+            m_gravity_cull_error = std::max(m_gravity_cull_error, cached->set.error);
+        }
+
+        m_gravity_masks.at(i) = cached->set.mask;
+        m_gravity_evaluations += __builtin_popcountll(cached->set.mask & valid) + unmasked;
+    }
+
+    // drop the sets of the owners that are gone
+    for(it = m_gravity_sets.begin(); it != m_gravity_sets.end();){
+        if(it->second.tick != m_gravity_tick)
+            it = m_gravity_sets.erase(it);
+        else
+            it++;
+    }
+
+    compute_gravity_selected(m_gravity_sources, m_gravity_bodies, m_gravity_masks);
+}
+
+
+double Physics::computeVesselCoM(const Vessel* vessel, btVector3& com) const{
+    const std::vector<BasePart*>& parts = vessel->getParts();
+    double mass = 0.0;
+
+    com = btVector3(0.0, 0.0, 0.0);
+    for(uint i=0; i < parts.size(); i++){
+        const btRigidBody* body = parts.at(i)->m_body.get();
+
+        if(!body || body->getInvMass() == 0.0)
+            continue;
+
+        com += (1 / body->getInvMass()) * body->getWorldTransform().getOrigin();
+        mass += 1 / body->getInvMass();
+    }
+    if(mass > 0.0)
+        com /= mass;
+
+    return mass;
+}
+
+
+double Physics::vesselTidalError(const Vessel* vessel, const btVector3& com) const{
+    const std::vector<BasePart*>& parts = vessel->getParts();
+    double max_dist2 = 0.0, max_dist, error = 0.0;
+
+    for(uint i=0; i < parts.size(); i++){
+        double dist2 = parts.at(i)->m_body->getWorldTransform().getOrigin().distance2(com);
+        max_dist2 = std::max(max_dist2, dist2);
+    }
+    max_dist = std::sqrt(max_dist2);
+
+    for(uint i=0; i < m_gravity_sources.size(); i++){
+        btVector3 source(m_gravity_sources.x[i], m_gravity_sources.y[i], m_gravity_sources.z[i]);
+        double R = source.distance(com);
+
+        error += 2.0 * m_gravity_sources.gm[i] * max_dist / (R * R * R);
+    }
+
+    return error;
+}
+
+
+void Physics::packGravityBody(btRigidBody* body, const Vessel* vessel){
+    if(body->getInvMass() == 0.0) // static or kinematic, gravity does nothing
+        return;
+
+    const btVector3& origin = body->getWorldTransform().getOrigin();
+
+    m_gravity_bodies.add(origin.getX(), origin.getY(), origin.getZ());
+    m_gravity_targets.emplace_back(body, nullptr,
+                                   vessel ? (const void*)vessel : (const void*)body);
+}
+
+
+void Physics::setGravityAggregation(bool enable, double tidal_threshold){
+    m_tidal_threshold = tidal_threshold;
+    m_gravity_aggregation = enable;
+}
+
+
+bool Physics::getGravityAggregation() const{
+    return m_gravity_aggregation;
+}
+
+
+double Physics::getGravityAggregationError() const{
+    return m_gravity_aggregation_error;
+}
+
+
+void Physics::setGravityCulling(bool enable, double threshold){
+    // the threshold first, the physics thread may see the flag as soon as it's set
+    m_cull_threshold = threshold;
+    m_gravity_culling = enable;
+}
+
+
+bool Physics::getGravityCulling() const{
+    return m_gravity_culling;
+}
+
+
+double Physics::getGravityCullError() const{
+    return m_gravity_cull_error;
+}
+
+
+static btVector3 vessel_com_velocity(const Vessel* vessel){
+    const std::vector<BasePart*>& parts = vessel->getParts();
+    btVector3 momentum(0.0, 0.0, 0.0);
+
+    for(uint i=0; i < parts.size(); i++){
+        if(parts.at(i)->m_body)
+            momentum += parts.at(i)->getMass() * parts.at(i)->m_body->getLinearVelocity();
+    }
+
+    return momentum / vessel->getTotalMass();
+}
 
-        for(uint i=0; i < parts.size(); i++){
-            btRigidBody* body = parts.at(i)->m_body.get();
-            const btVector3& object_origin = body->getWorldTransform().getOrigin();
 
-            applyGravityStar(star_mass, body, object_origin);
+void Physics::updateRails(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+    std::vector<Vessel*> to_pack;
+    std::vector<orbital_data> orbits;
+    std::vector<std::uint32_t> targets;
+    double requested = m_requested_warp.load();
+    bool allowed = requested > 1.0;
 
-            for(it = planets.begin(); it != planets.end(); it++){
-                const orbital_data& data =  it->second->getOrbitalData();
-                btVector3 pos_planet(data.pos.v[0], data.pos.v[1], data.pos.v[2]);
-                double Rh = pos_planet.distance(object_origin);
+    if(allowed){
+        std::unordered_set<const Vessel*> in_contact;
 
-                double acceleration = GRAVITATIONAL_CONSTANT * (data.m / (Rh*Rh));
-                btVector3 f = (1 / body->getInvMass()) * (pos_planet - object_origin).normalize()
-                               * acceleration;
-                body->applyCentralForce(f);
+        findVesselContacts(in_contact);
 
+        for(it = vessels.begin(); it != vessels.end() && allowed; it++){
+            Vessel* vessel = it->second.get();
+
+            if(vessel->hasActiveEngines() || railsProximity(vessel)){
+                allowed = false;
+            }
+            else if(!vessel->isOnRails()){
+                orbital_data orbit;
+                std::uint32_t target;
+
+                // the Kepler solver doesn't converge for near parabolic orbits (kepler.hpp)
+                if(in_contact.count(vessel) ||
+                   computeVesselOrbit(vessel, orbit, target) == EXIT_FAILURE ||
+                   orbit.e_0 >= PREDICTOR_MAX_CONIC_ECCENTRICITY){
+                    allowed = false;
+                    break;
+                }
+
+                to_pack.push_back(vessel);
+                orbits.push_back(orbit);
+                targets.push_back(target);
             }
         }
     }
+
+    if(allowed){
+        for(uint i=0; i < to_pack.size(); i++)
+            to_pack.at(i)->packRails(orbits.at(i), targets.at(i));
+
+        m_time_warp = requested;
+    }
+    else{
+        if(requested > 1.0){
+            log("Physics::updateRails: time warp x", requested, " not possible, a vessel ",
+                "has an active engine, contacts, a non-elliptic orbit or something close to it");
+            std::cerr << "Physics::updateRails: time warp x" << requested << " not possible, "
+                         "a vessel has an active engine, contacts, a non-elliptic orbit or something "
+                         "close to it" << std::endl;
+            // unless the logic thread asked for another warp meanwhile
+            m_requested_warp.compare_exchange_strong(requested, 1.0);
+        }
+
+        // the vessels have to be at the current time before going back to bullet
+        propagateRails(m_secs_since_j2000, false);
+        for(it = vessels.begin(); it != vessels.end(); it++){
+            Vessel* vessel = it->second.get();
+
+            if(vessel->isPacked() || !vessel->isOnRails())
+                continue;
+
+            // vessels that were warped far from the player stay on rails
+            if(m_residency && vessel != m_app->getPlayer()->getVessel() &&
+               vessel->getCoM().distance(m_residency_focus) > RESIDENCY_PACK_DISTANCE)
+                vessel->setPacked(true);
+            else
+                vessel->unpackRails();
+        }
+
+        m_time_warp = 1.0;
+    }
+}
+
+
+void Physics::countRailsVessels(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    m_vessels_on_rails = 0;
+    m_packed_vessels = 0;
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        m_vessels_on_rails += it->second->isOnRails();
+        m_packed_vessels += it->second->isPacked();
+    }
+}
+
+
+void Physics::findVesselContacts(std::unordered_set<const Vessel*>& in_contact){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+    std::unordered_map<const btCollisionObject*, const Vessel*> body_vessel;
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        const std::vector<BasePart*>& parts = it->second->getParts();
+
+        for(uint i=0; i < parts.size(); i++)
+            body_vessel[parts.at(i)->m_body.get()] = it->second.get();
+
+        if(it->second->isRigid())
+            body_vessel[it->second->getRigidBody()] = it->second.get();
+
+        if(it->second->isArticulated()){
+            const btMultiBody* multibody = it->second->getMultiBody();
+
+            body_vessel[multibody->getBaseCollider()] = it->second.get();
+            for(int j=0; j < multibody->getNumLinks(); j++)
+                body_vessel[multibody->getLink(j).m_collider] = it->second.get();
+        }
+    }
+
+    for(uint i=0; i <= m_clusters.size(); i++){
+        btDispatcher* dispatcher = getClusterWorld(i)->getDispatcher();
+
+        for(int j=0; j < dispatcher->getNumManifolds(); j++){
+            const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(j);
+
+            if(manifold->getNumContacts() == 0)
+                continue;
+
+            std::unordered_map<const btCollisionObject*, const Vessel*>::const_iterator a, b;
+            a = body_vessel.find(manifold->getBody0());
+            b = body_vessel.find(manifold->getBody1());
+            const Vessel* vessel_a = a != body_vessel.end() ? a->second : nullptr;
+            const Vessel* vessel_b = b != body_vessel.end() ? b->second : nullptr;
+
+            if(vessel_a != vessel_b){
+                in_contact.insert(vessel_a);
+                in_contact.insert(vessel_b);
+            }
+        }
+    }
+}
+
+
+int Physics::computeVesselOrbit(const Vessel* vessel, orbital_data& orbit,
+                                std::uint32_t& target) const{
+    const Predictor* predictor = m_app->getPredictor();
+    btVector3 com = vessel->getCoM() + m_world_origin;
+    btVector3 com_velocity;
+
+    if(vessel->getTotalMass() <= 0.0)
+        return EXIT_FAILURE;
+
+    com_velocity = vessel_com_velocity(vessel);
+    dmath::vec3 origin(com.getX(), com.getY(), com.getZ());
+    dmath::vec3 velocity(com_velocity.getX(), com_velocity.getY(), com_velocity.getZ());
+    target = predictor->getDominantBody(origin);
+
+    return predictor->computeOrbitalElements(origin, velocity, target, m_secs_since_j2000, orbit);
+}
+
+
+void Physics::updateResidency(){
+    const planet_map& planets = m_app->getAssetManager()->m_planetary_system->getPlanets();
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    const Vessel* player_vessel = m_app->getPlayer()->getVessel();
+    VesselMap::iterator it;
+    std::unordered_set<const Vessel*> in_contact;
+    bool contacts_found = false;
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        Vessel* vessel = it->second.get();
+        double distance = vessel->getCoM().distance(m_residency_focus);
+
+        if(vessel->isPacked()){
+            // already propagated to the current time
+            if(!m_residency || vessel == player_vessel || distance < RESIDENCY_UNPACK_DISTANCE){
+                vessel->setPacked(false);
+                vessel->unpackRails();
+            }
+        }
+        else if(m_residency && !vessel->isOnRails() && vessel != player_vessel &&
+                distance > RESIDENCY_PACK_DISTANCE){
+            orbital_data orbit;
+            std::uint32_t target;
+
+            if(!contacts_found){
+                findVesselContacts(in_contact);
+                contacts_found = true;
+            }
+
+            if(in_contact.count(vessel) || vessel->hasActiveEngines() || railsProximity(vessel) ||
+               computeVesselOrbit(vessel, orbit, target) == EXIT_FAILURE)
+                continue;
+
+            // the Kepler solver doesn't converge for near parabolic orbits (kepler.hpp)
+            if(orbit.e_0 >= PREDICTOR_MAX_CONIC_ECCENTRICITY)
+                continue;
+
+            // suborbital, it would go through the planet
+            if(target && orbit.a * AU_TO_METERS * (1.0 - orbit.e) <
+                         planets.at(target)->getOrbitalData().r + RAILS_PROXIMITY_DISTANCE)
+                continue;
+
+            vessel->packRails(orbit, target);
+            vessel->setPacked(true);
+        }
+    }
+}
+
+
+void Physics::propagateRails(double time, bool packed){
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    m_rails_orbits.clear();
+    m_rails_states.clear();
+    m_rails_vessels.clear();
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        Vessel* vessel = it->second.get();
+        std::uint32_t body = vessel->getRailsBody();
+
+        if(!vessel->isOnRails() || (!packed && vessel->isPacked()))
+            continue;
+
+        m_rails_orbits.add(vessel->getRailsOrbit(), GRAVITATIONAL_CONSTANT * (body ?
+                           planet_system->getPlanets().at(body)->getOrbitalData().m :
+                           planet_system->getStar().mass));
+        m_rails_states.add(m_rails_vessels.size(), time / SECONDS_IN_A_CENTURY);
+        m_rails_vessels.push_back(vessel);
+    }
+
+    if(!m_rails_vessels.size())
+        return;
+
+    propagate_kepler(m_rails_orbits, m_rails_states);
+
+    // propagateVessel can change the rails orbit, but the states are already computed
+    for(uint i=0; i < m_rails_vessels.size(); i++){
+        propagateVessel(m_rails_vessels.at(i), time,
+                        dmath::vec3(m_rails_states.x[i], m_rails_states.y[i], m_rails_states.z[i]),
+                        dmath::vec3(m_rails_states.vx[i], m_rails_states.vy[i],
+                                    m_rails_states.vz[i]));
+    }
+}
+
+
+void Physics::propagateVessel(Vessel* vessel, double time, const dmath::vec3& rel_origin,
+                              const dmath::vec3& rel_velocity){
+    const Predictor* predictor = m_app->getPredictor();
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    dmath::vec3 origin = rel_origin, velocity = rel_velocity;
+    std::uint32_t target;
+    bool escape = false;
+
+    // to the frame of the star, like Predictor::computeObjectPosVel with match_frame
+    if(vessel->getRailsBody()){
+        dmath::vec3 body_pos, body_vel;
+
+        planet_system->getPlanets().at(vessel->getRailsBody())->computePosVel(
+            time / SECONDS_IN_A_CENTURY, body_pos, body_vel);
+        origin += body_pos;
+        velocity += body_vel;
+    }
+
+    target = predictor->getDominantBody(origin);
+    if(target != vessel->getRailsBody()){
+        orbital_data orbit;
+
+        if(predictor->computeOrbitalElements(origin, velocity, target, time, orbit) ==
+           EXIT_SUCCESS && orbit.e_0 < PREDICTOR_MAX_CONIC_ECCENTRICITY){
+            vessel->setRailsOrbit(orbit, target);
+        }
+        else{
+            escape = true;
+        }
+    }
+
+    vessel->setRailsState(btVector3(origin.v[0], origin.v[1], origin.v[2]) - m_world_origin,
+                          btVector3(velocity.v[0], velocity.v[1], velocity.v[2]));
+
+    if(escape){ // escape or near parabolic trajectory, can't stay on rails
+        if(vessel->isPacked()){
+            vessel->setPacked(false);
+            vessel->unpackRails();
+        }
+        else{ // the next tick stops the warp
+            m_requested_warp = 1.0;
+        }
+    }
+}
+
+
+bool Physics::railsProximity(const Vessel* vessel) const{
+    const AssetManager* asset_manager = m_app->getAssetManager();
+    const planet_map& planets = asset_manager->m_planetary_system->getPlanets();
+    planet_map::const_iterator it;
+    VesselMap::const_iterator it2;
+    const btVector3& com = vessel->getCoM();
+
+    for(it = planets.begin(); it != planets.end(); it++){
+        const orbital_data& data = it->second->getOrbitalData();
+        btVector3 planet_pos = btVector3(data.pos.v[0], data.pos.v[1], data.pos.v[2]) -
+                               m_world_origin;
+
+        if(com.distance(planet_pos) < data.r + RAILS_PROXIMITY_DISTANCE)
+            return true;
+    }
+
+    for(it2 = asset_manager->m_active_vessels.begin();
+        it2 != asset_manager->m_active_vessels.end(); it2++){
+        const Vessel* other = it2->second.get();
+
+        if(other == vessel)
+            continue;
+
+        btVector3 rel_pos = other->getCoM() - com;
+        btVector3 rel_vel = other->getVesselVelocity() - vessel->getVesselVelocity();
+
+        // only if they are getting closer, docked or parked vessels can still warp
+        if(rel_pos.length() < RAILS_PROXIMITY_DISTANCE && rel_pos.dot(rel_vel) < 0.0)
+            return true;
+    }
+
+    return false;
+}
+
+
+void Physics::setTimeWarp(double warp){
+    m_requested_warp = std::min(std::max(warp, 1.0), MAX_TIME_WARP);
+}
+
+
+double Physics::getTimeWarp() const{
+    return m_time_warp;
+}
+
+
+void Physics::setPhysicsWarp(int warp){
+    m_physics_warp = std::min(std::max(warp, 1), MAX_PHYSICS_WARP);
+}
+
+
+int Physics::getPhysicsWarp() const{
+    return m_physics_warp;
+}
+
+
+void Physics::setPhysicsRate(double rate){
+    m_requested_rate = std::min(std::max(rate, MIN_PHYSICS_RATE), MAX_PHYSICS_RATE);
+}
+
+
+double Physics::getPhysicsRate() const{
+    return m_physics_rate;
+}
+
+
+void Physics::setReplayTicks(int due_ticks, int sub_ticks){
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+
+    m_replay_due_ticks = due_ticks;
+    m_replay_sub_ticks = due_ticks < 0 ? -1 : sub_ticks;
+}
+
+
+int Physics::getDueTicks() const{
+    return m_due_ticks;
+}
+
+
+int Physics::getSubTicks() const{
+    return m_frame_sub_ticks;
+}
+
+
+const time_point& Physics::getStateTime() const{
+    return m_state_time;
+}
+
+
+const physics_timing& Physics::getTiming() const{
+    return m_timing;
+}
+
+
+void Physics::setLockstep(bool lockstep){
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+
+    m_lockstep = lockstep;
+}
+
+
+double Physics::getFrameDeltaT() const{
+    return m_frame_delta_t;
+}
+
+
+const btVector3& Physics::getWorldOrigin() const{
+    return m_world_origin;
+}
+
+
+bool Physics::updateFloatingOrigin(const btVector3& focus){
+    if(focus.length() < FLOATING_ORIGIN_THRESHOLD)
+        return false;
+
+    shiftWorldOrigin(focus);
+    return true;
+}
+
+
+static void shift_collision_object(btCollisionObject* object, const btVector3& shift){
+    btTransform& transform = object->getWorldTransform();
+    btTransform& interpolation = object->getInterpolationWorldTransform();
+    btRigidBody* body = btRigidBody::upcast(object);
+
+    transform.setOrigin(transform.getOrigin() - shift);
+    interpolation.setOrigin(interpolation.getOrigin() - shift);
+
+    if(body && body->getMotionState()){
+        btTransform motion_state;
+
+        body->getMotionState()->getWorldTransform(motion_state);
+        motion_state.setOrigin(motion_state.getOrigin() - shift);
+        body->getMotionState()->setWorldTransform(motion_state);
+    }
+}
+
+
+void Physics::shiftWorldOrigin(const btVector3& shift){
+    AssetManager* asset_manager = m_app->getAssetManager();
+    VesselMap::iterator it;
+
+    for(uint i=0; i <= m_clusters.size(); i++){
+        btAlignedObjectArray<btCollisionObject*>& objects =
+            getClusterWorld(i)->getCollisionObjectArray();
+
+        for(int j=0; j < objects.size(); j++)
+            shift_collision_object(objects[j], shift);
+    }
+
+    // the vessels on rails and the parts of the rigid and articulated vessels are out of the world
+    for(it = asset_manager->m_active_vessels.begin(); it != asset_manager->m_active_vessels.end();
+        it++){
+        std::vector<BasePart*>& parts = it->second->getParts();
+
+        if(!it->second->isOnRails() && !it->second->isRigid() && !it->second->isArticulated())
+            continue;
+
+        // the colliders were shifted with the world, the base is the state of the multibody
+        if(it->second->isArticulated()){
+            btMultiBody* multibody = it->second->getMultiBody();
+            multibody->setBasePos(multibody->getBasePos() - shift);
+        }
+
+        for(uint i=0; i < parts.size(); i++){
+            if(parts.at(i)->m_body)
+                shift_collision_object(parts.at(i)->m_body.get(), shift);
+        }
+        if(it->second->isOnRails())
+            it->second->updateCoM(); // skipped by updateCoMs
+    }
+
+    m_world_origin += shift;
+
+    // the broadphases and the CoMs (used by rails and gravity) have to follow
+    for(uint i=0; i <= m_clusters.size(); i++)
+        getClusterWorld(i)->updateAabbs();
+    asset_manager->updateCoMs();
+}
+
+
+static double vessel_bounding_radius(const Vessel* vessel){
+    const std::vector<BasePart*>& parts = vessel->getParts();
+    const btVector3& com = vessel->getCoM();
+    double radius = 0.0;
+
+    for(uint i=0; i < parts.size(); i++){
+        const btRigidBody* body = parts.at(i)->m_body.get();
+        btVector3 center;
+        btScalar part_radius;
+
+        if(!body)
+            continue;
+
+        body->getCollisionShape()->getBoundingSphere(center, part_radius);
+        radius = std::max(radius, body->getWorldTransform().getOrigin().distance(com) +
+                                  center.length() + part_radius);
+    }
+
+    return radius;
+}
+
+
+static int find_cluster_root(std::vector<cluster_node>& nodes, int i){
+    while(nodes.at(i).parent != i){
+        nodes.at(i).parent = nodes.at(nodes.at(i).parent).parent; // path halving
+        i = nodes.at(i).parent;
+    }
+    return i;
+}
+
+
+static void add_pinned_node(std::vector<cluster_node>& nodes, const btRigidBody* body){
+    btVector3 center;
+    btScalar radius;
+
+    if(!body || !body->getBroadphaseProxy())
+        return;
+
+    body->getCollisionShape()->getBoundingSphere(center, radius);
+    nodes.emplace_back(body->getWorldTransform().getOrigin(), btVector3(0.0, 0.0, 0.0),
+                       center.length() + radius, nullptr, MAIN_CLUSTER, true);
+}
+
+
+void Physics::updateClusters(){
+    AssetManager* asset_manager = m_app->getAssetManager();
+    const Vessel* player_vessel = m_app->getPlayer()->getVessel();
+    VesselMap::iterator it;
+    std::unordered_map<int, std::vector<int>> root_nodes;
+    std::unordered_map<int, std::vector<int>>::iterator it2;
+    std::vector<std::vector<int>> groups;
+    std::vector<bool> claimed(m_clusters.size() + 1, false);
+    btVector3 mean_velocity(0.0, 0.0, 0.0);
+    int num_vessels = 0;
+    bool clusters = m_world_clusters;
+
+    m_cluster_nodes.clear();
+
+    for(it = asset_manager->m_active_vessels.begin(); it != asset_manager->m_active_vessels.end();
+        it++){
+        Vessel* vessel = it->second.get();
+        int cluster;
+
+        if(vessel->isOnRails() || vessel->getTotalMass() <= 0.0)
+            continue;
+
+        cluster = getBodyCluster(vessel->getRoot()->m_body.get());
+        if(!clusters){
+            if(cluster != MAIN_CLUSTER)
+                moveVessel(vessel, MAIN_CLUSTER);
+            continue;
+        }
+
+        m_cluster_nodes.emplace_back(vessel->getCoM(), vessel->getVesselVelocity(),
+                                     vessel_bounding_radius(vessel), vessel, cluster,
+                                     vessel == player_vessel);
+    }
+
+    if(!clusters)
+        return;
+
+    for(uint i=0; i < asset_manager->m_kinematics.size(); i++)
+        add_pinned_node(m_cluster_nodes, asset_manager->m_kinematics.at(i)->m_body.get());
+
+    for(uint i=0; i < asset_manager->m_objects.size(); i++)
+        add_pinned_node(m_cluster_nodes, asset_manager->m_objects.at(i)->m_body.get());
+
+    /* single linkage. The pairs are found with a sweep along x, a node reaches at most its
+       extent along any axis: the relative velocity of two vessels is bounded by their velocities
+       relative to the mean one, so two nodes can only be linked if their intervals
+       [x - extent, x + extent] overlap */
+    for(uint i=0; i < m_cluster_nodes.size(); i++){
+        if(m_cluster_nodes.at(i).vessel){
+            mean_velocity += m_cluster_nodes.at(i).velocity;
+            num_vessels++;
+        }
+    }
+    if(num_vessels)
+        mean_velocity /= num_vessels;
+
+    m_cluster_extents.resize(m_cluster_nodes.size());
+    m_cluster_order.resize(m_cluster_nodes.size());
+    for(uint i=0; i < m_cluster_nodes.size(); i++){
+        cluster_node& node = m_cluster_nodes.at(i);
+        double extent = 0.5 * CLUSTER_MARGIN + node.radius;
+
+        if(node.vessel)
+            extent += CLUSTER_LOOKAHEAD * (node.velocity - mean_velocity).length();
+        m_cluster_extents.at(i) = extent * std::max(1.0, CLUSTER_SPLIT_FACTOR);
+        m_cluster_order.at(i) = i;
+        node.parent = i;
+    }
+
+    std::sort(m_cluster_order.begin(), m_cluster_order.end(), [this](int a, int b){
+        return m_cluster_nodes.at(a).center.getX() - m_cluster_extents.at(a) <
+               m_cluster_nodes.at(b).center.getX() - m_cluster_extents.at(b);
+    });
+
+    for(uint k=0; k < m_cluster_order.size(); k++){
+        int i = m_cluster_order.at(k);
+        const cluster_node& a = m_cluster_nodes.at(i);
+        double a_max = a.center.getX() + m_cluster_extents.at(i);
+
+        for(uint l=k+1; l < m_cluster_order.size(); l++){
+            int j = m_cluster_order.at(l);
+            const cluster_node& b = m_cluster_nodes.at(j);
+            double reach = CLUSTER_MARGIN + a.radius + b.radius;
+
+            if(b.center.getX() - m_cluster_extents.at(j) > a_max) // the rest are farther
+                break;
+
+            if(a.pinned && b.pinned) // both go to the main world anyway
+                continue;
+
+            // kinematics move with their planet but their velocity is 0
+            if(a.vessel && b.vessel)
+                reach += CLUSTER_LOOKAHEAD * (a.velocity - b.velocity).length();
+
+            if(a.cluster == b.cluster)
+                reach *= CLUSTER_SPLIT_FACTOR;
+
+            if(a.center.distance2(b.center) < reach * reach){
+                int root_a = find_cluster_root(m_cluster_nodes, i);
+                int root_b = find_cluster_root(m_cluster_nodes, j);
+
+                // the root of a group with a pinned node is pinned
+                if(m_cluster_nodes.at(root_b).pinned)
+                    m_cluster_nodes.at(root_a).parent = root_b;
+                else
+                    m_cluster_nodes.at(root_b).parent = root_a;
+            }
+        }
+    }
+
+    for(uint i=0; i < m_cluster_nodes.size(); i++)
+        root_nodes[find_cluster_root(m_cluster_nodes, i)].push_back(i);
+
+    for(it2 = root_nodes.begin(); it2 != root_nodes.end(); it2++){
+        if(m_cluster_nodes.at(it2->first).pinned){ // main world
+            for(uint i=0; i < it2->second.size(); i++){
+                cluster_node& node = m_cluster_nodes.at(it2->second.at(i));
+
+                if(node.vessel && node.cluster != MAIN_CLUSTER)
+                    moveVessel(node.vessel, MAIN_CLUSTER);
+            }
+        }
+        else{
+            groups.push_back(std::move(it2->second));
+        }
+    }
+
+    // the biggest groups pick their cluster first, they are the most expensive to move
+    std::sort(groups.begin(), groups.end(),
+              [](const std::vector<int>& a, const std::vector<int>& b){
+                  return a.size() > b.size();
+              });
+    claimed.at(MAIN_CLUSTER) = true;
+    std::vector<int> targets(groups.size(), MAIN_CLUSTER);
+
+    for(uint i=0; i < groups.size(); i++){
+        std::unordered_map<int, int> votes;
+        int best = MAIN_CLUSTER, best_votes = 0;
+
+        for(uint j=0; j < groups.at(i).size(); j++){
+            int cluster = m_cluster_nodes.at(groups.at(i).at(j)).cluster;
+            int count = ++votes[cluster];
+
+            if(cluster != MAIN_CLUSTER && !claimed.at(cluster) && count > best_votes){
+                best = cluster;
+                best_votes = count;
+            }
+        }
+
+        if(best != MAIN_CLUSTER){
+            targets.at(i) = best;
+            claimed.at(best) = true;
+        }
+    }
+
+    for(uint i=0; i < groups.size(); i++){
+        if(targets.at(i) != MAIN_CLUSTER)
+            continue;
+
+        for(uint j=1; j < claimed.size() && targets.at(i) == MAIN_CLUSTER; j++){
+            if(!claimed.at(j)){
+                targets.at(i) = j;
+                claimed.at(j) = true;
+            }
+        }
+
+        if(targets.at(i) == MAIN_CLUSTER){
+            std::unique_ptr<DynamicsCluster> cluster(new DynamicsCluster(
+                m_dynamics_world->getGravity(), m_part_filter, m_multibody_world));
+            std::lock_guard<std::mutex> lock(m_clusters_lock);
+
+            cluster->getDynamicsWorld()->setDebugDrawer(m_debug_drawer);
+            m_clusters.push_back(std::move(cluster));
+            claimed.push_back(true);
+            targets.at(i) = m_clusters.size();
+        }
+    }
+
+    for(uint i=0; i < groups.size(); i++){
+        for(uint j=0; j < groups.at(i).size(); j++){
+            cluster_node& node = m_cluster_nodes.at(groups.at(i).at(j));
+
+            if(node.cluster != targets.at(i))
+                moveVessel(node.vessel, targets.at(i));
+        }
+    }
+}
+
+
+void Physics::moveVessel(Vessel* vessel, int cluster){
+    std::vector<BasePart*>& parts = vessel->getParts();
+    btRigidBody* rigid_body = vessel->getRigidBody();
+    btMultiBody* multibody = vessel->getMultiBody();
+
+    // the parts of rigid and articulated vessels are out of the world, but they keep the cluster
+    if(rigid_body){
+        const btBroadphaseProxy* proxy = rigid_body->getBroadphaseProxy();
+        short group = proxy->m_collisionFilterGroup, mask = proxy->m_collisionFilterMask;
+
+        removeBody(rigid_body);
+        rigid_body->setUserIndex2(cluster);
+        addRigidBody(rigid_body, group, mask);
+    }
+    else if(multibody){
+        const btBroadphaseProxy* proxy = multibody->getBaseCollider()->getBroadphaseHandle();
+        short group = proxy->m_collisionFilterGroup, mask = proxy->m_collisionFilterMask;
+
+        removeMultiBody(multibody);
+        multibody->getBaseCollider()->setUserIndex2(cluster);
+        for(int i=0; i < multibody->getNumLinks(); i++)
+            multibody->getLink(i).m_collider->setUserIndex2(cluster);
+        addMultiBody(multibody, group, mask);
+    }
+    else{
+        vessel->getRoot()->removeSubTreeFromWorld();
+    }
+
+    for(uint i=0; i < parts.size(); i++){
+        if(parts.at(i)->m_body)
+            parts.at(i)->m_body->setUserIndex2(cluster);
+    }
+
+    if(!rigid_body && !multibody)
+        vessel->getRoot()->addSubTreeToWorld();
+}
+
+
+void Physics::updateVesselBodies(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        Vessel* vessel = it->second.get();
+        int bodies = m_vessel_bodies;
+
+        if(vessel->isOnRails())
+            continue;
+
+        if(vessel->getParts().size() < 2)
+            bodies = VESSEL_BODIES_PARTS;
+
+        if(vessel->isRigid() && (bodies != VESSEL_BODIES_RIGID || vessel->isBodyOutdated()))
+            vessel->unpackRigid();
+        if(vessel->isArticulated() &&
+           (bodies != VESSEL_BODIES_ARTICULATED || vessel->isBodyOutdated()))
+            vessel->unpackArticulated();
+
+        if(bodies == VESSEL_BODIES_RIGID){
+            if(!vessel->isRigid())
+                vessel->packRigid(this);
+            else if(vessel->isMassOutdated())
+                vessel->updateRigidMass();
+        }
+        else if(bodies == VESSEL_BODIES_ARTICULATED){
+            if(!vessel->isArticulated())
+                vessel->packArticulated(this);
+            else if(vessel->isMassOutdated())
+                vessel->updateArticulatedMass();
+        }
+        else if(!vessel->getRoot()->m_body->getBroadphaseProxy()){
+            // decoupled from a rigid or articulated vessel, the parts were out of the world
+            vessel->getRoot()->addSubTreeToWorld();
+        }
+    }
+}
+
+
+void Physics::applyVesselForces(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        if(it->second->isRigid())
+            it->second->applyRigidForces();
+        else if(it->second->isArticulated())
+            it->second->applyArticulatedForces();
+    }
+}
+
+
+void Physics::updateVesselParts(){
+    VesselMap& vessels = m_app->getAssetManager()->m_active_vessels;
+    VesselMap::iterator it;
+
+    for(it = vessels.begin(); it != vessels.end(); it++){
+        if(it->second->isRigid())
+            it->second->updateRigidParts();
+        else if(it->second->isArticulated())
+            it->second->updateArticulatedParts();
+    }
+}
+
+
+void Physics::addMultiBody(btMultiBody* multibody, short group, short mask){
+    btMultiBodyDynamicsWorld* world = static_cast<btMultiBodyDynamicsWorld*>(
+        getBodyWorld(multibody->getBaseCollider()));
+
+    world->addMultiBody(multibody);
+    world->addCollisionObject(multibody->getBaseCollider(), group, mask);
+    for(int i=0; i < multibody->getNumLinks(); i++)
+        world->addCollisionObject(multibody->getLink(i).m_collider, group, mask);
+    m_proxy_creations += multibody->getNumLinks() + 1;
+}
+
+
+void Physics::removeMultiBody(btMultiBody* multibody){
+    btMultiBodyDynamicsWorld* world = static_cast<btMultiBodyDynamicsWorld*>(
+        getBodyWorld(multibody->getBaseCollider()));
+
+    for(int i=0; i < multibody->getNumLinks(); i++)
+        world->removeCollisionObject(multibody->getLink(i).m_collider);
+    world->removeCollisionObject(multibody->getBaseCollider());
+    world->removeMultiBody(multibody);
+}
+
+
+void Physics::stepWorlds(int max_sub_steps){
+    int num_worlds, first = 0;
+
+    m_step_worlds.clear();
+    m_step_worlds.push_back(m_dynamics_world.get());
+    for(uint i=0; i < m_clusters.size(); i++){
+        if(!m_clusters.at(i)->isEmpty())
+            m_step_worlds.push_back(m_clusters.at(i)->getDynamicsWorld());
+    }
+    num_worlds = m_step_worlds.size();
+
+    /* the main world steps on its own when it's multithreaded, inside a parallel region the
+       task scheduler of bullet would run serially */
+    if(m_bullet_multithreaded){
+        m_dynamics_world->stepSimulation(m_delta_t, max_sub_steps, m_delta_t);
+        first = 1;
+    }
+
+    /* the worlds share the collision shapes, which are not modified when stepping, and the
+       globals of bullet (profiler, contact callbacks, gContact*), which are only safe to use
+       from several threads in a thread safe build */
+#ifdef BT_THREADSAFE
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for(int i=first; i < num_worlds; i++){
+        m_step_worlds[i]->stepSimulation(m_delta_t, max_sub_steps, m_delta_t);
+    }
+}
+
+
+void Physics::applyBulletThreads(){
+    int threads = m_requested_threads;
+
+    if(m_bullet_multithreaded)
+        btGetTaskScheduler()->setNumThreads(threads); // sets the OpenMP threads too
+    else
+        omp_set_num_threads(threads);
+
+    m_bullet_threads = threads;
+    m_acc_bullet_time = 0.0;
+    m_acc_bullet_ticks = 0;
+}
+
+
+void Physics::applyPartFilter(){
+    bool enabled = m_requested_part_filter;
+
+    m_part_filter = enabled;
+    m_overlap_filter.enabled = enabled;
+    for(uint i=0; i < m_clusters.size(); i++)
+        m_clusters.at(i)->getOverlapFilter()->enabled = enabled;
+
+    for(uint i=0; i <= m_clusters.size(); i++){
+        btDiscreteDynamicsWorld* world = getClusterWorld(i);
+        btAlignedObjectArray<btCollisionObject*>& objects = world->getCollisionObjectArray();
+
+        for(int j=0; j < objects.size(); j++){
+            if(objects[j]->getBroadphaseHandle()){
+                world->refreshBroadphaseProxy(objects[j]);
+                m_proxy_creations++;
+            }
+        }
+    }
+}
+
+
+void Physics::countBroadphasePairs(int& pairs, long& rejected){
+    pairs = 0;
+    for(uint i=0; i < m_step_worlds.size(); i++)
+        pairs += m_step_worlds.at(i)->getPairCache()->getNumOverlappingPairs();
+
+    rejected = m_overlap_filter.rejected;
+    m_overlap_filter.rejected = 0;
+    for(uint i=0; i < m_clusters.size(); i++){
+        part_overlap_filter* filter = m_clusters.at(i)->getOverlapFilter();
+
+        rejected += filter->rejected;
+        filter->rejected = 0;
+    }
+}
+
+
+void Physics::setPartCollisionFilter(bool enable){
+    m_requested_part_filter = enable;
+}
+
+
+bool Physics::getPartCollisionFilter() const{
+    return m_part_filter;
+}
+
+
+void Physics::refreshVesselPairs(Vessel* vessel){
+    std::vector<BasePart*>& parts = vessel->getParts();
+
+    for(uint i=0; i < parts.size(); i++){
+        btRigidBody* body = parts.at(i)->m_body.get();
+
+        if(body && body->getBroadphaseHandle()){
+            getBodyWorld(body)->refreshBroadphaseProxy(body);
+            m_proxy_creations++;
+        }
+    }
+}
+
+
+void Physics::setBulletThreads(int threads){
+    m_requested_threads = std::min(std::max(threads, 1), getMaxBulletThreads());
+}
+
+
+int Physics::getBulletThreads() const{
+    return m_bullet_threads;
+}
+
+
+int Physics::getMaxBulletThreads() const{
+    if(m_bullet_multithreaded)
+        return btGetTaskScheduler()->getMaxNumThreads();
+    return omp_get_num_procs();
+}
+
+
+bool Physics::isBulletMultithreaded() const{
+    return m_bullet_multithreaded;
+}
+
+
+void Physics::setWorldClusters(bool enable){
+    m_world_clusters = enable;
+}
+
+
+bool Physics::getWorldClusters() const{
+    return m_world_clusters;
+}
+
+
+int Physics::getNumWorlds() const{
+    return m_step_worlds.size();
+}
+
+
+int Physics::setVesselBodies(int bodies){
+    if(bodies == VESSEL_BODIES_ARTICULATED && !m_multibody_world){
+        log("Physics::setVesselBodies: articulated vessels need the multibody world "
+            "(BULLET_MULTIBODY), using a body per part");
+        std::cerr << "Physics::setVesselBodies: articulated vessels need the multibody world "
+                     "(BULLET_MULTIBODY), using a body per part" << std::endl;
+        bodies = VESSEL_BODIES_PARTS;
+    }
+
+    m_vessel_bodies = bodies;
+    return bodies;
+}
+
+
+int Physics::getVesselBodies() const{
+    return m_vessel_bodies;
+}
+
+
+bool Physics::isMultiBodyWorld() const{
+    return m_multibody_world;
+}
+
+
+void Physics::setResidencyFocus(const btVector3& focus){
+    std::unique_lock<std::mutex> lck(m_sync_lock);
+
+    m_requested_focus = focus;
+}
+
+
+void Physics::setResidency(bool enable){
+    m_residency = enable;
+}
+
+
+bool Physics::getResidency() const{
+    return m_residency;
 }
 
 
@@ -1,13 +1,21 @@
 #ifndef BT_WRAPPER_HPP
 #define BT_WRAPPER_HPP
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <unordered_set>
+#include <unordered_map>
 
 #define BT_USE_DOUBLE_PRECISION
 #include <bullet/btBulletDynamicsCommon.h>
 
 #include "maths_funcs.hpp"
+#include "gravity.hpp"
+#include "kepler.hpp"
+#include "multithreading.hpp"
+#include "timing.hpp"
 
 
 /* custom bullet collision groups */
@@ -29,31 +37,116 @@
 /* distance macros */
 #define AU_TO_METERS 149597900000.0
 
+/* default maximum tidal error (m/s^2) allowed when a vessel's gravity is evaluated at its CoM */
+#define DEFAULT_TIDAL_THRESHOLD 1e-5
+/* every GRAVITY_AGGREGATION_CHECK_TICKS ticks the parts of the aggregated vessels are also
+   evaluated one by one, see Physics::getGravityAggregationError */
+#define GRAVITY_AGGREGATION_CHECK_TICKS 60
+
+/* time warp, vessels closer than RAILS_PROXIMITY_DISTANCE (m) to a planet's surface or to a vessel
+   they are approaching can't be on rails */
+#define MAX_TIME_WARP 100000.0
+#define RAILS_PROXIMITY_DISTANCE 2500.0
+
+/* physics warp, number of fixed ticks per tick of real time. The sub-ticks of a frame must fit in
+   PHYSICS_WARP_BUDGET times the real duration of the ticks that were due, the rest are dropped */
+#define MAX_PHYSICS_WARP 4
+#define PHYSICS_WARP_BUDGET 0.8
+
+/* fixed timestep, physics ticks at the physics rate (Hz) on its own clock, whatever the rate of
+   the logic thread (see Physics::waitSimulation). If physics lags more than MAX_CATCH_UP_TICKS
+   behind real time the rest of the lag is dropped */
+#define DEFAULT_PHYSICS_RATE 60.0
+#define MIN_PHYSICS_RATE 10.0
+#define MAX_PHYSICS_RATE 480.0
+#define MAX_CATCH_UP_TICKS 4
+
+/* floating origin, the dynamics world is rebased when the focus gets farther than this (m) from
+   the origin of the world */
+#define FLOATING_ORIGIN_THRESHOLD 20000.0
+
+/* world clusters, vessels closer than CLUSTER_MARGIN (m) plus the distance they close in
+   CLUSTER_LOOKAHEAD (s) share a dynamics world. Vessels that share a world are split only when
+   they are CLUSTER_SPLIT_FACTOR times farther apart, so they don't bounce between worlds. The
+   cluster 0 is the main world */
+#define CLUSTER_MARGIN 1000.0
+#define CLUSTER_LOOKAHEAD 2.0
+#define CLUSTER_SPLIT_FACTOR 1.5
+#define MAIN_CLUSTER 0
+
+/* vessel residency, vessels farther than RESIDENCY_PACK_DISTANCE (m) from the focus are packed
+   (put on rails) and they are unpacked when they get closer than RESIDENCY_UNPACK_DISTANCE. The
+   check, and the propagation of the packed vessels, runs every RESIDENCY_CHECK_TICKS ticks */
+#define RESIDENCY_PACK_DISTANCE 10000.0
+#define RESIDENCY_UNPACK_DISTANCE 8000.0
+#define RESIDENCY_CHECK_TICKS 30
+
+/* representation of the vessels in the dynamics world, see Physics::updateVesselBodies */
+#define VESSEL_BODIES_PARTS 0 // a rigid body per part, joined by constraints
+#define VESSEL_BODIES_RIGID 1 // a single rigid body with a compound shape
+#define VESSEL_BODIES_ARTICULATED 2 // a btMultiBody with fixed joints, needs the multibody world
+#define VESSEL_BODIES_NUM 3
+
+/* the average time of bullet for the current number of threads is sent to the debug overlay
+   every BULLET_THREAD_STATS_TICKS ticks */
+#define BULLET_THREAD_STATS_TICKS 60
+
 class Object;
 class BaseApp;
+class Vessel;
+class DynamicsCluster;
+class btConstraintSolverPoolMt;
+class btMultiBody;
+
+struct orbital_data;
+
+struct ephemeris_snapshot;
+struct physics_timing;
 
-struct thread_monitor;
+/* collision tag of the bodies that are not filtered by part_overlap_filter, see
+   Object::setCollisionTag */
+#define NO_COLLISION_TAG -1
 
 /*
-#include "BasePart.hpp"
-struct myFilterCallback: public btOverlapFilterCallback{
-    virtual bool needBroadphaseCollision(btBroadphaseProxy*proxy0,btBroadphaseProxy*proxy1) const{
-        BasePart* a;
-        BasePart* b;
-        a = dynamic_cast<BasePart*>(static_cast<btCollisionObject*>(proxy0->m_clientObject)->getUserPointer());
-        b = dynamic_cast<BasePart*>(static_cast<btCollisionObject*>(proxy1->m_clientObject)->getUserPointer());
-
-        if(a && b){
-            std::string name;
-            a->getName(name);
-            std::cout << name << std::endl;
-        }
+ * Overlap filter of the broadphase. Besides the usual group/mask test it rejects the pairs of
+ * bodies with the same collision tag (the parts of a vessel or of an editor subtree), which are
+ * kept together by their constraints, so they never reach the narrowphase. The tag is the user
+ * index of the body, so we don't have to touch the user pointer. The filter is only evaluated
+ * when a pair is created, after changing the tags the proxies have to be refreshed (see
+ * Physics::refreshVesselPairs).
+ *
+ * @enabled: if false only the group/mask test is done.
+ * @rejected: number of pairs rejected because of their tags, reset by Physics every tick.
+ */
+struct part_overlap_filter : public btOverlapFilterCallback{
+    bool enabled;
+    mutable long rejected;
 
-        bool collides = proxy0->m_collisionFilterGroup && proxy1->m_collisionFilterGroup;
-        return collides;
+    part_overlap_filter(){
+        enabled = true;
+        rejected = 0;
+    }
+
+    virtual bool needBroadphaseCollision(btBroadphaseProxy* proxy0,
+                                         btBroadphaseProxy* proxy1) const{
+        int tag;
+
+        if(!(proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) ||
+           !(proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask))
+            return false;
+
+        if(!enabled)
+            return true;
+
+        tag = static_cast<const btCollisionObject*>(proxy0->m_clientObject)->getUserIndex();
+        if(tag != NO_COLLISION_TAG &&
+           tag == static_cast<const btCollisionObject*>(proxy1->m_clientObject)->getUserIndex()){
+            rejected++;
+            return false;
+        }
+        return true;
     }
 };
-*/
 
 /*
  * Index-vertex array, used to create the collision shape for btGImpactMeshShape using trimeshes
@@ -87,6 +180,94 @@ struct load_times{
 };
 
 
+/*
+ * Receiver of the i-th element of the gravity arrays. If the element is an aggregated vessel (see
+ * Physics::setGravityAggregation) the acceleration is given to all its parts.
+ *
+ * @body: rigid body that receives the force, nullptr if the element is an aggregated vessel.
+ * @vessel: vessel that was evaluated at its CoM, nullptr if the element is a single body.
+ * @owner: key of the cached source set (see Physics::setGravityCulling), the vessel for its
+ * parts and the body for the free objects. The elements of an owner are contiguous.
+ */
+struct gravity_target{
+    btRigidBody* body;
+    Vessel* vessel;
+    const void* owner;
+
+    gravity_target(btRigidBody* rbody, Vessel* target_vessel, const void* set_owner){
+        body = rbody;
+        vessel = target_vessel;
+        owner = set_owner;
+    }
+};
+
+
+/*
+ * Source set of a rigid body or an aggregated vessel, cached between ticks (see
+ * Physics::setGravityCulling).
+ *
+ * @set: source set, see select_gravity_sources.
+ * @tick: last tick in which the body received gravity, the sets of the bodies that are gone
+ * are dropped.
+ */
+struct cached_gravity_set{
+    gravity_set set;
+    std::uint32_t tick;
+};
+
+
+/*
+ * Force and torque applied to a body through the command buffers (engines, mostly), saved at the
+ * start of a physics tick so they can be applied again in every sub-tick of the physics warp.
+ *
+ * @body: rigid body that received the force.
+ * @force: total force.
+ * @torque: total torque.
+ */
+struct external_force{
+    btRigidBody* body;
+    btVector3 force, torque;
+
+    external_force(btRigidBody* rbody, const btVector3& total_force,
+                   const btVector3& total_torque){
+        body = rbody;
+        force = total_force;
+        torque = total_torque;
+    }
+};
+
+
+/*
+ * Element of the scene partition, see Physics::updateClusters.
+ *
+ * @center: center of the bounding sphere, in world coordinates.
+ * @velocity: linear velocity, only used between vessels.
+ * @radius: radius of the bounding sphere.
+ * @vessel: the vessel, nullptr for objects that always stay in the main world (kinematics).
+ * @cluster: cluster the node is currently in.
+ * @parent: parent of the node in the union-find forest.
+ * @pinned: true if the node has to be in the main world.
+ */
+struct cluster_node{
+    btVector3 center, velocity;
+    double radius;
+    Vessel* vessel;
+    int cluster, parent;
+    bool pinned;
+
+    cluster_node(const btVector3& node_center, const btVector3& node_velocity, double node_radius,
+                 Vessel* node_vessel, int node_cluster, bool node_pinned){
+        center = node_center;
+        velocity = node_velocity;
+        radius = node_radius;
+        vessel = node_vessel;
+        cluster = node_cluster;
+        parent = 0;
+        pinned = node_pinned;
+    }
+};
+
+
 /*
  * This class manages Bullet and applies gravity to the objects, among other things. The method
  * runSimulation runs in a separate thread.
@@ -98,28 +279,430 @@ class Physics{
         std::unique_ptr<btCollisionDispatcher> m_dispatcher;
         std::unique_ptr<btBroadphaseInterface> m_overlapping_pair_cache;
         std::unique_ptr<btSequentialImpulseConstraintSolver> m_solver;
+        std::unique_ptr<btConstraintSolverPoolMt> m_solver_pool; // only multithreaded
         std::unique_ptr<btDiscreteDynamicsWorld> m_dynamics_world;
 
         /*
-         * Runs the simulation, is launched as a separate thead through startSimulation, uses the
-         * thread monitor to synchronize itself with the main thead.
+         * Runs the simulation, is launched as a separate thead through startSimulation. The
+         * frames run on their own clock, the logic thread only holds them back while it's
+         * synchronized with the world (see waitSimulation). In lockstep (see setLockstep) the
+         * thread runs a frame each time the logic thread calls wakeSimulation instead.
          */
         void runSimulation(int max_sub_steps);
-        void noticeLogic();
-        void waitLogic();
 
         /*
-         * Applies gravity, should be a n-body simulation in the future when we have more planets.
+         * Waits until the next frame can run: in lockstep until the logic thread requests it,
+         * otherwise until a tick is due and the logic thread is not synchronized. Returns false
+         * if the simulation has to end.
          */
-        void applyGravity();
-        void applyGravityStar(double star_mass, btRigidBody* rbody, const btVector3& rbody_origin);
+        bool waitFrame();
+
+        /*
+         * Runs a frame of the physics thread, the ticks that are due (see advanceStateTime) with
+         * the rails, the ephemeris and the kinematics, and updates the debug overlay.
+         *
+         * @max_sub_steps: maximum number of internal substeps of Bullet, see startSimulation.
+         * @timing: timing of the physics thread.
+         */
+        void runFrame(int max_sub_steps, physics_timing& timing);
+
+        /*
+         * Ephemeris worker, launched by startSimulation. Every time it's woken up with
+         * wakeEphemeris it computes the orbital elements of the planets at m_ephemeris_time into
+         * m_ephemeris_snapshot. The physics thread publishes the snapshot after stepping Bullet,
+         * so the planet positions of the next tick are computed while the current one steps.
+         */
+        void runEphemeris();
+        void wakeEphemeris(double cent_since_j2000);
+        void waitEphemeris();
+
+        /*
+         * Adds a rigid body to the gravity arrays, bodies with infinite mass are skipped.
+         *
+         * @body: pointer to the rigid body.
+         * @vessel: vessel of the body, nullptr if it's a free object.
+         */
+        void packGravityBody(btRigidBody* body, const Vessel* vessel=nullptr);
+
+        /*
+         * Updates the cached source set of every owner of the packed bodies (see
+         * setGravityCulling), drops the sets of the owners that are gone and computes the
+         * accelerations with compute_gravity_selected. The set of a vessel is selected at the
+         * position of its first body. Called by applyGravity after packing.
+         */
+        void selectGravitySources();
+
+        /*
+         * Computes the CoM of a vessel from the current transforms of its parts, weighted by the
+         * mass of their bodies. Vessel::getCoM is only updated by the logic thread, so it lags
+         * behind the parts when several ticks run per logic frame.
+         *
+         * @vessel: pointer to the vessel.
+         * @com: the CoM in world coordinates, set if the returned mass is positive.
+         * Returns the mass of the bodies of the vessel, 0 if none of them has a finite mass.
+         */
+        double computeVesselCoM(const Vessel* vessel, btVector3& com) const;
+
+        /*
+         * Returns an upper bound of the error (m/s^2) we make if the gravity of the vessel is
+         * evaluated only at its CoM. The gradient of the gravity field of each source is bounded
+         * by 2 * G * m / R^3, so the error is that times the distance between the CoM and the
+         * farthest part. Should be called after packing the sources.
+         *
+         * @vessel: pointer to the vessel.
+         * @com: CoM of the vessel, see computeVesselCoM.
+         */
+        double vesselTidalError(const Vessel* vessel, const btVector3& com) const;
+
+        /*
+         * Evaluates the parts of the aggregated vessels one by one, with the sources of their
+         * vessel, and stores the largest difference with the acceleration the vessel received in
+         * m_gravity_aggregation_error. Called by applyGravity after computing the gravity.
+         *
+         * @culling: true if the sources were culled this tick.
+         */
+        void checkGravityAggregation(bool culling);
+
+        /*
+         * Decides if the vessels can be on rails this tick and applies the requested time warp.
+         * Time warp needs every vessel on rails, so it's only allowed if no vessel has an active
+         * engine, contacts, an orbit with an eccentricity above PREDICTOR_MAX_CONIC_ECCENTRICITY
+         * (the Kepler solver doesn't converge) or is close to something (see railsProximity).
+         * Otherwise the warp falls back to 1 and the vessels on rails are put back into Bullet.
+         */
+        void updateRails();
+
+        /*
+         * Moves the vessels on rails along their conics to the given time, the states of all of
+         * them are computed at once with propagate_kepler and then passed to propagateVessel.
+         *
+         * @time: time since the reference epoch, in seconds.
+         * @packed: if false the packed vessels are skipped, they only have to be accurate when
+         * they are checked by updateResidency or unpacked.
+         */
+        void propagateRails(double time, bool packed);
+
+        /*
+         * Moves a vessel on rails to its state at the given time. If the vessel enters another
+         * sphere of influence its orbit is recomputed around the new dominant body, if the new
+         * orbit is an escape or too eccentric for the Kepler solver the vessel leaves the rails
+         * (the warp stops, or the vessel is unpacked).
+         *
+         * @vessel: pointer to the vessel.
+         * @time: time since the reference epoch, in seconds.
+         * @rel_origin: position of the vessel relative to its rails body (see propagateRails).
+         * @rel_velocity: velocity of the vessel relative to its rails body.
+         */
+        void propagateVessel(Vessel* vessel, double time, const dmath::vec3& rel_origin,
+                             const dmath::vec3& rel_velocity);
+
+        /*
+         * Packs the vessels that are far from the residency focus and unpacks the packed ones
+         * that got close, see RESIDENCY_PACK_DISTANCE. A vessel is only packed if it could be
+         * on rails (no engines, contacts or something close), its periapsis is above the
+         * surface of the dominant body, so it doesn't go through the planet, and its eccentricity
+         * is below PREDICTOR_MAX_CONIC_ECCENTRICITY, so the Kepler solver converges. The player's
+         * vessel is never packed. Should only run when the time warp is 1.
+         */
+        void updateResidency();
+
+        /*
+         * Computes the orbital elements of the CoM of a vessel around its dominant body, at the
+         * current time. Returns EXIT_FAILURE if the orbit is not elliptic.
+         *
+         * @vessel: pointer to the vessel, the CoM must be up to date.
+         * @orbit: returned orbital elements.
+         * @target: returned id of the dominant body, 0 for the star.
+         */
+        int computeVesselOrbit(const Vessel* vessel, orbital_data& orbit,
+                               std::uint32_t& target) const;
+
+        /*
+         * Finds the vessels that are touching something that is not themselves, in every world.
+         *
+         * @in_contact: returned set of vessels, may contain nullptr (objects and kinematics).
+         */
+        void findVesselContacts(std::unordered_set<const Vessel*>& in_contact);
+
+        /*
+         * Counts the vessels on rails and the packed vessels for the debug overlay.
+         */
+        void countRailsVessels();
+
+        /*
+         * Returns true if the vessel is too close to the surface of a planet or approaching
+         * another vessel, closer than RAILS_PROXIMITY_DISTANCE.
+         *
+         * @vessel: pointer to the vessel.
+         */
+        bool railsProximity(const Vessel* vessel) const;
+
+        /*
+         * Runs the fixed ticks of a physics frame, m_physics_warp of them per due tick if they
+         * fit in the time budget (see PHYSICS_WARP_BUDGET). Gravity and the forces of the command
+         * buffers are applied in every sub-tick (the one-shot forces only in the first one),
+         * Bullet clears the forces after each step. The ephemeris and the kinematics are still
+         * updated once per frame. Returns the number of sub-ticks run.
+         *
+         * @max_sub_steps: maximum number of internal substeps of Bullet, see startSimulation.
+         * @timing: timing of the physics thread, TP_GRAV_END is registered after the gravity of
+         * the first sub-tick, the rest of the sub-ticks are accounted as Bullet time.
+         * @due_ticks: ticks of real time to simulate, see advanceStateTime.
+         */
+        int stepSubTicks(int max_sub_steps, physics_timing& timing, int due_ticks);
+
+        /*
+         * Advances the state time by the fixed ticks that fit in the real time elapsed since the
+         * last frame, at most MAX_CATCH_UP_TICKS, and returns their number. It can be 0 if the
+         * logic thread runs faster than the physics rate.
+         */
+        int advanceStateTime();
+
+        /*
+         * Moves the forces that the command buffers applied to the parts to m_external_forces,
+         * the bodies are left without forces. Called by wakeSimulation, the forces of a logic
+         * frame replace the ones of the previous frame even if no tick ran in between.
+         */
+        void takeExternalForces();
+
+        /*
+         * Applies the forces taken by takeExternalForces, in every sub-tick until the next logic
+         * frame.
+         */
+        void applyExternalForces();
+
+        /*
+         * Applies the one-shot forces (see addOneShotForce) and drops them, only in the first
+         * sub-tick that runs.
+         */
+        void applyOneShotForces();
+
+        /*
+         * Translates every body of the dynamics world, and the bodies of the vessels on rails,
+         * by -shift and moves m_world_origin by +shift, so the absolute positions don't change.
+         *
+         * @shift: displacement of the origin of the world, in world coordinates.
+         */
+        void shiftWorldOrigin(const btVector3& shift);
+
+        /*
+         * Partitions the vessels into groups that are far away from each other, and moves each
+         * group into its own dynamics world (DynamicsCluster) so they can be stepped in parallel.
+         * The group of the player's vessel and the groups that are close to kinematics or objects
+         * stay in the main world. The groups keep the cluster that most of their vessels are
+         * already in, so only vessels that approach or leave a group are moved. The pairs are found
+         * by sweeping the nodes sorted along x, so only the nodes that are close along that axis
+         * are tested. If the clusters are disabled every vessel goes back to the main world.
+         */
+        void updateClusters();
+
+        /*
+         * Builds the bodies of the vessels according to the requested representation (see
+         * setVesselBodies): a single rigid body (Vessel::packRigid), a btMultiBody
+         * (Vessel::packArticulated) or a body per part. The bodies of a vessel are built again
+         * only when its tree changes (staging, decoupling), and their mass is updated in place
+         * when the mass of a part changes. Vessels with a single part always use their part.
+         */
+        void updateVesselBodies();
+
+        /*
+         * Moves the forces applied to the parts of the rigid and articulated vessels to their
+         * bodies, see Vessel::applyRigidForces and Vessel::applyArticulatedForces.
+         */
+        void applyVesselForces();
+
+        /*
+         * Moves the parts of the rigid and articulated vessels with their bodies after stepping,
+         * see Vessel::updateRigidParts and Vessel::updateArticulatedParts.
+         */
+        void updateVesselParts();
+
+        /*
+         * Moves the bodies and the constraints of a vessel to another cluster. The cluster of a
+         * body is stored in its user index 2.
+         *
+         * @vessel: pointer to the vessel.
+         * @cluster: index of the cluster, MAIN_CLUSTER for the main world.
+         */
+        void moveVessel(Vessel* vessel, int cluster);
+
+        /*
+         * Steps the main world and every cluster that is not empty, concurrently (OpenMP) if
+         * Bullet is built thread safe (BT_THREADSAFE, see BULLET_MT in the Makefile). Otherwise
+         * the worlds are stepped one after the other, they share the globals of Bullet (profiler,
+         * contact callbacks and counters).
+         *
+         * @max_sub_steps: maximum number of internal substeps of Bullet, see startSimulation.
+         */
+        void stepWorlds(int max_sub_steps);
+
+        /*
+         * Returns the dynamics world of a cluster, the main world if the index is not valid.
+         *
+         * @cluster: index of the cluster.
+         */
+        btDiscreteDynamicsWorld* getClusterWorld(int cluster);
+
+        /*
+         * Returns the index of the cluster that a body belongs to.
+         *
+         * @body: pointer to the body.
+         */
+        int getBodyCluster(const btCollisionObject* body) const;
+
+        /*
+         * Applies the requested number of threads (see setBulletThreads). OpenMP keeps the number
+         * of threads per calling thread, so this has to be called by the physics thread.
+         */
+        void applyBulletThreads();
+
+        /*
+         * Applies the requested state of the part filter (see setPartCollisionFilter) to the
+         * filters of every world and refreshes every proxy, so the pairs are created or rejected
+         * again. Should be called by the physics thread.
+         */
+        void applyPartFilter();
+
+        /*
+         * Counts the overlapping pairs of the worlds stepped during the last tick and the pairs
+         * rejected by their part filters since the last call, the counters of the filters are
+         * reset.
+         *
+         * @pairs: returns the number of overlapping pairs.
+         * @rejected: returns the number of rejected pairs.
+         */
+        void countBroadphasePairs(int& pairs, long& rejected);
 
         BaseApp* m_app;
 
-        double m_delta_t, m_secs_since_j2000; // m_delta_t in s
+        /* gravity arrays, m_gravity_targets[i] receives the i-th element of m_gravity_bodies.
+           They are members to avoid reallocations every tick */
+        gravity_sources m_gravity_sources;
+        gravity_bodies m_gravity_bodies;
+        std::vector<gravity_target> m_gravity_targets;
+        std::atomic<bool> m_gravity_aggregation;
+        std::atomic<double> m_tidal_threshold;
+        int m_gravity_aggregated_vessels; // number of vessels evaluated at their CoM last tick
+
+        /* per-part evaluation of the aggregated vessels, m_aggregation_index[j] is the element of
+           m_gravity_bodies of the vessel of the j-th part */
+        gravity_bodies m_aggregation_check;
+        std::vector<std::uint64_t> m_aggregation_masks;
+        std::vector<uint> m_aggregation_index;
+        int m_aggregation_check_ticks;
+        double m_gravity_aggregation_error; // m/s^2
+
+        /* gravity source culling, the sets are keyed by the owner of the gravity targets.
+           m_gravity_masks[i] is the set of the i-th element of m_gravity_bodies */
+        std::atomic<bool> m_gravity_culling;
+        std::atomic<double> m_cull_threshold;
+        double m_sets_threshold; // the threshold of the cached sets
+        std::unordered_map<const void*, cached_gravity_set> m_gravity_sets;
+        std::vector<std::uint64_t> m_gravity_masks;
+        std::uint32_t m_gravity_tick;
+        double m_gravity_cull_error; // max error of the culling last tick (m/s^2)
+        int m_gravity_evaluations; // source-body pairs evaluated last tick
+
+        /* conics of the vessels on rails, m_rails_vessels[i] is the vessel of the i-th query */
+        kepler_orbits m_rails_orbits;
+        kepler_states m_rails_states;
+        std::vector<Vessel*> m_rails_vessels;
+
+        /* time warp, the requested value is set by the logic thread and m_time_warp is the one
+           actually applied by updateRails, both are read by the two threads */
+        std::atomic<double> m_time_warp, m_requested_warp;
+        int m_vessels_on_rails, m_packed_vessels;
+
+        /* vessel residency, the focus is requested by the logic thread (see setResidencyFocus)
+           and copied by waitFrame, m_requested_focus is guarded by m_sync_lock */
+        btVector3 m_residency_focus, m_requested_focus;
+        std::atomic<bool> m_residency;
+        int m_residency_ticks;
+
+        /* physics warp, m_physics_substeps is the number of sub-ticks run in the last frame, it
+           might be less than m_physics_warp if the thread can't keep up */
+        std::atomic<int> m_physics_warp;
+        int m_physics_substeps;
+
+        /* forces of the command buffers. The continuous ones (engines) are applied in every
+           sub-tick until the next logic frame, the one-shot ones (separators) in the first
+           sub-tick that runs, see takeExternalForces and addOneShotForce */
+        std::vector<external_force> m_external_forces, m_one_shot_forces;
+
+        /* fixed timestep, m_state_time is the real time the simulated state corresponds to, it
+           follows the real time in steps of m_delta_t. The requested rate is set by the logic
+           thread */
+        time_point m_state_time;
+        std::atomic<double> m_physics_rate, m_requested_rate;
+
+        /* synchronization with the logic thread, see waitSimulation. The logic thread owns the
+           world while m_logic_sync is set and the physics thread while m_physics_busy is set,
+           m_frame_requested is only used in lockstep */
+        std::mutex m_sync_lock;
+        std::condition_variable m_sync_cv;
+        bool m_logic_sync, m_physics_busy, m_frame_requested, m_lockstep;
+
+        /* ticks, sub-ticks and simulated time (s) since the last synchronization, and the ones
+           of the logic frame (see getDueTicks and getFrameDeltaT) */
+        int m_sync_due_ticks, m_sync_sub_ticks;
+        double m_sync_delta_t;
+        int m_due_ticks, m_frame_sub_ticks;
+        double m_frame_delta_t;
+
+        /* ticks of the next frame when replaying a recording, -1 to follow the real time. Set
+           by the logic thread, see setReplayTicks. Replaying is always in lockstep */
+        int m_replay_due_ticks, m_replay_sub_ticks;
+
+        /* time points of the last frame of the physics thread, see getTiming */
+        physics_timing m_timing;
+
+        /* absolute (heliocentric) position of the origin of the dynamics world, bodies live in
+           world coordinates and planets, the camera and the predictor in absolute coordinates */
+        btVector3 m_world_origin;
+
+        /* world clusters, m_clusters[i] is the cluster i + 1. The node and world vectors are
+           members to avoid reallocations every tick */
+        std::vector<std::unique_ptr<DynamicsCluster>> m_clusters;
+        std::vector<cluster_node> m_cluster_nodes;
+        std::vector<double> m_cluster_extents; // half width of the sweep interval of each node
+        std::vector<int> m_cluster_order; // nodes sorted by the start of their interval
+        std::vector<btDiscreteDynamicsWorld*> m_step_worlds;
+        std::atomic<bool> m_world_clusters;
+        /* the physics thread takes it to add clusters, testRay and debugDrawWorlds (other
+           threads) to read the vector. The new clusters get m_debug_drawer */
+        mutable std::mutex m_clusters_lock;
+        btIDebugDraw* m_debug_drawer;
+
+        /* vessel representation, the multibody world is needed by the articulated vessels */
+        std::atomic<int> m_vessel_bodies;
+        bool m_multibody_world;
+
+        /* filter of the pairs between parts of the same vessel of the main world, the clusters
+           have their own. The requested value is set by the logic thread */
+        part_overlap_filter m_overlap_filter;
+        std::atomic<bool> m_part_filter, m_requested_part_filter;
+
+        /* broadphase proxies created, see getProxyCreations */
+        long m_proxy_creations;
+
+        /* threads of bullet, used by the task scheduler when the world is multithreaded and to
+           step the clusters. The requested value is set by the logic thread */
+        bool m_bullet_multithreaded;
+        std::atomic<int> m_bullet_threads, m_requested_threads;
+        double m_acc_bullet_time;
+        int m_acc_bullet_ticks;
+
+        double m_delta_t; // s
+        std::atomic<double> m_secs_since_j2000; // read by the logic and render threads
         std::thread m_thread_simulation;
         bool m_simulation_paused, m_end_simulation;
-        struct thread_monitor* m_thread_monitor;
+
+        /* ephemeris pipeline, the snapshot is the back buffer (the planets are the front) */
+        std::thread m_thread_ephemeris;
+        struct thread_monitor m_ephemeris_monitor;
+        std::unique_ptr<ephemeris_snapshot> m_ephemeris_snapshot;
+        double m_ephemeris_time;
+        bool m_end_ephemeris;
     public:
         Physics();
 
@@ -132,8 +715,18 @@ class Physics{
         ~Physics();
 
         /*
-         * Adds a rigid body to the dynamics world. This method should not be called when the 
-         * physics thread is running. Instead, use the command buffers of AssetManager or
+         * Applies gravity, should be a n-body simulation in the future when we have more planets.
+         * The sources and the bodies are packed into m_gravity_sources and m_gravity_bodies, the
+         * accelerations are computed with compute_gravity (or compute_gravity_selected if the
+         * culling is enabled) and then applied to the bodies. Called by the physics thread every
+         * tick, it's public for the benchmarks (tests/kernels_bench).
+         */
+        void applyGravity();
+
+        /*
+         * Adds a rigid body to the dynamics world of its cluster (see getBodyWorld), new bodies
+         * go to the main world. This method should not be called when the physics thread is
+         * running. Instead, use the command buffers of AssetManager or
          * AssetManagerInterface. To understand collision groups, collision masks and collision
          * flags look here:
          * https://pybullet.org/Bullet/phpBB3/viewtopic.php?t=11865
@@ -171,10 +764,33 @@ class Physics{
          */
         void removeBody(btRigidBody* body);
 
+        /*
+         * Sets the mass of a rigid body and updates its inertia in place, without taking it out
+         * of the world. The inertia of a shape is proportional to its mass, so it's scaled unless
+         * the body had infinite mass. The body is only added to the world again (which creates a
+         * new broadphase proxy) when its group or mask don't match the given ones, or when it
+         * changes between static and dynamic. This method should not be called when the physics
+         * thread is running, use command buffers instead.
+         *
+         * @body: pointer to the rigid body, it doesn't need to be in the world.
+         * @mass: new mass, in kg.
+         * @group: collision group the body should have.
+         * @mask: collision mask the body should have.
+         */
+        void updateMassProps(btRigidBody* body, double mass, short group, short mask);
+
+        /*
+         * Returns the number of broadphase proxies created since the start (bodies and colliders
+         * added to the worlds and refreshed proxies), to check that nothing re-creates them every
+         * tick.
+         */
+        long getProxyCreations() const;
+
         /*
          * Tests a ray, if it collides with an object it returns the pointer to that object. Mainly
          * used in the editor because it uses single precision. The collision group of this ray is
-         * set to 1 (CG_DEFAULT) by default, so it will collide with everything. This method is 
+         * set to 1 (CG_DEFAULT) by default, so it will collide with everything. The ray is tested
+         * against the main world and every cluster, the closest hit wins. This method is 
          * thread safe (data races might still occur).
          *
          * @ray_start_world: start of the ray, single precision.
@@ -192,6 +808,20 @@ class Physics{
          */
         Object* testRay(btCollisionWorld::ClosestRayResultCallback& ray_callback, const btVector3& ray_start, const btVector3& ray_end) const;
 
+        /*
+         * Sets the debug drawer of the main world and of the clusters, including the ones that
+         * are created later.
+         *
+         * @drawer: debug drawer, has to outlive the physics or be reset with nullptr.
+         */
+        void setDebugDrawer(btIDebugDraw* drawer);
+
+        /*
+         * Calls debugDrawWorld on the main world and on every cluster, see setDebugDrawer. Like
+         * testRay, it can be called from another thread but data races might occur.
+         */
+        void debugDrawWorlds();
+
         /*
          * Updates the AABB of the rigid body, may not be thread safe.
          *
@@ -210,6 +840,15 @@ class Physics{
         const btDiscreteDynamicsWorld* getDynamicsWorld() const;
         btDiscreteDynamicsWorld* getDynamicsWorld();
 
+        /*
+         * Returns the dynamics world a body belongs to, the main world (getDynamicsWorld) or the
+         * world of a cluster. Bodies that are not in a world (vessels on rails) return the world
+         * they'll be added to.
+         *
+         * @body: pointer to the body.
+         */
+        btDiscreteDynamicsWorld* getBodyWorld(const btCollisionObject* body);
+
         /*
          * Returns how much time has passed since the reference epoch, on the solar system that
          * should be J2000. The units is seconds.
@@ -225,8 +864,8 @@ class Physics{
         void setCurrentTime(double time);
 
         /*
-         * Starts the simulation by launching a thread with the method runSimulation. To make the
-         * simulation step use the thread monitor.
+         * Starts the simulation by launching a thread with the method runSimulation. The ticks
+         * don't start until the logic thread calls wakeSimulation.
          *
          * @time_step: time step of each tick.
          * @max_sub_steps: maximum number of internal substeps of Bullet. Ideally it should be more
@@ -239,10 +878,49 @@ class Physics{
         void startSimulation(int max_sub_steps);
 
         /*
-         * Wakes up the physics thread and tells it to stop, then the thread joins.
+         * Wakes up the physics thread and tells it to stop, then the thread joins. The ephemeris
+         * worker is also stopped.
          */
         void stopSimulation();
 
+        /*
+         * Synchronizes the logic thread with the world: waits for the frame that is running (in
+         * lockstep, for the one requested by wakeSimulation) and keeps the physics thread from
+         * starting another until wakeSimulation. In between the logic thread owns the world, it
+         * can process the command buffers, read the bodies for the render buffers... The ticks
+         * run since the previous call are what getDueTicks, getSubTicks and getFrameDeltaT return
+         * until the next one. The logic thread starts synchronized.
+         */
+        void waitSimulation();
+
+        /*
+         * Hands the world back to the physics thread after waitSimulation. The forces that the
+         * command buffers applied in this frame are taken out of the bodies (see
+         * takeExternalForces), and in lockstep a frame is requested. Called by the logic thread.
+         */
+        void wakeSimulation();
+
+        /*
+         * Enables or disables the lockstep: the physics thread runs a frame with the ticks that
+         * are due each time the logic thread calls wakeSimulation, and the next waitSimulation
+         * waits for it. The recordings need it to be deterministic. Should be called by the
+         * logic thread while synchronized.
+         *
+         * @lockstep: true to enable the lockstep.
+         */
+        void setLockstep(bool lockstep);
+
+        /*
+         * Adds a force that is applied in the first sub-tick that runs and then dropped, unlike
+         * the forces applied to the bodies (see takeExternalForces). Used by the command buffers,
+         * should be called by the logic thread while synchronized.
+         *
+         * @body: body of a part.
+         * @force: central force.
+         * @torque: torque.
+         */
+        void addOneShotForce(btRigidBody* body, const btVector3& force, const btVector3& torque);
+
         /*
          * Pauses or resumes the simulation. The thread will still step but Bullet won't update and
          * gravity won't be applied.
@@ -251,14 +929,302 @@ class Physics{
          */
         void pauseSimulation(bool stop_simulation);
 
+        /*
+         * Enables or disables the vessel-level gravity aggregation. When enabled, the gravity of
+         * each vessel is evaluated once at its CoM and distributed to the parts proportionally to
+         * their mass, unless the tidal error (see vesselTidalError) is above the threshold. In
+         * that case the vessel falls back to per-part evaluation. Thread safe, it's applied at the
+         * next tick.
+         *
+         * @enable: true to enable the aggregation.
+         * @tidal_threshold: maximum tidal error in m/s^2.
+         */
+        void setGravityAggregation(bool enable, double tidal_threshold=DEFAULT_TIDAL_THRESHOLD);
+
+        /*
+         * Returns true if the vessel-level gravity aggregation is enabled.
+         */
+        bool getGravityAggregation() const;
+
+        /*
+         * Returns the largest difference (m/s^2) between the acceleration of an aggregated
+         * vessel and the one of its parts evaluated one by one, measured every
+         * GRAVITY_AGGREGATION_CHECK_TICKS ticks. It should stay below the tidal threshold. It's
+         * written by the physics thread, read it while synchronized (see waitSimulation).
+         */
+        double getGravityAggregationError() const;
+
+        /*
+         * Enables or disables the culling of the gravity sources. When enabled, each body only
+         * receives the pull of the star, of the planets whose sphere of influence contains it and
+         * of the planets whose acceleration is above the threshold (see select_gravity_sources).
+         * The sets are cached and only recomputed when the body crosses a sphere of influence or
+         * every GRAVITY_SET_MAX_AGE ticks. Disabled by default, it's opt-in. Thread safe, it's
+         * applied at the next tick.
+         *
+         * @enable: true to enable the culling.
+         * @threshold: acceleration threshold in m/s^2.
+         */
+        void setGravityCulling(bool enable, double threshold=DEFAULT_GRAVITY_CULL_THRESHOLD);
+
+        /*
+         * Returns true if the culling of the gravity sources is enabled.
+         */
+        bool getGravityCulling() const;
+
+        /*
+         * Returns the maximum error of the culling during the last tick, in m/s^2. It's the
+         * largest sum of the accelerations of the culled sources of a body, 0 if disabled.
+         */
+        double getGravityCullError() const;
+
+        /*
+         * Requests a time warp factor, it's applied at the start of the next tick if every vessel
+         * can be put on rails, otherwise the request is dropped and the warp stays at 1. The
+         * value is clamped to [1, MAX_TIME_WARP]. Thread safe, a request made while the physics
+         * thread is dropping the previous one is kept.
+         *
+         * @warp: time warp factor.
+         */
+        void setTimeWarp(double warp);
+
+        /*
+         * Returns the time warp factor applied during the last tick.
+         */
+        double getTimeWarp() const;
+
+        /*
+         * Sets the physics warp, the number of fixed ticks run per tick of real time (see
+         * setPhysicsRate). Unlike the time warp, vessels stay in Bullet and engines can be on.
+         * The value is clamped to [1, MAX_PHYSICS_WARP], and it's ignored while the time warp is
+         * above 1. Thread safe, it's applied at the next frame.
+         *
+         * @warp: number of ticks per tick of real time.
+         */
+        void setPhysicsWarp(int warp);
+
+        /*
+         * Returns the requested physics warp.
+         */
+        int getPhysicsWarp() const;
+
+        /*
+         * Requests a physics rate, the number of fixed ticks per second of real time. It's
+         * applied at the start of the next frame and clamped to [MIN_PHYSICS_RATE,
+         * MAX_PHYSICS_RATE]. Thread safe.
+         *
+         * @rate: ticks per second.
+         */
+        void setPhysicsRate(double rate);
+
+        /*
+         * Returns the physics rate applied during the last frame.
+         */
+        double getPhysicsRate() const;
+
+        /*
+         * Fixes the ticks of the next frame instead of taking them from the real time, and
+         * disables the time budget of the physics warp. Used to replay recordings (see
+         * Recorder), the physics thread runs in lockstep meanwhile. Should be called by the logic
+         * thread while synchronized (see waitSimulation).
+         *
+         * @due_ticks: ticks of real time, -1 to go back to the real time.
+         * @sub_ticks: sub-ticks to run, at most due_ticks times the physics warp.
+         */
+        void setReplayTicks(int due_ticks, int sub_ticks);
+
+        /*
+         * Return the ticks of real time and the sub-ticks simulated between the last two
+         * synchronizations of the logic thread, see waitSimulation.
+         */
+        int getDueTicks() const;
+        int getSubTicks() const;
+
+        /*
+         * Returns the real time the current simulated state corresponds to, it's behind the
+         * real time by less than a tick. The render buffers are stamped with it, so the render
+         * thread can interpolate between them. Should be called when the physics thread is not
+         * running.
+         */
+        const time_point& getStateTime() const;
+
+        /*
+         * Returns the timing of the last frame of the physics thread (time points and averages),
+         * used by the headless app to print its stats. Should be called when the physics thread
+         * is not running.
+         */
+        const physics_timing& getTiming() const;
+
+        /*
+         * Returns the simulated time (s) between the last two synchronizations of the logic
+         * thread, m_delta_t times the number of sub-ticks, or times the time warp. Used to scale
+         * things that are updated once per logic frame, like the propellant flow of the engines.
+         */
+        double getFrameDeltaT() const;
+
+        /*
+         * Returns the absolute position of the origin of the dynamics world. Add it to the
+         * position of a body to get its absolute position, subtract it from an absolute position
+         * to place something in the world.
+         */
+        const btVector3& getWorldOrigin() const;
+
+        /*
+         * Rebases the dynamics world around the focus if it's farther than
+         * FLOATING_ORIGIN_THRESHOLD from the origin of the world, this keeps the coordinates
+         * that Bullet and the render transforms work with small. This method should not be
+         * called when the physics thread is running. Returns true if the world was rebased.
+         *
+         * @focus: position the world should be centered at (usually the CoM of the player's
+         * vessel), in world coordinates.
+         */
+        bool updateFloatingOrigin(const btVector3& focus);
+
+        /*
+         * Sets the point that the vessel residency (see updateResidency) is centered at, usually
+         * the CoM of the player's vessel, or the camera if there's no vessel. Thread safe, the
+         * physics thread picks it up at the start of its next frame.
+         *
+         * @focus: position of the focus, in world coordinates.
+         */
+        void setResidencyFocus(const btVector3& focus);
+
+        /*
+         * Enables or disables the vessel residency. When disabled the packed vessels are unpacked
+         * at the next check. Thread safe.
+         *
+         * @enable: true to enable the residency.
+         */
+        void setResidency(bool enable);
+
+        /*
+         * Returns true if the vessel residency is enabled.
+         */
+        bool getResidency() const;
+
+        /*
+         * Enables or disables the world clusters, see updateClusters. When disabled every vessel
+         * is stepped in the main world. Thread safe, it's applied at the next tick.
+         *
+         * @enable: true to enable the clusters.
+         */
+        void setWorldClusters(bool enable);
+
+        /*
+         * Returns true if the world clusters are enabled.
+         */
+        bool getWorldClusters() const;
+
+        /*
+         * Returns the number of worlds stepped in the last tick, the main world and the clusters
+         * that are not empty. It's written by the physics thread, read it while synchronized (see
+         * waitSimulation).
+         */
+        int getNumWorlds() const;
+
+        /*
+         * Sets how the vessels are represented in the dynamics world (VESSEL_BODIES_*), applied
+         * at the start of the next tick, see updateVesselBodies. The articulated vessels need the
+         * multibody world (see initDynamicsWorld). Thread safe.
+         *
+         * @bodies: representation of the vessels.
+         * Returns the representation that was set, VESSEL_BODIES_PARTS if the articulated
+         * vessels were requested without the multibody world.
+         */
+        int setVesselBodies(int bodies);
+
+        /*
+         * Returns the representation of the vessels, VESSEL_BODIES_*.
+         */
+        int getVesselBodies() const;
+
+        /*
+         * Returns true if the worlds are btMultiBodyDynamicsWorld, see initDynamicsWorld.
+         */
+        bool isMultiBodyWorld() const;
+
+        /*
+         * Adds a btMultiBody and its link colliders to the world of the cluster of its base
+         * collider. Only for the multibody world, not thread safe.
+         *
+         * @multibody: the multibody, its colliders should be set.
+         * @group: collision group of the colliders.
+         * @mask: collision mask of the colliders.
+         */
+        void addMultiBody(btMultiBody* multibody, short group, short mask);
+
+        /*
+         * Removes a btMultiBody and its link colliders from its world, not thread safe.
+         *
+         * @multibody: the multibody.
+         */
+        void removeMultiBody(btMultiBody* multibody);
+
+        /*
+         * Enables or disables the filter of the broadphase pairs between parts of the same
+         * vessel (see part_overlap_filter), it's applied at the start of the next tick. Thread
+         * safe.
+         *
+         * @enable: true to enable the filter.
+         */
+        void setPartCollisionFilter(bool enable);
+
+        /*
+         * Returns true if the part filter is enabled.
+         */
+        bool getPartCollisionFilter() const;
+
+        /*
+         * Refreshes the broadphase proxies of the parts of a vessel, so the pairs with the rest
+         * of the world are evaluated again by the filter. Has to be called after the collision
+         * tags of a vessel change (e.g. when it's created by decoupling parts of another vessel).
+         * Not thread safe.
+         *
+         * @vessel: raw pointer to the vessel.
+         */
+        void refreshVesselPairs(Vessel* vessel);
+
+        /*
+         * Requests the number of threads used to step Bullet, it's applied at the start of the
+         * next tick. With the multithreaded world they are the threads of the task scheduler
+         * (btDiscreteDynamicsWorldMt solves the constraints of a vessel in parallel), otherwise
+         * only the clusters are stepped in parallel (see stepWorlds). The value is clamped to
+         * [1, getMaxBulletThreads()]. Thread safe.
+         *
+         * @threads: number of threads.
+         */
+        void setBulletThreads(int threads);
+
+        /*
+         * Returns the number of threads used to step Bullet during the last tick.
+         */
+        int getBulletThreads() const;
+
+        /*
+         * Returns the maximum number of threads that can be used to step Bullet.
+         */
+        int getMaxBulletThreads() const;
+
+        /*
+         * Returns true if the dynamics world is multithreaded, see initDynamicsWorld.
+         */
+        bool isBulletMultithreaded() const;
+
         /*
          * Starts the bullet dynamics world. This should be ideally called at the start of the 
          * application.
          *
          * @gravity: gravity of the environment, defaults to 0 because we usually will apply our
          * own gravity.
+         * @multithreaded: if true the main world is a btDiscreteDynamicsWorldMt with a pool of
+         * constraint solvers, driven by the OpenMP task scheduler of Bullet. Bullet has to be
+         * built with BULLET2_USE_OPEN_MP_MULTITHREADING, otherwise we fall back to the sequential
+         * world.
+         * @multibody: if true (and not multithreaded) the worlds are btMultiBodyDynamicsWorld, so
+         * the vessels can be articulated (VESSEL_BODIES_ARTICULATED).
          */
-        void initDynamicsWorld(const btVector3& gravity = btVector3(0.0, 0.0, 0.0));
+        void initDynamicsWorld(const btVector3& gravity = btVector3(0.0, 0.0, 0.0),
+                               bool multithreaded = false, bool multibody = false);
 };
 
 
@@ -3,6 +3,7 @@
 #include "Physics.hpp"
 #include "AssetManager.hpp"
 #include "solvers.hpp"
+#include "kepler.hpp"
 #include "../assets/PlanetarySystem.hpp"
 
 
@@ -22,62 +23,21 @@ void Predictor::computeObjectPosVel(const orbital_data& data, std::uint32_t body
                                     dmath::vec3& velocity) const{
     const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
     double time_cent = time / SECONDS_IN_A_CENTURY;
-    double a = data.a_0 + data.a_d * time_cent;
-    double e = data.e_0 + data.e_d * time_cent;
-    double inc = data.i_0 + data.i_d * time_cent;
-    double L = data.L_0 + data.L_d * time_cent;
-    double p = data.p_0 + data.p_d * time_cent;
-    double W = data.W_0 + data.W_d * time_cent;
-
-    double M = L - p;
-    double w = p - W;
-    double E = M;
-    double ecc_d = 10.;
-
-    a *= AU_TO_METERS;
-
-    int iter = 0;
-    while(std::abs(ecc_d) > 1e-6 && iter < MAX_CONIC_SOLVER_ITER){
-        ecc_d = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
-        E -= ecc_d;
-        iter++;
-    }
-
-    double v = 2 * std::atan(std::sqrt((1 + e) / (1 - e)) * std::tan(E / 2));
-
-    double rad = a * (1 - e * std::cos(E));
-
-    origin.v[0] = rad * (std::cos(W) * std::cos(w + v) -
-                  std::sin(W) * std::sin(w + v) * std::cos(inc));
-    origin.v[1] = rad * (std::sin(inc) * std::sin(w + v));
-    origin.v[2] = rad * (std::sin(W) * std::cos(w + v) +
-                  std::cos(W) * std::sin(w + v) *std::cos(inc));
-
     double mu;
+
     if(body_target == 0)
         mu = GRAVITATIONAL_CONSTANT * planet_system->getStar().mass;
     else
         mu = GRAVITATIONAL_CONSTANT * 
              planet_system->getPlanets().at(body_target)->getOrbitalData().m;
 
-    double h = std::sqrt(mu * a * (1 - (e * e)));
-    double p_ = a * (1 - (e * e));
-
-    velocity.v[0] = (origin.v[0] * h * e / (rad * p_)) * std::sin(v) - (h / rad) *
-                    (std::cos(W) * std::sin(w + v) + std::sin(W) *
-                    std::cos(w + v) * std::cos(inc));
-    velocity.v[1] = (origin.v[1] * h * e / (rad * p_)) * std::sin(v) + (h / rad) * 
-                    (std::cos(w + v) * std::sin(inc));
-    velocity.v[2] = (origin.v[2] * h * e / (rad * p_)) * std::sin(v) - (h / rad) * 
-                    (std::sin(W) * std::sin(w + v) - std::cos(W) * 
-                    std::cos(w + v) * std::cos(inc));
+    kepler_state(data, mu, time_cent, origin, velocity);
 
     if(match_frame && body_target != 0){
         dmath::vec3 target_pos, target_vel;
-        const struct orbital_data& target_data = 
-            planet_system->getPlanets().at(body_target)->getOrbitalData();
 
-        computeObjectPosVel(target_data, 0, time, false, target_pos, target_vel);
+        planet_system->getPlanets().at(body_target)->computePosVel(time_cent, target_pos,
+                                                                    target_vel);
         origin += target_pos;
         velocity += target_vel;
     }
@@ -86,38 +46,264 @@ void Predictor::computeObjectPosVel(const orbital_data& data, std::uint32_t body
 
 void Predictor::computeObjectPos(const orbital_data& data, double time,
                                  dmath::vec3& planet_origin) const{
-    double e, W, w, inc, a, L, p, M, v;
-
-    // update planet position
-    a = data.a_0 + data.a_d * time;
-    e = data.e_0 + data.e_d * time;
-    inc = data.i_0 + data.i_d * time;
-    L = data.L_0 + data.L_d * time;
-    p = data.p_0 + data.p_d * time;
-    W = data.W_0 + data.W_d * time;
-
-
-    M = L - p;
-    w = p - W;
-
-    double E = M;
-    double ecc_d = 10.;
-    int iter = 0;
-    while(std::abs(ecc_d) > 1e-6 && iter < MAX_CONIC_SOLVER_ITER){
-        ecc_d = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
-        E -= ecc_d;
-        iter++;
+    kepler_position(data, time, planet_origin);
+}
+
+
+int Predictor::computeOrbitalElements(const dmath::vec3& origin, const dmath::vec3& velocity,
+                                      std::uint32_t body_target, double time,
+                                      orbital_data& data) const{
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    dmath::vec3 rel_origin = origin, rel_velocity = velocity;
+    double mu;
+
+    if(body_target == 0)
+        mu = GRAVITATIONAL_CONSTANT * planet_system->getStar().mass;
+    else{
+        dmath::vec3 target_pos, target_vel;
+        const Planet* target = planet_system->getPlanets().at(body_target).get();
+
+        target->computePosVel(time / SECONDS_IN_A_CENTURY, target_pos, target_vel);
+        rel_origin -= target_pos;
+        rel_velocity -= target_vel;
+        mu = GRAVITATIONAL_CONSTANT * target->getOrbitalData().m;
     }
 
-    v = 2 * std::atan(std::sqrt((1 + e) / (1 - e)) * std::tan(E / 2));
+    // our y axis is the z axis of the usual reference frame (see computeObjectPosVel)
+    dmath::vec3 r(rel_origin.v[0], rel_origin.v[2], rel_origin.v[1]);
+    dmath::vec3 v(rel_velocity.v[0], rel_velocity.v[2], rel_velocity.v[1]);
+    double rad = dmath::length(r);
+    double v2 = dmath::dot(v, v);
+
+    dmath::vec3 h = dmath::cross(r, v);
+    double h_len = dmath::length(h);
+    dmath::vec3 ecc_vec = (r * (v2 - mu / rad) - v * dmath::dot(r, v)) / mu;
+    double e = dmath::length(ecc_vec);
+
+    if(e >= 1.0 || h_len == 0.0)
+        return EXIT_FAILURE;
+
+    double a = 1.0 / (2.0 / rad - v2 / mu);
+    double inc = std::acos(h.v[2] / h_len);
+
+    // longitude of the ascending node, 0 if the orbit is equatorial
+    double W = 0.0;
+    if(std::sqrt(h.v[0] * h.v[0] + h.v[1] * h.v[1]) > 1e-12 * h_len)
+        W = std::atan2(h.v[0], -h.v[1]);
+
+    // basis of the orbital plane, node_dir points to the ascending node
+    dmath::vec3 node_dir(std::cos(W), std::sin(W), 0.0);
+    dmath::vec3 node_perp = dmath::cross(h / h_len, node_dir);
+
+    double w = 0.0;
+    if(e > 1e-10)
+        w = std::atan2(dmath::dot(ecc_vec, node_perp), dmath::dot(ecc_vec, node_dir));
+
+    double u = std::atan2(dmath::dot(r, node_perp), dmath::dot(r, node_dir)); // argument of latitude
+    double nu = u - w;
+    double E = 2 * std::atan(std::sqrt((1 - e) / (1 + e)) * std::tan(nu / 2));
+    double M = E - e * std::sin(E);
+    double mean_motion = std::sqrt(mu / (a * a * a));
+
+    data.m = 0.0;
+    data.r = 0.0;
+    data.a_0 = a / AU_TO_METERS;
+    data.e_0 = e;
+    data.i_0 = inc;
+    data.W_0 = W;
+    data.p_0 = W + w;
+    data.L_d = mean_motion * SECONDS_IN_A_CENTURY;
+    data.L_0 = M + data.p_0 - data.L_d * time / SECONDS_IN_A_CENTURY;
+    data.a_d = 0.0;
+    data.e_d = 0.0;
+    data.i_d = 0.0;
+    data.p_d = 0.0;
+    data.W_d = 0.0;
+
+    data.a = data.a_0;
+    data.e = e;
+    data.i = inc;
+    data.L = M + data.p_0;
+    data.p = data.p_0;
+    data.W = W;
+    data.M = M;
+    data.w = w;
+    data.E = E;
+    data.v = nu;
+    data.period = 2 * M_PI / mean_motion;
+    data.pos = rel_origin;
+    data.pos_prev = rel_origin;
+
+    return EXIT_SUCCESS;
+}
+
 
-    double rad = a * (1 - e * std::cos(E)) * AU_TO_METERS;
+std::uint32_t Predictor::getDominantBody(const dmath::vec3& origin) const{
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    const planet_map& planets = planet_system->getPlanets();
+    planet_map::const_iterator it;
+    double star_mass = planet_system->getStar().mass;
+    std::uint32_t dominant = 0;
+    double dominant_soi = 0.0;
 
-    planet_origin.v[0] = rad * (std::cos(W) * std::cos(w + v) -
-                         std::sin(W) * std::sin(w + v) * std::cos(inc));
-    planet_origin.v[1] = rad * (std::sin(inc) * std::sin(w + v));
-    planet_origin.v[2] = rad * (std::sin(W) * std::cos(w + v) +
-                         std::cos(W) * std::sin(w + v) *std::cos(inc));
+    for(it = planets.begin(); it != planets.end(); it++){
+        const orbital_data& data = it->second->getOrbitalData();
+        double soi = sphere_of_influence(data.a_0 * AU_TO_METERS, data.m, star_mass);
+
+        // the smallest sphere wins if they overlap (moons, if we ever have them)
+        if(dmath::distance(origin, data.pos) < soi && (!dominant || soi < dominant_soi)){
+            dominant = it->first;
+            dominant_soi = soi;
+        }
+    }
+
+    return dominant;
+}
+
+
+void Predictor::packGravitySources(double cent_since_j2000, gravity_sources& sources) const{
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    planet_map::const_iterator it;
+    const planet_map& planets = planet_system->getPlanets();
+    double star_mass = planet_system->getStar().mass;
+
+    // the star, centered at (0, 0, 0), and the planets
+    sources.clear();
+    sources.add(0.0, 0.0, 0.0, GRAVITATIONAL_CONSTANT * star_mass);
+    for(it=planets.begin();it!=planets.end();it++){
+        const orbital_data& data = it->second->getOrbitalData();
+        dmath::vec3 planet_origin;
+        it->second->computePosition(cent_since_j2000, planet_origin);
+
+        sources.add(planet_origin.v[0], planet_origin.v[1], planet_origin.v[2],
+                    GRAVITATIONAL_CONSTANT * data.m,
+                    sphere_of_influence(data.a_0 * AU_TO_METERS, data.m, star_mass));
+    }
+}
+
+
+bool Predictor::getPatchBody(double time, const dmath::vec3& origin,
+                             std::uint32_t& body) const{
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    const planet_map& planets = planet_system->getPlanets();
+    planet_map::const_iterator it;
+    double star_mass = planet_system->getStar().mass;
+    double body_soi = 0.0;
+
+    body = 0;
+    for(it = planets.begin(); it != planets.end(); it++){
+        const orbital_data& data = it->second->getOrbitalData();
+        double soi = sphere_of_influence(data.a_0 * AU_TO_METERS, data.m, star_mass);
+        double distance;
+        dmath::vec3 planet_origin;
+
+        it->second->computePosition(time / SECONDS_IN_A_CENTURY, planet_origin);
+        distance = dmath::distance(origin, planet_origin);
+
+        if(distance < soi * (1.0 - PREDICTOR_SOI_MARGIN)){
+            if(!body || soi < body_soi){
+                body = it->first;
+                body_soi = soi;
+            }
+        }
+        else if(distance < soi * (1.0 + PREDICTOR_SOI_MARGIN))
+            return false;
+    }
+
+    return true;
+}
+
+
+void Predictor::pushTrajectoryPoint(std::vector<GLfloat>& buffer, const dmath::vec3& origin,
+                                    double time, const struct fixed_time_trajectory_config& config,
+                                    const dmath::vec3& original_relative_pos) const{
+    const planet_map& planets = m_app->getAssetManager()->m_planetary_system->getPlanets();
+    dmath::vec3 planet_disp(0.0, 0.0, 0.0);
+
+    if(config.relative_to != 0){
+        dmath::vec3 planet_origin;
+
+        planets.at(config.relative_to)->computePosition(time / SECONDS_IN_A_CENTURY,
+                                                        planet_origin);
+        planet_disp = original_relative_pos - planet_origin;
+    }
+
+    buffer.push_back((origin.v[0] + planet_disp.v[0]) / config.predictor_scale);
+    buffer.push_back((origin.v[1] + planet_disp.v[1]) / config.predictor_scale);
+    buffer.push_back((origin.v[2] + planet_disp.v[2]) / config.predictor_scale);
+}
+
+
+bool Predictor::propagateConic(std::vector<GLfloat>& buffer, struct particle_state& state,
+                               double& time, double end_time,
+                               const struct fixed_time_trajectory_config& config,
+                               const dmath::vec3& original_relative_pos) const{
+    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
+    const planet_map& planets = planet_system->getPlanets();
+    double max_delta_t = config.predictor_period_secs / config.predictor_steps;
+    double prev_time = time, mu;
+    std::uint32_t body, sample_body;
+    orbital_data conic;
+    kepler_orbits orbit;
+    kepler_states samples;
+    std::vector<double> sample_times;
+
+    if(end_time - time <= PREDICTOR_MIN_STEP || !getPatchBody(time, state.origin, body) ||
+       computeOrbitalElements(state.origin, state.velocity, body, time, conic) == EXIT_FAILURE ||
+       conic.e_0 >= PREDICTOR_MAX_CONIC_ECCENTRICITY)
+        return false;
+
+    if(body == 0)
+        mu = GRAVITATIONAL_CONSTANT * planet_system->getStar().mass;
+    else
+        mu = GRAVITATIONAL_CONSTANT * planets.at(body)->getOrbitalData().m;
+
+    // all the samples up to the end in a batch, the ones after a crossing are thrown away
+    orbit.add(conic, mu);
+    for(double t = time; end_time - t > PREDICTOR_MIN_STEP;){
+        t = std::min(t + max_delta_t, end_time);
+        sample_times.push_back(t);
+        samples.add(0, t / SECONDS_IN_A_CENTURY);
+    }
+    propagate_kepler(orbit, samples);
+
+    for(uint i=0; i < sample_times.size(); i++){
+        dmath::vec3 origin(samples.x[i], samples.y[i], samples.z[i]), velocity;
+
+        if(body != 0){
+            dmath::vec3 body_origin;
+
+            planets.at(body)->computePosition(samples.time[i], body_origin);
+            origin += body_origin;
+        }
+
+        if(!getPatchBody(sample_times.at(i), origin, sample_body) || sample_body != body){
+            // the particle entered a band between the last sample and this one
+            double low = prev_time, high = sample_times.at(i);
+
+            while(high - low > PREDICTOR_CROSSING_TOLERANCE){
+                double mid = (low + high) / 2;
+
+                computeObjectPosVel(conic, body, mid, true, origin, velocity);
+                if(getPatchBody(mid, origin, sample_body) && sample_body == body)
+                    low = mid;
+                else
+                    high = mid;
+            }
+
+            time = high;
+            computeObjectPosVel(conic, body, time, true, state.origin, state.velocity);
+            pushTrajectoryPoint(buffer, state.origin, time, config, original_relative_pos);
+            return true;
+        }
+
+        pushTrajectoryPoint(buffer, origin, sample_times.at(i), config, original_relative_pos);
+        prev_time = sample_times.at(i);
+    }
+
+    time = prev_time;
+    computeObjectPosVel(conic, body, time, true, state.origin, state.velocity);
+    return true;
 }
 
 
@@ -128,11 +314,19 @@ void Predictor::computeTrajectoriesRender(std::vector<std::vector<GLfloat>>& pos
     assert(config.predictor_period_secs);
     assert(config.predictor_steps);
 
-    const PlanetarySystem* planet_system = m_app->getAssetManager()->m_planetary_system.get();
-    planet_map::const_iterator it;
-    const planet_map& planets = planet_system->getPlanets();
+    if(config.integrator != PREDICTOR_SYMPLECTIC_EULER){
+        position_buffers.resize(states.size());
+        for(uint i=0; i < states.size(); i++)
+            computeTrajectoryAdaptive(position_buffers.at(i), states.at(i), config);
+        return;
+    }
+
+    const planet_map& planets = m_app->getAssetManager()->m_planetary_system->getPlanets();
     dmath::vec3 original_relative_pos;
-    double star_mass = planet_system->getStar().mass;
+    gravity_sources sources;
+    gravity_bodies bodies;
+    std::vector<gravity_set> sets(states.size());
+    std::vector<std::uint64_t> masks(states.size());
 
     double time = config.predictor_start_time / SECONDS_IN_A_CENTURY;
     double predictor_delta_t_cent = config.predictor_period_secs / config.predictor_steps / 
@@ -150,47 +344,41 @@ void Predictor::computeTrajectoriesRender(std::vector<std::vector<GLfloat>>& pos
         position_buffers.at(i).push_back(states.at(i).origin.v[2] / config.predictor_scale);
     }
 
+    // from the ephemeris, the orbital data of the planets may be published meanwhile
     if(config.relative_to != 0)
-        original_relative_pos = planets.at(config.relative_to)->getOrbitalData().pos;
+        planets.at(config.relative_to)->computePosition(time, original_relative_pos);
 
     for(int i=0; i < config.predictor_steps; i++){
         dmath::vec3 planet_disp; // displacement of the planet we're rendering the orbit relative to
 
         time += predictor_delta_t_cent;
-        // iterate over each planet
-        for(it=planets.begin();it!=planets.end();it++){
-            const orbital_data& data = it->second->getOrbitalData();
+
+        packGravitySources(time, sources);
+        if(config.relative_to != 0){
             dmath::vec3 planet_origin;
-            computeObjectPos(data, time, planet_origin);
 
-            if(it->second->getId() == config.relative_to)
-                planet_disp = original_relative_pos - planet_origin;
+            planets.at(config.relative_to)->computePosition(time, planet_origin);
+            planet_disp = original_relative_pos - planet_origin;
+        }
 
-            // iterate over each object
-            for(uint j = 0; j < states.size(); j++){
-                struct particle_state& current = states.at(j);
+        // each particle only gets the pull of its sources, the sets are refreshed when it
+        // crosses a sphere of influence
+        bodies.clear();
+        for(uint j = 0; j < states.size(); j++){
+            const dmath::vec3& origin = states.at(j).origin;
 
-                // update gravity force on current particle
-                double Rh = dmath::distance(planet_origin, current.origin);
-                double acceleration = GRAVITATIONAL_CONSTANT * (data.m / (Rh*Rh));
-                dmath::vec3 f = dmath::normalise(planet_origin - current.origin)
-                                                 * acceleration * current.mass;
-                current.total_force += f;
-            }
+            select_gravity_sources(sources, origin.v[0], origin.v[1], origin.v[2],
+                                   config.gravity_threshold, sets.at(j));
+            masks.at(j) = sets.at(j).mask;
+            bodies.add(origin.v[0], origin.v[1], origin.v[2]);
         }
+        compute_gravity_selected(sources, bodies, masks);
 
         for(uint j = 0; j < states.size(); j++){
             struct particle_state& current = states.at(j);
-            // force of the star
-            double Rh = dmath::length(current.origin); // centered star com at (0, 0, 0)
-            double acceleration = GRAVITATIONAL_CONSTANT * (star_mass / (Rh*Rh));
-            //dmath::vec3 f = dmath::normalise(-current.origin) * acceleration * current.mass; // does not work?
-            dmath::vec3 f = dmath::normalise(dmath::vec3(-current.origin.v[0],
-                                                         -current.origin.v[1],
-                                                         -current.origin.v[2]))
-                                             * acceleration * current.mass;
 
-            current.total_force += f;
+            current.total_force += dmath::vec3(bodies.ax[j], bodies.ay[j], bodies.az[j]) *
+                                   current.mass;
 
             // solve motion current step
             solverSymplecticEuler(current, config.predictor_period_secs / config.predictor_steps);
@@ -214,6 +402,80 @@ void Predictor::computeTrajectoriesRender(std::vector<std::vector<GLfloat>>& pos
 }
 
 
+void Predictor::computeTrajectoryAdaptive(std::vector<GLfloat>& buffer,
+                                          struct particle_state& state,
+                                          const struct fixed_time_trajectory_config& config) const{
+    const planet_map& planets = m_app->getAssetManager()->m_planetary_system->getPlanets();
+    dmath::vec3 original_relative_pos;
+    gravity_sources sources;
+    gravity_bodies bodies;
+    gravity_set set;
+    std::vector<std::uint64_t> masks(1);
+    bool patched = config.integrator == PREDICTOR_PATCHED_CONIC;
+
+    double time = config.predictor_start_time; // seconds
+    double end_time = time + config.predictor_period_secs;
+    double max_delta_t = config.predictor_period_secs / config.predictor_steps;
+    double delta_t = max_delta_t;
+
+    // the sources are packed again for each evaluation, the stages are at different times
+    auto acceleration = [&](double t, const dmath::vec3& origin) -> dmath::vec3{
+        packGravitySources(t / SECONDS_IN_A_CENTURY, sources);
+        select_gravity_sources(sources, origin.v[0], origin.v[1], origin.v[2],
+                               config.gravity_threshold, set);
+        masks.at(0) = set.mask;
+        bodies.clear();
+        bodies.add(origin.v[0], origin.v[1], origin.v[2]);
+        compute_gravity_selected(sources, bodies, masks);
+
+        return dmath::vec3(bodies.ax[0], bodies.ay[0], bodies.az[0]);
+    };
+
+    if(config.relative_to != 0)
+        planets.at(config.relative_to)->computePosition(time / SECONDS_IN_A_CENTURY,
+                                                        original_relative_pos);
+
+    buffer.clear();
+    buffer.reserve(3 * (config.predictor_steps + 1));
+    buffer.push_back(state.origin.v[0] / config.predictor_scale);
+    buffer.push_back(state.origin.v[1] / config.predictor_scale);
+    buffer.push_back(state.origin.v[2] / config.predictor_scale);
+
+    if(patched)
+        propagateConic(buffer, state, time, end_time, config, original_relative_pos);
+    state.total_force = acceleration(time, state.origin) * state.mass;
+
+    for(int i=0; i < PREDICTOR_MAX_ADAPTIVE_STEPS && end_time - time > PREDICTOR_MIN_STEP; i++){
+        double step = std::min(std::min(delta_t, max_delta_t), end_time - time);
+
+        if(config.integrator == PREDICTOR_ADAPTIVE_LEAPFROG){
+            solverAdaptiveLeapfrog(state, time, step, config.eta, acceleration);
+            delta_t = step;
+        }
+        else{
+            bool accepted = solverDormandPrince(state, time, step, config.tolerance,
+                                                acceleration);
+            delta_t = step;
+            if(delta_t < PREDICTOR_MIN_STEP)
+                break;
+            if(!accepted)
+                continue;
+        }
+
+        pushTrajectoryPoint(buffer, state.origin, time, config, original_relative_pos);
+
+        if(delta_t < PREDICTOR_MIN_STEP)
+            break;
+
+        // back to the closed form once the particle is out of the band and on an ellipse, the
+        // force at the start of the next step is stale then
+        if(patched && propagateConic(buffer, state, time, end_time, config,
+                                     original_relative_pos))
+            state.total_force = acceleration(time, state.origin) * state.mass;
+    }
+}
+
+
 /*void compute_trajectories_double(const PlanetarySystem* planet_system,
                                  std::vector<std::vector<dmath::vec3>>& positions,
                                  std::vector<struct particle_state>& states,
@@ -5,11 +5,10 @@
 #include <bullet/btBulletDynamicsCommon.h>
 
 #include "maths_funcs.hpp"
+#include "gravity.hpp"
 #include "../assets/Planet.hpp"
 
 
-#define MAX_CONIC_SOLVER_ITER 10
-
 class BaseApp;
 class PlanetarySystem;
 
@@ -54,12 +53,43 @@ struct particle_state{
 };
 
 
+/* integrators of the predictor, see solvers.hpp */
+#define PREDICTOR_SYMPLECTIC_EULER 0 // fixed step, predictor_period_secs / predictor_steps
+#define PREDICTOR_DORMAND_PRINCE 1 // adaptive, error control with tolerance
+#define PREDICTOR_ADAPTIVE_LEAPFROG 2 // adaptive, step from eta
+#define PREDICTOR_PATCHED_CONIC 3 // closed form inside the spheres, Dormand-Prince near them
+
+#define DEFAULT_PREDICTOR_TOLERANCE 1e-9
+#define DEFAULT_PREDICTOR_ETA 0.01
+/* bound of the steps (accepted or not) of the adaptive integrators per particle */
+#define PREDICTOR_MAX_ADAPTIVE_STEPS 100000
+/* the adaptive integrators give up if the step gets shorter than this (seconds), the particle has
+   fallen into a point mass */
+#define PREDICTOR_MIN_STEP 1e-3
+/* the patched conics are only used this fraction inside a sphere of influence (or outside, for
+   the star), the band in between is integrated numerically */
+#define PREDICTOR_SOI_MARGIN 0.2
+/* precision of the crossing times of the bands, in seconds */
+#define PREDICTOR_CROSSING_TOLERANCE 1.0
+/* more eccentric conics are integrated, the Kepler solver is only exact below this (kepler.hpp) */
+#define PREDICTOR_MAX_CONIC_ECCENTRICITY 0.95
+
+
+/*
+ * Configuration of the predictor. With the adaptive integrators predictor_period_secs /
+ * predictor_steps is the longest step (so the rendered line has at least predictor_steps
+ * segments), and they take shorter steps where the trajectory bends, like in a flyby.
+ */
 struct fixed_time_trajectory_config{
     double predictor_start_time;
     double predictor_period_secs;
     int predictor_steps;
     float predictor_scale;
     std::uint32_t relative_to;
+    double gravity_threshold; // see select_gravity_sources, 0 to evaluate every planet
+    int integrator; // PREDICTOR_*
+    double tolerance; // relative local error per step of PREDICTOR_DORMAND_PRINCE
+    double eta; // fraction of the dynamical time per step of PREDICTOR_ADAPTIVE_LEAPFROG
 
     fixed_time_trajectory_config(){
         predictor_start_time = 0;
@@ -67,15 +97,25 @@ struct fixed_time_trajectory_config{
         predictor_steps = 400;
         predictor_scale = 1.0;
         relative_to = 0;
+        gravity_threshold = DEFAULT_GRAVITY_CULL_THRESHOLD;
+        integrator = PREDICTOR_DORMAND_PRINCE;
+        tolerance = DEFAULT_PREDICTOR_TOLERANCE;
+        eta = DEFAULT_PREDICTOR_ETA;
     }
 
     fixed_time_trajectory_config(double start_time, double period_secs, int steps,
-                                 float scale, std::uint32_t relative){
+                                 float scale, std::uint32_t relative,
+                                 double threshold=DEFAULT_GRAVITY_CULL_THRESHOLD,
+                                 int solver=PREDICTOR_DORMAND_PRINCE){
         predictor_start_time = start_time;
         predictor_period_secs = period_secs;
         predictor_steps = steps;
         predictor_scale = scale;
         relative_to = relative;
+        gravity_threshold = threshold;
+        integrator = solver;
+        tolerance = DEFAULT_PREDICTOR_TOLERANCE;
+        eta = DEFAULT_PREDICTOR_ETA;
     }
 };
 
@@ -83,6 +123,72 @@ struct fixed_time_trajectory_config{
 class Predictor{
     private:
         const BaseApp* m_app;
+
+        /*
+         * Fills sources with the star and the planets at the given time, with their spheres of
+         * influence.
+         *
+         * @cent_since_j2000: time, in centuries.
+         * @sources: output sources, cleared first.
+         */
+        void packGravitySources(double cent_since_j2000, gravity_sources& sources) const;
+
+        /*
+         * Finds the body whose conic the patched conic predictor follows at the given point: the
+         * planet whose sphere of influence, shrunk by PREDICTOR_SOI_MARGIN, contains the origin,
+         * or the star if the origin is outside every sphere grown by the margin. Returns false if
+         * the origin is in the band around a sphere, where both pulls matter. Uses the ephemeris.
+         *
+         * @time: time, in seconds.
+         * @origin: cartesian coordinates of the particle.
+         * @body: will contain the id of the body, 0 for the star.
+         */
+        bool getPatchBody(double time, const dmath::vec3& origin, std::uint32_t& body) const;
+
+        /*
+         * Adds the position of a particle to its render buffer, see computeTrajectoriesRender.
+         *
+         * @buffer: render buffer of the particle.
+         * @origin: cartesian coordinates of the particle.
+         * @time: time of the position, in seconds.
+         * @config: configuration of the prediction.
+         * @original_relative_pos: position of config.relative_to at the start of the prediction.
+         */
+        void pushTrajectoryPoint(std::vector<GLfloat>& buffer, const dmath::vec3& origin,
+                                 double time, const struct fixed_time_trajectory_config& config,
+                                 const dmath::vec3& original_relative_pos) const;
+
+        /*
+         * Closed form part of PREDICTOR_PATCHED_CONIC. If the particle has a patch body (see
+         * getPatchBody) and its orbit around it is elliptic, the conic is sampled every
+         * predictor_period_secs / predictor_steps with propagate_kepler until the end of the
+         * prediction or until the particle enters a band, whose crossing time is found by
+         * bisection. The samples are added to the buffer and the particle and the time are
+         * advanced. Returns false if the particle isn't in a conic, nothing is done then.
+         *
+         * @buffer: render buffer of the particle.
+         * @state: motion state of the particle, its total_force is not updated.
+         * @time: time of the particle, in seconds.
+         * @end_time: end of the prediction, in seconds.
+         * @config: configuration of the prediction.
+         * @original_relative_pos: position of config.relative_to at the start of the prediction.
+         */
+        bool propagateConic(std::vector<GLfloat>& buffer, struct particle_state& state,
+                            double& time, double end_time,
+                            const struct fixed_time_trajectory_config& config,
+                            const dmath::vec3& original_relative_pos) const;
+
+        /*
+         * computeTrajectoriesRender for a single particle with one of the adaptive integrators
+         * (or the patched conics, whose numerical parts use Dormand-Prince), each particle takes
+         * its own steps so they are predicted one by one. The buffer gets a point per step.
+         *
+         * @buffer: output buffer of the particle, see computeTrajectoriesRender.
+         * @state: initial motion state of the particle.
+         * @config: configuration of the prediction.
+         */
+        void computeTrajectoryAdaptive(std::vector<GLfloat>& buffer, struct particle_state& state,
+                                       const struct fixed_time_trajectory_config& config) const;
     public:
         Predictor(const BaseApp* app);
         ~Predictor();
@@ -109,14 +215,40 @@ class Predictor{
 
         /*
          * Calculates the position of the object with the parameters given in data (check Planet.hpp) at
-         * the queried time.
+         * the queried time by solving Kepler's equation (kepler_position). The positions of the
+         * planets should be queried with Planet::computePosition, which uses their ephemeris.
          * 
          * @data: the orbital parameters of the object (struct defined in Planet.hpp).
          * @time: the time at which we want to know the position. In centuries.
          * @planet_origin: is updated with the position of the planet at the queried time
          */
         void computeObjectPos(const orbital_data& data, double time, dmath::vec3& planet_origin) const;
-                                          
+
+        /*
+         * Inverse of computeObjectPosVel, computes the orbital elements of an object from its
+         * cartesian origin and velocity. The rates (a_d, e_d, etc) are set to 0 except L_d, which
+         * is the mean motion, so computeObjectPosVel propagates the orbit as a fixed conic. The
+         * state is absolute (the frame of the star), the state of the target is subtracted here.
+         * Returns EXIT_FAILURE if the orbit is not elliptic, the Kepler solver can't handle it.
+         *
+         * @origin: cartesian coordinates of the object.
+         * @velocity: velocity of the object.
+         * @body_target: id of the planet that the object orbits, 0 if it orbits the star.
+         * @time: time of the state, in seconds.
+         * @data: will contain the orbital parameters of the object.
+         */
+        int computeOrbitalElements(const dmath::vec3& origin, const dmath::vec3& velocity,
+                                   std::uint32_t body_target, double time,
+                                   orbital_data& data) const;
+
+        /*
+         * Returns the id of the planet whose sphere of influence contains the given origin, or 0
+         * if the star is the dominant body. Uses the current positions of the planets.
+         *
+         * @origin: cartesian coordinates of the object.
+         */
+        std::uint32_t getDominantBody(const dmath::vec3& origin) const;
+
         /*
          * This function computes the trajectories of different particles given their initial
          * motion state and a planetary system object. These predictions are used specifically to
@@ -124,13 +256,20 @@ class Predictor{
          * the starting time of the simulation (which determines the initial position of the
          * planets), the number of steps, the time delta of each step, and the scale of the stored 
          * coordinates. The precision of the predictions depends on the time delta of each step and 
-         * the number of steps.
+         * the number of steps. The planets whose pull is below config.gravity_threshold are culled
+         * (see select_gravity_sources), the set of each particle is refreshed when it crosses a
+         * sphere of influence. Only uses the ephemeris of the planets, so it can run in a worker
+         * thread (see PredictorService).
          * 
          * @position_buffers: reference to a vector of vectors of float (does not need to be
          * initialised). Each buffer belongs to a particle, and will contiguously contain the 3D
          * location of the particle at each time step, the components of the coordinates are also
          * contiguous (x1, y1, z1, x2, y2, z2, etc). These buffers can directly be used to render
-         * the trajectories of the praticles. Returns a buffer of size (predictor_steps + 1) * 3.
+         * the trajectories of the praticles. With PREDICTOR_SYMPLECTIC_EULER each buffer has size
+         * (predictor_steps + 1) * 3, with the adaptive integrators it has a point per step taken.
+         * With PREDICTOR_PATCHED_CONIC, the particles that orbit a single body are propagated in
+         * closed form (the pull of the rest of bodies is ignored) and only the crossings of the
+         * spheres of influence and the non elliptic orbits (flybys) are integrated.
          * @states: the initial motion states of each particle.
          * @config: struct of type fixed_time_trajectory_config (defined above) with the
          * configuration parameters of the trajectory, .
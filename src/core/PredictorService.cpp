@@ -0,0 +1,146 @@
+#include <cmath>
+
+#include "PredictorService.hpp"
+#include "log.hpp"
+
+
+/* set in m_middle when the worker has published a result the consumer hasn't taken */
+#define RESULT_FRESH 4
+
+
+PredictorService::PredictorService(const Predictor* predictor){
+    m_predictor = predictor;
+    m_end = false;
+    m_has_key = false;
+    m_back = 0;
+    m_middle = 1;
+    m_front = 2;
+    m_version = 0;
+    m_num_computed = 0;
+    m_num_hits = 0;
+
+    m_thread = std::thread(&PredictorService::run, this);
+}
+
+
+PredictorService::~PredictorService(){
+    {
+        std::unique_lock<std::mutex> lck(m_monitor.mtx_start);
+        m_end = true;
+        m_monitor.worker_start = true;
+        m_monitor.cv_start.notify_all();
+    }
+    m_thread.join();
+    log("PredictorService::~PredictorService: ", m_num_computed.load(), " predictions, ",
+        m_num_hits.load(), " cache hits");
+}
+
+
+void PredictorService::run(){
+    std::vector<struct particle_state> states;
+    struct fixed_time_trajectory_config config;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lck(m_monitor.mtx_start);
+            while(!m_monitor.worker_start){
+                m_monitor.cv_start.wait(lck);
+            }
+            m_monitor.worker_start = false;
+
+            if(m_end)
+                break;
+
+            // the requests submitted from now on replace this one
+            states = m_pending_states;
+            config = m_pending_config;
+        }
+
+        trajectory_result& back = m_results[m_back];
+
+        m_predictor->computeTrajectoriesRender(back.position_buffers, states, config);
+        back.config = config;
+        back.version = ++m_version;
+
+        m_back = m_middle.exchange(m_back | RESULT_FRESH, std::memory_order_acq_rel) &
+                 ~RESULT_FRESH;
+        m_num_computed++;
+    }
+}
+
+
+bool PredictorService::isCached(const std::vector<struct particle_state>& states,
+                                const struct fixed_time_trajectory_config& config) const{
+    if(!m_has_key || states.size() != m_key_states.size())
+        return false;
+
+    if(config.predictor_period_secs != m_key_config.predictor_period_secs ||
+       config.predictor_steps != m_key_config.predictor_steps ||
+       config.predictor_scale != m_key_config.predictor_scale ||
+       config.relative_to != m_key_config.relative_to ||
+       config.gravity_threshold != m_key_config.gravity_threshold ||
+       config.integrator != m_key_config.integrator ||
+       config.tolerance != m_key_config.tolerance ||
+       config.eta != m_key_config.eta)
+        return false;
+
+    double step = config.predictor_period_secs / config.predictor_steps;
+    if(std::abs(config.predictor_start_time - m_key_config.predictor_start_time) >
+       step * PREDICTOR_EPOCH_TOLERANCE)
+        return false;
+
+    // the mass doesn't change the trajectory
+    for(uint i=0; i < states.size(); i++){
+        const struct particle_state& key = m_key_states.at(i);
+
+        if(dmath::length(states.at(i).origin - key.origin) / config.predictor_scale >
+           PREDICTOR_POSITION_TOLERANCE)
+            return false;
+        if(dmath::length(states.at(i).velocity - key.velocity) >
+           PREDICTOR_VELOCITY_TOLERANCE * dmath::length(key.velocity))
+            return false;
+    }
+
+    return true;
+}
+
+
+bool PredictorService::submit(const std::vector<struct particle_state>& states,
+                              const struct fixed_time_trajectory_config& config){
+    if(isCached(states, config)){
+        m_num_hits++;
+        return false;
+    }
+
+    m_key_states = states;
+    m_key_config = config;
+    m_has_key = true;
+
+    std::unique_lock<std::mutex> lck(m_monitor.mtx_start);
+    m_pending_states = states;
+    m_pending_config = config;
+    m_monitor.worker_start = true;
+    m_monitor.cv_start.notify_all();
+
+    return true;
+}
+
+
+const trajectory_result* PredictorService::getResult(){
+    if(m_middle.load(std::memory_order_relaxed) & RESULT_FRESH)
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~RESULT_FRESH;
+
+    if(!m_results[m_front].version)
+        return nullptr;
+    return &m_results[m_front];
+}
+
+
+std::uint64_t PredictorService::getNumComputed() const{
+    return m_num_computed.load();
+}
+
+
+std::uint64_t PredictorService::getNumHits() const{
+    return m_num_hits.load();
+}
@@ -0,0 +1,137 @@
+#ifndef PREDICTOR_SERVICE_HPP
+#define PREDICTOR_SERVICE_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "Predictor.hpp"
+#include "multithreading.hpp"
+
+
+/* a request is a cache hit if the positions moved less than this, in rendered units (meters
+   divided by predictor_scale) */
+#define PREDICTOR_POSITION_TOLERANCE 1e-3
+/* same, for the velocities, relative to the magnitude of the cached velocity */
+#define PREDICTOR_VELOCITY_TOLERANCE 1e-4
+/* same, for the start time, in steps of the prediction (predictor_period_secs / predictor_steps) */
+#define PREDICTOR_EPOCH_TOLERANCE 0.5
+
+
+/*
+ * A finished prediction, see Predictor::computeTrajectoriesRender.
+ *
+ * @position_buffers: one buffer per particle with the coordinates of its points, (predictor_steps +
+ * 1) * 3 of them with PREDICTOR_SYMPLECTIC_EULER, a point per step taken with the adaptive
+ * integrators (at least predictor_steps + 1).
+ * @config: configuration of the prediction.
+ * @version: increases with each prediction, 0 if the result is empty.
+ */
+struct trajectory_result{
+    std::vector<std::vector<GLfloat>> position_buffers;
+    struct fixed_time_trajectory_config config;
+    std::uint64_t version;
+
+    trajectory_result(){
+        version = 0;
+    }
+};
+
+
+/*
+ * Computes the trajectory predictions of the planetarium in a worker thread, so the render thread
+ * only submits requests and picks up finished results, it never waits for the predictor.
+ *
+ * Requests are coalesced: the worker always takes the last one, the ones submitted while it was
+ * busy are dropped. A request whose states, configuration and start time are within the
+ * PREDICTOR_*_TOLERANCE of the last submitted one is a cache hit and is not submitted at all, so
+ * the predictor only runs when the trajectory would actually look different (the vessel
+ * maneuvers, the time advances more than half a step, the GUI changes the configuration...).
+ *
+ * The results are handed to the consumer with a triple buffer: the worker writes the back buffer
+ * and swaps it with the middle one with an atomic exchange, the consumer swaps the middle buffer
+ * with its front buffer if it's fresh. Nobody waits for anybody and the buffers are reused, so
+ * nothing gets allocated once they are big enough. There must be a single consumer thread.
+ */
+
+class PredictorService{
+    private:
+        const Predictor* m_predictor;
+
+        std::thread m_thread;
+        struct thread_monitor m_monitor;
+        bool m_end; // protected by m_monitor.mtx_start
+
+        // last request, written by submit and taken by the worker under m_monitor.mtx_start
+        std::vector<struct particle_state> m_pending_states;
+        struct fixed_time_trajectory_config m_pending_config;
+
+        // key of the last submitted request, only accessed by the submitting thread
+        std::vector<struct particle_state> m_key_states;
+        struct fixed_time_trajectory_config m_key_config;
+        bool m_has_key;
+
+        // triple buffer, m_back belongs to the worker and m_front to the consumer
+        trajectory_result m_results[3];
+        std::atomic<int> m_middle; // index of the middle buffer, ored with RESULT_FRESH
+        int m_back, m_front;
+        std::uint64_t m_version; // worker only
+
+        std::atomic<std::uint64_t> m_num_computed, m_num_hits;
+
+        /*
+         * Worker loop, launched by the constructor.
+         */
+        void run();
+
+        /*
+         * Returns true if the request is within the tolerances of the last submitted one.
+         */
+        bool isCached(const std::vector<struct particle_state>& states,
+                      const struct fixed_time_trajectory_config& config) const;
+    public:
+        /*
+         * Constructor, launches the worker thread.
+         *
+         * @predictor: predictor used to compute the trajectories, has to outlive the service.
+         */
+        PredictorService(const Predictor* predictor);
+
+        /*
+         * Destructor, tells the worker to stop and joins it. If it's computing a prediction the
+         * destructor waits for it to end.
+         */
+        ~PredictorService();
+
+        /*
+         * Submits a prediction to the worker, unless it's a cache hit (see isCached). Returns true
+         * if the request was submitted. Never blocks for longer than the copy of the states.
+         *
+         * @states: initial motion states of each particle.
+         * @config: configuration of the prediction, see Predictor::computeTrajectoriesRender.
+         */
+        bool submit(const std::vector<struct particle_state>& states,
+                    const struct fixed_time_trajectory_config& config);
+
+        /*
+         * Returns the last finished prediction, or nullptr if there's none yet. The result is
+         * valid until the next call to this method, which has to be made by the same thread.
+         */
+        const trajectory_result* getResult();
+
+        /*
+         * Returns the number of predictions computed by the worker.
+         */
+        std::uint64_t getNumComputed() const;
+
+        /*
+         * Returns the number of requests that were cache hits.
+         */
+        std::uint64_t getNumHits() const;
+};
+
+
+#endif
@@ -0,0 +1,234 @@
+#include <iostream>
+
+#include "Recorder.hpp"
+#include "log.hpp"
+
+
+template<typename T> static void write_value(std::ofstream& output, const T& value){
+    output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+template<typename T> static bool read_value(std::ifstream& input, T& value){
+    input.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(input);
+}
+
+
+Recorder::Recorder(){
+    m_mode = RECORDER_OFF;
+    m_seed = 0;
+    m_frames = 0;
+    m_divergent_frames = 0;
+    m_first_divergence = -1;
+}
+
+
+Recorder::~Recorder(){
+}
+
+
+bool Recorder::startRecording(const std::string& path, std::uint32_t seed,
+                              std::uint64_t initial_digest){
+    m_output.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!m_output){
+        std::cerr << "Recorder::startRecording: can't create the recording " << path << std::endl;
+        log("Recorder::startRecording: can't create the recording ", path);
+        return false;
+    }
+
+    write_value(m_output, std::uint32_t(RECORDING_MAGIC));
+    write_value(m_output, std::uint32_t(RECORDING_VERSION));
+    write_value(m_output, seed);
+    write_value(m_output, initial_digest);
+
+    m_path = path;
+    m_mode = RECORDER_RECORD;
+    m_seed = seed;
+    m_frames = 0;
+    m_start = sch_now();
+    log("Recorder::startRecording: recording to ", path, " with seed ", seed);
+
+    return true;
+}
+
+
+bool Recorder::startReplay(const std::string& path, std::uint64_t initial_digest){
+    std::uint32_t magic, version;
+    std::uint64_t recorded_digest;
+
+    m_input.open(path, std::ios::in | std::ios::binary);
+    if(!m_input){
+        std::cerr << "Recorder::startReplay: can't open the recording " << path << std::endl;
+        log("Recorder::startReplay: can't open the recording ", path);
+        return false;
+    }
+
+    if(!read_value(m_input, magic) || !read_value(m_input, version) ||
+       !read_value(m_input, m_seed) || !read_value(m_input, recorded_digest) ||
+       magic != RECORDING_MAGIC || version != RECORDING_VERSION){
+        std::cerr << "Recorder::startReplay: " << path << " is not a valid recording" << std::endl;
+        log("Recorder::startReplay: ", path, " is not a valid recording");
+        m_input.close();
+        return false;
+    }
+
+    if(recorded_digest != initial_digest){
+        std::cerr << "Recorder::startReplay: the initial state doesn't match the one of the "
+                     "recording, build the same vessel in the editor" << std::endl;
+        log("Recorder::startReplay: the initial state doesn't match the one of the recording");
+        m_input.close();
+        return false;
+    }
+
+    m_path = path;
+    m_mode = RECORDER_REPLAY;
+    m_frames = 0;
+    m_divergent_frames = 0;
+    m_first_divergence = -1;
+    m_start = sch_now();
+    log("Recorder::startReplay: replaying ", path, " with seed ", m_seed);
+
+    return true;
+}
+
+
+bool Recorder::beginFrame(){
+    if(m_mode == RECORDER_REPLAY)
+        return readFrame();
+    return m_mode == RECORDER_RECORD;
+}
+
+
+void Recorder::endFrame(){
+    if(m_mode == RECORDER_RECORD)
+        writeFrame();
+    else if(m_mode == RECORDER_REPLAY)
+        compareFrame();
+    m_frames++;
+}
+
+
+void Recorder::writeFrame(){
+    const input_state& input = m_frame.input;
+
+    m_output.write(input.pressed_keys, sizeof(input.pressed_keys));
+    m_output.write(input.pressed_mbuttons, sizeof(input.pressed_mbuttons));
+    write_value(m_output, input.mouse_posx);
+    write_value(m_output, input.mouse_posy);
+    write_value(m_output, input.mouse_posx_prev);
+    write_value(m_output, input.mouse_posy_prev);
+    write_value(m_output, input.xoffset);
+    write_value(m_output, input.yoffset);
+    write_value(m_output, std::uint8_t(input.mouse_moved));
+    write_value(m_output, std::uint32_t(input.keys_pressed.size()));
+    for(uint i=0; i < input.keys_pressed.size(); i++)
+        write_value(m_output, std::int32_t(input.keys_pressed.at(i)));
+
+    write_value(m_output, m_frame.num_commands);
+    write_value(m_output, m_frame.commands_digest);
+    write_value(m_output, std::int32_t(m_frame.due_ticks));
+    write_value(m_output, std::int32_t(m_frame.sub_ticks));
+    write_value(m_output, m_frame.state_digest);
+}
+
+
+bool Recorder::readFrame(){
+    input_state& input = m_recorded.input;
+    std::uint8_t mouse_moved;
+    std::uint32_t num_keys;
+    std::int32_t value;
+
+    m_input.read(input.pressed_keys, sizeof(input.pressed_keys));
+    m_input.read(input.pressed_mbuttons, sizeof(input.pressed_mbuttons));
+    read_value(m_input, input.mouse_posx);
+    read_value(m_input, input.mouse_posy);
+    read_value(m_input, input.mouse_posx_prev);
+    read_value(m_input, input.mouse_posy_prev);
+    read_value(m_input, input.xoffset);
+    read_value(m_input, input.yoffset);
+    read_value(m_input, mouse_moved);
+    input.mouse_moved = mouse_moved;
+
+    input.keys_pressed.clear();
+    if(read_value(m_input, num_keys)){
+        for(std::uint32_t i=0; i < num_keys && read_value(m_input, value); i++)
+            input.keys_pressed.push_back(value);
+    }
+
+    read_value(m_input, m_recorded.num_commands);
+    read_value(m_input, m_recorded.commands_digest);
+    read_value(m_input, value);
+    m_recorded.due_ticks = value;
+    read_value(m_input, value);
+    m_recorded.sub_ticks = value;
+
+    // a truncated frame is dropped
+    return read_value(m_input, m_recorded.state_digest);
+}
+
+
+void Recorder::compareFrame(){
+    bool commands = m_frame.num_commands == m_recorded.num_commands &&
+                    m_frame.commands_digest == m_recorded.commands_digest;
+    bool state = m_frame.state_digest == m_recorded.state_digest;
+
+    if(commands && state)
+        return;
+
+    if(m_first_divergence < 0){
+        m_first_divergence = m_frames;
+        std::cerr << "Recorder::compareFrame: the replay diverges at frame " << m_frames
+                  << (commands ? "" : ", different commands (")
+                  << (commands ? "" : std::to_string(m_frame.num_commands) + " instead of " +
+                                      std::to_string(m_recorded.num_commands) + ")")
+                  << (state ? "" : ", different state of the vessels") << std::endl;
+        log("Recorder::compareFrame: the replay diverges at frame ", m_frames, ", commands ",
+            m_frame.num_commands, "/", m_recorded.num_commands, (commands ? " match" : " differ"),
+            ", state ", (state ? "matches" : "differs"));
+    }
+    m_divergent_frames++;
+}
+
+
+void Recorder::finish(){
+    double elapsed = duration(sch_now() - m_start).count() / 1000.0; // ms
+
+    if(m_mode == RECORDER_RECORD){
+        m_output.close();
+        std::cout << "Recorder: recorded " << m_frames << " frames to " << m_path << std::endl;
+        log("Recorder::finish: recorded ", m_frames, " frames to ", m_path);
+    }
+    else if(m_mode == RECORDER_REPLAY){
+        m_input.close();
+        std::cout << "Recorder: replayed " << m_frames << " frames of " << m_path << " in "
+                  << elapsed << " ms (" << (m_frames ? elapsed / m_frames : 0.0)
+                  << " ms/frame), " << m_divergent_frames << " divergent frames";
+        if(m_first_divergence >= 0)
+            std::cout << ", first at frame " << m_first_divergence;
+        std::cout << std::endl;
+        log("Recorder::finish: replayed ", m_frames, " frames of ", m_path, " in ", elapsed,
+            " ms, ", m_divergent_frames, " divergent frames, first at ", m_first_divergence);
+    }
+    m_mode = RECORDER_OFF;
+}
+
+
+recorded_frame& Recorder::getFrame(){
+    return m_frame;
+}
+
+
+const recorded_frame& Recorder::getRecordedFrame() const{
+    return m_recorded;
+}
+
+
+int Recorder::getMode() const{
+    return m_mode;
+}
+
+
+std::uint32_t Recorder::getSeed() const{
+    return m_seed;
+}
@@ -0,0 +1,155 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "Input.hpp"
+#include "timing.hpp"
+
+
+#define RECORDER_OFF 0
+#define RECORDER_RECORD 1
+#define RECORDER_REPLAY 2
+
+/* first bytes of a recording file ("PECR") and version of the format */
+#define RECORDING_MAGIC 0x52434550
+#define RECORDING_VERSION 1
+
+/* FNV-1a, used for the digests of the commands and the simulation state */
+#define DIGEST_OFFSET_BASIS 14695981039346656037ULL
+#define DIGEST_PRIME 1099511628211ULL
+
+
+/*
+ * Folds the given bytes into the digest.
+ *
+ * @digest: current value of the digest, DIGEST_OFFSET_BASIS to start a new one.
+ * @data: pointer to the bytes.
+ * @size: number of bytes.
+ * Returns the updated digest.
+ */
+inline std::uint64_t digest_bytes(std::uint64_t digest, const void* data, std::size_t size){
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for(std::size_t i=0; i < size; i++){
+        digest ^= bytes[i];
+        digest *= DIGEST_PRIME;
+    }
+    return digest;
+}
+
+
+/*
+ * Everything that is recorded in a logic frame of the simulation.
+ *
+ * @input: input state after polling the events.
+ * @num_commands: number of commands applied by processCommandBuffers.
+ * @commands_digest: digest of the types and the data of those commands.
+ * @due_ticks: ticks of real time simulated by the physics thread, see Physics::setReplayTicks.
+ * @sub_ticks: sub-ticks actually run, they can be less than the due ones because of the physics
+ * warp budget.
+ * @state_digest: digest of the state of the vessels at the end of the frame.
+ */
+struct recorded_frame{
+    input_state input;
+    std::uint32_t num_commands;
+    std::uint64_t commands_digest;
+    int due_ticks, sub_ticks;
+    std::uint64_t state_digest;
+};
+
+
+/*
+ * Records the simulation frame by frame to a file, or replays a recording. A recording holds the
+ * seed of the id generator (see set_id_seed) and, per frame, the input and the number of physics
+ * ticks, which are the sources of non-determinism of the simulation (live input and thread
+ * timing). The replay feeds them back, so the logic pushes the same commands and the physics
+ * thread steps the same way, and compares the digests of the commands and of the state of the
+ * vessels with the recorded ones, frame by frame. A replay runs as fast as it can, so it can be
+ * used as a benchmark workload.
+ *
+ * The simulation starts from the vessel built in the editor, which isn't recorded, the digest of
+ * the initial state is checked before replaying. Multithreaded Bullet (BULLET_MT) isn't
+ * deterministic, so its recordings diverge when replayed.
+ */
+
+class Recorder{
+    private:
+        std::ofstream m_output;
+        std::ifstream m_input;
+        std::string m_path;
+        int m_mode;
+        std::uint32_t m_seed;
+
+        /* frame being filled by the simulation and, when replaying, the recorded one */
+        recorded_frame m_frame, m_recorded;
+        long m_frames, m_divergent_frames, m_first_divergence;
+        time_point m_start;
+
+        void writeFrame();
+        bool readFrame();
+
+        /*
+         * Compares m_frame with m_recorded, logs the first divergence and counts the divergent
+         * frames.
+         */
+        void compareFrame();
+    public:
+        Recorder();
+        ~Recorder();
+
+        /*
+         * Creates a recording file and writes its header. Returns false if the file can't be
+         * created, the recorder stays off.
+         *
+         * @path: path of the recording.
+         * @seed: seed of the id generator, should be set by the caller.
+         * @initial_digest: digest of the initial state of the simulation.
+         */
+        bool startRecording(const std::string& path, std::uint32_t seed,
+                            std::uint64_t initial_digest);
+
+        /*
+         * Opens a recording and reads its header. Returns false if the file can't be read or
+         * the initial state doesn't match the recorded one, the recorder stays off.
+         *
+         * @path: path of the recording.
+         * @initial_digest: digest of the initial state of the simulation.
+         */
+        bool startReplay(const std::string& path, std::uint64_t initial_digest);
+
+        /*
+         * Starts a frame, when replaying it reads the next recorded frame. Returns false if
+         * there are no frames left.
+         */
+        bool beginFrame();
+
+        /*
+         * Ends a frame, it's written or compared with the recorded one.
+         */
+        void endFrame();
+
+        /*
+         * Closes the file and prints the summary of the recording or the replay.
+         */
+        void finish();
+
+        /*
+         * Returns the frame being filled by the simulation.
+         */
+        recorded_frame& getFrame();
+
+        /*
+         * Returns the recorded frame, only valid when replaying.
+         */
+        const recorded_frame& getRecordedFrame() const;
+
+        int getMode() const;
+        std::uint32_t getSeed() const;
+};
+
+
+#endif
@@ -33,6 +33,7 @@ RenderContext::RenderContext(BaseApp* app){
     m_camera = app->getCamera();
     m_window_handler = app->getWindowHandler();
     m_buffers = app->getRenderBuffers();
+    m_interpolated.reset(new render_buffer());
     m_app = app;
     m_draw_overlay = false;
     m_debug_draw = false;
@@ -83,8 +84,7 @@ RenderContext::RenderContext(BaseApp* app){
 void RenderContext::setDebugDrawer(){
     m_physics = m_app->getPhysics();
     m_debug_drawer.reset(new DebugDrawer(this));
-    btDiscreteDynamicsWorld* d_world = m_physics->getDynamicsWorld();
-    d_world->setDebugDrawer(m_debug_drawer.get());
+    m_physics->setDebugDrawer(m_debug_drawer.get());
 }
 
 
@@ -97,6 +97,7 @@ RenderContext::~RenderContext(){
     glDeleteShader(m_debug_shader);
     glDeleteShader(m_sprite_shader);
     glDeleteShader(m_tnl_shader);
+    glDeleteShader(m_orbit_shader);
 
     check_gl_errors(true, "RenderContext::~RenderContext");
 }
@@ -181,6 +182,10 @@ void RenderContext::loadShaders(){
     glUniformMatrix4fv(m_tnl_view_mat, 1, GL_FALSE, m_camera->getViewMatrix().m);
     glUniformMatrix4fv(m_tnl_proj_mat, 1, GL_FALSE, m_camera->getProjMatrix().m);
 
+    m_orbit_shader = create_programme_from_files("../shaders/orbit_vs.glsl",
+                                                 "../shaders/orbit_fs.glsl");
+    log_programme_info(m_orbit_shader);
+
     check_gl_errors(true, "RenderContext::loadShaders");
 }
 
@@ -241,12 +246,141 @@ void RenderContext::renderBulletDebug(const math::mat4& view_mat){
     const dmath::vec3& cam_position = m_camera->getCamPosition();
     m_debug_drawer->getReady();
     m_debug_drawer->setCameraCenter(btVector3(cam_position.v[0], cam_position.v[1], cam_position.v[2]));
-    m_physics->getDynamicsWorld()->debugDrawWorld();
+    m_physics->debugDrawWorlds();
 
     check_gl_errors(true, "RenderContext::renderBulletDebug");
 }
 
 
+/*
+ * Interpolates between two rigid transforms, the rotation is slerped and the translation lerped.
+ * from_mat3 returns the scalar part of the quaternion last while quat_to_mat4 expects it first.
+ */
+static math::mat4 interpolate_transform(const math::mat4& from, const math::mat4& to, float t){
+    math::mat3 rot_from, rot_to;
+    math::versor q_from, q_to, q;
+    math::mat4 result;
+
+    for(int col=0; col < 3; col++){
+        for(int row=0; row < 3; row++){
+            rot_from.m[col * 3 + row] = from.m[col * 4 + row];
+            rot_to.m[col * 3 + row] = to.m[col * 4 + row];
+        }
+    }
+    q_from = math::from_mat3(rot_from);
+    q_to = math::from_mat3(rot_to);
+    q = math::slerp(q_from, q_to, t);
+    q = math::normalise(q);
+
+    std::swap(q.q[2], q.q[3]); // x y z w -> x y w z
+    std::swap(q.q[1], q.q[2]); // x y w z -> x w y z
+    std::swap(q.q[0], q.q[1]); // x w y z -> w x y z
+    result = math::quat_to_mat4(q);
+
+    for(int i=12; i < 15; i++)
+        result.m[i] = from.m[i] + (to.m[i] - from.m[i]) * t;
+
+    return result;
+}
+
+
+struct render_buffer* RenderContext::interpolateBuffers(){
+    struct render_buffer* last;
+    struct render_buffer* previous;
+    float alpha = 1.0f;
+
+    m_buffers->manager_lock.lock();
+    last = m_buffers->getBuffer(m_buffers->last_updated);
+    previous = m_buffers->getBuffer(m_buffers->previous);
+    m_buffers->manager_lock.unlock();
+
+    if(!last)
+        return nullptr;
+
+    last->buffer_lock.lock();
+    if(previous){
+        previous->buffer_lock.lock();
+
+        // the previous buffer might have been updated again after reading the buffer manager
+        if(previous->timestamp < last->timestamp){
+            double interval = duration(last->timestamp - previous->timestamp).count();
+            double elapsed = duration(sch_now() - last->timestamp).count();
+
+            alpha = std::min(std::max(elapsed / interval, 0.0), 1.0);
+        }
+        else{
+            previous->buffer_lock.unlock();
+            previous = nullptr;
+        }
+    }
+
+    m_interpolated->buffer.clear();
+    for(uint i=0; i < last->buffer.size(); i++){
+        const object_transform& to = last->buffer.at(i);
+        m_interpolated->buffer.emplace_back(std::shared_ptr<Object>(to.object_ptr), to.transform);
+    }
+    m_interpolated->planet_buffer = last->planet_buffer;
+    m_interpolated->view_mat = last->view_mat;
+    m_interpolated->cam_origin = last->cam_origin;
+    m_interpolated->timestamp = last->timestamp;
+
+    if(previous && alpha < 1.0f){
+        std::vector<object_transform>& objects = m_interpolated->buffer;
+        const std::vector<object_transform>& previous_objects = previous->buffer;
+        std::vector<planet_transform>& planets = m_interpolated->planet_buffer;
+
+        /* the transforms of the objects are relative to the camera of their buffer, so
+           interpolating them interpolates the camera too. The objects usually are in the same
+           order in both buffers, new objects are not interpolated */
+        m_previous_objects.clear();
+        for(uint i=0; i < objects.size(); i++){
+            const object_transform* from = nullptr;
+
+            if(i < previous_objects.size() &&
+               previous_objects.at(i).object_ptr == objects.at(i).object_ptr){
+                from = &previous_objects.at(i);
+            }
+            else{
+                if(m_previous_objects.empty()){
+                    for(uint j=0; j < previous_objects.size(); j++)
+                        m_previous_objects[previous_objects.at(j).object_ptr.get()] = j;
+                }
+                std::unordered_map<const Object*, uint>::const_iterator it =
+                    m_previous_objects.find(objects.at(i).object_ptr.get());
+                if(it != m_previous_objects.end())
+                    from = &previous_objects.at(it->second);
+            }
+
+            if(from)
+                objects.at(i).transform = interpolate_transform(from->transform,
+                                                                objects.at(i).transform, alpha);
+        }
+
+        // the planets don't change, only their positions are interpolated
+        if(planets.size() == previous->planet_buffer.size()){
+            for(uint i=0; i < planets.size(); i++){
+                const dmath::mat4& from = previous->planet_buffer.at(i).transform;
+
+                for(int j=12; j < 15; j++)
+                    planets.at(i).transform.m[j] = from.m[j] + (planets.at(i).transform.m[j] -
+                                                                from.m[j]) * alpha;
+            }
+        }
+
+        m_interpolated->view_mat = interpolate_transform(previous->view_mat, last->view_mat,
+                                                         alpha);
+        m_interpolated->cam_origin = previous->cam_origin + (last->cam_origin -
+                                                             previous->cam_origin) * alpha;
+    }
+
+    if(previous)
+        previous->buffer_lock.unlock();
+    last->buffer_lock.unlock();
+
+    return m_interpolated.get();
+}
+
+
 void RenderContext::render(){
     int num_rendered = 0;
 
@@ -291,16 +425,8 @@ void RenderContext::render(){
     setLightPositionRender();
 
     // scene render, should we make a separate function?
-    if(m_buffers->last_updated != none){
-        struct render_buffer* rbuf;
-        if(m_buffers->last_updated == buffer_1){
-            m_buffers->buffer_1.buffer_lock.lock();
-            rbuf = &m_buffers->buffer_1;
-        }
-        else{
-            m_buffers->buffer_2.buffer_lock.lock();
-            rbuf = &m_buffers->buffer_2;
-        }
+    struct render_buffer* rbuf = interpolateBuffers();
+    if(rbuf){
         switch(m_app->getRenderState()){
             case RENDER_NOTHING:
                 break;
@@ -319,8 +445,6 @@ void RenderContext::render(){
         }
         if(m_debug_draw && (RENDER_EDITOR | RENDER_SIMULATION))
             renderBulletDebug(rbuf->view_mat);
-
-        rbuf->buffer_lock.unlock();
     }
 
     m_timing.register_tp(TP_SCENE_END);
@@ -411,6 +535,9 @@ void RenderContext::useProgram(int shader) const{
         case SHADER_TEXTURE_NO_LIGHT:
             glUseProgram(m_tnl_shader);
             break;
+        case SHADER_ORBIT:
+            glUseProgram(m_orbit_shader);
+            break;
         default:
             std::cerr << "RenderContext::useProgram - wrong shader value " << shader << std::endl;
             log("RenderContext::useProgram - wrong shader value ", shader);
@@ -440,6 +567,8 @@ GLuint RenderContext::getUniformLocation(int shader, const char* location) const
             return glGetUniformLocation(m_sprite_shader, location);
         case SHADER_TEXTURE_NO_LIGHT:
             return glGetUniformLocation(m_tnl_shader, location);
+        case SHADER_ORBIT:
+            return glGetUniformLocation(m_orbit_shader, location);
         default:
             std::cerr << "RenderContext::getUniformLocation - wrong shader value " << shader << std::endl;
             log("RenderContext::getUniformLocation - wrong shader value ", shader);
@@ -604,21 +733,9 @@ void RenderContext::renderImGui(){
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    if(m_buffers->last_updated != none){
-        if(m_buffers->last_updated == buffer_1){
-            m_buffers->buffer_1.buffer_lock.lock();
-            for(uint i=0; i<m_buffers->buffer_1.buffer.size(); i++){
-                m_buffers->buffer_1.buffer.at(i).object_ptr.get()->renderOther();
-            }
-            m_buffers->buffer_1.buffer_lock.unlock();
-        }
-        else{
-            m_buffers->buffer_2.buffer_lock.lock();
-            for(uint i=0; i<m_buffers->buffer_2.buffer.size(); i++){
-                m_buffers->buffer_2.buffer.at(i).object_ptr.get()->renderOther();
-            }
-            m_buffers->buffer_2.buffer_lock.unlock();
-        }
+    // same objects as the scene, m_interpolated is only touched by the render thread
+    for(uint i=0; i<m_interpolated->buffer.size(); i++){
+        m_interpolated->buffer.at(i).object_ptr.get()->renderOther();
     }
 
     switch(m_app->getGUIMode()){
@@ -6,6 +6,7 @@
 #include <thread>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include "maths_funcs.hpp"
 #include "timing.hpp"
@@ -23,9 +24,11 @@ class FontAtlas;
 class Text2D;
 class BaseApp;
 class BaseRenderer;
+class Object;
 
 struct object_transform;
 struct planet_transform;
+struct render_buffer;
 
 
 /* shader macros */
@@ -37,6 +40,7 @@ struct planet_transform;
 #define SHADER_DEBUG 6
 #define SHADER_SPRITE 7
 #define SHADER_TEXTURE_NO_LIGHT 8
+#define SHADER_ORBIT 9
 
 /* gui modes */
 #define GUI_MODE_NONE 0
@@ -94,6 +98,8 @@ class RenderContext{
 
         GLuint m_tnl_shader;
         GLint m_tnl_view_mat, m_tnl_proj_mat;
+
+        GLuint m_orbit_shader;
         // shaders //
 
         GLuint m_bound_vao;
@@ -123,6 +129,11 @@ class RenderContext{
         // synchronization
         struct render_buffers* m_buffers;
 
+        /* render state of the frame interpolated from the two latest render buffers, and the
+           index of the objects of the previous buffer (only used when their order changed) */
+        std::unique_ptr<render_buffer> m_interpolated;
+        std::unordered_map<const Object*, uint> m_previous_objects;
+
         // gui
         BaseGUI* m_editor_gui;
         BaseGUI* m_planetarium_gui;
@@ -159,6 +170,15 @@ class RenderContext{
          */
         void render();
 
+        /*
+         * Interpolates the last updated render buffer and the previous one into m_interpolated,
+         * so the scene moves smoothly when rendering faster than the physics rate. The render
+         * state is one buffer interval behind: at the time the last buffer is stamped with the
+         * previous one is rendered, and one interval later the last one. The buffers are only
+         * locked while interpolating. Returns nullptr if there's nothing to render yet.
+         */
+        struct render_buffer* interpolateBuffers();
+
         /*
          * Renders Dear-ImGUI.
          */
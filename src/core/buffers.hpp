@@ -4,6 +4,8 @@
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <cstdint>
+#include <chrono>
 
 #define BT_USE_DOUBLE_PRECISION
 #include <bullet/btBulletDynamicsCommon.h>
@@ -74,8 +76,8 @@ struct planet_transform{
 };
 
 
-/* Buffer manager, essentialy an enum that helps manage the latest updated buffer */
-enum buffer_manager: char{none = 0, buffer_1 = 1, buffer_2 = 2};
+/* Buffer manager, essentialy an enum that helps manage the latest updated buffers */
+enum buffer_manager: char{none = 0, buffer_1 = 1, buffer_2 = 2, buffer_3 = 3};
 
 /*
  * Render buffer struct, holds the necessary stuff used to render the scene.
@@ -84,6 +86,8 @@ enum buffer_manager: char{none = 0, buffer_1 = 1, buffer_2 = 2};
  * @planet_buffer: vector of planet transforms.
  * @view_mat: state of the view matrix in the current tick.
  * @cam_origin: origin of the camera at that tick, used to render Planets.
+ * @timestamp: real time the simulated state of the buffer corresponds to, see
+ * Physics::getStateTime. The render thread interpolates between the two latest buffers with it.
  * @buffer_lock: lock of the buffer, used to avoid the AssetManager and the render thread 
  * manipulating the buffers at the same time (something rare but can happen, see 
  * AssetManager::updateBuffers or RenderContext::renderSceneEditor for example.
@@ -93,155 +97,139 @@ struct render_buffer{
     std::vector<planet_transform> planet_buffer;
     math::mat4 view_mat;
     dmath::vec3 cam_origin;
+    std::chrono::steady_clock::time_point timestamp;
     std::mutex buffer_lock;
 };
 
 
 /*
- * This struct holds two (render_buffer)s and a buffer manager. The buffer manager indicates the
- * lastest updated buffer. The render thread will always use the last updated buffer to render,
- * while the asset manager will always update the other one. This avoids waiting for the buffer
- * to be free, but it can still happen that both threads want to use the same buffer (again see
- * AssetManager::updateBuffers). In that case the locks avoid writing/reading races.
+ * This struct holds three (render_buffer)s and a buffer manager for the two latest ones. The
+ * render thread interpolates between the previous and the last updated buffers (see
+ * RenderContext::interpolateBuffers), while the asset manager updates the third one. This avoids
+ * waiting for the buffers to be free, but it can still happen that both threads want to use the
+ * same buffer if the render thread is slow (again see AssetManager::updateBuffers). In that case
+ * the locks avoid writing/reading races.
  *
  * @buffer_1: buffer 1.
  * @buffer_2: buffer 2.
+ * @buffer_3: buffer 3.
  * @last_updated: indicates the last updated buffer.
+ * @previous: indicates the buffer updated before the last one, it has an older timestamp.
+ * @manager_lock: protects last_updated and previous.
  */
 struct render_buffers{
     render_buffer buffer_1;
     render_buffer buffer_2;
+    render_buffer buffer_3;
     buffer_manager last_updated;
+    buffer_manager previous;
+    std::mutex manager_lock;
+
+    /*
+     * Returns the buffer indicated by the manager, nullptr if it's none.
+     *
+     * @which: the buffer.
+     */
+    render_buffer* getBuffer(buffer_manager which){
+        switch(which){
+            case buffer_manager::buffer_1:
+                return &buffer_1;
+            case buffer_manager::buffer_2:
+                return &buffer_2;
+            case buffer_manager::buffer_3:
+                return &buffer_3;
+            default:
+                return nullptr;
+        }
+    }
 };
 
 
 /*************************************************************************************************/
 /*                                                                                               */
-/*                                    Command buffer messages                                    */
+/*                                        Command records                                        */
 /*                                                                                               */
-/* These messages are used to communicate Vessels and Object/Parts with the asset manager. These */
-/* messages are stored in buffers in the AssetManager, some of which be accessed by Parts and    */
-/* Vessels via the AssetManagerInterface.                                                        */
+/* These records are used to communicate Vessels and Object/Parts with the asset manager. They   */
+/* are pushed to the CommandQueue of the AssetManager via the AssetManagerInterface, and applied */
+/* in batches (grouped by type and body) by AssetManager::processCommandBuffers.                 */
 /*                                                                                               */
-/* We don't explain how the buffers should be used in here, for that see the header file of      */
+/* We don't explain how the commands should be used in here, for that see the header file of     */
 /* AssetManagerInterface or AssetManager.                                                        */
 /*************************************************************************************************/
 
 class BasePart;
 
 
-/* Message used in m_set_motion_state_buffer, can't be accessed via AssetManagerInterface */
-struct set_motion_state_msg{
-    Object* object;
-    btVector3 origin;
-    btQuaternion initial_rotation;
-
-    /* Constructor.
-     *
-     * @obj: raw pointer to the object.
-     * @orig: constant reference to the new origin of the object.
-     * @rot: constant reference to the new rotation of the object.
-     */
-    set_motion_state_msg(Object* obj, const btVector3& orig, const btQuaternion& rot){
-        object = obj;
-        origin = orig;
-        initial_rotation = rot;
-    }
+/* Types of the commands, in the order they are applied by AssetManager::processCommandBuffers */
+enum command_type: std::uint8_t{
+    CMD_ADD_BODY = 0,                // target: BasePart, data: origin, inertia, rotation
+    CMD_APPLY_FORCE,                 // target: BasePart, data: force, relative position, once
+    CMD_SET_MOTION_STATE,            // target: Object, data: origin, rotation
+    CMD_BUILD_CONSTRAINT_SUBTREE,    // target: BasePart
+    CMD_ADD_CONSTRAINT,              // target: BasePart, payload: unique_ptr<btTypedConstraint>
+    CMD_SET_MASS,                    // target: BasePart, data: mass
+    CMD_REMOVE_PART_CONSTRAINT,      // target: BasePart
+    CMD_ADD_VESSEL,                  // payload: shared_ptr<Vessel>
+    CMD_DELETE_SUBTREE,              // payload: shared_ptr<BasePart>
+    CMD_SET_VESSEL_VELOCITY,         // target: Vessel, data: velocity
+    CMD_NUM_TYPES
 };
 
 
-/* Message used in m_add_constraint_buffer, can be accessed via AssetManagerInterface::addConstraint */
-struct add_contraint_msg{
-    BasePart* part;
-    std::unique_ptr<btTypedConstraint> constraint_uptr;
-
-    /* Constructor.
-     *
-     * @ptr: raw pointer to the object.
-     * @c_uptr: rvalue reference to the unique pointer of the constraint, this message will take 
-     * ownership of the object.
-     */
-    add_contraint_msg(BasePart* ptr, std::unique_ptr<btTypedConstraint>&& c_uptr){
-        part = ptr;
-        constraint_uptr = std::move(c_uptr);
-    }
-};
+/* number of scalars of a command, enough for CMD_ADD_BODY */
+#define COMMAND_DATA_SIZE 10
 
 
-/* Message used in m_add_body_buffer, can be accessed via AssetManagerInterface::addBody */
-struct add_body_msg{
-    BasePart* part;
-    btVector3 origin;
-    btVector3 inertia;
-    btQuaternion rotation;
-
-    /* Constructor.
-     *
-     * @ptr: raw pointer to the object that contains the rigid body.
-     * @orig: constant reference to the origin of the object.
-     * @iner: constant reference to the inertia vector of the object.
-     * @rot: constant reference to the rotation of the object.
-     */
-    add_body_msg(BasePart* ptr, const btVector3& orig, const btVector3& iner, const btQuaternion& rot){
-        part = ptr;
-        origin = orig;
-        inertia = iner;
-        rotation = rot;
+/*
+ * Compact tagged command record, fixed size so it can be stored in the ring of the CommandQueue.
+ *
+ * @type: type of the command.
+ * @target: raw pointer to the target of the command (BasePart, Object or Vessel depending on the
+ * type), nullptr if the command has a payload instead.
+ * @payload: object owned by the command (a constraint, a vessel or a subtree), allocated in the
+ * arena of the CommandQueue. See CommandQueue::allocate and CommandQueue::take.
+ * @data: vectors, rotations and scalars of the command.
+ */
+struct command{
+    command_type type;
+    void* target;
+    void* payload;
+    btScalar data[COMMAND_DATA_SIZE];
+
+    command(){
+        type = CMD_NUM_TYPES;
+        target = nullptr;
+        payload = nullptr;
     }
-};
-
-
-/* Message used in m_apply_force_buffer, can be accessed via AssetManagerInterface::applyForce */
-struct apply_force_msg{
-    BasePart* part;
-    btVector3 force;
-    btVector3 rel_pos;
 
-    /* Constructor.
-     *
-     * @ptr: raw pointer to the object that contains the rigid body.
-     * @f: constant reference of the force vector we want to apply, in newtons.
-     * @r_pos: constant reference of the relative application point of the force, in meters.
-     */
-    apply_force_msg(BasePart* ptr, const btVector3& f, const btVector3& r_pos){
-        part = ptr;
-        force = f;
-        rel_pos = r_pos;
+    command(command_type cmd_type, void* cmd_target){
+        type = cmd_type;
+        target = cmd_target;
+        payload = nullptr;
+        for(int i=0; i < COMMAND_DATA_SIZE; i++)
+            data[i] = 0.0; // the unused values are part of the digest, see Recorder
     }
-};
-
 
-/* Message used in m_set_mass_buffer, can be accessed via AssetManagerInterface::setMassProps */
-struct set_mass_props_msg{
-    BasePart* part;
-    double mass;
-
-    /* Constructor.
-     *
-     * @ptr: raw pointer to the object that contains the rigid body.
-     * @m: new mass value, in kilograms.
-     */
-    set_mass_props_msg(BasePart* ptr, double m){
-        part = ptr;
-        mass = m;
+    /* Methods to pack and unpack the vectors and rotations starting at data[offset] */
+    void setVector(int offset, const btVector3& v){
+        data[offset] = v.getX();
+        data[offset + 1] = v.getY();
+        data[offset + 2] = v.getZ();
     }
-};
 
+    void setRotation(int offset, const btQuaternion& q){
+        data[offset] = q.getX();
+        data[offset + 1] = q.getY();
+        data[offset + 2] = q.getZ();
+        data[offset + 3] = q.getW();
+    }
 
-/* Message used to set the velocity of a vessel, including the whole subtree, can be accessed via
-   AssetManagerInterface::setVesselVelocity*/
-struct set_vessel_velocity_msg{
-    Vessel* vessel;
-    btVector3 velocity;
+    btVector3 getVector(int offset) const{
+        return btVector3(data[offset], data[offset + 1], data[offset + 2]);
+    }
 
-    /* Constructor
-     *
-     * @ptr: raw pointer to a Vessel.
-     * @vel: new velocity value.
-     */
-    set_vessel_velocity_msg(Vessel* ptr, const btVector3& vel){
-        vessel = ptr;
-        velocity = vel;
+    btQuaternion getRotation(int offset) const{
+        return btQuaternion(data[offset], data[offset + 1], data[offset + 2], data[offset + 3]);
     }
 };
 
@@ -0,0 +1,388 @@
+#include <cmath>
+#include <algorithm>
+
+#include "gravity.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAVITY_X86
+#endif
+
+
+void gravity_sources::clear(){
+    x.clear();
+    y.clear();
+    z.clear();
+    gm.clear();
+    soi.clear();
+}
+
+
+void gravity_sources::add(double px, double py, double pz, double mu, double radius){
+    x.push_back(px);
+    y.push_back(py);
+    z.push_back(pz);
+    gm.push_back(mu);
+    soi.push_back(radius);
+}
+
+
+std::size_t gravity_sources::size() const{
+    return gm.size();
+}
+
+
+void gravity_bodies::clear(){
+    x.clear();
+    y.clear();
+    z.clear();
+}
+
+
+void gravity_bodies::add(double px, double py, double pz){
+    x.push_back(px);
+    y.push_back(py);
+    z.push_back(pz);
+}
+
+
+std::size_t gravity_bodies::size() const{
+    return x.size();
+}
+
+
+static inline void gravity_single_body(const gravity_sources& sources, gravity_bodies& bodies,
+                                       std::size_t i){
+    double ax = 0.0, ay = 0.0, az = 0.0;
+
+    for(std::size_t j=0; j < sources.size(); j++){
+        double dx = sources.x[j] - bodies.x[i];
+        double dy = sources.y[j] - bodies.y[i];
+        double dz = sources.z[j] - bodies.z[i];
+        double r2 = dx * dx + dy * dy + dz * dz;
+        double k = sources.gm[j] / (r2 * std::sqrt(r2));
+
+        ax += dx * k;
+        ay += dy * k;
+        az += dz * k;
+    }
+
+    bodies.ax[i] = ax;
+    bodies.ay[i] = ay;
+    bodies.az[i] = az;
+}
+
+
+void compute_gravity_scalar(const gravity_sources& sources, gravity_bodies& bodies){
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    for(std::size_t i=0; i < bodies.size(); i++)
+        gravity_single_body(sources, bodies, i);
+}
+
+
+#ifdef GRAVITY_X86
+
+/* no FMA on purpose, this way the vectorized paths give the same results as the scalar code */
+__attribute__((target("avx2")))
+static std::size_t compute_gravity_avx2(const gravity_sources& sources, gravity_bodies& bodies){
+    std::size_t n = bodies.size() - bodies.size() % 4;
+
+    for(std::size_t i=0; i < n; i += 4){
+        __m256d bx = _mm256_loadu_pd(&bodies.x[i]);
+        __m256d by = _mm256_loadu_pd(&bodies.y[i]);
+        __m256d bz = _mm256_loadu_pd(&bodies.z[i]);
+        __m256d ax = _mm256_setzero_pd();
+        __m256d ay = _mm256_setzero_pd();
+        __m256d az = _mm256_setzero_pd();
+
+        for(std::size_t j=0; j < sources.size(); j++){
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(sources.x[j]), bx);
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(sources.y[j]), by);
+            __m256d dz = _mm256_sub_pd(_mm256_set1_pd(sources.z[j]), bz);
+            __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                       _mm256_mul_pd(dz, dz));
+            __m256d k = _mm256_div_pd(_mm256_set1_pd(sources.gm[j]),
+                                      _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+
+            ax = _mm256_add_pd(ax, _mm256_mul_pd(dx, k));
+            ay = _mm256_add_pd(ay, _mm256_mul_pd(dy, k));
+            az = _mm256_add_pd(az, _mm256_mul_pd(dz, k));
+        }
+
+        _mm256_storeu_pd(&bodies.ax[i], ax);
+        _mm256_storeu_pd(&bodies.ay[i], ay);
+        _mm256_storeu_pd(&bodies.az[i], az);
+    }
+
+    return n;
+}
+
+
+#ifdef __SSE2__
+static std::size_t compute_gravity_sse2(const gravity_sources& sources, gravity_bodies& bodies){
+    std::size_t n = bodies.size() - bodies.size() % 2;
+
+    for(std::size_t i=0; i < n; i += 2){
+        __m128d bx = _mm_loadu_pd(&bodies.x[i]);
+        __m128d by = _mm_loadu_pd(&bodies.y[i]);
+        __m128d bz = _mm_loadu_pd(&bodies.z[i]);
+        __m128d ax = _mm_setzero_pd();
+        __m128d ay = _mm_setzero_pd();
+        __m128d az = _mm_setzero_pd();
+
+        for(std::size_t j=0; j < sources.size(); j++){
+            __m128d dx = _mm_sub_pd(_mm_set1_pd(sources.x[j]), bx);
+            __m128d dy = _mm_sub_pd(_mm_set1_pd(sources.y[j]), by);
+            __m128d dz = _mm_sub_pd(_mm_set1_pd(sources.z[j]), bz);
+            __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                                    _mm_mul_pd(dz, dz));
+            __m128d k = _mm_div_pd(_mm_set1_pd(sources.gm[j]), _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+
+            ax = _mm_add_pd(ax, _mm_mul_pd(dx, k));
+            ay = _mm_add_pd(ay, _mm_mul_pd(dy, k));
+            az = _mm_add_pd(az, _mm_mul_pd(dz, k));
+        }
+
+        _mm_storeu_pd(&bodies.ax[i], ax);
+        _mm_storeu_pd(&bodies.ay[i], ay);
+        _mm_storeu_pd(&bodies.az[i], az);
+    }
+
+    return n;
+}
+#endif
+
+
+static bool cpu_has_avx2(){
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+
+__attribute__((target("avx2")))
+static std::size_t compute_gravity_selected_avx2(const gravity_sources& sources,
+                                                 gravity_bodies& bodies,
+                                                 const std::vector<std::uint64_t>& masks){
+    std::size_t n = bodies.size() - bodies.size() % 4;
+    std::size_t num_sources = std::min(sources.size(), (std::size_t)GRAVITY_MAX_SOURCES);
+    std::uint64_t valid = num_sources < GRAVITY_MAX_SOURCES ? (std::uint64_t(1) << num_sources) - 1 :
+                                             ~std::uint64_t(0);
+
+    for(std::size_t i=0; i < n; i += 4){
+        __m256d bx = _mm256_loadu_pd(&bodies.x[i]);
+        __m256d by = _mm256_loadu_pd(&bodies.y[i]);
+        __m256d bz = _mm256_loadu_pd(&bodies.z[i]);
+        __m256d ax = _mm256_setzero_pd();
+        __m256d ay = _mm256_setzero_pd();
+        __m256d az = _mm256_setzero_pd();
+        std::uint64_t any = (masks[i] | masks[i + 1] | masks[i + 2] | masks[i + 3]) & valid;
+        bool uniform = (masks[i] & masks[i + 1] & masks[i + 2] & masks[i + 3] & valid) == any;
+
+        // the sources past GRAVITY_MAX_SOURCES are always evaluated
+        for(std::size_t j=0; j < sources.size(); j++){
+            if(j < num_sources){
+                if(!(any & (std::uint64_t(1) << j))){ // skip to the next source of the masks
+                    std::uint64_t rest = any >> j;
+
+                    if(!rest){
+                        j = num_sources - 1;
+                        continue;
+                    }
+                    j += __builtin_ctzll(rest);
+                }
+            }
+
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(sources.x[j]), bx);
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(sources.y[j]), by);
+            __m256d dz = _mm256_sub_pd(_mm256_set1_pd(sources.z[j]), bz);
+            __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                       _mm256_mul_pd(dz, dz));
+            __m256d k = _mm256_div_pd(_mm256_set1_pd(sources.gm[j]),
+                                      _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+
+            if(!uniform && j < num_sources){
+                std::uint64_t bit = std::uint64_t(1) << j;
+                __m256d keep = _mm256_castsi256_pd(_mm256_set_epi64x(
+                    masks[i + 3] & bit ? -1 : 0, masks[i + 2] & bit ? -1 : 0,
+                    masks[i + 1] & bit ? -1 : 0, masks[i] & bit ? -1 : 0));
+
+                k = _mm256_and_pd(k, keep);
+            }
+
+            ax = _mm256_add_pd(ax, _mm256_mul_pd(dx, k));
+            ay = _mm256_add_pd(ay, _mm256_mul_pd(dy, k));
+            az = _mm256_add_pd(az, _mm256_mul_pd(dz, k));
+        }
+
+        _mm256_storeu_pd(&bodies.ax[i], ax);
+        _mm256_storeu_pd(&bodies.ay[i], ay);
+        _mm256_storeu_pd(&bodies.az[i], az);
+    }
+
+    return n;
+}
+
+
+/* spheres of influence of the first num_sources sources that contain the point, four per
+   iteration. Returns the number of sources checked */
+__attribute__((target("avx2")))
+static std::size_t soi_mask_avx2(const gravity_sources& sources, std::size_t num_sources,
+                                 double px, double py, double pz, std::uint64_t& inside){
+    std::size_t n = num_sources - num_sources % 4;
+    __m256d bx = _mm256_set1_pd(px);
+    __m256d by = _mm256_set1_pd(py);
+    __m256d bz = _mm256_set1_pd(pz);
+
+    for(std::size_t i=0; i < n; i += 4){
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&sources.x[i]), bx);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&sources.y[i]), by);
+        __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&sources.z[i]), bz);
+        __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                   _mm256_mul_pd(dz, dz));
+        __m256d soi = _mm256_loadu_pd(&sources.soi[i]);
+
+        inside |= std::uint64_t(_mm256_movemask_pd(_mm256_cmp_pd(r2, _mm256_mul_pd(soi, soi),
+                                                                 _CMP_LT_OQ))) << i;
+    }
+
+    return n;
+}
+
+#endif
+
+
+void compute_gravity(const gravity_sources& sources, gravity_bodies& bodies){
+    std::size_t done = 0;
+
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+#ifdef GRAVITY_X86
+    if(cpu_has_avx2())
+        done = compute_gravity_avx2(sources, bodies);
+#ifdef __SSE2__
+    else
+        done = compute_gravity_sse2(sources, bodies);
+#endif
+#endif
+
+    // remainder (or everything if there's no SIMD support)
+    for(std::size_t i=done; i < bodies.size(); i++)
+        gravity_single_body(sources, bodies, i);
+}
+
+
+double sphere_of_influence(double a, double mass, double primary_mass){
+    return a * std::pow(mass / primary_mass, 0.4);
+}
+
+
+bool select_gravity_sources(const gravity_sources& sources, double px, double py, double pz,
+                            double threshold, gravity_set& set){
+    std::uint64_t inside = 0;
+    std::size_t num_sources = std::min(sources.size(), (std::size_t)GRAVITY_MAX_SOURCES);
+    std::size_t done = 0;
+
+    // only the distances and without branches, this runs for every body every tick. The squared
+    // radius of the infinite spheres is still infinite
+#ifdef GRAVITY_X86
+    if(cpu_has_avx2())
+        done = soi_mask_avx2(sources, num_sources, px, py, pz, inside);
+#endif
+    for(std::size_t i=done; i < num_sources; i++){
+        double dx = sources.x[i] - px;
+        double dy = sources.y[i] - py;
+        double dz = sources.z[i] - pz;
+        double r2 = dx * dx + dy * dy + dz * dz;
+
+        inside |= std::uint64_t(r2 < sources.soi[i] * sources.soi[i]) << i;
+    }
+
+    if(inside == set.inside && set.age < GRAVITY_SET_MAX_AGE){
+        set.age++;
+        return false;
+    }
+
+    set.mask = ~std::uint64_t(0);
+    set.inside = inside;
+    set.age = 0;
+    set.error = 0.0;
+
+    if(sources.size() > GRAVITY_MAX_SOURCES)
+        return true;
+
+    for(std::size_t i=0; i < sources.size(); i++){
+        double dx = sources.x[i] - px;
+        double dy = sources.y[i] - py;
+        double dz = sources.z[i] - pz;
+        double r2 = dx * dx + dy * dy + dz * dz;
+        double acceleration = sources.gm[i] / r2;
+
+        if(r2 >= sources.soi[i] * sources.soi[i] && acceleration < threshold){
+            set.mask &= ~(std::uint64_t(1) << i);
+            set.error += acceleration;
+        }
+    }
+
+    return true;
+}
+
+
+static inline void gravity_selected_single_body(const gravity_sources& sources,
+                                                gravity_bodies& bodies, std::uint64_t mask,
+                                                std::size_t i){
+    double ax = 0.0, ay = 0.0, az = 0.0;
+
+    for(std::size_t j=0; j < sources.size(); j++){
+        if(j < GRAVITY_MAX_SOURCES && !(mask & (std::uint64_t(1) << j)))
+            continue;
+
+        double dx = sources.x[j] - bodies.x[i];
+        double dy = sources.y[j] - bodies.y[i];
+        double dz = sources.z[j] - bodies.z[i];
+        double r2 = dx * dx + dy * dy + dz * dz;
+        double k = sources.gm[j] / (r2 * std::sqrt(r2));
+
+        ax += dx * k;
+        ay += dy * k;
+        az += dz * k;
+    }
+
+    bodies.ax[i] = ax;
+    bodies.ay[i] = ay;
+    bodies.az[i] = az;
+}
+
+
+void compute_gravity_selected(const gravity_sources& sources, gravity_bodies& bodies,
+                              const std::vector<std::uint64_t>& masks){
+    std::size_t done = 0;
+
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+#ifdef GRAVITY_X86
+    if(cpu_has_avx2())
+        done = compute_gravity_selected_avx2(sources, bodies, masks);
+#endif
+
+    for(std::size_t i=done; i < bodies.size(); i++)
+        gravity_selected_single_body(sources, bodies, masks[i], i);
+}
+
+
+const char* gravity_kernel_name(){
+#ifdef GRAVITY_X86
+    if(cpu_has_avx2())
+        return "avx2";
+#ifdef __SSE2__
+    return "sse2";
+#endif
+#endif
+    return "scalar";
+}
@@ -0,0 +1,148 @@
+#ifndef GRAVITY_HPP
+#define GRAVITY_HPP
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+
+/* default acceleration (m/s^2) below which a source is culled if the body is not inside its sphere
+   of influence, see select_gravity_sources */
+#define DEFAULT_GRAVITY_CULL_THRESHOLD 1e-6
+/* the source set of a body is refreshed at least every GRAVITY_SET_MAX_AGE selections, the sources
+   move even if the body doesn't cross a sphere of influence */
+#define GRAVITY_SET_MAX_AGE 600
+/* the source sets are bit masks, with more sources nothing is culled */
+#define GRAVITY_MAX_SOURCES 64
+
+
+/*
+ * Structure-of-arrays with the gravity sources (the star and the planets). Each source is stored
+ * as a position and its standard gravitational parameter (G * m), so the kernel doesn't have to
+ * multiply by the gravitational constant for every pair.
+ *
+ * @x, @y, @z: coordinates of the sources.
+ * @gm: standard gravitational parameter of each source.
+ * @soi: radius of the sphere of influence of each source, infinite for the star (never culled).
+ */
+struct gravity_sources{
+    std::vector<double> x, y, z, gm, soi;
+
+    void clear();
+    void add(double px, double py, double pz, double mu,
+             double radius=std::numeric_limits<double>::infinity());
+    std::size_t size() const;
+};
+
+
+/*
+ * Structure-of-arrays with the bodies that receive gravity. The packing stage fills the
+ * coordinates and the kernel writes the accelerations, the caller is in charge of converting
+ * the accelerations to forces (using the masses of the bodies) and scattering them back.
+ *
+ * @x, @y, @z: coordinates of the bodies.
+ * @ax, @ay, @az: output accelerations, resized by the kernel.
+ */
+struct gravity_bodies{
+    std::vector<double> x, y, z;
+    std::vector<double> ax, ay, az;
+
+    void clear();
+    void add(double px, double py, double pz);
+    std::size_t size() const;
+};
+
+
+/*
+ * Source set of a body, bit i of the mask is set if the body receives the pull of the i-th source.
+ * The set is cached by the caller and only recomputed when the body crosses a sphere of influence
+ * (or every GRAVITY_SET_MAX_AGE selections), see select_gravity_sources.
+ *
+ * @mask: sources that are evaluated.
+ * @inside: spheres of influence that contain the body, bit i is the one of the i-th source.
+ * @age: number of selections since the set was computed.
+ * @error: sum of the accelerations of the culled sources when the set was computed (m/s^2), an
+ * upper bound of the error of the culling.
+ */
+struct gravity_set{
+    std::uint64_t mask, inside;
+    int age;
+    double error;
+
+    gravity_set(){
+        mask = ~std::uint64_t(0);
+        inside = 0;
+        age = GRAVITY_SET_MAX_AGE; // never selected
+        error = 0.0;
+    }
+};
+
+
+/*
+ * Radius of the sphere of influence (Laplace) of a body that orbits a much heavier primary.
+ *
+ * @a: semi-major axis of the orbit of the body, in meters.
+ * @mass: mass of the body.
+ * @primary_mass: mass of the primary.
+ */
+double sphere_of_influence(double a, double mass, double primary_mass);
+
+/*
+ * Updates the source set of a body at the given position. If the body is still in the same spheres
+ * of influence as the last time and the set is younger than GRAVITY_SET_MAX_AGE the set is kept,
+ * this only costs a distance check per source. Otherwise the set is recomputed: a source is kept
+ * if its sphere of influence contains the body or if its acceleration is at least the threshold.
+ * With a threshold of 0 nothing is culled.
+ *
+ * @sources: gravity sources.
+ * @px, @py, @pz: position of the body.
+ * @threshold: acceleration threshold, in m/s^2.
+ * @set: cached set of the body, updated.
+ *
+ * Returns true if the set was recomputed.
+ */
+bool select_gravity_sources(const gravity_sources& sources, double px, double py, double pz,
+                            double threshold, gravity_set& set);
+
+/*
+ * Like compute_gravity, but each body only receives the pull of the sources of its mask (see
+ * select_gravity_sources), the sources past GRAVITY_MAX_SOURCES are always evaluated. With AVX2
+ * the bodies are evaluated four at a time, looping only over the sources of their masks (the
+ * lanes whose mask doesn't have a source add 0), the bodies of a vessel are packed together so
+ * the four masks are usually the same. Otherwise the scalar code is used.
+ *
+ * @sources: gravity sources.
+ * @bodies: bodies, the accelerations are written here.
+ * @masks: source set of each body.
+ */
+void compute_gravity_selected(const gravity_sources& sources, gravity_bodies& bodies,
+                              const std::vector<std::uint64_t>& masks);
+
+/*
+ * Computes the gravitational acceleration that each body receives from all the sources, the
+ * results are written in the ax, ay and az arrays of bodies. The inner loop is vectorized over
+ * the bodies, AVX2 (four bodies per iteration) is used if the CPU supports it, otherwise it
+ * falls back to SSE2 (two bodies) or to scalar code. All paths compute in double precision.
+ *
+ * @sources: gravity sources.
+ * @bodies: bodies, the accelerations are written here.
+ */
+void compute_gravity(const gravity_sources& sources, gravity_bodies& bodies);
+
+/*
+ * Scalar version of compute_gravity, always available. Useful to validate the vectorized paths.
+ *
+ * @sources: gravity sources.
+ * @bodies: bodies, the accelerations are written here.
+ */
+void compute_gravity_scalar(const gravity_sources& sources, gravity_bodies& bodies);
+
+/*
+ * Returns the name of the kernel that compute_gravity uses on this CPU ("avx2", "sse2" or
+ * "scalar").
+ */
+const char* gravity_kernel_name();
+
+
+#endif
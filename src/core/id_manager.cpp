@@ -93,6 +93,12 @@ short create_id(std::uint32_t& id, short set){
 }
 
 
+void set_id_seed(std::uint32_t seed){
+    generator.seed(seed);
+    distribution.reset();
+}
+
+
 short print_set(short set){
     std::unordered_set<std::uint32_t>* uset_ptr;
     std::unordered_set<std::uint32_t>::iterator it;
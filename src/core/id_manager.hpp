@@ -52,6 +52,14 @@ short remove_id(std::uint32_t id, short set);
  */
 short create_id(std::uint32_t& id, short set);
 
+/*
+ * Seeds the generator of the random IDs, the IDs created afterwards only depend on the seed and
+ * the order of the requests. The default seed is 0, see Recorder.
+ *
+ * @seed: seed of the generator.
+ */
+void set_id_seed(std::uint32_t seed);
+
 /*
  * Prints all the IDs from the given set.
  */
@@ -0,0 +1,376 @@
+#include <cmath>
+
+#include "kepler.hpp"
+#include "Physics.hpp"
+#include "../assets/Planet.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEPLER_X86
+#endif
+
+
+/* pi / 2 split in three parts (Cody-Waite, from fdlibm), the products with small integers are
+   exact */
+#define PIO2_1 1.57079632673412561417e+00
+#define PIO2_2 6.07710050630396597660e-11
+#define PIO2_3 2.02226624879595063154e-21
+/* same for 2 * pi, multiplying by 4 is exact */
+#define TWO_PI_1 (4 * PIO2_1)
+#define TWO_PI_2 (4 * PIO2_2)
+#define TWO_PI_3 (4 * PIO2_3)
+
+/* fdlibm's __kernel_sin and __kernel_cos, valid in [-pi/4, pi/4] */
+#define SIN_S1 -1.66666666666666324348e-01
+#define SIN_S2 8.33333333332248946124e-03
+#define SIN_S3 -1.98412698298579493134e-04
+#define SIN_S4 2.75573137070700676789e-06
+#define SIN_S5 -2.50507602534068634195e-08
+#define SIN_S6 1.58969099521155010221e-10
+#define COS_C1 4.16666666666666019037e-02
+#define COS_C2 -1.38888888888741095749e-03
+#define COS_C3 2.48015872894767294178e-05
+#define COS_C4 -2.75573143513906633035e-07
+#define COS_C5 2.08757232129817482790e-09
+#define COS_C6 -1.13596475577881948265e-11
+
+
+void kepler_orbits::clear(){
+    a_0.clear(); a_d.clear();
+    e_0.clear(); e_d.clear();
+    i_0.clear(); i_d.clear();
+    L_0.clear(); L_d.clear();
+    p_0.clear(); p_d.clear();
+    W_0.clear(); W_d.clear();
+    gm.clear();
+}
+
+
+void kepler_orbits::add(const orbital_data& data, double mu){
+    a_0.push_back(data.a_0); a_d.push_back(data.a_d);
+    e_0.push_back(data.e_0); e_d.push_back(data.e_d);
+    i_0.push_back(data.i_0); i_d.push_back(data.i_d);
+    L_0.push_back(data.L_0); L_d.push_back(data.L_d);
+    p_0.push_back(data.p_0); p_d.push_back(data.p_d);
+    W_0.push_back(data.W_0); W_d.push_back(data.W_d);
+    gm.push_back(mu);
+}
+
+
+std::size_t kepler_orbits::size() const{
+    return gm.size();
+}
+
+
+void kepler_states::clear(){
+    orbit.clear();
+    time.clear();
+}
+
+
+void kepler_states::add(std::uint32_t orbit_index, double cent_since_j2000){
+    orbit.push_back(orbit_index);
+    time.push_back(cent_since_j2000);
+}
+
+
+std::size_t kepler_states::size() const{
+    return time.size();
+}
+
+
+/* elements of a single query, see kepler_single */
+struct kepler_elements{
+    double a_0, a_d, e_0, e_d, i_0, i_d, L_0, L_d, p_0, p_d, W_0, W_d, gm;
+};
+
+
+static inline void kepler_single(const kepler_elements& el, double t, double* pos, double* vel){
+    double a = (el.a_0 + el.a_d * t) * AU_TO_METERS;
+    double e = el.e_0 + el.e_d * t;
+    double inc = el.i_0 + el.i_d * t;
+    double L = el.L_0 + el.L_d * t;
+    double p = el.p_0 + el.p_d * t;
+    double W = el.W_0 + el.W_d * t;
+
+    double M = L - p;
+    double w = p - W;
+
+    // M in [-pi, pi], L grows a lot with time
+    double k = std::round(M / (2 * M_PI));
+    M = ((M - k * TWO_PI_1) - k * TWO_PI_2) - k * TWO_PI_3;
+
+    // Danby's starting point
+    double E = M + (std::sin(M) < 0.0 ? -0.85 : 0.85) * e;
+    for(int i=0; i < KEPLER_ITERATIONS; i++)
+        E -= (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
+
+    double sin_E = std::sin(E), cos_E = std::cos(E);
+    double b = a * std::sqrt(1 - e * e);
+    double n = std::sqrt(el.gm / (a * a * a)) / (1 - e * cos_E); // dE/dt
+
+    // perifocal frame
+    double P = a * (cos_E - e), Q = b * sin_E;
+    double dP = -a * sin_E * n, dQ = b * cos_E * n;
+
+    // our y axis is the z axis of the usual reference frame
+    double cos_w = std::cos(w), sin_w = std::sin(w);
+    double cos_W = std::cos(W), sin_W = std::sin(W);
+    double cos_i = std::cos(inc), sin_i = std::sin(inc);
+
+    double rc = cos_w * P - sin_w * Q, rs = sin_w * P + cos_w * Q;
+    double vc = cos_w * dP - sin_w * dQ, vs = sin_w * dP + cos_w * dQ;
+
+    pos[0] = cos_W * rc - sin_W * cos_i * rs;
+    pos[1] = sin_i * rs;
+    pos[2] = sin_W * rc + cos_W * cos_i * rs;
+    vel[0] = cos_W * vc - sin_W * cos_i * vs;
+    vel[1] = sin_i * vs;
+    vel[2] = sin_W * vc + cos_W * cos_i * vs;
+}
+
+
+static inline void kepler_single_query(const kepler_orbits& orbits, kepler_states& states,
+                                       std::size_t i){
+    std::size_t j = states.orbit[i];
+    kepler_elements el = {orbits.a_0[j], orbits.a_d[j], orbits.e_0[j], orbits.e_d[j],
+                          orbits.i_0[j], orbits.i_d[j], orbits.L_0[j], orbits.L_d[j],
+                          orbits.p_0[j], orbits.p_d[j], orbits.W_0[j], orbits.W_d[j],
+                          orbits.gm[j]};
+    double pos[3], vel[3];
+
+    kepler_single(el, states.time[i], pos, vel);
+    states.x[i] = pos[0];
+    states.y[i] = pos[1];
+    states.z[i] = pos[2];
+    states.vx[i] = vel[0];
+    states.vy[i] = vel[1];
+    states.vz[i] = vel[2];
+}
+
+
+static void resize_states(kepler_states& states){
+    states.x.resize(states.size());
+    states.y.resize(states.size());
+    states.z.resize(states.size());
+    states.vx.resize(states.size());
+    states.vy.resize(states.size());
+    states.vz.resize(states.size());
+}
+
+
+void propagate_kepler_scalar(const kepler_orbits& orbits, kepler_states& states){
+    resize_states(states);
+
+    for(std::size_t i=0; i < states.size(); i++)
+        kepler_single_query(orbits, states, i);
+}
+
+
+void kepler_state(const orbital_data& data, double mu, double cent_since_j2000,
+                  dmath::vec3& pos, dmath::vec3& vel){
+    kepler_elements el = {data.a_0, data.a_d, data.e_0, data.e_d, data.i_0, data.i_d,
+                          data.L_0, data.L_d, data.p_0, data.p_d, data.W_0, data.W_d, mu};
+
+    kepler_single(el, cent_since_j2000, pos.v, vel.v);
+}
+
+
+void kepler_position(const orbital_data& data, double cent_since_j2000, dmath::vec3& pos){
+    dmath::vec3 vel;
+
+    kepler_state(data, 0.0, cent_since_j2000, pos, vel);
+}
+
+
+void kepler_orbit_axes(const orbital_data& data, double cent_since_j2000, dmath::vec3& p_axis,
+                       dmath::vec3& q_axis, double& e, double& M){
+    double t = cent_since_j2000;
+    double a = (data.a_0 + data.a_d * t) * AU_TO_METERS;
+    double inc = data.i_0 + data.i_d * t;
+    double L = data.L_0 + data.L_d * t;
+    double p = data.p_0 + data.p_d * t;
+    double W = data.W_0 + data.W_d * t;
+    double w = p - W;
+
+    e = data.e_0 + data.e_d * t;
+    M = L - p;
+
+    double k = std::round(M / (2 * M_PI));
+    M = ((M - k * TWO_PI_1) - k * TWO_PI_2) - k * TWO_PI_3;
+
+    double b = a * std::sqrt(1 - e * e);
+    double cos_w = std::cos(w), sin_w = std::sin(w);
+    double cos_W = std::cos(W), sin_W = std::sin(W);
+    double cos_i = std::cos(inc), sin_i = std::sin(inc);
+
+    // columns of the rotation of kepler_single, scaled by the semi-axes
+    p_axis.v[0] = a * (cos_W * cos_w - sin_W * cos_i * sin_w);
+    p_axis.v[1] = a * sin_i * sin_w;
+    p_axis.v[2] = a * (sin_W * cos_w + cos_W * cos_i * sin_w);
+    q_axis.v[0] = -b * (cos_W * sin_w + sin_W * cos_i * cos_w);
+    q_axis.v[1] = b * sin_i * cos_w;
+    q_axis.v[2] = b * (cos_W * cos_i * cos_w - sin_W * sin_w);
+}
+
+
+#ifdef KEPLER_X86
+
+/* no FMA on purpose, like the gravity kernel */
+__attribute__((target("avx2")))
+static inline void sincos_avx2(__m256d x, __m256d& s, __m256d& c){
+    // x = q * pi / 2 + r, |r| <= pi / 4
+    __m256d q = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(2 / M_PI)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(q, _mm256_set1_pd(PIO2_1)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(q, _mm256_set1_pd(PIO2_2)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(q, _mm256_set1_pd(PIO2_3)));
+
+    __m256d z = _mm256_mul_pd(r, r);
+    __m256d ps = _mm256_set1_pd(SIN_S6);
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(SIN_S5));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(SIN_S4));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(SIN_S3));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(SIN_S2));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(SIN_S1));
+    __m256d sin_r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(z, r), ps));
+
+    __m256d pc = _mm256_set1_pd(COS_C6);
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(COS_C5));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(COS_C4));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(COS_C3));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(COS_C2));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(COS_C1));
+    __m256d cos_r = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(1.0),
+                                                _mm256_mul_pd(_mm256_set1_pd(0.5), z)),
+                                  _mm256_mul_pd(_mm256_mul_pd(z, z), pc));
+
+    // quadrant: odd ones swap sin and cos, 2 and 3 negate sin, 1 and 2 negate cos
+    __m256i quadrant = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(q));
+    __m256i one = _mm256_set1_epi64x(1), two = _mm256_set1_epi64x(2);
+    __m256d swap = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(quadrant, one), one));
+    __m256i sign_s = _mm256_slli_epi64(_mm256_and_si256(quadrant, two), 62);
+    __m256i sign_c = _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(quadrant, one), two),
+                                       62);
+
+    s = _mm256_blendv_pd(sin_r, cos_r, swap);
+    c = _mm256_blendv_pd(cos_r, sin_r, swap);
+    s = _mm256_xor_pd(s, _mm256_castsi256_pd(sign_s));
+    c = _mm256_xor_pd(c, _mm256_castsi256_pd(sign_c));
+}
+
+
+__attribute__((target("avx2")))
+static std::size_t propagate_kepler_avx2(const kepler_orbits& orbits, kepler_states& states){
+    std::size_t n = states.size() - states.size() % 4;
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+
+    for(std::size_t i=0; i < n; i += 4){
+        __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&states.orbit[i]));
+        __m256d t = _mm256_loadu_pd(&states.time[i]);
+
+#define KEPLER_GATHER(v) _mm256_i32gather_pd(orbits.v.data(), idx, 8)
+#define KEPLER_ELEMENT(v) _mm256_add_pd(KEPLER_GATHER(v##_0), \
+                                        _mm256_mul_pd(KEPLER_GATHER(v##_d), t))
+        __m256d a = _mm256_mul_pd(KEPLER_ELEMENT(a), _mm256_set1_pd(AU_TO_METERS));
+        __m256d e = KEPLER_ELEMENT(e);
+        __m256d inc = KEPLER_ELEMENT(i);
+        __m256d L = KEPLER_ELEMENT(L);
+        __m256d p = KEPLER_ELEMENT(p);
+        __m256d W = KEPLER_ELEMENT(W);
+        __m256d gm = KEPLER_GATHER(gm);
+#undef KEPLER_ELEMENT
+#undef KEPLER_GATHER
+
+        __m256d M = _mm256_sub_pd(L, p);
+        __m256d w = _mm256_sub_pd(p, W);
+
+        __m256d k = _mm256_round_pd(_mm256_mul_pd(M, _mm256_set1_pd(1 / (2 * M_PI))),
+                                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        M = _mm256_sub_pd(M, _mm256_mul_pd(k, _mm256_set1_pd(TWO_PI_1)));
+        M = _mm256_sub_pd(M, _mm256_mul_pd(k, _mm256_set1_pd(TWO_PI_2)));
+        M = _mm256_sub_pd(M, _mm256_mul_pd(k, _mm256_set1_pd(TWO_PI_3)));
+
+        __m256d sin_E, cos_E;
+        sincos_avx2(M, sin_E, cos_E);
+        __m256d start = _mm256_blendv_pd(_mm256_set1_pd(0.85), _mm256_set1_pd(-0.85),
+                                         _mm256_cmp_pd(sin_E, zero, _CMP_LT_OQ));
+        __m256d E = _mm256_add_pd(M, _mm256_mul_pd(start, e));
+
+        for(int j=0; j < KEPLER_ITERATIONS; j++){
+            sincos_avx2(E, sin_E, cos_E);
+            __m256d f = _mm256_sub_pd(_mm256_sub_pd(E, _mm256_mul_pd(e, sin_E)), M);
+            __m256d df = _mm256_sub_pd(one, _mm256_mul_pd(e, cos_E));
+            E = _mm256_sub_pd(E, _mm256_div_pd(f, df));
+        }
+        sincos_avx2(E, sin_E, cos_E);
+
+        __m256d b = _mm256_mul_pd(a, _mm256_sqrt_pd(_mm256_sub_pd(one, _mm256_mul_pd(e, e))));
+        __m256d dE = _mm256_div_pd(_mm256_sqrt_pd(_mm256_div_pd(gm, _mm256_mul_pd(a,
+                                                  _mm256_mul_pd(a, a)))),
+                                   _mm256_sub_pd(one, _mm256_mul_pd(e, cos_E)));
+
+        __m256d P = _mm256_mul_pd(a, _mm256_sub_pd(cos_E, e));
+        __m256d Q = _mm256_mul_pd(b, sin_E);
+        __m256d dP = _mm256_sub_pd(zero, _mm256_mul_pd(_mm256_mul_pd(a, sin_E), dE));
+        __m256d dQ = _mm256_mul_pd(_mm256_mul_pd(b, cos_E), dE);
+
+        __m256d sin_w, cos_w, sin_W, cos_W, sin_i, cos_i;
+        sincos_avx2(w, sin_w, cos_w);
+        sincos_avx2(W, sin_W, cos_W);
+        sincos_avx2(inc, sin_i, cos_i);
+
+        __m256d rc = _mm256_sub_pd(_mm256_mul_pd(cos_w, P), _mm256_mul_pd(sin_w, Q));
+        __m256d rs = _mm256_add_pd(_mm256_mul_pd(sin_w, P), _mm256_mul_pd(cos_w, Q));
+        __m256d vc = _mm256_sub_pd(_mm256_mul_pd(cos_w, dP), _mm256_mul_pd(sin_w, dQ));
+        __m256d vs = _mm256_add_pd(_mm256_mul_pd(sin_w, dP), _mm256_mul_pd(cos_w, dQ));
+        __m256d sin_W_cos_i = _mm256_mul_pd(sin_W, cos_i);
+        __m256d cos_W_cos_i = _mm256_mul_pd(cos_W, cos_i);
+
+        _mm256_storeu_pd(&states.x[i], _mm256_sub_pd(_mm256_mul_pd(cos_W, rc),
+                                                     _mm256_mul_pd(sin_W_cos_i, rs)));
+        _mm256_storeu_pd(&states.y[i], _mm256_mul_pd(sin_i, rs));
+        _mm256_storeu_pd(&states.z[i], _mm256_add_pd(_mm256_mul_pd(sin_W, rc),
+                                                     _mm256_mul_pd(cos_W_cos_i, rs)));
+        _mm256_storeu_pd(&states.vx[i], _mm256_sub_pd(_mm256_mul_pd(cos_W, vc),
+                                                      _mm256_mul_pd(sin_W_cos_i, vs)));
+        _mm256_storeu_pd(&states.vy[i], _mm256_mul_pd(sin_i, vs));
+        _mm256_storeu_pd(&states.vz[i], _mm256_add_pd(_mm256_mul_pd(sin_W, vc),
+                                                      _mm256_mul_pd(cos_W_cos_i, vs)));
+    }
+
+    return n;
+}
+
+
+static bool cpu_has_avx2(){
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+#endif
+
+
+void propagate_kepler(const kepler_orbits& orbits, kepler_states& states){
+    std::size_t done = 0;
+
+    resize_states(states);
+
+#ifdef KEPLER_X86
+    if(cpu_has_avx2())
+        done = propagate_kepler_avx2(orbits, states);
+#endif
+
+    // remainder (or everything if there's no SIMD support)
+    for(std::size_t i=done; i < states.size(); i++)
+        kepler_single_query(orbits, states, i);
+}
+
+
+const char* kepler_kernel_name(){
+#ifdef KEPLER_X86
+    if(cpu_has_avx2())
+        return "avx2";
+#endif
+    return "scalar";
+}
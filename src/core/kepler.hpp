@@ -0,0 +1,120 @@
+#ifndef KEPLER_HPP
+#define KEPLER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "maths_funcs.hpp"
+
+
+struct orbital_data;
+
+
+/* Newton iterations of the Kepler solver. They are fixed so every lane of the vectorized kernel
+   does the same work, with the starting point of Danby this is enough for e < 0.95 */
+#define KEPLER_ITERATIONS 8
+
+
+/*
+ * Structure-of-arrays with the orbits to propagate, each one is the constant part of an
+ * orbital_data (the initial values and the rates of the elements) and the standard gravitational
+ * parameter of the primary, which is only needed for the velocities.
+ *
+ * @a_0, @a_d ... @W_d: see orbital_data (Planet.hpp), a in AU and the angles in rads.
+ * @gm: standard gravitational parameter of the body we orbit (G * m).
+ */
+struct kepler_orbits{
+    std::vector<double> a_0, a_d, e_0, e_d, i_0, i_d, L_0, L_d, p_0, p_d, W_0, W_d;
+    std::vector<double> gm;
+
+    void clear();
+    void add(const orbital_data& data, double mu);
+    std::size_t size() const;
+};
+
+
+/*
+ * Structure-of-arrays with the (orbit, time) pairs to evaluate. The packing stage fills the
+ * indices and the times, the kernel writes the states. The states are relative to the primary.
+ *
+ * @orbit: index of the orbit in kepler_orbits.
+ * @time: time of each query, in centuries since j2000.
+ * @x, @y, @z: output positions in meters, resized by the kernel.
+ * @vx, @vy, @vz: output velocities in meters per second, resized by the kernel.
+ */
+struct kepler_states{
+    std::vector<std::int32_t> orbit;
+    std::vector<double> time;
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+
+    void clear();
+    void add(std::uint32_t orbit_index, double cent_since_j2000);
+    std::size_t size() const;
+};
+
+
+/*
+ * Propagates every query of states along its orbit. Kepler's equation is solved with
+ * KEPLER_ITERATIONS Newton iterations and the position is computed from the eccentric anomaly,
+ * without the true anomaly. If the CPU supports AVX2 four queries are evaluated per iteration
+ * with polynomial approximations of sin and cos (fdlibm's kernels, within a couple of ulps of
+ * libm), otherwise the scalar code is used. All paths compute in double precision.
+ *
+ * @orbits: orbits.
+ * @states: queries, the states are written here.
+ */
+void propagate_kepler(const kepler_orbits& orbits, kepler_states& states);
+
+/*
+ * Scalar version of propagate_kepler, always available. Useful to validate the vectorized path.
+ *
+ * @orbits: orbits.
+ * @states: queries, the states are written here.
+ */
+void propagate_kepler_scalar(const kepler_orbits& orbits, kepler_states& states);
+
+/*
+ * Returns the name of the kernel that propagate_kepler uses on this CPU ("avx2" or "scalar").
+ */
+const char* kepler_kernel_name();
+
+/*
+ * Computes the state of a single orbit with the scalar code of propagate_kepler.
+ *
+ * @data: orbital parameters of the body (struct defined in Planet.hpp).
+ * @mu: standard gravitational parameter of the primary, only used for the velocity.
+ * @cent_since_j2000: time at which we want the state, in centuries.
+ * @pos: will contain the position relative to the primary, in meters.
+ * @vel: will contain the velocity relative to the primary, in meters per second.
+ */
+void kepler_state(const orbital_data& data, double mu, double cent_since_j2000,
+                  dmath::vec3& pos, dmath::vec3& vel);
+
+/*
+ * Same as kepler_state, but only computes the position.
+ *
+ * @data: orbital parameters of the body (struct defined in Planet.hpp).
+ * @cent_since_j2000: time at which we want the position, in centuries.
+ * @pos: will contain the position relative to the primary, in meters.
+ */
+void kepler_position(const orbital_data& data, double cent_since_j2000, dmath::vec3& pos);
+
+/*
+ * Computes the orbit at the given time as an ellipse, the position at the eccentric anomaly E is
+ * p_axis * (cos(E) - e) + q_axis * sin(E), the same that kepler_position computes. Used to draw
+ * the orbits without evaluating each point on the CPU.
+ *
+ * @data: orbital parameters of the body (struct defined in Planet.hpp).
+ * @cent_since_j2000: time of the orbit, in centuries.
+ * @p_axis: will contain the semi-major axis pointing to the periapsis, in meters.
+ * @q_axis: will contain the semi-minor axis pointing to 90º of eccentric anomaly, in meters.
+ * @e: will contain the eccentricity.
+ * @M: will contain the mean anomaly of the body, in [-pi, pi].
+ */
+void kepler_orbit_axes(const orbital_data& data, double cent_since_j2000, dmath::vec3& p_axis,
+                       dmath::vec3& q_axis, double& e, double& M);
+
+
+#endif
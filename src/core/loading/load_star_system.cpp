@@ -127,6 +127,7 @@ int load_planets(const tinyxml2::XMLElement* planets_element, planet_map& planet
         double mean_anomaly_d = data.L_d - data.p;
 
         data.period = ((2 * M_PI) / mean_anomaly_d);
+        current_planet->initEphemeris();
 
         current_planet->setID(str_hash(name));
         res = planets.insert({current_planet->getId(), std::move(current_planet)});
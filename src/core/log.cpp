@@ -26,6 +26,7 @@ int log_start(){
 }
 
 
+#ifndef HEADLESS
 void log_gl_params(){
     std::ostringstream message;
     GLenum params[] = {
@@ -77,3 +78,4 @@ void log_gl_params(){
     log(names[12], (unsigned int)s);
     log("-----------------------------\n");*/
 }
+#endif
@@ -4,7 +4,15 @@
 struct particle_state;
 
 // Some integrators to solve the motion equations. The two Euler ones are first order, the Verlet
-// is second order. Maybe some day we should add higher order methods.
+// and the leapfrog are second order and the Dormand-Prince is fifth order. The Euler and Verlet
+// solvers take a fixed step, the adaptive ones (at the end of the file) pick their own step and
+// evaluate the acceleration themselves, so they take a function instead of the applied forces.
+
+
+/* step control of the adaptive solvers */
+#define SOLVER_SAFETY 0.9 // fraction of the optimal step that is actually taken
+#define SOLVER_MIN_SCALE 0.2 // the step shrinks at most this much per try
+#define SOLVER_MAX_SCALE 5.0 // and grows at most this much per step
 
 /*
  * Integrates the forces applied to a particle to find its next position using the Euler method.
@@ -74,4 +82,63 @@ inline void solverVerlet(struct particle_state& p, double delta_t){
 }
 
 
+
+/*
+ * One step of the Dormand-Prince 5(4) embedded Runge-Kutta method, with error control. The local
+ * error is estimated with the embedded fourth order solution, relative to the magnitudes of the
+ * position and the velocity. If it's below the tolerance the step is accepted and the particle
+ * and t are advanced, otherwise nothing changes. Either way delta_t is set to the step of the next
+ * try. Returns true if the step was accepted.
+ *
+ * The acceleration only depends on the time and the position (gravity), the acceleration function
+ * has the signature dmath::vec3 f(double t, const dmath::vec3& origin). Like in the other solvers
+ * total_force has to contain the force at the start of the step, and after an accepted step it
+ * contains the force at the new position, which is the first stage of the next step (FSAL). So
+ * each step costs 6 evaluations of the acceleration.
+ *
+ * @p: particle, its total_force has to be the force at (t, p.origin).
+ * @t: time of the particle, in seconds.
+ * @delta_t: step to try, will contain the step of the next try.
+ * @tolerance: maximum relative local error per step.
+ * @acceleration: function that returns the acceleration at the given time and position.
+ */
+template<typename F>
+bool solverDormandPrince(struct particle_state& p, double& t, double& delta_t, double tolerance,
+                         F acceleration);
+
+
+/*
+ * Kick-drift-kick leapfrog, symplectic when the step is fixed. Uses the same convention as
+ * solverDormandPrince for the forces: total_force has to be the force at the start and will be the
+ * force at the end, so each step costs a single evaluation of the acceleration.
+ *
+ * @p: particle, its total_force has to be the force at (t, p.origin).
+ * @t: time of the particle at the start of the step, in seconds.
+ * @delta_t: time interval used to solve the motion of the particle.
+ * @acceleration: function that returns the acceleration at the given time and position.
+ */
+template<typename F>
+void solverLeapfrog(struct particle_state& p, double t, double delta_t, F acceleration);
+
+
+/*
+ * Leapfrog with a variable step. The next step is eta times |a| / |da/dt| (Aarseth's criterion,
+ * the jerk is the difference of the accelerations of the step), a fraction of the local dynamical
+ * time, which is short in close encounters and long in the cruise. Changing the step breaks the
+ * symplecticity (the energy error is not bounded anymore), but it only costs an evaluation per
+ * step. The step is always accepted, t is advanced. delta_t > 0.
+ *
+ * @p: particle, its total_force has to be the force at (t, p.origin).
+ * @t: time of the particle, in seconds.
+ * @delta_t: step to take, will contain the next step.
+ * @eta: accuracy parameter, fraction of the dynamical time per step.
+ * @acceleration: function that returns the acceleration at the given time and position.
+ */
+template<typename F>
+void solverAdaptiveLeapfrog(struct particle_state& p, double& t, double& delta_t, double eta,
+                            F acceleration);
+
+
+#include "solvers.tpp"
+
 #endif
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <algorithm>
+
+
+template<typename F>
+bool solverDormandPrince(struct particle_state& p, double& t, double& delta_t, double tolerance,
+                         F acceleration){
+    // Butcher tableau, the last row is the fifth order solution
+    static const double c[7] = {0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0, 1.0};
+    static const double a[7][6] = {
+        {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        {1.0 / 5.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        {3.0 / 40.0, 9.0 / 40.0, 0.0, 0.0, 0.0, 0.0},
+        {44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0, 0.0, 0.0, 0.0},
+        {19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0, 0.0, 0.0},
+        {9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0, 0.0},
+        {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0}
+    };
+    // fifth minus fourth order weights
+    static const double e[7] = {71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0,
+                                -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0};
+    dmath::vec3 kx[7], kv[7]; // derivatives of the position and the velocity at each stage
+    dmath::vec3 origin, velocity, error_x(0.0, 0.0, 0.0), error_v(0.0, 0.0, 0.0);
+    double h = delta_t;
+
+    kx[0] = p.velocity;
+    kv[0] = p.total_force / p.mass;
+    for(int i=1; i < 7; i++){
+        origin = p.origin;
+        velocity = p.velocity;
+        for(int j=0; j < i; j++){
+            origin = origin + kx[j] * (h * a[i][j]);
+            velocity = velocity + kv[j] * (h * a[i][j]);
+        }
+        kx[i] = velocity;
+        kv[i] = acceleration(t + c[i] * h, origin);
+    }
+
+    for(int i=0; i < 7; i++){
+        error_x = error_x + kx[i] * (h * e[i]);
+        error_v = error_v + kv[i] * (h * e[i]);
+    }
+
+    double scale_x = tolerance * std::max(dmath::length(p.origin), dmath::length(origin));
+    double scale_v = tolerance * std::max(dmath::length(p.velocity), dmath::length(velocity));
+    double error = std::max(scale_x > 0.0 ? dmath::length(error_x) / scale_x : 0.0,
+                            scale_v > 0.0 ? dmath::length(error_v) / scale_v : 0.0);
+
+    double factor = error > 0.0 ? SOLVER_SAFETY * std::pow(error, -0.2) : SOLVER_MAX_SCALE;
+    delta_t = h * std::min(SOLVER_MAX_SCALE, std::max(SOLVER_MIN_SCALE, factor));
+
+    if(error > 1.0)
+        return false;
+
+    p.prev_origin = p.origin;
+    p.origin = origin;
+    p.velocity = velocity;
+    p.total_force = kv[6] * p.mass;
+    t += h;
+
+    return true;
+}
+
+
+template<typename F>
+void solverLeapfrog(struct particle_state& p, double t, double delta_t, F acceleration){
+    dmath::vec3 half_velocity = p.velocity + p.total_force / p.mass * (delta_t / 2);
+
+    p.prev_origin = p.origin;
+    p.origin = p.origin + half_velocity * delta_t;
+
+    dmath::vec3 acceleration_tp1 = acceleration(t + delta_t, p.origin);
+    p.velocity = half_velocity + acceleration_tp1 * (delta_t / 2);
+    p.total_force = acceleration_tp1 * p.mass;
+}
+
+
+template<typename F>
+void solverAdaptiveLeapfrog(struct particle_state& p, double& t, double& delta_t, double eta,
+                            F acceleration){
+    dmath::vec3 acceleration_t = p.total_force / p.mass;
+
+    solverLeapfrog(p, t, delta_t, acceleration);
+    t += delta_t;
+
+    dmath::vec3 acceleration_tp1 = p.total_force / p.mass;
+    double jerk = dmath::length(acceleration_tp1 - acceleration_t) / delta_t;
+    double step = jerk > 0.0 ? eta * dmath::length(acceleration_tp1) / jerk :
+                               delta_t * SOLVER_MAX_SCALE;
+
+    delta_t = std::min(delta_t * SOLVER_MAX_SCALE, std::max(delta_t * SOLVER_MIN_SCALE, step));
+}
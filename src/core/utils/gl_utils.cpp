@@ -11,6 +11,8 @@
 #include "../common.hpp"
 
 
+/* headless builds (HEADLESS) have no GL context, they only use the bounding boxes */
+#ifndef HEADLESS
 void log_shader_info(GLuint shader_index){
     int actual_length = 0;
     char message[LOG_GL_MAX_LENGTH];
@@ -255,6 +257,7 @@ double get_fps(){
 
     return fps;
 }
+#endif
 
 
 struct bbox get_AABB(GLfloat* vbuffer, int n_vert){
@@ -320,6 +323,11 @@ struct bbox get_AABB(GLfloat* vbuffer, int n_vert){
 
 
 bool check_gl_errors(bool print, const char* caller){
+#ifdef HEADLESS
+    UNUSED(print);
+    UNUSED(caller);
+    return false;
+#else
     bool error = false;
     GLenum e = glGetError();
 
@@ -335,4 +343,5 @@ bool check_gl_errors(bool print, const char* caller){
     }
 
     return error;
+#endif
 }
@@ -41,8 +41,6 @@ GameEditor::GameEditor(BaseApp* app, FontAtlas* font_atlas){
     m_asset_manager = m_app->getAssetManager();
     m_player = m_app->getPlayer();
 
-    m_thread_monitor= m_app->getThreadMonitor();
-
     m_def_font_atlas = font_atlas;
 
     m_editor_gui.reset(new EditorGUI(m_app, m_def_font_atlas));
@@ -107,22 +105,6 @@ void GameEditor::synchPostStep(){
 }
 
 
-void GameEditor::wakePhysics(){
-    std::unique_lock<std::mutex> lck2(m_thread_monitor->mtx_start);
-    m_thread_monitor->worker_start = true;
-    m_thread_monitor->cv_start.notify_all();
-}
-
-
-void GameEditor::waitPhysics(){
-    std::unique_lock<std::mutex> lck(m_thread_monitor->mtx_end);
-    while(!m_thread_monitor->worker_ended){
-        m_thread_monitor->cv_end.wait(lck);
-    }
-    m_thread_monitor->worker_ended = false;
-}
-
-
 int GameEditor::start(){
     double delta_t_ms = (1. / 60.) * 1000000.;
     logic_timing timing;
@@ -136,20 +118,20 @@ int GameEditor::start(){
         timing.register_tp(TP_LOGIC_START);
 
         synchPreStep();
-        wakePhysics();
+        m_physics->wakeSimulation();
         logic();
 
         m_render_context->getDebugOverlay()->setLogicTimes(timing);
 
-        waitPhysics();
-        synchPostStep();
-
         timing.register_tp(TP_LOGIC_END);
         timing.update();
 
         if(timing.current_sleep > 0.0){
             std::this_thread::sleep_for(duration(timing.current_sleep));
         }
+
+        m_physics->waitSimulation();
+        synchPostStep();
     }
     clearSymmetrySubtrees();
 
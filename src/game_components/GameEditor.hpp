@@ -26,8 +26,6 @@ class Player;
 class EditorGUI;
 class EditorRenderer;
 
-struct thread_monitor;
-
 #define EXIT_LAUNCH 1
 #define EXIT_MAIN_MENU 2
 
@@ -68,13 +66,9 @@ class GameEditor{
         Physics* m_physics;
         Player* m_player;
 
-        struct thread_monitor* m_thread_monitor;
-
         // main loop
         void synchPreStep();
         void synchPostStep();
-        void wakePhysics();
-        void waitPhysics();
 
         //void placeClonedSubtreesRadial(BasePart* parent);
         void processInput();
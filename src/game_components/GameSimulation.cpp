@@ -1,6 +1,7 @@
 #include <memory>
 #include <iostream>
 #include <algorithm>
+#include <random>
 
 #include "GameSimulation.hpp"
 #include "../core/log.hpp"
@@ -16,6 +17,8 @@
 #include "../core/Frustum.hpp"
 #include "../core/timing.hpp"
 #include "../core/Predictor.hpp"
+#include "../core/Recorder.hpp"
+#include "../core/id_manager.hpp"
 #include "../GUI/DebugOverlay.hpp"
 #include "../assets/Vessel.hpp"
 #include "../assets/BasePart.hpp"
@@ -52,12 +55,13 @@ GameSimulation::GameSimulation(BaseApp* app, const FontAtlas* font_atlas){
     m_window_handler = m_app->getWindowHandler();
     m_predictor = m_app->getPredictor();
 
-    m_thread_monitor= m_app->getThreadMonitor();
     m_quit = false;
     m_current_view = VIEW_SIMULATION;
     m_freecam = true;
     m_selected_planet = 0;
     m_selected_planet_idx = 0;
+    m_recorder.reset(new Recorder());
+    m_recording_mode = RECORDER_OFF;
 
     m_renderer_simulation.reset(new SimulationRenderer(m_app));
     m_app->getRenderContext()->setRenderer(m_renderer_simulation.get(), RENDER_SIMULATION);
@@ -97,33 +101,112 @@ int GameSimulation::start(){
     m_camera->setSpeed(630000.0f);
     m_camera->createProjMat(1.0, 63000000, 67.0);
     m_render_context->setLightPosition(math::vec3(63000000000.0, 0.0, 0.0));
+    startRecorder();
 
     while(!m_quit){
         timing.register_tp(TP_LOGIC_START);
 
         synchPreStep();
-        wakePhysics();
+        if(m_quit) // the replay ended
+            break;
+        m_physics->wakeSimulation();
         logic();
 
         m_render_context->getDebugOverlay()->setLogicTimes(timing);
 
-        waitPhysics();
-        synchPostStep();
-
         timing.register_tp(TP_LOGIC_END);
         timing.update();
 
-        if(timing.current_sleep > 0.0){
+        if(timing.current_sleep > 0.0 && m_recorder->getMode() != RECORDER_REPLAY){
             std::this_thread::sleep_for(duration(timing.current_sleep));
         }
+
+        /* physics keeps ticking on its own clock while we sleep, the world is only held from
+           here to the next wakeSimulation */
+        m_physics->waitSimulation();
+        synchPostStep();
     }
 
+    m_recorder->finish();
+    m_physics->setReplayTicks(-1, -1);
+    m_physics->setLockstep(false);
+    m_asset_manager->setDigestCommands(false);
+
     return 0;
 }
 
 
+void GameSimulation::setRecording(int mode, const std::string& path){
+    m_recording_mode = mode;
+    m_recording_path = path;
+}
+
+
+void GameSimulation::startRecorder(){
+    std::uint64_t initial_digest;
+
+    if(m_recording_mode == RECORDER_OFF)
+        return;
+
+    /* the commands of the editor and the launch are applied first, so the initial state is the
+       vessel on the launch base */
+    m_asset_manager->processCommandBuffers(false);
+    m_asset_manager->updateCoMs();
+    initial_digest = m_asset_manager->getStateDigest();
+
+    if(m_recording_mode == RECORDER_RECORD){
+        std::uint32_t seed = std::random_device()();
+
+        if(!m_recorder->startRecording(m_recording_path, seed, initial_digest))
+            return;
+    }
+    else if(!m_recorder->startReplay(m_recording_path, initial_digest)){
+        return;
+    }
+
+    set_id_seed(m_recorder->getSeed());
+    m_asset_manager->setDigestCommands(true);
+    // a recorded frame has to match a physics frame
+    m_physics->setLockstep(true);
+}
+
+
+void GameSimulation::recordPreStep(){
+    if(!m_recorder->beginFrame()){
+        m_quit = true;
+        return;
+    }
+
+    recorded_frame& frame = m_recorder->getFrame();
+
+    m_asset_manager->getCommandsDigest(frame.num_commands, frame.commands_digest);
+    if(m_recorder->getMode() == RECORDER_REPLAY){
+        const recorded_frame& recorded = m_recorder->getRecordedFrame();
+
+        // the live input is discarded
+        m_input->setState(recorded.input);
+        m_physics->setReplayTicks(recorded.due_ticks, recorded.sub_ticks);
+    }
+    else{
+        m_input->getState(frame.input);
+    }
+}
+
+
+void GameSimulation::recordPostStep(){
+    recorded_frame& frame = m_recorder->getFrame();
+
+    frame.due_ticks = m_physics->getDueTicks();
+    frame.sub_ticks = m_physics->getSubTicks();
+    frame.state_digest = m_asset_manager->getStateDigest();
+    m_recorder->endFrame();
+}
+
+
 void GameSimulation::synchPostStep(){
     m_asset_manager->updateCoMs();
+    if(m_recorder->getMode() != RECORDER_OFF)
+        recordPostStep();
     if(m_current_view == VIEW_SIMULATION)
         updateCameraSimulation();
     else
@@ -132,27 +215,39 @@ void GameSimulation::synchPostStep(){
 }
 
 
-void GameSimulation::waitPhysics(){
-    std::unique_lock<std::mutex> lck(m_thread_monitor->mtx_end);
-    while(!m_thread_monitor->worker_ended){
-        m_thread_monitor->cv_end.wait(lck);
-    }
-    m_thread_monitor->worker_ended = false;
-}
-
-
 void GameSimulation::synchPreStep(){
     m_asset_manager->processCommandBuffers(false);
+    updateFloatingOrigin();
+    updateResidencyFocus();
     m_input->update();
     m_window_handler->update();
+    if(m_recorder->getMode() != RECORDER_OFF)
+        recordPreStep();
     m_frustum->extractPlanes(m_camera->getCenteredViewMatrix(), m_camera->getProjMatrix(), false);
 }
 
 
-void GameSimulation::wakePhysics(){
-    std::unique_lock<std::mutex> lck2(m_thread_monitor->mtx_start);
-    m_thread_monitor->worker_start = true;
-    m_thread_monitor->cv_start.notify_all();
+void GameSimulation::updateFloatingOrigin(){
+    const Vessel* vessel = m_player->getVessel();
+
+    if(vessel){
+        m_physics->updateFloatingOrigin(vessel->getCoM());
+    }
+}
+
+
+void GameSimulation::updateResidencyFocus(){
+    const Vessel* vessel = m_player->getVessel();
+
+    if(vessel){
+        m_physics->setResidencyFocus(vessel->getCoM());
+    }
+    else{
+        const dmath::vec3& cam_origin = m_camera->getCamPosition();
+
+        m_physics->setResidencyFocus(btVector3(cam_origin.v[0], cam_origin.v[1], cam_origin.v[2]) -
+                                     m_physics->getWorldOrigin());
+    }
 }
 
 
@@ -188,7 +283,8 @@ void GameSimulation::updatePlanetarium(){
     else if(action == PLANETARIUM_ACTION_SET_POSITION){
         Vessel* vessel = m_app->getPlayer()->getVessel();
         if(vessel){
-            const btVector3 origin = m_gui_planetarium->getCheatPosition();
+            const btVector3 origin = m_gui_planetarium->getCheatPosition() -
+                                     m_physics->getWorldOrigin();
             const btQuaternion rotation = vessel->getRoot()->m_body->getOrientation();
             vessel->setSubTreeMotionState(origin, rotation); // thread safe
         }
@@ -210,8 +306,8 @@ void GameSimulation::updatePlanetarium(){
                                              cheat_orbit_data.body_target, current_time,
                                              cheat_orbit_data.match_frame, origin, velocity);
 
-            vessel->setSubTreeMotionState(btVector3(origin.v[0], origin.v[1], origin.v[2]),
-                                          rotation); // thread safe
+            vessel->setSubTreeMotionState(btVector3(origin.v[0], origin.v[1], origin.v[2]) -
+                                          m_physics->getWorldOrigin(), rotation); // thread safe
             m_app->getAssetManager()->setVesselVelocity(vessel, 
                                     btVector3(velocity.v[0], velocity.v[1], velocity.v[2]));
         }
@@ -259,6 +355,24 @@ void GameSimulation::processInput(){
         m_render_context->reloadShaders();
         m_render_context->setLightPosition(math::vec3(63000000000.0, 0.0, 0.0));
     }
+
+    // time warp, the physics thread drops it if some vessel can't be put on rails. With alt it's
+    // the physics warp, which keeps the vessels in bullet
+    bool alt = m_input->pressed_keys[GLFW_KEY_LEFT_ALT] & (INPUT_KEY_DOWN | INPUT_KEY_REPEAT);
+
+    if(m_input->pressed_keys[GLFW_KEY_PERIOD] == INPUT_KEY_DOWN){
+        if(alt)
+            m_physics->setPhysicsWarp(m_physics->getPhysicsWarp() + 1);
+        else
+            m_physics->setTimeWarp(m_physics->getTimeWarp() * 10.0);
+    }
+
+    if(m_input->pressed_keys[GLFW_KEY_COMMA] == INPUT_KEY_DOWN){
+        if(alt)
+            m_physics->setPhysicsWarp(m_physics->getPhysicsWarp() - 1);
+        else
+            m_physics->setTimeWarp(m_physics->getTimeWarp() / 10.0);
+    }
 }
 
 
@@ -268,7 +382,8 @@ void GameSimulation::updateCameraSimulation(){
         m_camera->freeCameraUpdate();
     }
     else if(vessel){ // sanity check for vessel
-        const btVector3& com = vessel->getCoM();
+        // the camera works in absolute coordinates
+        btVector3 com = vessel->getCoM() + m_physics->getWorldOrigin();
         m_camera->setCameraPosition(dmath::vec3(com.getX(), com.getY(), com.getZ()));
         // setCamAxisRotation(); // inherited from Player, should set the up vector of the camera
                                  // and change its inclination. It is not implemented 
@@ -340,6 +455,38 @@ void GameSimulation::processKeyboardInputSimulation(){
         }
     }
 
+    if(m_input->pressed_keys[GLFW_KEY_F3] == INPUT_KEY_DOWN){
+        m_physics->setGravityAggregation(!m_physics->getGravityAggregation());
+    }
+
+    if(m_input->pressed_keys[GLFW_KEY_F9] == INPUT_KEY_DOWN){
+        m_physics->setGravityCulling(!m_physics->getGravityCulling());
+    }
+
+    if(m_input->pressed_keys[GLFW_KEY_F4] == INPUT_KEY_DOWN){
+        m_physics->setWorldClusters(!m_physics->getWorldClusters());
+    }
+
+    if(m_input->pressed_keys[GLFW_KEY_F6] == INPUT_KEY_DOWN){
+        m_physics->setResidency(!m_physics->getResidency());
+    }
+
+    if(m_input->pressed_keys[GLFW_KEY_F7] == INPUT_KEY_DOWN){
+        m_physics->setPartCollisionFilter(!m_physics->getPartCollisionFilter());
+    }
+
+    // cycles the representation of the vessels: parts, rigid and articulated
+    if(m_input->pressed_keys[GLFW_KEY_F8] == INPUT_KEY_DOWN){
+        m_physics->setVesselBodies((m_physics->getVesselBodies() + 1) % VESSEL_BODIES_NUM);
+    }
+
+    // cycles the threads of bullet through the powers of two
+    if(m_input->pressed_keys[GLFW_KEY_F5] == INPUT_KEY_DOWN){
+        int threads = m_physics->getBulletThreads() * 2;
+
+        m_physics->setBulletThreads(threads > m_physics->getMaxBulletThreads() ? 1 : threads);
+    }
+
     if((m_input->pressed_keys[GLFW_KEY_LEFT_SHIFT] & (INPUT_KEY_DOWN | INPUT_KEY_REPEAT)) 
        && (m_input->pressed_keys[GLFW_KEY_C] & INPUT_KEY_DOWN)){
         setPlayerTarget();
@@ -420,15 +567,17 @@ void GameSimulation::onRightMouseButton(){
 
     m_camera->castRayMousePos(1000.f, ray_start_world, ray_end_world);
 
-    btCollisionWorld::ClosestRayResultCallback ray_callback(btVector3(ray_start_world.v[0], 
-                                                ray_start_world.v[1], ray_start_world.v[2]),
-                                                            btVector3(ray_end_world.v[0],
-                                                ray_end_world.v[1], ray_end_world.v[2]));
+    // the camera ray is in absolute coordinates
+    const btVector3& world_origin = m_physics->getWorldOrigin();
+    btVector3 ray_start = btVector3(ray_start_world.v[0], ray_start_world.v[1],
+                                    ray_start_world.v[2]) - world_origin;
+    btVector3 ray_end = btVector3(ray_end_world.v[0], ray_end_world.v[1],
+                                  ray_end_world.v[2]) - world_origin;
+
+    btCollisionWorld::ClosestRayResultCallback ray_callback(ray_start, ray_end);
     ray_callback.m_collisionFilterGroup = CG_RAY_EDITOR_SELECT;
 
-    obj = m_physics->testRay(ray_callback, 
-                             btVector3(ray_start_world.v[0], ray_start_world.v[1], ray_start_world.v[2]),
-                             btVector3(ray_end_world.v[0], ray_end_world.v[1], ray_end_world.v[2]));
+    obj = m_physics->testRay(ray_callback, ray_start, ray_end);
 
     if(obj){
         part = static_cast<BasePart*>(obj);
@@ -479,6 +628,7 @@ void GameSimulation::editorToSimulation(){
         btVector3 to(-26504446806.42, -38663.47, 144693255900.63);
         to += reference_ellipse_to_xyz(btRadians(0.0), btRadians(0.0),
                                        6371555.0 - vsl->getLowerBound());
+        to -= m_physics->getWorldOrigin();
         btVector3 disp;
         btTransform transform;
 
@@ -497,6 +647,8 @@ void GameSimulation::editorToSimulation(){
         //vsl->setVesselVelocity(btVector3(0.0, 0.0, 0.0));
 
         m_asset_manager->m_active_vessels.insert({vsl->getId(), vsl});
+        // the pairs created in the editor before the subtrees were attached are removed
+        m_physics->refreshVesselPairs(vsl.get());
     }
 }
 
@@ -517,7 +669,8 @@ void GameSimulation::initLaunchBase(){
 
     ground->setCollisionGroup(CG_DEFAULT | CG_KINEMATIC);
     ground->setCollisionFilters(~CG_RAY_EDITOR_RADIAL & ~CG_RAY_EDITOR_SELECT);
-    ground->addBody(local_origin + origin, btVector3(0.0, 0.0, 0.0), quat);
+    ground->addBody(local_origin + origin - m_physics->getWorldOrigin(), btVector3(0.0, 0.0, 0.0),
+                    quat);
     ground->setTransform(local_origin, quat);
 
     m_asset_manager->m_kinematics.emplace_back(ground);
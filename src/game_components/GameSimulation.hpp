@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <string>
 #include <stdint.h>
 
 class FontAtlas;
@@ -21,8 +23,7 @@ class WindowHandler;
 class Frustum;
 class Planet;
 class Predictor;
-
-struct thread_monitor;
+class Recorder;
 
 #define VIEW_SIMULATION 1
 #define VIEW_PLANETARIUM 2
@@ -48,7 +49,6 @@ class GameSimulation{
         std::unique_ptr<PlanetariumGUI> m_gui_planetarium;
 
         int m_current_view;
-        struct thread_monitor* m_thread_monitor;
         bool m_quit;
 
         uint32_t m_selected_planet;
@@ -56,6 +56,11 @@ class GameSimulation{
         bool m_freecam;
         std::vector<const Planet*> m_ordered_planets;
 
+        /* recording or replay of the simulation, see setRecording */
+        std::unique_ptr<Recorder> m_recorder;
+        std::string m_recording_path;
+        int m_recording_mode;
+
         void logic();
         void processKeyboardInputSimulation();
         void processKeyboardInputPlanetarium();
@@ -74,8 +79,16 @@ class GameSimulation{
 
         void synchPostStep();
         void synchPreStep();
-        void wakePhysics();
-        void waitPhysics();
+        void updateFloatingOrigin();
+        void updateResidencyFocus();
+
+        /*
+         * Start the recorder if a recording or a replay was requested, and record or feed the
+         * recorded frame before and after the physics step (see Recorder).
+         */
+        void startRecorder();
+        void recordPreStep();
+        void recordPostStep();
     public:
         GameSimulation(BaseApp* app, const FontAtlas* font_atlas);
         ~GameSimulation();
@@ -83,6 +96,16 @@ class GameSimulation{
         int start();
 
         void setUpSimulation();
+
+        /*
+         * Requests to record the simulation to a file or to replay a recording, it starts with
+         * the simulation. Replays run as fast as possible and end the simulation when the
+         * recording ends.
+         *
+         * @mode: RECORDER_RECORD or RECORDER_REPLAY (see core/Recorder.hpp).
+         * @path: path of the recording.
+         */
+        void setRecording(int mode, const std::string& path);
 };
 
 
@@ -1,5 +1,8 @@
+#include <cstring>
+
 #include "App.hpp"
 #include "core/log.hpp"
+#include "core/Recorder.hpp"
 #include "core/utils/utils.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -9,7 +12,25 @@
 
 
 int main(int argc, char* argv[]){
-    UNUSED(argc); UNUSED(argv);
+    int recording_mode = RECORDER_OFF;
+    std::string recording_path;
+
+    /* --record <file> records the simulation, --replay <file> replays it. Relative paths start
+       at the directory of the executable, see change_cwd_to_selfpath */
+    for(int i=1; i < argc; i++){
+        if(!std::strcmp(argv[i], "--record") && i + 1 < argc){
+            recording_mode = RECORDER_RECORD;
+            recording_path = argv[++i];
+        }
+        else if(!std::strcmp(argv[i], "--replay") && i + 1 < argc){
+            recording_mode = RECORDER_REPLAY;
+            recording_path = argv[++i];
+        }
+        else{
+            std::cerr << "Unknown argument " << argv[i] << ", usage: " << argv[0]
+                      << " [--record <file> | --replay <file>]" << std::endl;
+        }
+    }
 
     if(change_cwd_to_selfpath() == EXIT_FAILURE)
         std::cerr << "Could not change the cwd to executable path, proceeding" << std::endl;
@@ -17,6 +38,8 @@ int main(int argc, char* argv[]){
     log_start();
 
     App* app = new App();
+    if(recording_mode != RECORDER_OFF)
+        app->setRecording(recording_mode, recording_path);
     app->run();
     delete app;
 
@@ -0,0 +1,115 @@
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "HeadlessApp.hpp"
+#include "core/log.hpp"
+#include "core/Recorder.hpp"
+#include "core/utils/utils.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+
+/*
+ * Builds and runs a workload, returns the exit code of the run.
+ *
+ * @workload: vessels and frames to simulate.
+ * @recording_mode: RECORDER_OFF, RECORDER_RECORD or RECORDER_REPLAY.
+ * @recording_path: path of the recording.
+ */
+static int run_workload(const headless_workload& workload, int recording_mode,
+                        const std::string& recording_path){
+    int ret;
+    HeadlessApp* app = new HeadlessApp(workload);
+
+    if(recording_mode != RECORDER_OFF)
+        app->setRecording(recording_mode, recording_path);
+    app->run();
+    ret = app->getExitCode();
+    delete app;
+
+    return ret;
+}
+
+
+int main(int argc, char* argv[]){
+    headless_workload workload;
+    int recording_mode = RECORDER_OFF, ret = EXIT_SUCCESS;
+    std::string recording_path;
+    bool sweep = false;
+
+    for(int i=1; i < argc; i++){
+        if(!std::strcmp(argv[i], "--vessels") && i + 1 < argc){
+            workload.num_vessels = std::max(std::atoi(argv[++i]), 0);
+        }
+        else if(!std::strcmp(argv[i], "--parts") && i + 1 < argc){
+            workload.parts_per_vessel = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if(!std::strcmp(argv[i], "--frames") && i + 1 < argc){
+            workload.num_frames = std::max(std::atol(argv[++i]), 1L);
+        }
+        else if(!std::strcmp(argv[i], "--part") && i + 1 < argc){
+            workload.part_name = argv[++i];
+        }
+        else if(!std::strcmp(argv[i], "--sub-ticks") && i + 1 < argc){
+            workload.sub_ticks = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if(!std::strcmp(argv[i], "--aggregation")){
+            workload.gravity_aggregation = true;
+        }
+        else if(!std::strcmp(argv[i], "--culling")){
+            workload.gravity_culling = true;
+        }
+        else if(!std::strcmp(argv[i], "--spacing") && i + 1 < argc){
+            workload.vessel_spacing = std::max(std::atof(argv[++i]), 0.0);
+        }
+        else if(!std::strcmp(argv[i], "--no-clusters")){
+            workload.world_clusters = false;
+        }
+        else if(!std::strcmp(argv[i], "--no-residency")){
+            workload.residency = false;
+        }
+        else if(!std::strcmp(argv[i], "--sweep")){
+            sweep = true;
+        }
+        else if(!std::strcmp(argv[i], "--record") && i + 1 < argc){
+            recording_mode = RECORDER_RECORD;
+            recording_path = argv[++i];
+        }
+        else if(!std::strcmp(argv[i], "--replay") && i + 1 < argc){
+            recording_mode = RECORDER_REPLAY;
+            recording_path = argv[++i];
+        }
+        else{
+            std::cerr << "Unknown argument " << argv[i] << ", usage: " << argv[0]
+                      << " [--vessels <n>] [--parts <n>] [--frames <n>] [--part <name>]"
+                      << " [--sub-ticks <n>] [--aggregation] [--culling] [--spacing <m>]"
+                      << " [--no-clusters] [--no-residency] [--sweep]"
+                      << " [--record <file> | --replay <file>]"
+                      << std::endl;
+        }
+    }
+
+    if(change_cwd_to_selfpath() == EXIT_FAILURE)
+        std::cerr << "Could not change the cwd to executable path, proceeding" << std::endl;
+
+    log_start();
+
+    if(!sweep)
+        return run_workload(workload, recording_mode, recording_path);
+
+    // scaling of the world clusters, compare with --no-clusters
+    if(recording_mode != RECORDER_OFF)
+        std::cerr << "The sweep can't be recorded or replayed, ignoring " << recording_path
+                  << std::endl;
+    workload.vessel_spacing = HEADLESS_SWEEP_SPACING;
+    workload.residency = false;
+    for(int n=HEADLESS_SWEEP_MIN; n <= HEADLESS_SWEEP_MAX && ret == EXIT_SUCCESS;
+        n += HEADLESS_SWEEP_STEP){
+        workload.num_vessels = n;
+        ret = run_workload(workload, RECORDER_OFF, recording_path);
+    }
+
+    return ret;
+}
@@ -16,6 +16,7 @@
 #include "../core/Player.hpp"
 #include "../core/utils/gl_utils.hpp"
 #include "../core/Predictor.hpp"
+#include "../core/PredictorService.hpp"
 #include "../assets/Planet.hpp"
 #include "../assets/PlanetarySystem.hpp"
 #include "../assets/Vessel.hpp"
@@ -40,6 +41,9 @@ PlanetariumRenderer::PlanetariumRenderer(BaseApp* app, PlanetariumGUI* planetari
     m_skybox_model_loc = m_render_context->getUniformLocation(SHADER_TEXTURE_NO_LIGHT, "model");
 
     m_target_fade = 0.0;
+    m_pred_vertices = 0;
+    m_pred_version = 0;
+    m_predictor_service.reset(new PredictorService(m_app->getPredictor()));
 
     check_gl_errors(true, "PlanetariumRenderer::PlanetariumRenderer");
 
@@ -50,7 +54,6 @@ PlanetariumRenderer::PlanetariumRenderer(BaseApp* app, PlanetariumGUI* planetari
 
 PlanetariumRenderer::~PlanetariumRenderer(){
     glDeleteBuffers(1, &m_pred_vbo_vert);
-    glDeleteBuffers(1, &m_pred_vbo_ind);
     glDeleteVertexArrays(1, &m_pred_vao);
 
     check_gl_errors(true, "PlanetariumRenderer::~PlanetariumRenderer");
@@ -66,28 +69,22 @@ void PlanetariumRenderer::initBuffers(){
     glVertexAttribPointer(0, 3,  GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(0);
 
-    glGenBuffers(1, &m_pred_vbo_ind);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_pred_vbo_ind);
-
     check_gl_errors(true, "PlanetariumRenderer::initBuffers");
 }
 
 
 int PlanetariumRenderer::render(struct render_buffer* rbuf){
-    m_app->getAssetManager()->m_planetary_system->updateRenderBuffers(
-        m_app->getPhysics()->getCurrentTime() / SECONDS_IN_A_CENTURY);
-
     glClearColor(0.f, 0.f, 0.f, 0.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     renderSkybox(rbuf->view_mat);
+    renderOrbits(rbuf->view_mat);
 
     m_render_context->useProgram(SHADER_DEBUG);
 
     glUniformMatrix4fv(m_debug_view_mat, 1, GL_FALSE, rbuf->view_mat.m);
     glUniformMatrix4fv(m_debug_proj_mat, 1, GL_FALSE, m_app->getCamera()->getProjMatrix().m);
 
-    renderOrbits(rbuf->planet_buffer);
     renderPredictions();
 
     check_gl_errors(true, "PlanetariumRenderer::render");
@@ -97,9 +94,8 @@ int PlanetariumRenderer::render(struct render_buffer* rbuf){
 
 void PlanetariumRenderer::renderPredictions(){
     const Vessel* user_vessel = m_app->getPlayer()->getVessel();
-    const Predictor* predictor = m_app->getPredictor();
+    const trajectory_result* prediction;
     std::vector<struct particle_state> states;
-    std::vector<std::vector<GLfloat>> prediction_buffers;
     struct fixed_time_trajectory_config config = m_planetarium_gui->getPredictorConfig();
     config.predictor_scale = PLANETARIUM_SCALE_FACTOR;
     config.predictor_start_time = m_app->getPhysics()->getCurrentTime();
@@ -111,7 +107,7 @@ void PlanetariumRenderer::renderPredictions(){
         btVector3 bvec3;
         dmath::vec3 vessel_com, vessel_vel;
 
-        bvec3 = user_vessel->getCoM();
+        bvec3 = user_vessel->getCoM() + m_app->getPhysics()->getWorldOrigin();
         vessel_com = dmath::vec3(bvec3.getX(), bvec3.getY(), bvec3.getZ());
 
         bvec3 = user_vessel->getRoot()->m_body->getLinearVelocity();
@@ -119,56 +115,41 @@ void PlanetariumRenderer::renderPredictions(){
 
         states.emplace_back(vessel_com, vessel_vel, user_vessel->getTotalMass());
     }
-    
-    std::unique_ptr<GLuint[]> index_buffer;
-    index_buffer.reset(new GLuint[2 * config.predictor_steps]);
-
-    // can't find a smarter way to initialise this buffer
-    for(int i=0; i < config.predictor_steps; i++){
-        index_buffer[i * 2] = i;
-        index_buffer[i * 2 + 1] = i + 1;
-    }
 
-    predictor->computeTrajectoriesRender(prediction_buffers, states, config);
+    // the prediction is computed by the service's worker, until it's done we draw the last one
+    m_predictor_service->submit(states, config);
+    prediction = m_predictor_service->getResult();
+    if(prediction == nullptr)
+        return;
 
     m_render_context->bindVao(m_pred_vao);
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_pred_vbo_vert);
-    glBufferData(GL_ARRAY_BUFFER, prediction_buffers.at(0).size() * sizeof(GLfloat),
-                 &prediction_buffers.at(0)[0], GL_STATIC_DRAW);
+    if(prediction->version != m_pred_version){
+        const std::vector<GLfloat>& buffer = prediction->position_buffers.at(0);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_pred_vbo_ind);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 2 * config.predictor_steps * sizeof(GLuint),
-                 index_buffer.get(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, m_pred_vbo_vert);
+        glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(GLfloat), &buffer[0],
+                     GL_DYNAMIC_DRAW);
+        m_pred_vertices = buffer.size() / 3;
+        m_pred_version = prediction->version;
+    }
 
     m_render_context->useProgram(SHADER_DEBUG);
 
     glUniform3f(m_debug_color_location, 0.f, 1.f, 0.f);
     glUniform1f(m_debug_alpha_location, 1.f);
 
-    glDrawElements(GL_LINES, config.predictor_steps * 2, GL_UNSIGNED_INT, NULL);
+    glDrawArrays(GL_LINE_STRIP, 0, m_pred_vertices);
 
     check_gl_errors(true, "PlanetariumRenderer::renderPredictions");
 }
 
 
-void PlanetariumRenderer::renderOrbits(const std::vector<planet_transform>& buff){
-    m_render_context->useProgram(SHADER_DEBUG);
-
-    for(uint i=0; i < buff.size(); i++){
-        const Planet* current = buff.at(i).planet_ptr;
-        const math::vec3& color = current->getBaseColor();
-
-        if(current->getId() == m_app->getPlayer()->getPlanetariumSelectedPlanet()){
-            glUniform3f(m_debug_color_location, color.v[0], color.v[1], color.v[2]);
-            glUniform1f(m_debug_alpha_location, 1 - m_target_fade);
-        }
-        else{
-            glUniform3f(m_debug_color_location, color.v[0]*0.5, color.v[1]*0.5, color.v[2]*0.5);
-            glUniform1f(m_debug_alpha_location, 1 - m_target_fade);
-        }
-        current->renderOrbit();
-    }
+void PlanetariumRenderer::renderOrbits(const math::mat4& view_mat){
+    m_app->getAssetManager()->m_planetary_system->renderOrbits(
+        m_app->getPhysics()->getCurrentTime() / SECONDS_IN_A_CENTURY, view_mat,
+        m_app->getCamera()->getProjMatrix(), m_app->getPlayer()->getPlanetariumSelectedPlanet(),
+        1 - m_target_fade);
     check_gl_errors(true, "PlanetariumRenderer::renderOrbits");
 }
 
@@ -1,6 +1,8 @@
 #ifndef PLANETRENDERER_HPP
 #define PLANETRENDERER_HPP
 #include <vector>
+#include <memory>
+#include <cstdint>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -13,6 +15,7 @@
 class BaseApp;
 class RenderContext;
 class PlanetariumGUI;
+class PredictorService;
 
 #define SKYBOX_SIZE 100000.0f
 
@@ -27,15 +30,18 @@ class PlanetariumRenderer : public BaseRenderer{
         // skybox render
         GLuint m_vao, m_vbo_vert, m_vbo_tex, m_textures[6];
         GLint m_skybox_view_loc, m_skybox_proj_loc, m_skybox_model_loc;
-        // prediction render
-        GLuint m_pred_vao, m_pred_vbo_vert, m_pred_vbo_ind;
+        // prediction render, the vbo is only updated when the service publishes a new prediction
+        GLuint m_pred_vao, m_pred_vbo_vert;
+        GLsizei m_pred_vertices;
+        std::uint64_t m_pred_version;
+        std::unique_ptr<PredictorService> m_predictor_service;
 
         float m_target_fade = 0.0;
 
         math::mat4 m_skybox_transforms[6];
 
         void renderPredictions();
-        void renderOrbits(const std::vector<planet_transform>& buff);
+        void renderOrbits(const math::mat4& view_mat);
         void createSkybox();
         void renderSkybox(const math::mat4& view_mat);
         void initBuffers();
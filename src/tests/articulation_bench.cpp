@@ -0,0 +1,259 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#define BT_USE_DOUBLE_PRECISION
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBody.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+#include <bullet/BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
+
+/*
+ * Compares the two ways a vessel can be simulated by Physics: a rigid body per part joined by
+ * btGeneric6DofConstraint (with the parameters of BasePart::buildSubTreeConstraints) and a
+ * btMultiBody with fixed joints (Vessel::packArticulated). The vessel is a stack of boxes pushed
+ * by a thrust at the bottom and a lateral torque at the top, the benchmark prints the average
+ * step time and the maximum drift of the joints (error of the relative transforms between
+ * parents and children, that should be constant).
+ *
+ * Build with "make articulation-bench".
+ */
+
+#define BENCH_TICKS 600
+#define BENCH_DELTA_T (1.0 / 60.0)
+#define BENCH_PART_MASS 100.0
+#define BENCH_SPACING 1.05 // the boxes don't touch
+#define BENCH_THRUST 5000.0 // N per part
+#define BENCH_TORQUE 2000.0 // N*m per part
+
+
+struct bench_result{
+    double step_time; // ms
+    double max_position_drift; // m
+    double max_angle_drift; // rad
+};
+
+
+struct bench_world{
+    std::unique_ptr<btDefaultCollisionConfiguration> collision_configuration;
+    std::unique_ptr<btCollisionDispatcher> dispatcher;
+    std::unique_ptr<btBroadphaseInterface> broadphase;
+    std::unique_ptr<btSequentialImpulseConstraintSolver> solver;
+    std::unique_ptr<btDiscreteDynamicsWorld> world;
+
+    bench_world(bool multibody){
+        collision_configuration.reset(new btDefaultCollisionConfiguration());
+        dispatcher.reset(new btCollisionDispatcher(collision_configuration.get()));
+        broadphase.reset(new btDbvtBroadphase());
+
+        if(multibody){
+            btMultiBodyConstraintSolver* mb_solver = new btMultiBodyConstraintSolver;
+
+            solver.reset(mb_solver);
+            world.reset(new btMultiBodyDynamicsWorld(dispatcher.get(), broadphase.get(),
+                                                     mb_solver, collision_configuration.get()));
+        }
+        else{
+            solver.reset(new btSequentialImpulseConstraintSolver);
+            world.reset(new btDiscreteDynamicsWorld(dispatcher.get(), broadphase.get(),
+                                                    solver.get(), collision_configuration.get()));
+        }
+        world->setGravity(btVector3(0.0, 0.0, 0.0));
+    }
+};
+
+
+static btTransform part_transform(int i){
+    return btTransform(btQuaternion::getIdentity(), btVector3(0.0, i * BENCH_SPACING, 0.0));
+}
+
+
+/* position and angle error of the transform of a child relative to its parent */
+static void joint_drift(const btTransform& parent, const btTransform& child,
+                        const btTransform& initial, double& position, double& angle){
+    btTransform relative = parent.inverse() * child;
+
+    position = (relative.getOrigin() - initial.getOrigin()).length();
+    angle = (initial.getRotation().inverse() * relative.getRotation()).getAngle();
+    if(angle > SIMD_PI)
+        angle = SIMD_2_PI - angle;
+}
+
+
+static void update_drift(const std::vector<btTransform>& transforms,
+                         const btTransform& initial, bench_result& result){
+    for(uint i=1; i < transforms.size(); i++){
+        double position, angle;
+
+        joint_drift(transforms.at(i - 1), transforms.at(i), initial, position, angle);
+        result.max_position_drift = std::max(result.max_position_drift, position);
+        result.max_angle_drift = std::max(result.max_angle_drift, angle);
+    }
+}
+
+
+static bench_result bench_constraints(int num_parts, btCollisionShape* shape){
+    bench_world bw(false);
+    std::vector<std::unique_ptr<btDefaultMotionState>> motion_states;
+    std::vector<std::unique_ptr<btRigidBody>> bodies;
+    std::vector<std::unique_ptr<btGeneric6DofConstraint>> constraints;
+    std::vector<btTransform> transforms(num_parts);
+    btTransform initial = part_transform(0).inverse() * part_transform(1);
+    bench_result result = {0.0, 0.0, 0.0};
+    btVector3 inertia;
+
+    shape->calculateLocalInertia(BENCH_PART_MASS, inertia);
+
+    for(int i=0; i < num_parts; i++){
+        motion_states.emplace_back(new btDefaultMotionState(part_transform(i)));
+        btRigidBody::btRigidBodyConstructionInfo rb_info(BENCH_PART_MASS,
+                                                         motion_states.back().get(), shape,
+                                                         inertia);
+        bodies.emplace_back(new btRigidBody(rb_info));
+        bodies.back()->setActivationState(DISABLE_DEACTIVATION);
+        bw.world->addRigidBody(bodies.back().get());
+
+        if(i == 0)
+            continue;
+
+        // same frames and parameters as BasePart::buildSubTreeConstraints
+        btTransform frame_child = part_transform(i).inverse() * part_transform(i - 1);
+        btGeneric6DofConstraint* constraint =
+            new btGeneric6DofConstraint(*bodies.at(i - 1), *bodies.at(i),
+                                        btTransform::getIdentity(), frame_child, false);
+
+        for(int axis=0; axis < 6; axis++){
+            constraint->setParam(BT_CONSTRAINT_STOP_CFM, 0.f, axis);
+            constraint->setParam(BT_CONSTRAINT_STOP_ERP, 0.8f, axis);
+        }
+        constraint->setOverrideNumSolverIterations(100);
+
+        btVector3 limits = btVector3(0, 0, 0);
+        constraint->setLinearLowerLimit(limits);
+        constraint->setLinearUpperLimit(limits);
+        constraint->setAngularLowerLimit(limits);
+        constraint->setAngularUpperLimit(limits);
+
+        constraints.emplace_back(constraint);
+        bw.world->addConstraint(constraint, true);
+    }
+
+    std::chrono::duration<double, std::milli> total(0.0);
+    for(int tick=0; tick < BENCH_TICKS; tick++){
+        bodies.front()->applyCentralForce(btVector3(0.0, BENCH_THRUST * num_parts, 0.0));
+        bodies.back()->applyTorque(btVector3(BENCH_TORQUE * num_parts, 0.0, 0.0));
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bw.world->stepSimulation(BENCH_DELTA_T, 0);
+        total += std::chrono::steady_clock::now() - start;
+
+        for(int i=0; i < num_parts; i++)
+            transforms.at(i) = bodies.at(i)->getWorldTransform();
+        update_drift(transforms, initial, result);
+    }
+    result.step_time = total.count() / BENCH_TICKS;
+
+    for(uint i=0; i < constraints.size(); i++)
+        bw.world->removeConstraint(constraints.at(i).get());
+    for(uint i=0; i < bodies.size(); i++)
+        bw.world->removeRigidBody(bodies.at(i).get());
+
+    return result;
+}
+
+
+static bench_result bench_multibody(int num_parts, btCollisionShape* shape){
+    bench_world bw(true);
+    btMultiBodyDynamicsWorld* world = static_cast<btMultiBodyDynamicsWorld*>(bw.world.get());
+    std::vector<std::unique_ptr<btMultiBodyLinkCollider>> colliders;
+    std::vector<btTransform> transforms(num_parts);
+    btTransform initial = part_transform(0).inverse() * part_transform(1);
+    bench_result result = {0.0, 0.0, 0.0};
+    btVector3 inertia;
+
+    shape->calculateLocalInertia(BENCH_PART_MASS, inertia);
+
+    // same construction as Vessel::packArticulated, every link is attached to the previous one
+    std::unique_ptr<btMultiBody> multibody(new btMultiBody(num_parts - 1, BENCH_PART_MASS,
+                                                           inertia, false, false));
+    for(int i=1; i < num_parts; i++){
+        multibody->setupFixed(i - 1, BENCH_PART_MASS, inertia, i - 2,
+                              initial.getRotation().inverse(), initial.getOrigin(),
+                              btVector3(0.0, 0.0, 0.0));
+    }
+    multibody->setLinearDamping(0.0);
+    multibody->setAngularDamping(0.0);
+    multibody->setHasSelfCollision(false);
+    multibody->setCanSleep(false);
+    multibody->finalizeMultiDof();
+    multibody->setBaseWorldTransform(part_transform(0));
+    world->addMultiBody(multibody.get());
+
+    for(int i=0; i < num_parts; i++){
+        colliders.emplace_back(new btMultiBodyLinkCollider(multibody.get(), i - 1));
+        colliders.back()->setCollisionShape(shape);
+        colliders.back()->setWorldTransform(part_transform(i));
+        world->addCollisionObject(colliders.back().get());
+
+        if(i == 0)
+            multibody->setBaseCollider(colliders.back().get());
+        else
+            multibody->getLink(i - 1).m_collider = colliders.back().get();
+    }
+
+    std::chrono::duration<double, std::milli> total(0.0);
+    for(int tick=0; tick < BENCH_TICKS; tick++){
+        multibody->clearForcesAndTorques();
+        multibody->addBaseForce(btVector3(0.0, BENCH_THRUST * num_parts, 0.0));
+        if(num_parts > 1)
+            multibody->addLinkTorque(num_parts - 2, btVector3(BENCH_TORQUE * num_parts, 0.0, 0.0));
+        else
+            multibody->addBaseTorque(btVector3(BENCH_TORQUE * num_parts, 0.0, 0.0));
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        world->stepSimulation(BENCH_DELTA_T, 0);
+        total += std::chrono::steady_clock::now() - start;
+
+        for(int i=0; i < num_parts; i++)
+            transforms.at(i) = colliders.at(i)->getWorldTransform();
+        update_drift(transforms, initial, result);
+    }
+    result.step_time = total.count() / BENCH_TICKS;
+
+    for(uint i=0; i < colliders.size(); i++)
+        world->removeCollisionObject(colliders.at(i).get());
+    world->removeMultiBody(multibody.get());
+
+    return result;
+}
+
+
+static void print_result(const char* name, int num_parts, const bench_result& result){
+    std::cout << std::setw(12) << name << std::setw(8) << num_parts
+              << std::setw(14) << std::fixed << std::setprecision(4) << result.step_time
+              << std::setw(16) << std::scientific << std::setprecision(3)
+              << result.max_position_drift << std::setw(16) << result.max_angle_drift
+              << std::endl;
+}
+
+
+int main(){
+    const int num_parts[] = {10, 50, 200};
+    btBoxShape shape(btVector3(0.5, 0.5, 0.5));
+
+    std::cout << std::setw(12) << "method" << std::setw(8) << "parts" << std::setw(14)
+              << "step (ms)" << std::setw(16) << "drift (m)" << std::setw(16) << "drift (rad)"
+              << std::endl;
+
+    for(uint i=0; i < sizeof(num_parts) / sizeof(num_parts[0]); i++){
+        print_result("constraints", num_parts[i], bench_constraints(num_parts[i], &shape));
+        print_result("multibody", num_parts[i], bench_multibody(num_parts[i], &shape));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,696 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+
+#include "../core/BaseApp.hpp"
+#include "../core/AssetManager.hpp"
+#include "../core/Physics.hpp"
+#include "../core/Predictor.hpp"
+#include "../core/Frustum.hpp"
+#include "../core/kepler.hpp"
+#include "../core/gravity.hpp"
+#include "../core/maths_funcs.hpp"
+#include "../core/log.hpp"
+#include "../core/utils/utils.hpp"
+#include "../assets/Object.hpp"
+#include "../assets/Planet.hpp"
+#include "../assets/PlanetarySystem.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+/*
+ * Micro-benchmarks of the hot kernels of the simulation: the orbital elements of the planets,
+ * their ephemeris, the positions given by the predictor, the batched Kepler propagation (whose
+ * vectorized path is also checked against the scalar one), the trajectories of the orbit lines, an
+ * earth flyby with each integrator of the predictor (steps and final error in the param column),
+ * year long predictions of circular orbits with Dormand-Prince and with the patched conics,
+ * the gravity of the physics thread (with and without the culling of the sources, whose error is
+ * reported in the param column), the frustum culling and the matrix product. Every kernel is
+ * called in batches, each sample is the time of one batch divided by its size and the benchmark
+ * prints the min, median and p99 (ns per call) over BENCH_SAMPLES samples, as CSV or as JSON with
+ * --json. The inputs come from a fixed seed, so two runs are comparable. The exit code is non
+ * zero if the vectorized Kepler path doesn't match the scalar one.
+ *
+ * It uses the objects of the headless simulation (no window or OpenGL), the star system is loaded
+ * from ../data like the apps. Build with "make bench".
+ */
+
+#define BENCH_SAMPLES 200
+#define BENCH_SEED 1234
+#define BENCH_TARGET_SAMPLE_NS 200000.0 // the batch is sized so a sample takes ~0.2 ms
+#define BENCH_MAX_BATCH 1000000
+#define BENCH_J2000_CENTURIES 0.25 // around year 2025
+#define BENCH_KEPLER_TOLERANCE 1e-9 // max relative error of propagate_kepler vs the scalar path
+#define BENCH_VESSEL_PARTS 16 // bodies per vessel of the gravity culling benchmark
+#define BENCH_ORBIT_SPREAD 0.5 // gravity bodies are within +-50% of a planet's semi-major axis
+#define BENCH_FLYBY_DAYS 30.0 // length of the flyby prediction
+#define BENCH_FLYBY_APPROACH_DAYS 2.0 // time to the closest approach, from the start
+#define BENCH_FLYBY_VINF 4000.0 // hyperbolic excess velocity relative to the earth, m/s
+#define BENCH_FLYBY_IMPACT 30000000.0 // impact parameter, m (periapsis of ~14000 km)
+#define BENCH_FLYBY_ACCURACY 100000.0 // final position error the integrators have to reach, m
+#define BENCH_FLYBY_MAX_STEPS 3276800 // the fixed step sweep gives up here
+#define BENCH_FLYBY_SAMPLES 5 // samples of each flyby prediction, they're slow
+#define BENCH_YEAR_DAYS 365.0 // length of the long horizon predictions
+#define BENCH_YEAR_EARTH_RADIUS 20000000.0 // radius of the circular earth orbit, m
+#define BENCH_YEAR_SUN_RADIUS 1.25 // radius of the circular orbit around the sun, AU
+
+
+struct bench_result{
+    std::string name;
+    std::string param;
+    int samples;
+    long batch;
+    double min_ns, median_ns, p99_ns;
+};
+
+
+/*
+ * Times a kernel, first the batch is calibrated so a sample lasts ~BENCH_TARGET_SAMPLE_NS.
+ *
+ * @name: name of the kernel.
+ * @param: parameter of the run (number of bodies, steps, etc), empty if none.
+ * @kernel: function that calls the kernel once.
+ * @max_batch: upper bound of the batch, for kernels that are too slow to be repeated.
+ * @num_samples: number of samples.
+ */
+bench_result run_bench(const std::string& name, const std::string& param,
+                       const std::function<void()>& kernel, long max_batch=BENCH_MAX_BATCH,
+                       int num_samples=BENCH_SAMPLES){
+    typedef std::chrono::steady_clock clock;
+    bench_result result;
+    std::vector<double> samples;
+    long batch = 1;
+
+    // warm up and calibration
+    while(batch < max_batch){
+        clock::time_point start = clock::now();
+        for(long i=0; i < batch; i++)
+            kernel();
+        double elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if(elapsed >= BENCH_TARGET_SAMPLE_NS)
+            break;
+        batch *= 2;
+    }
+    batch = std::min(batch, max_batch);
+
+    samples.reserve(num_samples);
+    for(int s=0; s < num_samples; s++){
+        clock::time_point start = clock::now();
+        for(long i=0; i < batch; i++)
+            kernel();
+        samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() /
+                          batch);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    result.name = name;
+    result.param = param;
+    result.samples = num_samples;
+    result.batch = batch;
+    result.min_ns = samples.front();
+    result.median_ns = samples.at(samples.size() / 2);
+    result.p99_ns = samples.at(std::min(samples.size() - 1, size_t(samples.size() * 0.99)));
+
+    return result;
+}
+
+
+void print_csv(const std::vector<bench_result>& results){
+    std::cout << "name,param,samples,batch,min_ns,median_ns,p99_ns" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for(uint i=0; i < results.size(); i++){
+        const bench_result& r = results.at(i);
+        std::cout << r.name << "," << r.param << "," << r.samples << "," << r.batch << ","
+                  << r.min_ns << "," << r.median_ns << "," << r.p99_ns << std::endl;
+    }
+}
+
+
+void print_json(const std::vector<bench_result>& results){
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[" << std::endl;
+    for(uint i=0; i < results.size(); i++){
+        const bench_result& r = results.at(i);
+        std::cout << "  {\"name\": \"" << r.name << "\", \"param\": \"" << r.param
+                  << "\", \"samples\": " << r.samples << ", \"batch\": " << r.batch
+                  << ", \"min_ns\": " << r.min_ns << ", \"median_ns\": " << r.median_ns
+                  << ", \"p99_ns\": " << r.p99_ns << "}" << (i + 1 < results.size() ? "," : "")
+                  << std::endl;
+    }
+    std::cout << "]" << std::endl;
+}
+
+
+void bench_orbits(BaseApp& app, std::mt19937& gen, std::vector<bench_result>& results){
+    std::hash<std::string> str_hash;
+    const Predictor* predictor = app.getPredictor();
+    PlanetarySystem* system = app.getAssetManager()->m_planetary_system.get();
+    planet_map& planets = system->getPlanets();
+    Planet* earth = planets.at(str_hash("Earth")).get();
+    Planet* mars = planets.at(str_hash("Mars")).get();
+    std::uniform_real_distribution<double> time_dist(-1.0, 1.0); // centuries
+    std::vector<double> times(1024);
+    uint index = 0;
+    volatile double sink;
+
+    for(uint i=0; i < times.size(); i++)
+        times.at(i) = time_dist(gen);
+
+    results.push_back(run_bench("Planet::updateOrbitalElements", "", [&](){
+        earth->updateOrbitalElements(times.at(index++ & 1023));
+    }));
+
+    results.push_back(run_bench("Planet::computePosition", "", [&](){
+        dmath::vec3 pos;
+        earth->computePosition(times.at(index++ & 1023), pos);
+        sink = pos.v[0];
+    }));
+
+    results.push_back(run_bench("Predictor::computeObjectPos", "", [&](){
+        dmath::vec3 pos;
+        predictor->computeObjectPos(earth->getOrbitalData(), times.at(index++ & 1023), pos);
+        sink = pos.v[0];
+    }));
+
+    results.push_back(run_bench("Predictor::computeObjectPosVel", "", [&](){
+        dmath::vec3 pos, vel;
+        predictor->computeObjectPosVel(mars->getOrbitalData(), 0,
+                                       times.at(index++ & 1023) * SECONDS_IN_A_CENTURY, false,
+                                       pos, vel);
+        sink = pos.v[0] + vel.v[0];
+    }));
+    (void)sink;
+
+    system->updateOrbitalElements(BENCH_J2000_CENTURIES);
+}
+
+
+/*
+ * Batched Kepler propagation, vectorized and scalar. Returns EXIT_FAILURE if the vectorized path
+ * differs from the scalar one by more than BENCH_KEPLER_TOLERANCE (relative).
+ */
+int bench_kepler(BaseApp& app, std::mt19937& gen, std::vector<bench_result>& results){
+    planet_map& planets = app.getAssetManager()->m_planetary_system->getPlanets();
+    double star_mu = GRAVITATIONAL_CONSTANT *
+                     app.getAssetManager()->m_planetary_system->getStar().mass;
+    std::uniform_real_distribution<double> time_dist(-1.0, 1.0); // centuries
+    kepler_orbits orbits;
+    int sizes[] = {1, 64, 1024, 4096};
+    int ret = EXIT_SUCCESS;
+    volatile double sink;
+
+    for(planet_map::iterator it=planets.begin(); it != planets.end(); it++)
+        orbits.add(it->second->getOrbitalData(), star_mu);
+
+    for(uint i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        kepler_states states, reference;
+        double max_error = 0.0;
+
+        for(int j=0; j < sizes[i]; j++)
+            states.add(j % orbits.size(), time_dist(gen));
+        reference = states;
+
+        propagate_kepler(orbits, states);
+        propagate_kepler_scalar(orbits, reference);
+        for(uint j=0; j < states.size(); j++){
+            dmath::vec3 pos(states.x[j], states.y[j], states.z[j]);
+            dmath::vec3 ref(reference.x[j], reference.y[j], reference.z[j]);
+            dmath::vec3 vel(states.vx[j], states.vy[j], states.vz[j]);
+            dmath::vec3 ref_vel(reference.vx[j], reference.vy[j], reference.vz[j]);
+
+            max_error = std::max(max_error, dmath::length(pos - ref) / dmath::length(ref));
+            max_error = std::max(max_error, dmath::length(vel - ref_vel) /
+                                            dmath::length(ref_vel));
+        }
+        if(max_error > BENCH_KEPLER_TOLERANCE){
+            std::cerr << "kernels_bench: propagate_kepler (" << kepler_kernel_name()
+                      << ") differs from the scalar path, relative error " << max_error
+                      << std::endl;
+            log("kernels_bench: propagate_kepler (", kepler_kernel_name(),
+                ") differs from the scalar path, relative error ", max_error);
+            ret = EXIT_FAILURE;
+        }
+
+        // per query, so the sizes are comparable
+        bench_result res = run_bench("propagate_kepler", "queries=" + std::to_string(sizes[i]) +
+                                     " kernel=" + kepler_kernel_name(), [&](){
+            propagate_kepler(orbits, states);
+            sink = states.x[0];
+        });
+        res.min_ns /= sizes[i];
+        res.median_ns /= sizes[i];
+        res.p99_ns /= sizes[i];
+        results.push_back(res);
+
+        res = run_bench("propagate_kepler_scalar", "queries=" + std::to_string(sizes[i]), [&](){
+            propagate_kepler_scalar(orbits, reference);
+            sink = reference.x[0];
+        });
+        res.min_ns /= sizes[i];
+        res.median_ns /= sizes[i];
+        res.p99_ns /= sizes[i];
+        results.push_back(res);
+    }
+    (void)sink;
+
+    return ret;
+}
+
+
+void bench_trajectories(BaseApp& app, std::mt19937& gen, std::vector<bench_result>& results){
+    std::hash<std::string> str_hash;
+    const Predictor* predictor = app.getPredictor();
+    const Planet* earth = app.getAssetManager()->m_planetary_system->getPlanets().at(
+        str_hash("Earth")).get();
+    const orbital_data& earth_data = earth->getOrbitalData();
+    std::uniform_real_distribution<double> offset_dist(7000000.0, 40000000.0); // m
+    std::vector<struct particle_state> states;
+    std::vector<std::vector<GLfloat>> buffers;
+    dmath::vec3 earth_pos, earth_vel;
+    int steps[] = {100, 400, 1600};
+
+    predictor->computeObjectPosVel(earth_data, 0, BENCH_J2000_CENTURIES * SECONDS_IN_A_CENTURY,
+                                   false, earth_pos, earth_vel);
+
+    // a few particles around the earth, in the frame of the star
+    for(int i=0; i < 4; i++){
+        double r = offset_dist(gen);
+        double v = std::sqrt(GRAVITATIONAL_CONSTANT * earth_data.m / r);
+        dmath::vec3 origin = earth_pos + dmath::vec3(r, 0.0, 0.0);
+        dmath::vec3 velocity = earth_vel + dmath::vec3(0.0, 0.0, v);
+
+        states.emplace_back(origin, velocity, 1000.0);
+    }
+
+    for(uint i=0; i < sizeof(steps) / sizeof(steps[0]); i++){
+        fixed_time_trajectory_config config(BENCH_J2000_CENTURIES * SECONDS_IN_A_CENTURY,
+                                            86400.0 * 30.0, steps[i], 1.0, earth->getId(),
+                                            DEFAULT_GRAVITY_CULL_THRESHOLD,
+                                            PREDICTOR_SYMPLECTIC_EULER);
+
+        results.push_back(run_bench("Predictor::computeTrajectoriesRender",
+                                    "steps=" + std::to_string(steps[i]), [&](){
+            std::vector<struct particle_state> states_copy(states);
+            predictor->computeTrajectoriesRender(buffers, states_copy, config);
+        }, 64));
+    }
+}
+
+
+/*
+ * Hyperbolic flyby of the earth, predicted with the fixed step symplectic Euler (doubling the
+ * steps until the final position is within BENCH_FLYBY_ACCURACY of the reference) and with the
+ * adaptive integrators at a few tolerances. The reference is Dormand-Prince with a tolerance of
+ * 1e-13. The param column has the steps taken and the final error.
+ */
+void bench_flyby(BaseApp& app, std::vector<bench_result>& results){
+    std::hash<std::string> str_hash;
+    const Predictor* predictor = app.getPredictor();
+    const Planet* earth = app.getAssetManager()->m_planetary_system->getPlanets().at(
+        str_hash("Earth")).get();
+    double start = BENCH_J2000_CENTURIES * SECONDS_IN_A_CENTURY;
+    double approach = BENCH_FLYBY_APPROACH_DAYS * 86400.0;
+    std::vector<std::vector<GLfloat>> buffers;
+    dmath::vec3 earth_pos, earth_vel, reference;
+
+    // straight line approach that would miss the earth by the impact parameter
+    earth->computePosVel((start + approach) / SECONDS_IN_A_CENTURY, earth_pos, earth_vel);
+    dmath::vec3 v_inf = dmath::normalise(earth_pos) * BENCH_FLYBY_VINF;
+    dmath::vec3 impact = dmath::normalise(earth_vel) * BENCH_FLYBY_IMPACT;
+    std::vector<struct particle_state> states;
+    states.emplace_back(earth_pos + impact - (earth_vel + v_inf) * approach, earth_vel + v_inf,
+                        1000.0);
+
+    // returns the final position and the steps taken
+    auto predict = [&](const fixed_time_trajectory_config& config, long& steps) -> dmath::vec3{
+        std::vector<struct particle_state> states_copy(states);
+        predictor->computeTrajectoriesRender(buffers, states_copy, config);
+
+        steps = buffers.at(0).size() / 3 - 1;
+        // the error is measured on the final state in doubles, not on the float render buffer
+        return states_copy.at(0).origin;
+    };
+    auto run = [&](const std::string& integrator, const fixed_time_trajectory_config& config){
+        long steps;
+        double error = dmath::length(predict(config, steps) - reference);
+        std::ostringstream param;
+
+        param << "flyby " << integrator << " steps=" << steps << " error_km=" << error / 1000.0;
+        results.push_back(run_bench("Predictor::computeTrajectoriesRender", param.str(), [&](){
+            predict(config, steps);
+        }, 1, BENCH_FLYBY_SAMPLES));
+    };
+
+    fixed_time_trajectory_config config(start, BENCH_FLYBY_DAYS * 86400.0, 400, 1.0, 0,
+                                        DEFAULT_GRAVITY_CULL_THRESHOLD, PREDICTOR_DORMAND_PRINCE);
+    long reference_steps;
+    config.tolerance = 1e-13;
+    reference = predict(config, reference_steps);
+
+    // the fixed step sweep, only the first one that is accurate enough is timed
+    config.integrator = PREDICTOR_SYMPLECTIC_EULER;
+    for(config.predictor_steps = 400; config.predictor_steps <= BENCH_FLYBY_MAX_STEPS;
+        config.predictor_steps *= 2){
+        long steps;
+
+        if(dmath::length(predict(config, steps) - reference) < BENCH_FLYBY_ACCURACY){
+            run("symplectic_euler", config);
+            break;
+        }
+    }
+    if(config.predictor_steps > BENCH_FLYBY_MAX_STEPS)
+        std::cerr << "kernels_bench: the symplectic Euler flyby didn't reach the accuracy in "
+                  << BENCH_FLYBY_MAX_STEPS << " steps" << std::endl;
+
+    double tolerances[] = {1e-7, 1e-9, 1e-11};
+    config.predictor_steps = 400;
+    config.integrator = PREDICTOR_DORMAND_PRINCE;
+    for(uint i=0; i < sizeof(tolerances) / sizeof(tolerances[0]); i++){
+        std::ostringstream integrator;
+
+        config.tolerance = tolerances[i];
+        integrator << "dormand_prince tolerance=" << tolerances[i];
+        run(integrator.str(), config);
+    }
+
+    double etas[] = {0.03, 0.01, 0.003};
+    config.integrator = PREDICTOR_ADAPTIVE_LEAPFROG;
+    for(uint i=0; i < sizeof(etas) / sizeof(etas[0]); i++){
+        std::ostringstream integrator;
+
+        config.eta = etas[i];
+        integrator << "adaptive_leapfrog eta=" << etas[i];
+        run(integrator.str(), config);
+    }
+
+    config.integrator = PREDICTOR_PATCHED_CONIC;
+    config.tolerance = DEFAULT_PREDICTOR_TOLERANCE;
+    run("patched_conic", config);
+}
+
+
+/*
+ * Year long predictions of circular orbits around the earth and around the sun (between the
+ * earth and mars), with Dormand-Prince and with the patched conics. The reference is
+ * Dormand-Prince with a tolerance of 1e-11, the param column has the points of the line and the
+ * final error.
+ */
+void bench_long_horizon(BaseApp& app, std::vector<bench_result>& results){
+    std::hash<std::string> str_hash;
+    const Predictor* predictor = app.getPredictor();
+    const PlanetarySystem* planet_system = app.getAssetManager()->m_planetary_system.get();
+    const Planet* earth = planet_system->getPlanets().at(str_hash("Earth")).get();
+    double start = BENCH_J2000_CENTURIES * SECONDS_IN_A_CENTURY;
+    std::vector<std::vector<GLfloat>> buffers;
+    dmath::vec3 earth_pos, earth_vel;
+
+    earth->computePosVel(start / SECONDS_IN_A_CENTURY, earth_pos, earth_vel);
+
+    // both orbits are in the plane of the earth's orbit
+    dmath::vec3 normal = dmath::normalise(dmath::cross(earth_pos, earth_vel));
+    dmath::vec3 radial = dmath::normalise(earth_pos);
+    dmath::vec3 prograde = dmath::cross(normal, radial);
+    double earth_mu = GRAVITATIONAL_CONSTANT * earth->getOrbitalData().m;
+    double sun_mu = GRAVITATIONAL_CONSTANT * planet_system->getStar().mass;
+    double sun_radius = BENCH_YEAR_SUN_RADIUS * AU_TO_METERS;
+
+    std::vector<struct particle_state> earth_orbit, sun_orbit;
+    earth_orbit.emplace_back(earth_pos + radial * BENCH_YEAR_EARTH_RADIUS,
+                             earth_vel + prograde * std::sqrt(earth_mu / BENCH_YEAR_EARTH_RADIUS),
+                             1000.0);
+    // opposite to the earth, far from its sphere of influence
+    sun_orbit.emplace_back(-radial * sun_radius, -prograde * std::sqrt(sun_mu / sun_radius),
+                           1000.0);
+
+    auto predict = [&](const std::vector<struct particle_state>& states,
+                       const fixed_time_trajectory_config& config, long& points) -> dmath::vec3{
+        std::vector<struct particle_state> states_copy(states);
+        predictor->computeTrajectoriesRender(buffers, states_copy, config);
+
+        points = buffers.at(0).size() / 3;
+        // the error is measured on the final state in doubles, not on the float render buffer
+        return states_copy.at(0).origin;
+    };
+
+    const std::vector<struct particle_state>* orbits[] = {&earth_orbit, &sun_orbit};
+    const char* names[] = {"earth", "sun"};
+    for(uint i=0; i < sizeof(orbits) / sizeof(orbits[0]); i++){
+        fixed_time_trajectory_config config(start, BENCH_YEAR_DAYS * 86400.0, 400, 1.0, 0,
+                                            DEFAULT_GRAVITY_CULL_THRESHOLD,
+                                            PREDICTOR_DORMAND_PRINCE);
+        dmath::vec3 reference;
+        long points;
+
+        config.tolerance = 1e-11;
+        reference = predict(*orbits[i], config, points);
+
+        int integrators[] = {PREDICTOR_DORMAND_PRINCE, PREDICTOR_PATCHED_CONIC};
+        const char* integrator_names[] = {"dormand_prince", "patched_conic"};
+        config.tolerance = DEFAULT_PREDICTOR_TOLERANCE;
+        for(uint j=0; j < sizeof(integrators) / sizeof(integrators[0]); j++){
+            std::ostringstream param;
+            double error;
+
+            config.integrator = integrators[j];
+            error = dmath::length(predict(*orbits[i], config, points) - reference);
+            param << "year " << names[i] << " " << integrator_names[j] << " points=" << points
+                  << " error_km=" << error / 1000.0;
+            results.push_back(run_bench("Predictor::computeTrajectoriesRender", param.str(),
+                                        [&](){
+                predict(*orbits[i], config, points);
+            }, 1, BENCH_FLYBY_SAMPLES));
+        }
+    }
+}
+
+
+void bench_gravity(BaseApp& app, std::mt19937& gen, std::vector<bench_result>& results){
+    Physics* physics = app.getPhysics();
+    AssetManager* asset_manager = app.getAssetManager();
+    const planet_map& planets = asset_manager->m_planetary_system->getPlanets();
+    std::unique_ptr<btCollisionShape> shape(new btSphereShape(1.0));
+    std::uniform_real_distribution<double> dir_dist(-1.0, 1.0);
+    std::uniform_real_distribution<double> spread_dist(1.0 - BENCH_ORBIT_SPREAD,
+                                                       1.0 + BENCH_ORBIT_SPREAD);
+    std::uniform_int_distribution<int> planet_dist(0, planets.size() - 1);
+    std::vector<double> radii;
+    int sizes[] = {1, 64, 1024, 4096};
+
+    // the world origin is the star, the bodies are spread around the planets' orbits so none of
+    // them is inside the star (Mercury's inner bound is still ~40 solar radii away)
+    for(planet_map::const_iterator it=planets.begin(); it != planets.end(); it++)
+        radii.push_back(it->second->getOrbitalData().a_0 * AU_TO_METERS);
+
+    for(uint i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        for(int j=0; j < sizes[i]; j++){
+            std::shared_ptr<Object> obj = std::make_shared<Object>(nullptr, physics, shape.get(),
+                                                                   100.0, 0);
+            dmath::vec3 dir = dmath::normalise(dmath::vec3(dir_dist(gen), dir_dist(gen),
+                                                           dir_dist(gen)));
+            dmath::vec3 pos = dir * (radii.at(planet_dist(gen)) * spread_dist(gen));
+
+            obj->addBody(btVector3(pos.v[0], pos.v[1], pos.v[2]), btVector3(0.0, 0.0, 0.0),
+                         btQuaternion::getIdentity());
+            asset_manager->m_objects.push_back(std::move(obj));
+        }
+
+        results.push_back(run_bench("Physics::applyGravity", "bodies=" + std::to_string(sizes[i]),
+                                    [&](){
+            physics->applyGravity();
+        }));
+
+        for(uint j=0; j < asset_manager->m_objects.size(); j++)
+            asset_manager->m_objects.at(j)->removeBody();
+        asset_manager->m_objects.clear();
+    }
+}
+
+
+void bench_gravity_culling(BaseApp& app, std::mt19937& gen, std::vector<bench_result>& results){
+    std::hash<std::string> str_hash;
+    const PlanetarySystem* system = app.getAssetManager()->m_planetary_system.get();
+    const planet_map& planets = system->getPlanets();
+    const orbital_data& earth_data = planets.at(str_hash("Earth"))->getOrbitalData();
+    double star_mass = system->getStar().mass;
+    std::uniform_real_distribution<double> dir_dist(-1.0, 1.0);
+    std::uniform_real_distribution<double> alt_dist(6.4e6, 4.2e7); // m, up to geostationary
+    std::uniform_real_distribution<double> part_dist(-20.0, 20.0);
+    gravity_sources sources;
+    int sizes[] = {1, 64, 1024, 4096};
+
+    sources.add(0.0, 0.0, 0.0, GRAVITATIONAL_CONSTANT * star_mass);
+    for(planet_map::const_iterator it=planets.begin(); it != planets.end(); it++){
+        const orbital_data& data = it->second->getOrbitalData();
+
+        sources.add(data.pos.v[0], data.pos.v[1], data.pos.v[2], GRAVITATIONAL_CONSTANT * data.m,
+                    sphere_of_influence(data.a_0 * AU_TO_METERS, data.m, star_mass));
+    }
+
+    // vessels around the earth, where Neptune's pull is of no use. Like Physics::applyGravity the
+    // set is selected once per vessel, at its first part
+    for(uint i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        int num_vessels = std::max(1, sizes[i] / BENCH_VESSEL_PARTS);
+        int parts = sizes[i] / num_vessels;
+        gravity_bodies full, culled;
+        std::vector<gravity_set> sets(num_vessels);
+        std::vector<std::uint64_t> masks(sizes[i]);
+        double max_error = 0.0, bound = 0.0;
+
+        for(int v=0; v < num_vessels; v++){
+            dmath::vec3 dir = dmath::normalise(dmath::vec3(dir_dist(gen), dir_dist(gen),
+                                                           dir_dist(gen)));
+            dmath::vec3 center = earth_data.pos + dir * alt_dist(gen);
+
+            for(int j=0; j < parts; j++){
+                dmath::vec3 pos = center + dmath::vec3(part_dist(gen), part_dist(gen),
+                                                       part_dist(gen));
+
+                full.add(pos.v[0], pos.v[1], pos.v[2]);
+                culled.add(pos.v[0], pos.v[1], pos.v[2]);
+            }
+        }
+
+        std::function<void()> select = [&](){
+            for(int v=0; v < num_vessels; v++){
+                select_gravity_sources(sources, culled.x[v * parts], culled.y[v * parts],
+                                       culled.z[v * parts], DEFAULT_GRAVITY_CULL_THRESHOLD,
+                                       sets[v]);
+                std::fill(masks.begin() + v * parts, masks.begin() + (v + 1) * parts,
+                          sets[v].mask);
+            }
+        };
+
+        compute_gravity(sources, full);
+        select();
+        compute_gravity_selected(sources, culled, masks);
+        for(int j=0; j < sizes[i]; j++){
+            dmath::vec3 diff(full.ax[j] - culled.ax[j], full.ay[j] - culled.ay[j],
+                             full.az[j] - culled.az[j]);
+            max_error = std::max(max_error, dmath::length(diff));
+        }
+        for(int v=0; v < num_vessels; v++)
+            bound = std::max(bound, sets[v].error);
+
+        std::ostringstream param;
+        param << "bodies=" << sizes[i] << " max_error=" << std::scientific << std::setprecision(2)
+              << max_error << " bound=" << bound;
+
+        results.push_back(run_bench("compute_gravity", "bodies=" + std::to_string(sizes[i]),
+                                    [&](){
+            compute_gravity(sources, full);
+        }));
+
+        // includes the selection, which is done every tick
+        results.push_back(run_bench("compute_gravity_selected", param.str(), [&](){
+            select();
+            compute_gravity_selected(sources, culled, masks);
+        }));
+    }
+}
+
+
+void bench_frustum(std::mt19937& gen, std::vector<bench_result>& results){
+    Frustum frustum;
+    std::uniform_real_distribution<float> pos_dist(-200.0, 200.0);
+    std::uniform_real_distribution<float> angle_dist(0.0, 360.0);
+    std::vector<math::mat4> models(1024);
+    math::vec3 box[8];
+    uint index = 0;
+    volatile bool sink;
+
+    frustum.extractPlanes(math::perspective(67.0, 16.0 / 9.0, 0.1, 1000.0),
+                          math::identity_mat4(), true);
+    for(int i=0; i < 8; i++)
+        box[i] = math::vec3(i & 1 ? 1.0 : -1.0, i & 2 ? 1.0 : -1.0, i & 4 ? 1.0 : -1.0);
+    for(uint i=0; i < models.size(); i++){
+        math::mat4 rot = math::rotate_y_deg(math::rotate_x_deg(math::identity_mat4(),
+                                                               angle_dist(gen)), angle_dist(gen));
+        models.at(i) = math::translate(rot, math::vec3(pos_dist(gen), pos_dist(gen),
+                                                       pos_dist(gen)));
+    }
+
+    results.push_back(run_bench("Frustum::checkBox", "", [&](){
+        sink = frustum.checkBox(box, models.at(index++ & 1023));
+    }));
+    (void)sink;
+}
+
+
+void bench_mat4(std::mt19937& gen, std::vector<bench_result>& results){
+    std::uniform_real_distribution<float> dist(-1.0, 1.0);
+    std::vector<math::mat4> mats(1024);
+    math::mat4 acc = math::identity_mat4();
+    uint index = 0;
+    volatile float sink;
+
+    for(uint i=0; i < mats.size(); i++)
+        for(int j=0; j < 16; j++)
+            mats.at(i).m[j] = dist(gen);
+
+    results.push_back(run_bench("math::mat4::operator*", "", [&](){
+        acc = mats.at(index & 1023) * mats.at((index + 1) & 1023);
+        index++;
+    }));
+    sink = acc.m[0];
+    (void)sink;
+}
+
+
+int main(int argc, char* argv[]){
+    bool json = false;
+    std::vector<bench_result> results;
+    std::mt19937 gen(BENCH_SEED);
+
+    for(int i=1; i < argc; i++){
+        if(!std::strcmp(argv[i], "--json"))
+            json = true;
+        else
+            std::cerr << "Unknown argument " << argv[i] << ", usage: " << argv[0] << " [--json]"
+                      << std::endl;
+    }
+
+    if(change_cwd_to_selfpath() == EXIT_FAILURE)
+        std::cerr << "Could not change the cwd to executable path, proceeding" << std::endl;
+
+    log_start();
+
+    BaseApp app;
+
+    app.getPhysics()->initDynamicsWorld();
+    if(app.getAssetManager()->loadStarSystem() == EXIT_FAILURE){
+        std::cerr << "kernels_bench: fatal - failed to load the star system" << std::endl;
+        log("kernels_bench: fatal - failed to load the star system");
+        return EXIT_FAILURE;
+    }
+    app.getAssetManager()->m_planetary_system->updateOrbitalElements(BENCH_J2000_CENTURIES);
+
+    bench_orbits(app, gen, results);
+    int ret = bench_kepler(app, gen, results);
+    bench_trajectories(app, gen, results);
+    bench_flyby(app, results);
+    bench_long_horizon(app, results);
+    bench_gravity(app, gen, results);
+    bench_gravity_culling(app, gen, results);
+    bench_frustum(gen, results);
+    bench_mat4(gen, results);
+
+    if(json)
+        print_json(results);
+    else
+        print_csv(results);
+
+    app.getAssetManager()->cleanup();
+
+    return ret;
+}